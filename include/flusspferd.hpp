@@ -51,6 +51,7 @@ THE SOFTWARE.
 #include "flusspferd/encodings.hpp"
 #include "flusspferd/evaluate.hpp"
 #include "flusspferd/exception.hpp"
+#include "flusspferd/external_memory.hpp"
 #include "flusspferd/function_adapter.hpp"
 #include "flusspferd/getopt.hpp"
 #include "flusspferd/modules.hpp"
@@ -73,5 +74,6 @@ THE SOFTWARE.
 #include "flusspferd/value.hpp"
 #include "flusspferd/value_io.hpp"
 #include "flusspferd/version.hpp"
+#include "flusspferd/xdr.hpp"
 
 #endif
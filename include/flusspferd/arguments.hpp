@@ -30,7 +30,6 @@ THE SOFTWARE.
 #include "spidermonkey/arguments.hpp"
 #include "root.hpp"
 #include "value.hpp"
-#include <boost/shared_ptr.hpp>
 #include <vector>
 
 namespace flusspferd {
@@ -38,12 +37,12 @@ namespace flusspferd {
 /**
  * Holds the %arguments for a Javascript %function call.
  *
+ * Up to eight %arguments are stored inline, so building an argument list
+ * for a callback does not allocate.
+ *
  * @ingroup functions
  */
 class arguments : public Impl::arguments_impl {
-private:
-  std::vector<boost::shared_ptr<root_value> > roots;
-
 public:
   /// An empty arguments object.
   arguments() { }
@@ -94,7 +93,9 @@ public:
   /**
    * Add a value to the back of the arguments list, rooting it.
    *
-   * The value will be explicitly rooted.
+   * The arguments object is rooted as a whole (including all values added
+   * with #push_back) for as long as it exists, so rooting does not
+   * allocate per value.
    *
    * @param v The element to be added.
    */
@@ -28,7 +28,11 @@ THE SOFTWARE.
 
 #include "native_object_base.hpp"
 #include "class_description.hpp"
+#include "external_memory.hpp"
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
 #include <vector>
+#include <string>
 
 namespace flusspferd {
 
@@ -41,32 +45,69 @@ FLUSSPFERD_CLASS_DESCRIPTION(
   (full_name, "binary.Binary")
   (constructor_name, "Binary")
   (constructible, 0)
-  (augment_prototype, 1)
   (methods,
     ("toByteArray", bind, to_byte_array)
     ("toArray", bind, to_array)
     ("indexOf", bind, index_of)
     ("lastIndexOf", bind, last_index_of)
+    ("indexOfSequence", bind, index_of_sequence)
+    ("count", bind, count_sequence)
     ("byteAt", bind, byte_at)
     ("charAt", alias, "byteAt")
     ("get", bind, get)
     ("slice", bind, slice)
     ("concat", bind, concat)
     ("split", bind, split)
-    ("decodeToString", bind, decode_to_string)))
+    ("decodeToString", bind, decode_to_string)
+    ("__iterator__", bind, iterator)
+    ("values", bind, values)
+    ("pairs", bind, pairs)))
 {
 public:
-  static void augment_prototype(object &);
 
   typedef unsigned char element_type;
   typedef std::vector<element_type> vector_type;
 
+  /**
+   * Immutable backing store that can be shared between several blobs.
+   *
+   * A blob either owns its bytes (in a vector) or is a view of
+   * [offset, offset+length) into a shared storage. Views are created by
+   * slicing ByteStrings and are turned back into owned data the first time
+   * they are modified (copy on write).
+   */
+  class storage : boost::noncopyable {
+  public:
+    virtual ~storage() {}
+
+    virtual element_type const *data() const = 0;
+    virtual std::size_t size() const = 0;
+  };
+
+  typedef boost::shared_ptr<storage const> storage_ptr;
+
+  /**
+   * Create a storage by taking over the contents of @p v. @p v will be empty
+   * afterwards.
+   */
+  static storage_ptr adopt_storage(vector_type &v);
+
+  /**
+   * Create a read-only storage mapping the whole file @p path into memory.
+   * Falls back to reading the file on systems without mmap.
+   */
+  static storage_ptr map_file(std::string const &path);
+
 protected:
   binary(object const &o, call_context &x);
   binary(object const &o, binary const &b);
   binary(object const &o, element_type const *p, std::size_t n);
+  binary(object const &o, storage_ptr const &s, std::size_t offset,
+         std::size_t n);
 
   virtual binary &create(element_type const *p, std::size_t n) = 0;
+  virtual binary &create_view(
+    storage_ptr const &s, std::size_t offset, std::size_t n) = 0;
   virtual value element(element_type byte) = 0;
 
   template<typename It>
@@ -75,26 +116,103 @@ protected:
   }
 
 protected:
+  // Integer indices are served directly by property_op; reads define no
+  // property. Only "in", hasOwnProperty and assignments resolve an index, to
+  // a shared property without a value.
   void property_op(property_mode mode, value const &id, value &data);
   bool property_resolve(value const &id, unsigned access);
 
+  friend class binary_iterator;
+
 public:
+  /**
+   * Mutable access to the bytes. If the blob is currently a view into shared
+   * storage, the bytes are copied first.
+   */
   vector_type &get_data();
   std::size_t set_length(std::size_t);
 
   std::size_t get_length();
 
-  vector_type const &get_const_data() { return get_data(); }
+  /**
+   * Report the capacity of the owned bytes to the garbage collector. Call it
+   * after growing the vector returned by get_data().
+   */
+  void update_memory();
+
+  /**
+   * Read-only view of the bytes, in shared storage or owned. Unlike
+   * get_data() it never copies, and it is invalidated by any modification of
+   * the blob.
+   */
+  class const_range {
+  public:
+    typedef element_type const *const_iterator;
+    typedef const_iterator iterator;
+
+    const_range(const_iterator begin, const_iterator end)
+      : begin_(begin), end_(end)
+    {}
+
+    const_iterator begin() const { return begin_; }
+    const_iterator end() const { return end_; }
+    std::size_t size() const { return end_ - begin_; }
+    bool empty() const { return begin_ == end_; }
+    element_type const &operator[](std::size_t i) const { return begin_[i]; }
+
+  private:
+    const_iterator begin_;
+    const_iterator end_;
+  };
+
+  const_range get_const_data() const {
+    return const_range(const_begin(), const_end());
+  }
+
+  /**
+   * Read-only access to the bytes that never copies. The pointers are
+   * invalidated by any modification of the blob.
+   */
+  element_type const *const_begin() const;
+  element_type const *const_end() const;
+
+  bool is_shared() const { return v_storage.get() != 0; }
+
+  /**
+   * Return a blob of the same type containing the bytes [begin, end). This is
+   * a view sharing the storage of this blob where that is safe.
+   */
+  binary &sub_range(std::size_t begin, std::size_t end);
+
+  /**
+   * The bytes as immutable storage that can be handed to another thread
+   * without copying. Owned bytes are moved into a new storage first; after
+   * that the blob shares it (and copies on the next modification) unless
+   * @p detach is set, in which case the blob is left empty.
+   *
+   * @param offset Set to the offset of the bytes in the storage.
+   * @param length Set to the number of bytes.
+   * @param detach Whether to leave the blob empty.
+   */
+  storage_ptr share_storage(std::size_t &offset, std::size_t &length,
+                            bool detach = false);
 
 protected:
   void do_append(arguments &x);
 
+  void share();
+  void unshare();
+  bool can_share();
+
   std::pair<std::size_t, std::size_t>
   range(int begin, boost::optional<int> end);
 
   std::pair<std::size_t, std::size_t>
   length_range(int begin, boost::optional<int> length);
 
+  std::pair<std::size_t, std::size_t>
+  search_range(boost::optional<int> start, boost::optional<int> stop);
+
   void debug_rep(std::ostream &o);
 
 public:
@@ -104,15 +222,58 @@ public:
     value byte, boost::optional<int> start, boost::optional<int> stop);
   int last_index_of(
     value byte, boost::optional<int> start, boost::optional<int> stop);
+  int index_of_sequence(
+    value seq, boost::optional<int> start, boost::optional<int> stop);
+  int count_sequence(
+    value seq, boost::optional<int> start, boost::optional<int> stop);
   byte_string &byte_at(int offset);
   int get(int offset);
   object slice(int begin, boost::optional<int> end);
   void concat(call_context &x);
   array split(value delim, object options);
   string decode_to_string(boost::optional<std::string> const &enc);
+  object iterator();
+  object values();
+  object pairs();
 
 private:
   vector_type v_data;
+
+  storage_ptr v_storage;
+  std::size_t v_offset;
+  std::size_t v_length;
+  external_memory v_memory;
+};
+
+/**
+ * Native iterator over the indices, bytes or [index, byte] pairs of a
+ * Binary, as returned by Binary#__iterator__, Binary#values and
+ * Binary#pairs.
+ */
+FLUSSPFERD_CLASS_DESCRIPTION(
+  binary_iterator,
+  (full_name, "binary.BinaryIterator")
+  (constructor_name, "BinaryIterator")
+  (constructible, false)
+  (methods,
+    ("next", bind, next)
+    ("__iterator__", bind, iterator)))
+{
+public:
+  enum mode_type { indices, values, pairs };
+
+  binary_iterator(object const &o, binary &source, mode_type mode);
+
+  value next();
+  object iterator();
+
+protected:
+  void trace(tracer &);
+
+private:
+  binary *source;
+  std::size_t pos;
+  mode_type mode;
 };
 
 FLUSSPFERD_CLASS_DESCRIPTION(
@@ -137,10 +298,18 @@ public:
   byte_string(object const &o, call_context &x);
   byte_string(object const &o, binary const &b);
   byte_string(object const &o, element_type const *p, std::size_t n);
+  byte_string(object const &o, storage_ptr const &s, std::size_t offset,
+              std::size_t n);
 
   virtual binary &create(element_type const *p, std::size_t n);
+  virtual binary &create_view(
+    storage_ptr const &s, std::size_t offset, std::size_t n);
   virtual value element(element_type byte);
 
+protected:
+  void property_op(property_mode mode, value const &id, value &data);
+  void trace(tracer &trc);
+
 public:
   std::string to_string();
   object to_byte_string();
@@ -149,6 +318,9 @@ public:
   std::string to_source();
 
   static byte_string &join(array &arr, binary &delim);
+
+private:
+  object bytes; // the context's shared one-byte ByteStrings, once looked up
 };
 
 FLUSSPFERD_CLASS_DESCRIPTION(
@@ -190,8 +362,12 @@ public:
   byte_array(object const &o, call_context &x);
   byte_array(object const &o, binary const &b);
   byte_array(object const &o, element_type const *p, std::size_t n);
+  byte_array(object const &o, storage_ptr const &s, std::size_t offset,
+             std::size_t n);
 
   virtual binary &create(element_type const *p, std::size_t n);
+  virtual binary &create_view(
+    storage_ptr const &s, std::size_t offset, std::size_t n);
   virtual value element(element_type byte);
 
 public:
@@ -211,7 +387,7 @@ public:
   void for_each(object callback, object thisObj);
   bool every(object callback, object thisObj);
   bool some(object callback, object thisObj);
-  int count(object callback, object thisObj);
+  int count(value callback, object thisObj);
   byte_array &map(object callback, object thisObj);
   value reduce(object callback, value initial_value);
   value reduce_right(object callback, value initial_value);
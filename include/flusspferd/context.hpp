@@ -90,6 +90,38 @@ public:
    */
   void gc(bool maybe = false);
 
+  /**
+   * Report that @p bytes of native memory are now kept alive by Javascript
+   * objects of this context.
+   *
+   * The amount counts towards the next garbage collection the same way
+   * memory allocated by the engine itself does. Prefer
+   * flusspferd::external_memory, which also reports the matching free.
+   *
+   * @param bytes The number of bytes allocated.
+   * @param category The name the bytes are counted under in
+   *                 external_memory::totals.
+   */
+  void report_external_alloc(std::size_t bytes, char const *category = "other");
+
+  /**
+   * Report that @p bytes previously reported with #report_external_alloc
+   * have been freed.
+   *
+   * @param bytes The number of bytes freed.
+   * @param category The category they were reported under.
+   */
+  void report_external_free(std::size_t bytes, char const *category = "other");
+
+  /**
+   * Stop the script running in this context as soon as possible, like an
+   * exception that cannot be caught.
+   *
+   * Unlike the other methods this may be called from any thread, as long as
+   * the context is not destroyed at the same time.
+   */
+  void interrupt();
+
   /**
    * Tie the context to the current thread. Must be called
    * before the context is used in a thread.
@@ -144,6 +176,24 @@ public:
     return prototype(T::class_info::full_name());
   }
 
+  /**
+   * Keep an object for as long as the context exists, for native code that
+   * caches JavaScript values (such as the shared one-byte ByteStrings).
+   * Replaces any object stored under the same name.
+   *
+   * @param name The name of the cache.
+   * @param obj  The object, which stays rooted.
+   */
+  void set_cache(std::string const &name, object const &obj);
+
+  /**
+   * Get an object stored by set_cache.
+   *
+   * @param name The name of the cache.
+   * @return     The object, or a null object if there is none.
+   */
+  object cache(std::string const &name) const;
+
   /**
    * Add a constructor to the context's constructor registry.
    *
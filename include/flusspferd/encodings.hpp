@@ -29,7 +29,10 @@ THE SOFTWARE.
 #include "string.hpp"
 #include "binary.hpp"
 #include "class_description.hpp"
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <string>
+#include <vector>
 
 namespace flusspferd {
 
@@ -42,6 +45,76 @@ namespace encodings {
   object convert(
     std::string const &from_enc, std::string const &to_enc, binary &source);
 
+  /**
+   * Incremental character set converter (iconv) working on plain byte
+   * buffers.
+   *
+   * Input can be pushed in arbitrary chunks. Conversion always resumes where
+   * iconv stopped, and an incomplete multi-byte sequence at the end of a
+   * chunk is kept until the next push.
+   */
+  class converter : boost::noncopyable {
+  public:
+    converter(std::string const &from, std::string const &to);
+    ~converter();
+
+    /// Convert [in, in + n) and append the result to @p out.
+    void push(
+      binary::element_type const *in, std::size_t n,
+      binary::vector_type &out);
+
+    /**
+     * Append any closing sequence to @p out. Throws if an incomplete
+     * multi-byte sequence is left. The converter cannot be used afterwards.
+     */
+    void close(binary::vector_type &out);
+
+    bool is_closed() const;
+
+  private:
+    class impl;
+    boost::scoped_ptr<impl> p;
+  };
+
+  /**
+   * Converts between Javascript strings (UTF-16) and a character set, chunk
+   * by chunk. UTF-8 and ISO-8859-1 are converted directly, other character
+   * sets through iconv. Invalid input throws.
+   */
+  class text_codec : boost::noncopyable {
+  public:
+    /// Throws if @p charset is not supported.
+    explicit text_codec(std::string const &charset);
+    ~text_codec();
+
+    std::string const &charset() const;
+
+    /**
+     * Encode [begin, end) and append the result to @p out. A surrogate pair
+     * must not be split between calls, except for iconv character sets.
+     */
+    void encode(
+      js_char16_t const *begin, js_char16_t const *end,
+      binary::vector_type &out);
+
+    /**
+     * Decode [begin, end) and append the result to @p out.
+     *
+     * Unless @p final is set, an incomplete sequence at the end is not
+     * decoded. For UTF-8 it is left in the input, and the return value tells
+     * how many bytes were used; iconv keeps it for the next call instead.
+     *
+     * @return The number of bytes used.
+     */
+    std::size_t decode(
+      binary::element_type const *begin, binary::element_type const *end,
+      std::vector<js_char16_t> &out, bool final);
+
+  private:
+    class impl;
+    boost::scoped_ptr<impl> p;
+  };
+
   FLUSSPFERD_CLASS_DESCRIPTION(
     transcoder,
     (full_name, "encodings.Transcoder")
@@ -0,0 +1,90 @@
+// vim:ts=2:sw=2:expandtab:autoindent:filetype=cpp:
+/*
+The MIT License
+
+Copyright (c) 2008, 2009 Flusspferd contributors (see "CONTRIBUTORS" or
+                                       http://flusspferd.org/contributors.txt)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef FLUSSPFERD_EVENT_HPP
+#define FLUSSPFERD_EVENT_HPP
+
+#include <cstddef>
+
+namespace boost { namespace asio { class io_service; } }
+
+namespace flusspferd {
+
+class object;
+
+/**
+ * The event loop.
+ *
+ * Every thread running Javascript (the main thread and each worker) has one
+ * event loop. Its handlers are run on that thread, inside event::run() or
+ * event::run_once(), so they may use the thread's context freely.
+ *
+ * Native code starts asynchronous operations on event::io_service(). To hand
+ * a result computed on another thread back to Javascript, get the
+ * io_service on the Javascript thread and call its thread-safe
+ * <code>post()</code> from the other thread.
+ *
+ * @ingroup jsext
+ */
+namespace event {
+
+/// The io_service of the current thread's event loop.
+boost::asio::io_service &io_service();
+
+/**
+ * Run handlers until there is no more work.
+ *
+ * Exceptions thrown by handlers are passed on; the loop can be run again
+ * afterwards.
+ *
+ * @return The number of handlers run.
+ */
+std::size_t run();
+
+/**
+ * Wait for and run one handler.
+ *
+ * @return The number of handlers run: 1, or 0 if there was no more work.
+ */
+std::size_t run_once();
+
+/**
+ * Destroy the current thread's event loop, cancelling all timers and
+ * watchers and dropping all pending handlers.
+ *
+ * Threads that create their own context must call this before the context
+ * is destroyed.
+ */
+void shutdown();
+
+}
+
+void load_event_module(object container);
+
+}
+
+#endif
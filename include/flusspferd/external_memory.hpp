@@ -0,0 +1,91 @@
+// vim:ts=2:sw=2:expandtab:autoindent:filetype=cpp:
+/*
+The MIT License
+
+Copyright (c) 2008, 2009 Flusspferd contributors (see "CONTRIBUTORS" or
+                                       http://flusspferd.org/contributors.txt)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef FLUSSPFERD_EXTERNAL_MEMORY_HPP
+#define FLUSSPFERD_EXTERNAL_MEMORY_HPP
+
+#include <boost/noncopyable.hpp>
+#include <map>
+#include <string>
+
+namespace flusspferd {
+
+/**
+ * Accounts for native memory that is kept alive by a Javascript object.
+ *
+ * SpiderMonkey only sees the size of its own heap, so big native buffers
+ * behind small wrapper objects never make it collect garbage. Growing an
+ * external_memory reports the difference to the garbage collector of the
+ * current context (see context::report_external_alloc) and every change is
+ * counted in the per-category totals returned by #totals.
+ *
+ * Typically a member of a native object, resized whenever its buffers change
+ * and released together with the object.
+ *
+ * @ingroup gc
+ */
+class external_memory : boost::noncopyable {
+public:
+  /**
+   * Constructor.
+   *
+   * @param category Name the bytes are counted under. Must be a string
+   *                 literal (or otherwise outlive the program).
+   * @param bytes Initial size.
+   */
+  explicit external_memory(char const *category, std::size_t bytes = 0);
+
+  /// Destructor. Releases the accounted bytes.
+  ~external_memory();
+
+  /// Set the number of accounted bytes.
+  void resize(std::size_t bytes);
+
+  /// The number of accounted bytes.
+  std::size_t size() const { return bytes; }
+
+  /// Map from category name to bytes currently accounted.
+  typedef std::map<std::string, std::size_t> totals_map;
+
+  /**
+   * The bytes currently accounted per category, over all threads.
+   */
+  static totals_map totals();
+
+#ifndef IN_DOXYGEN
+  static void update_total(
+    char const *category, std::size_t added, std::size_t removed);
+#endif
+
+private:
+  char const *category;
+  std::size_t bytes;
+};
+
+}
+
+#endif
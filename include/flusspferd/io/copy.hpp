@@ -0,0 +1,76 @@
+// vim:ts=2:sw=2:expandtab:autoindent:filetype=cpp:
+/*
+The MIT License
+
+Copyright (c) 2008, 2009 Flusspferd contributors (see "CONTRIBUTORS" or
+                                       http://flusspferd.org/contributors.txt)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef FLUSSPFERD_IO_COPY_HPP
+#define FLUSSPFERD_IO_COPY_HPP
+
+#include <boost/noncopyable.hpp>
+#include <boost/cstdint.hpp>
+#include <streambuf>
+#include <vector>
+
+namespace flusspferd { namespace io {
+
+/**
+ * Copies data between file descriptors or streambufs, letting the kernel do
+ * the work where possible: splice when one end is a pipe, copy_file_range
+ * between regular files, and sendfile from regular files (all Linux only).
+ * Otherwise data is read and written through a buffer, which is reused for
+ * every copy made with the same copier.
+ *
+ * @ingroup io
+ */
+class copier : private boost::noncopyable {
+public:
+  /// Default size of the buffer.
+  static std::size_t const default_buffer_size = 64 * 1024;
+
+  explicit copier(std::size_t buffer_size = default_buffer_size);
+
+  /**
+   * Copy everything from the current position of @p in to its end, writing
+   * it at the current position of @p out. Throws on errors.
+   *
+   * @return The number of bytes copied.
+   */
+  boost::uint64_t copy(int in, int out);
+
+  /**
+   * Copy everything left in @p in to @p out, and flush @p out. If both are
+   * io::fd_streambuf objects, whatever they have buffered is dealt with and
+   * the file descriptors are copied directly.
+   *
+   * @return The number of bytes copied.
+   */
+  boost::uint64_t copy(std::streambuf &in, std::streambuf &out);
+
+private:
+  std::vector<char> buffer;
+};
+
+}}
+
+#endif
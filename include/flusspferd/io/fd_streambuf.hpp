@@ -0,0 +1,179 @@
+// vim:ts=2:sw=2:expandtab:autoindent:filetype=cpp:
+/*
+The MIT License
+
+Copyright (c) 2008, 2009 Flusspferd contributors (see "CONTRIBUTORS" or
+                                       http://flusspferd.org/contributors.txt)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef FLUSSPFERD_IO_FD_STREAMBUF_HPP
+#define FLUSSPFERD_IO_FD_STREAMBUF_HPP
+
+#include <boost/noncopyable.hpp>
+#include <streambuf>
+#include <ios>
+#include <cstddef>
+
+namespace flusspferd { namespace io {
+
+/**
+ * A std::streambuf reading from and writing to a file descriptor with its own
+ * buffers, bypassing C stdio.
+ *
+ * @ingroup io
+ */
+class fd_streambuf : public std::streambuf, private boost::noncopyable {
+public:
+  /// How output is buffered.
+  enum buffer_mode {
+    /// Line buffering for terminals, full buffering otherwise.
+    buffer_auto,
+    /// Every write goes to the file descriptor immediately.
+    buffer_none,
+    /// Output is written whenever a new line has been written.
+    buffer_line,
+    /// Output is written when the buffer is full or on sync().
+    buffer_full
+  };
+
+  /// Default size of the input and output buffers.
+  static std::size_t const default_size = 64 * 1024;
+
+  /**
+   * Constructor.
+   *
+   * @param fd The file descriptor.
+   * @param own Whether to close @p fd on destruction.
+   * @param mode The output buffering.
+   * @param size The buffer size.
+   */
+  explicit fd_streambuf(int fd, bool own = false,
+                        buffer_mode mode = buffer_auto,
+                        std::size_t size = default_size);
+
+  /// Destructor. Writes pending output.
+  ~fd_streambuf();
+
+  /// The file descriptor.
+  int fd() const { return fd_; }
+
+  /// Whether the file descriptor refers to a terminal.
+  bool is_tty() const { return tty; }
+
+  /// The effective output buffering (never buffer_auto).
+  buffer_mode mode() const { return mode_; }
+
+  /// The buffer size.
+  std::size_t size() const { return size_; }
+
+  /**
+   * Change the buffering. Pending output is written first.
+   *
+   * @param mode The output buffering.
+   * @param size The buffer size, must be positive.
+   */
+  void set_buffering(buffer_mode mode, std::size_t size);
+
+  /**
+   * Write pending output of @p other before reading input, like
+   * std::ios::tie. Typically stdin is tied to stdout.
+   */
+  void tie(std::streambuf *other) { tied = other; }
+
+  /**
+   * Align the buffers to @p alignment bytes (0 for no alignment), as needed
+   * for a file descriptor opened with O_DIRECT. The buffer size is rounded
+   * up to a multiple of @p alignment. Transfers the kernel rejects as
+   * unaligned (such as the last, partial block of a file) are retried
+   * without O_DIRECT.
+   */
+  void set_alignment(std::size_t alignment);
+
+  /**
+   * Write pending output and give read-ahead input back to the file (by
+   * seeking back), so that the file descriptor can be used directly.
+   *
+   * @return Whether nothing is left in the buffers. Input read from pipes
+   *         and terminals cannot be given back.
+   */
+  bool release();
+
+  /**
+   * Read up to @p n bytes at @p offset (pread), without changing the current
+   * position. Pending output is written first.
+   *
+   * @return The number of bytes read, or -1 on error (see errno).
+   */
+  std::streamsize read_at(std::streamoff offset, char *data, std::size_t n);
+
+  /**
+   * Write @p n bytes at @p offset (pwrite), without changing the current
+   * position. Pending output is written first.
+   *
+   * @return Whether all data was written. On error, see errno.
+   */
+  bool write_at(std::streamoff offset, char const *data, std::size_t n);
+
+protected:
+  int_type underflow();
+  int_type overflow(int_type ch);
+  std::streamsize xsputn(char const *s, std::streamsize n);
+  int sync();
+
+  pos_type seekoff(off_type off, std::ios::seekdir dir,
+                   std::ios::openmode which = std::ios::in | std::ios::out);
+  pos_type seekpos(pos_type pos,
+                   std::ios::openmode which = std::ios::in | std::ios::out);
+
+private:
+  // A buffer that can be aligned for O_DIRECT
+  class buffer : private boost::noncopyable {
+  public:
+    buffer() : data(0), size(0) {}
+    ~buffer();
+
+    void reset(std::size_t size, std::size_t alignment);
+
+    char *data;
+    std::size_t size;
+  };
+
+  bool write_out();
+  void drop_input();
+  bool write_fd(char const *data, std::size_t n);
+  std::streamsize read_fd(char *data, std::size_t n);
+  bool direct_rejected(int error);
+  void allocate();
+
+  int fd_;
+  bool own;
+  bool tty;
+  buffer_mode mode_;
+  std::size_t size_;
+  std::size_t alignment;
+  std::streambuf *tied;
+  buffer in;
+  buffer out;
+};
+
+}}
+
+#endif
@@ -40,7 +40,13 @@ FLUSSPFERD_CLASS_DESCRIPTION(
   (constructor_arity, 1)
   (methods,
     ("open", bind, open)
-    ("close", bind, close))
+    ("close", bind, close)
+    ("seek", bind, seek)
+    ("tell", bind, tell)
+    ("readAt", bind, read_at)
+    ("writeAt", bind, write_at)
+    ("advise", bind, advise)
+    ("preallocate", bind, preallocate))
   (constructor_methods,
     ("create", bind_static, create)
     ("exists", bind_static, exists)))
@@ -54,6 +60,18 @@ public: // javascript methods
   void open(char const *name, value options);
   void close();
 
+  double seek(double offset, boost::optional<std::string> const &whence);
+  double tell();
+
+  object read_at(double offset, unsigned size,
+                 boost::optional<byte_array&> output);
+  void write_at(double offset, value data);
+
+  void advise(std::string const &advice, boost::optional<double> offset,
+              boost::optional<double> length);
+  void preallocate(double length, boost::optional<double> offset,
+                   boost::optional<bool> keep_size);
+
 public: // constructor methods
   static void create(char const *name, boost::optional<int> mode);
   static bool exists(char const *name) FLUSSPFERD_DEPRECATED;
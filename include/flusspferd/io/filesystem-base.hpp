@@ -40,11 +40,14 @@ namespace io {
 namespace fs_base {
 
   object raw_open(char const* name, value mode, value permissions);
+  object map_file(std::string const &path);
 
   string canonical(std::string const &path);
   boost::filesystem::path canonicalize(boost::filesystem::path in);
 
   void move(std::string const &source, std::string const &target);
+  void copy(std::string const &source, std::string const &target);
+  void copy_tree(std::string const &source, std::string const &target);
   void remove(std::string const &target);
   void touch(std::string const &path, object mtime);
 
@@ -78,6 +81,8 @@ namespace fs_base {
 
   array list(std::string const &path);
   object iterate(std::string const &path);
+  object walk(std::string const &root, value options);
+  array glob(std::string const &pattern);
 }
 
 }}
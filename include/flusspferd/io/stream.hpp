@@ -32,9 +32,15 @@ THE SOFTWARE.
 #include "../class_description.hpp"
 #include "../string.hpp"
 #include "../binary.hpp"
+#include <boost/optional.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <streambuf>
 
-namespace flusspferd { namespace io {
+namespace flusspferd {
+
+namespace encodings { class text_codec; }
+
+namespace io {
 
 FLUSSPFERD_CLASS_DESCRIPTION(
   stream,
@@ -49,11 +55,19 @@ FLUSSPFERD_CLASS_DESCRIPTION(
     ("write", bind, write)
     ("flush", bind, flush)
     ("print", bind, print)
-    ("readLine", bind, read_line))
+    ("readLine", bind, read_line)
+    ("readLineBinary", bind, read_line_binary)
+    ("lines", bind, lines)
+    ("setBuffering", bind, set_buffering)
+    ("isatty", bind, isatty)
+    ("pipeTo", bind, pipe_to))
   (properties,
-    ("fieldSeparator", variable, " ")
-    ("recordSeparator", variable, "\n")
-    ("autoFlush", variable, false)))
+    ("fieldSeparator", getter_setter,
+      (get_field_separator, set_field_separator))
+    ("recordSeparator", getter_setter,
+      (get_record_separator, set_record_separator))
+    ("autoFlush", getter_setter, (get_auto_flush, set_auto_flush))
+    ("charset", getter_setter, (get_charset, set_charset))))
 {
 public:
   stream(object const &o, std::streambuf *b);
@@ -75,9 +89,104 @@ public: // javascript methods
 
   void print(call_context &);
   string read_line(value sep);
+  object read_line_binary(value sep);
+  object lines(value sep, boost::optional<unsigned> batch_size);
+
+  void set_buffering(std::string const &mode, boost::optional<unsigned> size);
+  bool isatty();
+  double pipe_to(stream &target, value options);
+
+public: // javascript properties
+  value get_field_separator();
+  void set_field_separator(value sep);
+
+  value get_record_separator();
+  void set_record_separator(value sep);
+
+  bool get_auto_flush();
+  void set_auto_flush(bool flush);
+
+  std::string get_charset();
+  void set_charset(std::string const &charset);
+
+public:
+  /**
+   * Read up to and including the next occurrence of @p sep, or up to the end
+   * of the stream, and append it to @p line. The streambuf's buffer is
+   * scanned in place.
+   *
+   * @return Whether anything was read.
+   */
+  bool read_line_bytes(std::string const &sep, std::string &line);
+
+  /**
+   * The bytes of a Javascript line separator: a string encoded in the
+   * stream's charset, or the contents of a Binary. Defaults to "\n".
+   */
+  std::string separator_bytes(value sep);
+
+  /**
+   * Encode the text [data, data + n) in the stream's charset and write it,
+   * chunk by chunk.
+   */
+  void write_text(js_char16_t const *data, std::size_t n);
+
+  /// Encode @p text in the stream's charset and append it to @p out.
+  void encode_text(string const &text, binary::vector_type &out);
+
+  /// Decode [data, data + n) from the stream's charset.
+  string decode_text(char const *data, std::size_t n);
+
+  /**
+   * Whether print flushes the stream even without autoFlush. True by
+   * default; system.stdout turns it off and leaves flushing to its buffer.
+   */
+  void set_flush_on_print(bool flush);
 
 private:
+  typedef std::basic_string<js_char16_t> utf16_string;
+
+  void print_value(value const &v);
+  void write_text(utf16_string const &text);
+
   std::streambuf *streambuf_;
+  boost::scoped_ptr<encodings::text_codec> codec;
+
+  // The separators and autoFlush are read on every print and write, so they
+  // are kept here rather than as Javascript properties.
+  boost::optional<utf16_string> field_separator;
+  boost::optional<utf16_string> record_separator;
+  bool auto_flush;
+  bool flush_on_print;
+};
+
+/**
+ * Native iterator over the lines of a stream, as returned by Stream#lines.
+ * Each step returns an Array with a batch of lines.
+ */
+FLUSSPFERD_CLASS_DESCRIPTION(
+  line_iterator,
+  (full_name, "IO.LineIterator")
+  (constructor_name, "LineIterator")
+  (constructible, false)
+  (methods,
+    ("next", bind, next)
+    ("__iterator__", bind, iterator)))
+{
+public:
+  line_iterator(object const &o, stream &source, std::string const &sep,
+                std::size_t batch_size);
+
+  object next();
+  object iterator();
+
+protected:
+  void trace(tracer &);
+
+private:
+  stream *source;
+  std::string sep;
+  std::size_t batch_size;
 };
 
 }}
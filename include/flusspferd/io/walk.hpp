@@ -0,0 +1,135 @@
+// vim:ts=2:sw=2:expandtab:autoindent:filetype=cpp:
+/*
+The MIT License
+
+Copyright (c) 2008, 2009 Flusspferd contributors (see "CONTRIBUTORS" or
+                                       http://flusspferd.org/contributors.txt)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef FLUSSPFERD_IO_WALK_HPP
+#define FLUSSPFERD_IO_WALK_HPP
+
+#include "../native_object_base.hpp"
+#include "../class.hpp"
+#include "../class_description.hpp"
+#include "../array.hpp"
+#include <boost/scoped_ptr.hpp>
+#include <boost/optional.hpp>
+#include <string>
+#include <vector>
+
+namespace flusspferd { namespace io {
+
+/**
+ * Matches paths against a glob pattern one path component at a time, so that
+ * a directory walk can leave out subtrees that cannot contain a match.
+ *
+ * Within a component, @c * matches any number of characters, @c ? a single
+ * character and <tt>[...]</tt> one of a set (negated with @c ! or @c ^).
+ * A component that is just @c ** matches any number of directories. As in the
+ * shell, a leading dot in a name has to be matched explicitly.
+ *
+ * @ingroup io
+ */
+class glob_matcher {
+public:
+  /// The pattern components that a path matched so far can continue with.
+  typedef std::vector<unsigned> state_type;
+
+  explicit glob_matcher(std::string const &pattern);
+
+  /// State of the empty path.
+  state_type start() const;
+
+  /// State after appending the component @p name.
+  state_type step(state_type const &state, std::string const &name) const;
+
+  /// Whether a path in @p state matches the whole pattern.
+  bool matches(state_type const &state) const;
+
+  /// Whether anything below a path in @p state can match.
+  bool can_descend(state_type const &state) const;
+
+  /// Match a single component.
+  static bool match_component(char const *pattern, char const *name);
+
+  /// Whether @p component contains any wildcard characters.
+  static bool is_literal(std::string const &component);
+
+private:
+  state_type closure(state_type const &state) const;
+
+  std::vector<std::string> components;
+};
+
+FLUSSPFERD_CLASS_DESCRIPTION(
+  walker,
+  (full_name, "IO.Walker")
+  (constructor_name, "Walker")
+  (constructible, false)
+  (methods,
+    ("next", bind, next)
+    ("__iterator__", bind, iterator)))
+{
+public:
+  struct options {
+    options();
+
+    bool follow_links;
+    unsigned max_depth;
+    bool stat;
+    unsigned stat_threads;
+    std::size_t batch_size;
+    boost::optional<std::string> glob;
+    value filter;
+
+    // Yield the paths only, instead of entry objects
+    bool paths_only;
+  };
+
+  /**
+   * Walk the tree below @p root. An empty @p root walks the working
+   * directory, with paths relative to it.
+   */
+  walker(object const &o, std::string const &root, options const &opts);
+  ~walker();
+
+  object next();
+  object iterator();
+
+  /**
+   * Append the next entries to @p out, up to the batch size.
+   *
+   * @return false at the end of the walk.
+   */
+  bool next_batch(array &out);
+
+protected:
+  void trace(tracer &);
+
+private:
+  class impl;
+  boost::scoped_ptr<impl> p;
+};
+
+}}
+
+#endif
@@ -32,6 +32,10 @@ THE SOFTWARE.
 #include "array.hpp"
 #include "native_function_base.hpp"
 #include <boost/filesystem.hpp>
+#include <boost/shared_ptr.hpp>
+#include <vector>
+#include <string>
+#include <utility>
 
 namespace flusspferd {
 
@@ -127,19 +131,45 @@ public:
 
   static string load_module_text(boost::filesystem::path filename, boost::optional<object> cache = boost::none);
 
+  /// Option lines ("// name: value") found at the top of a module
+  typedef std::vector<std::pair<std::string, std::string> > module_options;
+
+  /// Read and decode a module's source, collecting its option lines
+  static string read_module_text(boost::filesystem::path filename, module_options &options);
+
+  /// Store option lines in the module's options object
+  static void set_module_options(object opts, module_options const &options);
+
   /// Create a sub-%require object for the given module id
   object new_require_function(string const &id);
 
   /// Populate values in require.main for @c id
   void set_main_module(std::string const &id);
 
+  /// Write the modules reachable from @p roots into the bundle file @p output
+  /**
+   * Dependencies are found by looking for calls of %require with a string
+   * literal as argument. Native modules are not included in the bundle.
+   */
+  void write_bundle(std::vector<std::string> const &roots,
+                    std::string const &output);
+
 protected:
   object module_cache;
   object paths;
   object alias;
   object preload;
   object main;
+  object compile_cache;
+  object resolve_cache;
+  object bundles;
 
+  /// Search results for require.paths, shared by all %require functions
+  struct resolution_state;
+  boost::shared_ptr<resolution_state> resolution;
+
+  /// A module stored in one of the files in require.bundles
+  struct bundle_entry;
 
   std::string current_id();
 
@@ -154,13 +184,29 @@ protected:
 
   void require_js(boost::filesystem::path filename,
                   std::string const &id,
-                  object cache);
+                  object cache,
+                  bundle_entry const *bundled = 0);
+
+  /// Compile a module, or load it from the compiled module cache or a bundle
+  object compile_module(boost::filesystem::path const &filename,
+                        object options,
+                        bundle_entry const *bundled = 0);
+
+  /// Find a module in require.bundles by canonical id or top-level name
+  bundle_entry const *find_bundled(std::string const &id, bool top_level_name);
+
+  /// Load a bundled module unless it is in the module_cache already
+  object load_bundled_module(bundle_entry const &entry);
 
   static id_classification classify_id(std::string const &id);
 
   boost::optional<boost::filesystem::path>
   find_top_level_js_module(std::string const & id, bool not_found_is_fatal);
 
+  /// All files called @p name in require.paths, canonicalized, in search order
+  std::vector<boost::filesystem::path>
+  find_in_paths(boost::filesystem::path const &name);
+
 };
 
 } // namespace flusspferd
@@ -180,7 +180,14 @@ protected:
     /**
      * class name used when constructing. (???)
      */
-    property_classname = 16
+    property_classname = 16,
+
+    /**
+     * The lookup itself is the result, as for the @c in operator, or it is
+     * made by native code such as @c hasOwnProperty. Plain reads and writes
+     * by scripts do not set this.
+     */
+    property_testing = 32
   };
 
   /**
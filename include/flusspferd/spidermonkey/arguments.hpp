@@ -39,16 +39,33 @@ class value;
 namespace Impl {
 
 class arguments_impl {
-  std::vector<jsval> values; // values from the user are added here
+public:
+  // number of user provided values stored without touching the heap
+  enum { inline_capacity = 8 };
+
+private:
+  jsval inline_values[inline_capacity];
+  std::vector<jsval> spill; // used once inline_values is exhausted
   std::size_t n;
   jsval *argv;
+  bool user; // values were added by the user and are owned by this pack
+
+  // Packs holding rooted values are linked into a per-runtime list which is
+  // traced by the garbage collector as a whole (see init.cpp).
+  arguments_impl **root_prev;
+  arguments_impl *root_next;
 
 public:
-  arguments_impl(std::size_t n, jsval *argv) : n(n), argv(argv) { }
+  arguments_impl(std::size_t n, jsval *argv)
+    : n(n), argv(argv), user(false), root_prev(0), root_next(0)
+  { }
   arguments_impl(arguments_impl const &o);
+  ~arguments_impl() { remove_root(); }
 
 protected:
-  arguments_impl() : n(0), argv(0x0) {}
+  arguments_impl()
+    : n(0), argv(inline_values), user(true), root_prev(0), root_next(0)
+  { }
   arguments_impl(std::vector<value> const &o);
 
 protected:
@@ -56,12 +73,27 @@ protected:
   jsval *get() { return argv; }
   std::size_t size() const { return n; }
 
-  std::vector<jsval> &data() { return values; }
-  std::vector<jsval> const &data() const { return values; }
-  void reset_argv();
+  void push(jsval v) {
+    if (n < inline_capacity) {
+      inline_values[n++] = v;
+    } else {
+      push_spill(v);
+    }
+  }
+
+  void add_root();
+  void remove_root() {
+    if (!root_prev)
+      return;
+    *root_prev = root_next;
+    if (root_next)
+      root_next->root_prev = root_prev;
+    root_prev = 0;
+    root_next = 0;
+  }
 
   bool is_userprovided() const {
-    return values.size() == n; // TODO does this fix the problem?
+    return user;
   }
 
   arguments_impl &operator=(arguments_impl const &o);
@@ -78,12 +110,26 @@ protected:
   };
 
   friend jsval *get_arguments(arguments_impl &);
+  friend jsval *get_arguments(arguments_impl const &);
+  friend void trace_arguments_roots(JSTracer *, arguments_impl *);
+
+private:
+  void push_spill(jsval v);
+  void assign(arguments_impl const &o);
 };
 
 inline jsval *get_arguments(arguments_impl &arg) {
   return arg.get();
 }
 
+// SpiderMonkey copies argv into its own frame and never writes back, so a
+// const pack can be passed without copying it first.
+inline jsval *get_arguments(arguments_impl const &arg) {
+  return arg.argv;
+}
+
+void trace_arguments_roots(JSTracer *trc, arguments_impl *first);
+
 }
 
 #endif
@@ -28,7 +28,10 @@ THE SOFTWARE.
 #define FLUSSPFERD_SPIDERMONKEY_INIT_HPP
 
 #include "../init.hpp"
+#include "../current_context_scope.hpp"
 #include "context.hpp"
+#include <boost/optional.hpp>
+#include <boost/utility/in_place_factory.hpp>
 
 typedef struct JSContext JSContext;
 typedef struct JSRuntime JSRuntime;
@@ -39,12 +42,31 @@ namespace flusspferd {
 
 namespace Impl {
 
-inline JSContext *current_context() {
-  return get_context(flusspferd::current_context());
-}
+// The JSContext of the current context (read from thread local storage).
+JSContext *current_context();
+
+// Makes ctx the current context for the duration of a native callback. When
+// the engine calls back into the context that is already current (the usual
+// case) this is a single pointer comparison; only otherwise is a context
+// handle created and entered.
+class callback_context_scope {
+public:
+  explicit callback_context_scope(JSContext *ctx) {
+    if (ctx != current_context())
+      scope = boost::in_place(wrap_context(ctx));
+  }
+
+private:
+  boost::optional<current_context_scope> scope;
+};
 
 JSRuntime *get_runtime();
 
+class arguments_impl;
+
+// Head of the list of rooted argument packs of the current runtime.
+arguments_impl *&get_arguments_roots();
+
 }
 
 #endif
@@ -167,6 +167,17 @@ public:
    */
   string substr(size_t start, size_t length) const;
 
+  /**
+   * Get the interned copy of the string.
+   *
+   * Interned strings are shared, live as long as the runtime and do not need
+   * to be rooted. Using them as property names avoids converting the name on
+   * every access, so they are useful for names that are used many times.
+   *
+   * @return The interned string.
+   */
+  string intern() const;
+
   /**
    * Concatenate two strings.
    *
@@ -33,6 +33,14 @@ class object;
 
 void load_system_module(object &context);
 
+/**
+ * Write pending output of system.stdout and system.stderr of this thread.
+ *
+ * Call this before writing to std::cout or std::cerr, so that the output
+ * appears in order.
+ */
+void flush_standard_streams();
+
 }
 
 #endif
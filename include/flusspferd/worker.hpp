@@ -0,0 +1,96 @@
+// vim:ts=2:sw=2:expandtab:autoindent:filetype=cpp:
+/*
+The MIT License
+
+Copyright (c) 2008, 2009 Flusspferd contributors (see "CONTRIBUTORS" or
+                                       http://flusspferd.org/contributors.txt)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef FLUSSPFERD_WORKER_HPP
+#define FLUSSPFERD_WORKER_HPP
+
+#include "binary.hpp"
+#include <vector>
+#include <string>
+
+namespace flusspferd {
+
+class value;
+class object;
+
+/**
+ * A Javascript value serialized so that it can be re-created in another
+ * runtime, usually on another thread (a "structured clone").
+ *
+ * Supported are undefined, null, booleans, numbers, strings, arrays, plain
+ * objects (their enumerable properties) and ByteStrings and ByteArrays.
+ * Objects referenced more than once, including cycles, are re-created with
+ * the same structure. Functions and other native objects cannot be cloned.
+ *
+ * The bytes of ByteStrings and ByteArrays are not copied: they are moved
+ * into immutable storage that is shared with the clone (see
+ * binary::share_storage).
+ *
+ * @ingroup jsext
+ */
+class structured_clone {
+public:
+  /// Create a clone of undefined.
+  structured_clone();
+
+  /**
+   * Serialize @p v.
+   *
+   * @param v The value.
+   * @param transfer An array of ByteArrays to transfer: their bytes are moved
+   *                 into the clone and they are left empty. Other ByteArrays
+   *                 keep their bytes and copy them on the next modification.
+   */
+  explicit structured_clone(value const &v, object const &transfer = object());
+
+  /// Re-create the value in the current context.
+  value restore() const;
+
+  /// The size of the serialized data, not counting shared binary data.
+  std::size_t size() const { return data.size(); }
+
+#ifndef IN_DOXYGEN
+  struct blob {
+    binary::storage_ptr storage;
+    std::size_t offset;
+    std::size_t length;
+  };
+
+private:
+  std::vector<unsigned char> data;
+  std::vector<blob> blobs;
+
+  class writer;
+  class reader;
+#endif
+};
+
+void load_worker_module(object container, std::string const &argv0);
+
+}
+
+#endif
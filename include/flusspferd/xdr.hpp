@@ -0,0 +1,73 @@
+// vim:ts=2:sw=2:expandtab:autoindent:filetype=cpp:
+/*
+The MIT License
+
+Copyright (c) 2008, 2009 Flusspferd contributors (see "CONTRIBUTORS" or
+                                       http://flusspferd.org/contributors.txt)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef FLUSSPFERD_XDR_HPP
+#define FLUSSPFERD_XDR_HPP
+
+#include "object.hpp"
+#include <vector>
+#include <string>
+
+namespace flusspferd {
+
+/**
+ * @name Serializing compiled code
+ * @addtogroup evaluate_compile
+ */
+//@{
+
+/**
+ * Serialize a compiled Javascript function into engine-specific bytecode.
+ *
+ * @param fun The function. Must be a function compiled from source.
+ * @param out The bytecode is appended to this vector.
+ * @return Whether the function could be serialized.
+ */
+bool serialize_function(object const &fun, std::vector<unsigned char> &out);
+
+/**
+ * Re-create a function from bytecode created by #serialize_function.
+ *
+ * The bytecode must have been created by the same engine version (see
+ * #bytecode_version).
+ *
+ * @param data The bytecode.
+ * @param n The length of the bytecode.
+ * @return The function or a null object if the data could not be decoded.
+ */
+object deserialize_function(unsigned char const *data, std::size_t n);
+
+/**
+ * A string identifying the bytecode format of the Javascript engine. Bytecode
+ * is only compatible between identical versions.
+ */
+std::string bytecode_version();
+
+//@}
+
+}
+
+#endif
@@ -24,18 +24,42 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 */
 #include "flusspferd/binary.hpp"
-#include "flusspferd/evaluate.hpp"
+#include "flusspferd/init.hpp"
 #include "flusspferd/encodings.hpp"
 #include "flusspferd/create/array.hpp"
 #include "flusspferd/create/function.hpp"
 #include "flusspferd/create/native_object.hpp"
+#include "flusspferd/context.hpp"
+#include "flusspferd/external_memory.hpp"
+#include "flusspferd/tracer.hpp"
 #include <sstream>
+#include <fstream>
 #include <algorithm>
+#include <cstring>
 #include <boost/ref.hpp>
 #include <boost/fusion/include/make_vector.hpp>
 
+#if defined(__SSE2__) && defined(__GNUC__)
+#define FLUSSPFERD_BINARY_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef FLUSSPFERD_HAVE_POSIX
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#endif
+
 static char const *DEFAULT_ENCODING = "UTF-8";
 
+// Slices shorter than this are copied instead of sharing the storage, so that
+// small pieces do not keep big buffers alive.
+static std::size_t const SHARE_THRESHOLD = 64;
+
 using namespace flusspferd;
 namespace fusion = boost::fusion;
 
@@ -44,6 +68,7 @@ void flusspferd::load_binary_module(object container) {
   load_class<binary>(exports);
   load_class<byte_string>(exports);
   load_class<byte_array>(exports);
+  load_class<binary_iterator>(exports);
   container.call("require", "encodings");
 }
 
@@ -63,14 +88,296 @@ static int get_byte(value byte_) {
   binary &byte_bin = flusspferd::get_native<binary>(byte_o);
   if (byte_bin.get_length() != 1)
     throw exception("Byte must not be a non single-element Binary");
-  byte = byte_bin.get_const_data()[0];
+  byte = byte_bin.const_begin()[0];
   return byte;
 }
 
+// Get a byte sequence from a Byte, an Array of Bytes or a Binary. Only bytes
+// from Numbers or Arrays are copied into buf.
+static void get_sequence(
+  value v, binary::vector_type &buf,
+  binary::element_type const *&begin, binary::element_type const *&end)
+{
+  if (v.is_object() && !v.is_null() && v.get_object().is_array()) {
+    array a(v.get_object());
+    std::size_t n = a.length();
+    buf.reserve(n);
+    for (std::size_t i = 0; i < n; ++i)
+      buf.push_back(get_byte(a.get_element(i)));
+  } else if (v.is_int()) {
+    buf.push_back(get_byte(v));
+  } else {
+    object o = v.to_object();
+    if (o.is_null())
+      throw exception("Not a valid byte sequence");
+    binary &b = flusspferd::get_native<binary>(o);
+    begin = b.const_begin();
+    end = b.const_end();
+    return;
+  }
+  begin = buf.empty() ? 0 : &buf[0];
+  end = begin + buf.size();
+}
+
+// -- search ----------------------------------------------------------------
+
+// All search functions work on [p, e) and return e if nothing was found.
+
+namespace {
+  typedef binary::element_type const *const_pointer;
+
+  // memchr is vectorized (and dispatched on the CPU at runtime) by any decent
+  // libc, so it is the best single byte search available.
+  const_pointer find_byte(const_pointer p, const_pointer e, int c) {
+    if (p >= e)
+      return e;
+    void const *r = std::memchr(p, c, e - p);
+    return r ? static_cast<const_pointer>(r) : e;
+  }
+
+  const_pointer rfind_byte(const_pointer p, const_pointer e, int c) {
+    if (p >= e)
+      return e;
+#ifdef __GLIBC__
+    void const *r = ::memrchr(p, c, e - p);
+    return r ? static_cast<const_pointer>(r) : e;
+#else
+    for (const_pointer i = e; i != p; )
+      if (*--i == c)
+        return i;
+    return e;
+#endif
+  }
+
+  // Search for any of a set of bytes.
+  class byte_set {
+  public:
+    byte_set() : n(0) {
+      std::fill(table, table + 256, false);
+    }
+
+    void insert(binary::element_type c) {
+      if (table[c])
+        return;
+      table[c] = true;
+      if (n < MAX_VECTOR)
+        bytes[n] = c;
+      ++n;
+    }
+
+    bool contains(binary::element_type c) const {
+      return table[c];
+    }
+
+    const_pointer find(const_pointer p, const_pointer e) const {
+      if (n == 0)
+        return e;
+      if (n == 1)
+        return find_byte(p, e, bytes[0]);
+#ifdef FLUSSPFERD_BINARY_SSE2
+      if (n <= MAX_VECTOR && p < e) {
+        __m128i v[MAX_VECTOR];
+        for (std::size_t i = 0; i < MAX_VECTOR; ++i)
+          v[i] = _mm_set1_epi8(char(bytes[i < n ? i : 0]));
+        while (e - p >= 16) {
+          __m128i chunk = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p));
+          __m128i m = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, v[0]), _mm_cmpeq_epi8(chunk, v[1])),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, v[2]), _mm_cmpeq_epi8(chunk, v[3])));
+          int mask = _mm_movemask_epi8(m);
+          if (mask)
+            return p + __builtin_ctz(mask);
+          p += 16;
+        }
+      }
+#endif
+      for (; p < e; ++p)
+        if (table[*p])
+          return p;
+      return e;
+    }
+
+  private:
+    enum { MAX_VECTOR = 4 };
+
+    bool table[256];
+    binary::element_type bytes[MAX_VECTOR];
+    std::size_t n;
+  };
+
+  // Search for a byte sequence: find candidates for the first byte with
+  // memchr and verify them with memcmp.
+  const_pointer find_sequence(
+    const_pointer p, const_pointer e, const_pointer nb, const_pointer ne)
+  {
+    std::size_t n = ne - nb;
+    if (n == 0)
+      return p;
+    if (std::size_t(e - p) < n)
+      return e;
+    const_pointer last = e - n + 1;
+    for (;;) {
+      p = find_byte(p, last, nb[0]);
+      if (p == last)
+        return e;
+      if (std::memcmp(p + 1, nb + 1, n - 1) == 0)
+        return p;
+      ++p;
+    }
+  }
+
+  // Search for the first of several byte sequences in one pass. Positions
+  // are found via the set of first bytes, then only the delimiters starting
+  // with that byte are compared. If several delimiters match at the same
+  // position, the one added first wins.
+  class multi_searcher {
+  public:
+    void add(const_pointer b, const_pointer e) {
+      if (b == e)
+        return;
+      std::size_t id = needles.size();
+      needles.push_back(std::make_pair(b, e));
+      first.insert(*b);
+      by_first[*b].push_back(id);
+    }
+
+    bool empty() const {
+      return needles.empty();
+    }
+
+    // Returns the position of the match and stores the delimiter in id.
+    const_pointer find(const_pointer p, const_pointer e, std::size_t &id) const
+    {
+      if (needles.size() == 1) {
+        id = 0;
+        return find_sequence(p, e, needles[0].first, needles[0].second);
+      }
+      for (;;) {
+        p = first.find(p, e);
+        if (p == e)
+          return e;
+        std::vector<std::size_t> const &c = by_first[*p];
+        for (std::size_t i = 0; i < c.size(); ++i) {
+          const_pointer nb = needles[c[i]].first;
+          std::size_t n = needles[c[i]].second - nb;
+          if (std::size_t(e - p) >= n && std::memcmp(p, nb, n) == 0) {
+            id = c[i];
+            return p;
+          }
+        }
+        ++p;
+      }
+    }
+
+  private:
+    std::vector<std::pair<const_pointer, const_pointer> > needles;
+    std::vector<std::size_t> by_first[256];
+    byte_set first;
+  };
+}
+
+// -- storage ---------------------------------------------------------------
+
+namespace {
+  class vector_storage : public binary::storage {
+  public:
+    vector_storage(binary::vector_type &v)
+      : memory("binary")
+    {
+      data_.swap(v);
+      memory.resize(data_.capacity());
+    }
+
+    binary::element_type const *data() const {
+      return data_.empty() ? 0 : &data_[0];
+    }
+
+    std::size_t size() const {
+      return data_.size();
+    }
+
+  private:
+    binary::vector_type data_;
+    external_memory memory;
+  };
+
+#ifdef FLUSSPFERD_HAVE_POSIX
+  class mapped_storage : public binary::storage {
+  public:
+    mapped_storage(std::string const &path)
+      : addr(0), length(0)
+    {
+      int fd = ::open(path.c_str(), O_RDONLY);
+      if (fd == -1)
+        throw exception("Could not map file: '" + std::string(std::strerror(errno))
+                        + "' (" + path + ")");
+
+      struct stat st;
+      if (::fstat(fd, &st) != 0) {
+        int err = errno;
+        ::close(fd);
+        throw exception("Could not map file: '" + std::string(std::strerror(err))
+                        + "' (" + path + ")");
+      }
+
+      length = st.st_size;
+
+      // mmap does not accept a length of 0
+      if (length > 0) {
+        void *p = ::mmap(0, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+          int err = errno;
+          ::close(fd);
+          throw exception("Could not map file: '" +
+                          std::string(std::strerror(err)) + "' (" + path + ")");
+        }
+        addr = static_cast<binary::element_type*>(p);
+      }
+
+      ::close(fd);
+    }
+
+    ~mapped_storage() {
+      if (addr)
+        ::munmap(addr, length);
+    }
+
+    binary::element_type const *data() const {
+      return addr;
+    }
+
+    std::size_t size() const {
+      return length;
+    }
+
+  private:
+    binary::element_type *addr;
+    std::size_t length;
+  };
+#endif
+}
+
+binary::storage_ptr binary::adopt_storage(vector_type &v) {
+  return storage_ptr(new vector_storage(v));
+}
+
+binary::storage_ptr binary::map_file(std::string const &path) {
+#ifdef FLUSSPFERD_HAVE_POSIX
+  return storage_ptr(new mapped_storage(path));
+#else
+  std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+  if (!in)
+    throw exception("Could not map file (" + path + ")");
+  vector_type v(
+    (std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  return adopt_storage(v);
+#endif
+}
+
 // -- binary ----------------------------------------------------------------
 
 binary::binary(object const &o, call_context &x)
-  : base_type(o)
+  : base_type(o), v_offset(0), v_length(0), v_memory("binary")
 {
   value data = x.arg[0];
   if (data.is_undefined_or_null())
@@ -85,6 +392,7 @@ binary::binary(object const &o, call_context &x)
     if (i > 2147483647)
       throw exception("Cannot create binary larger than 2147483647 bytes");
     v_data.resize(i);
+    update_memory();
     return;
   }
 
@@ -94,11 +402,19 @@ binary::binary(object const &o, call_context &x)
     if (o.is_array()) {
       convert<vector_type>::from_value conv;
       conv.perform(o).swap(v_data);
+      update_memory();
       return;
     } else {
       try {
         binary &b = flusspferd::get_native<binary>(o);
-        v_data = b.v_data;
+        if (b.is_shared()) {
+          v_storage = b.v_storage;
+          v_offset = b.v_offset;
+          v_length = b.v_length;
+        } else {
+          v_data = b.v_data;
+        }
+        update_memory();
         return;
       } catch (flusspferd::exception&) {
       }
@@ -119,53 +435,41 @@ binary::binary(object const &o, call_context &x)
 }
 
 binary::binary(object const &o, binary const &b)
-  : base_type(o), v_data(b.v_data)
-{}
+  : base_type(o),
+    v_data(b.is_shared() ? vector_type() : b.v_data),
+    v_storage(b.v_storage),
+    v_offset(b.v_offset),
+    v_length(b.v_length),
+    v_memory("binary")
+{
+  update_memory();
+}
 
 binary::binary(object const &o, element_type const *p, std::size_t n)
-  : base_type(o), v_data(p, p + n)
-{}
+  : base_type(o), v_data(p, p + n), v_offset(0), v_length(0),
+    v_memory("binary")
+{
+  update_memory();
+}
+
+binary::binary(
+    object const &o, storage_ptr const &s, std::size_t offset, std::size_t n)
+  : base_type(o), v_storage(s), v_offset(offset), v_length(n),
+    v_memory("binary")
+{
+  if (!s || offset + n > s->size())
+    throw exception("Invalid range for binary storage", "RangeError");
+}
+
+bool binary::property_resolve(value const &id, unsigned access) {
+  // Reads of a missing property reach property_op without any property, so
+  // nothing is defined for them. SpiderMonkey only reports a resolved id if
+  // it is defined, so "in" and hasOwnProperty, and assignments (which would
+  // otherwise add a property with a slot), get a shared property without a
+  // value of its own.
+  if (!(access & (property_testing | property_assigning)))
+    return false;
 
-void binary::augment_prototype(object &proto) {
-  static const char* js_iterator =
-    "function() { return require('util/range').Range(0, this.length) }";
-  root_value iter_val(evaluate(js_iterator, strlen(js_iterator)));
-  proto.define_property("__iterator__", iter_val);
-
-  static const char* js_val_iter =
-    "var i = 0;"
-    "while (i < this.length) {"
-    "  yield this[i];"
-    "  ++i;"
-    "}"
-    ;
-  root_object values_fn(
-    flusspferd::create<function>(
-      param::_name = "values",
-      param::_function = js_val_iter,
-      param::_file = __FILE__,
-      param::_line = __LINE__));
-
-  proto.define_property("values", value(),
-      property_attributes(dont_enumerate, values_fn));
-
-  static const char* js_pairs_iter =
-    "function() {"
-    "  var i = 0;"
-    "  while (i < this.length) {"
-    "    yield [i, this[i]];"
-    "    ++i;"
-    "  }"
-    "}";
-
-  root_object pairs_fn(
-      evaluate(js_pairs_iter, strlen(js_pairs_iter)).get_object());
-
-  proto.define_property("pairs", value(),
-      property_attributes(dont_enumerate, pairs_fn));
-}
-
-bool binary::property_resolve(value const &id, unsigned /*flags*/) {
   if (!id.is_int())
     return false;
 
@@ -174,11 +478,10 @@ bool binary::property_resolve(value const &id, unsigned /*flags*/) {
   if (uid < 0)
     return false;
 
-  if (size_t(uid) >= v_data.size())
+  if (size_t(uid) >= get_length())
     return false;
- 
-  value v = element(v_data[uid]);
-  define_property(id.to_string(), v, permanent_shared_property);
+
+  define_property(id.to_string(), value(), permanent_shared_property);
   return true;
 }
 
@@ -191,86 +494,208 @@ void binary::property_op(property_mode mode, value const &id, value &x) {
     return;
   }
 
-  if (index < 0 || std::size_t(index) >= v_data.size())
+  if (index < 0 || std::size_t(index) >= get_length())
     throw exception("Out of bounds of binary");//TODO
 
   switch (mode) {
   case property_get:
-    x = element(v_data[index]);
+    x = element(const_begin()[index]);
     break;
   case property_set:
-    v_data[index] = get_byte(x);
+    get_data()[index] = get_byte(x);
+    break;
+  case property_add:
+    // The byte is written by the set that follows
     break;
-  default: break;
+  case property_delete:
+    throw exception("Cannot delete elements of a Binary", "TypeError");
   };
 }
 
 binary::vector_type &binary::get_data() {
+  unshare();
   return v_data;
 }
 
 std::size_t binary::get_length() {
+  if (is_shared())
+    return v_length;
   return v_data.size();
 }
 
 std::size_t binary::set_length(std::size_t n) {
+  unshare();
   v_data.resize(n);
+  update_memory();
   return v_data.size();
 }
 
+void binary::update_memory() {
+  // Shared storage accounts for itself (see vector_storage)
+  v_memory.resize(v_data.capacity());
+}
+
+binary::element_type const *binary::const_begin() const {
+  if (is_shared())
+    return v_storage->data() + v_offset;
+  return v_data.empty() ? 0 : &v_data[0];
+}
+
+binary::element_type const *binary::const_end() const {
+  if (is_shared())
+    return v_storage->data() + v_offset + v_length;
+  return const_begin() + v_data.size();
+}
+
+void binary::share() {
+  if (is_shared())
+    return;
+  v_length = v_data.size();
+  v_offset = 0;
+  v_storage = adopt_storage(v_data);
+  update_memory();
+}
+
+void binary::unshare() {
+  if (!is_shared())
+    return;
+  vector_type(const_begin(), const_end()).swap(v_data);
+  v_storage.reset();
+  update_memory();
+  v_offset = 0;
+  v_length = 0;
+}
+
+bool binary::can_share() {
+  // ByteArrays are usually modified in place, so turning an owned ByteArray
+  // into shared storage would only cause a copy later on.
+  return is_shared() || dynamic_cast<byte_string*>(this);
+}
+
+binary &binary::sub_range(std::size_t begin, std::size_t end) {
+  if (end - begin < SHARE_THRESHOLD || !can_share())
+    return create(const_begin() + begin, end - begin);
+  share();
+  return create_view(v_storage, v_offset + begin, end - begin);
+}
+
+binary::storage_ptr binary::share_storage(
+  std::size_t &offset, std::size_t &length, bool detach)
+{
+  share();
+  storage_ptr result = v_storage;
+  offset = v_offset;
+  length = v_length;
+  if (detach) {
+    v_storage.reset();
+    v_offset = 0;
+    v_length = 0;
+  }
+  return result;
+}
+
 object binary::to_byte_array() {
   return flusspferd::create<byte_array>(fusion::vector1<binary const&>(*this));
 }
 
 array binary::to_array() {
-  return array(value(v_data).to_object());
+  return array(value(vector_type(const_begin(), const_end())).to_object());
+}
+
+std::pair<std::size_t, std::size_t>
+binary::search_range(boost::optional<int> start_, boost::optional<int> stop_) {
+  int n = get_length();
+  int start = start_.get_value_or(0);
+  if (start < 0)
+    start = 0;
+  if (start > n)
+    start = n;
+  // stop is the (inclusive) index of the last byte to look at
+  int stop = stop_.get_value_or(n - 1);
+  if (stop >= n)
+    stop = n - 1;
+  if (stop < start - 1)
+    stop = start - 1;
+  return std::pair<std::size_t, std::size_t>(start, stop + 1);
 }
 
 int binary::index_of(
   value byte_, boost::optional<int> start_, boost::optional<int> stop_)
 {
   int byte = get_byte(byte_);
-  int start = start_.get_value_or(0);
-  if (start < 0)
-    start = 0;
-  int stop = stop_.get_value_or(get_length() - 1);
-  if (std::size_t(stop) >= get_length())
-    stop = get_length() - 1;
+  std::pair<std::size_t, std::size_t> r = search_range(start_, stop_);
 
-  for (; start <= stop; ++start)
-    if (v_data[start] == byte)
-      return start;
-  return -1;
+  const_pointer b = const_begin() + r.first;
+  const_pointer e = const_begin() + r.second;
+  const_pointer found = find_byte(b, e, byte);
+  return found == e ? -1 : int(found - const_begin());
 }
 
 int binary::last_index_of(
   value byte_, boost::optional<int> start_, boost::optional<int> stop_)
 {
   int byte = get_byte(byte_);
-  int start = start_.get_value_or(0);
-  if (start < 0)
-    start = 0;
-  int stop = stop_.get_value_or(get_length() - 1);
-  if (std::size_t(stop) >= get_length())
-    stop = get_length() - 1;
+  std::pair<std::size_t, std::size_t> r = search_range(start_, stop_);
 
-  for (; start <= stop; --stop)
-    if (v_data[stop] == byte)
-      return stop;
-  return -1;
+  const_pointer b = const_begin() + r.first;
+  const_pointer e = const_begin() + r.second;
+  const_pointer found = rfind_byte(b, e, byte);
+  return found == e ? -1 : int(found - const_begin());
+}
+
+int binary::index_of_sequence(
+  value seq, boost::optional<int> start_, boost::optional<int> stop_)
+{
+  vector_type buf;
+  const_pointer nb, ne;
+  get_sequence(seq, buf, nb, ne);
+
+  std::pair<std::size_t, std::size_t> r = search_range(start_, stop_);
+
+  const_pointer b = const_begin() + r.first;
+  const_pointer e = const_begin() + r.second;
+  const_pointer found = find_sequence(b, e, nb, ne);
+  return found == e ? -1 : int(found - const_begin());
+}
+
+int binary::count_sequence(
+  value seq, boost::optional<int> start_, boost::optional<int> stop_)
+{
+  vector_type buf;
+  const_pointer nb, ne;
+  get_sequence(seq, buf, nb, ne);
+
+  if (nb == ne)
+    throw exception("Cannot count empty sequences");
+
+  std::pair<std::size_t, std::size_t> r = search_range(start_, stop_);
+
+  const_pointer p = const_begin() + r.first;
+  const_pointer e = const_begin() + r.second;
+  std::size_t n = ne - nb;
+
+  int result = 0;
+  for (;;) {
+    p = n == 1 ? find_byte(p, e, *nb) : find_sequence(p, e, nb, ne);
+    if (p == e)
+      break;
+    ++result;
+    p += n;
+  }
+  return result;
 }
 
 byte_string &binary::byte_at(int offset) {
   if (offset < 0 || std::size_t(offset) > get_length())
     throw exception("Offset outside range", "RangeError");
   return flusspferd::create<byte_string>(
-    fusion::make_vector(&v_data[offset], 1));
+    fusion::make_vector(const_begin() + offset, 1));
 }
 
 int binary::get(int offset) {
   if (offset < 0 || std::size_t(offset) > get_length())
     throw exception("Offset outside range", "RangeError");
-  return v_data[offset];
+  return const_begin()[offset];
 }
 
 std::pair<std::size_t, std::size_t>
@@ -313,18 +738,32 @@ binary::length_range(int start, boost::optional<int> length_) {
 
 object binary::slice(int begin, boost::optional<int> end) {
   std::pair<std::size_t, std::size_t> x = range(begin, end);
-  return create(&v_data[x.first], x.second - x.first);
+  return sub_range(x.first, x.second);
 }
 
 void binary::concat(call_context &x) {
   local_root_scope scope;
-  binary &res = create(&v_data[0], v_data.size()); //copy
+  binary &res = create(const_begin(), get_length()); //copy
   res.do_append(x.arg);
   x.result = res;
 }
 
+namespace {
+  // Reports the grown bytes of a blob once a mutation is done, even if it
+  // ends with an exception.
+  class memory_update {
+  public:
+    explicit memory_update(binary &b) : b(b) {}
+    ~memory_update() { b.update_memory(); }
+
+  private:
+    binary &b;
+  };
+}
+
 void binary::do_append(arguments &arg) {
-  vector_type &out = v_data;
+  memory_update update(*this);
+  vector_type &out = get_data();
   for (arguments::iterator it = arg.begin(); it != arg.end(); ++it) {
     value el = *it;
     if (el.is_int()) {
@@ -349,7 +788,12 @@ void binary::do_append(arguments &arg) {
         }
       } else {
         binary &x = flusspferd::get_native<binary>(o);
-        out.insert(out.end(), x.v_data.begin(), x.v_data.end());
+        if (&x == this) {
+          vector_type tmp(out);
+          out.insert(out.end(), tmp.begin(), tmp.end());
+        } else {
+          out.insert(out.end(), x.const_begin(), x.const_end());
+        }
       }
     }
   }
@@ -411,32 +855,28 @@ array binary::split(value delim, object options) {
 
   // Main loop
 
-  typedef vector_type::iterator iterator;
-  iterator pos = v_data.begin();
+  typedef element_type const *iterator;
+  iterator const begin = const_begin();
+  iterator const end = const_end();
+  iterator pos = begin;
+
+  multi_searcher searcher;
+  for (std::size_t i = 0; i < delims.size(); ++i)
+    searcher.add(delims[i]->const_begin(), delims[i]->const_end());
 
   array results = flusspferd::create<array>();
 
   // Loop only through the first count-1 elements
   for (std::size_t n = 1; n < count; ++n) {
     // Search for the first occurring delimiter
-    std::size_t delim_id = delims.size();
-    iterator first_found = v_data.end();
-    for (std::size_t i = 0; i < delims.size(); ++i) {
-      binary &delim = *delims[i];
-      iterator found = std::search(
-        pos, v_data.end(),
-        delim.get_data().begin(), delim.get_data().end());
-      if (found < first_found) {
-        first_found = found;
-        delim_id = i;
-      }
-    }
+    std::size_t delim_id;
+    iterator first_found = searcher.find(pos, end, delim_id);
 
     // No delimiter found
-    if (delim_id == delims.size())
+    if (first_found == end)
       break;
 
-    binary &elem = create_range(pos, first_found);
+    binary &elem = sub_range(pos - begin, first_found - begin);
 
     // Add element
     results.push(elem);
@@ -450,22 +890,24 @@ array binary::split(value delim, object options) {
   }
 
   // Add last element, possibly containing delimiters
-  results.push(create_range(pos, v_data.end()));
+  results.push(sub_range(pos - begin, end - begin));
 
   return results;
 }
 
 void binary::debug_rep(std::ostream &stream) {
-  stream << "length:" << v_data.size();
-  std::size_t n = std::min(v_data.size(), std::size_t(10));
+  element_type const *data = const_begin();
+  std::size_t length = get_length();
+  stream << "length:" << length;
+  std::size_t n = std::min(length, std::size_t(10));
   if (n)
     stream << " -- ";
   for (std::size_t i = 0; i < n; ++i) {
     if (i)
       stream << ',';
-    stream << int(v_data[i]);
+    stream << int(data[i]);
   }
-  if (n < v_data.size())
+  if (n < length)
     stream << "...";
 }
 
@@ -473,6 +915,62 @@ string binary::decode_to_string(boost::optional<std::string> const &enc) {
   return encodings::convert_to_string(enc ? enc.get() : DEFAULT_ENCODING, *this);
 }
 
+object binary::iterator() {
+  return flusspferd::create<binary_iterator>(
+    fusion::vector2<binary &, binary_iterator::mode_type>(
+      *this, binary_iterator::indices));
+}
+
+object binary::values() {
+  return flusspferd::create<binary_iterator>(
+    fusion::vector2<binary &, binary_iterator::mode_type>(
+      *this, binary_iterator::values));
+}
+
+object binary::pairs() {
+  return flusspferd::create<binary_iterator>(
+    fusion::vector2<binary &, binary_iterator::mode_type>(
+      *this, binary_iterator::pairs));
+}
+
+// -- binary_iterator -------------------------------------------------------
+
+binary_iterator::binary_iterator(
+    object const &o, binary &source, mode_type mode)
+  : base_type(o), source(&source), pos(0), mode(mode)
+{}
+
+void binary_iterator::trace(tracer &trc) {
+  trc("source", *static_cast<object*>(source));
+}
+
+object binary_iterator::iterator() {
+  return *this;
+}
+
+value binary_iterator::next() {
+  // The length is checked on every step as ByteArrays can change under us.
+  if (pos >= source->get_length())
+    throw exception(current_context().global().get_property("StopIteration"));
+
+  std::size_t i = pos++;
+
+  switch (mode) {
+  case indices:
+    return value(i);
+  case values:
+    return source->element(source->const_begin()[i]);
+  default:
+    break;
+  }
+
+  root_value elem(source->element(source->const_begin()[i]));
+  array result = flusspferd::create<array>();
+  result.set_element(0, value(i));
+  result.set_element(1, elem);
+  return result;
+}
+
 // -- byte_string -----------------------------------------------------------
 
 byte_string::byte_string(object const &o, call_context &x)
@@ -487,12 +985,56 @@ byte_string::byte_string(object const &o, element_type const *p, std::size_t n)
   : base_type(o, p, n)
 {}
 
+byte_string::byte_string(
+    object const &o, storage_ptr const &s, std::size_t offset, std::size_t n)
+  : base_type(o, s, offset, n)
+{}
+
 binary &byte_string::create(element_type const *p, std::size_t n) {
   return flusspferd::create<byte_string>(fusion::make_vector(p, n));
 }
 
+binary &byte_string::create_view(
+    storage_ptr const &s, std::size_t offset, std::size_t n)
+{
+  return flusspferd::create<byte_string>(
+    fusion::vector3<storage_ptr const &, std::size_t, std::size_t>(
+      s, offset, n));
+}
+
 value byte_string::element(element_type e) {
-  return create(&e, 1);
+  // ByteStrings are immutable, so all one-byte results for a given byte can
+  // share the same object. The 256 instances are cached in the context; each
+  // ByteString looks them up once and keeps the array.
+  if (bytes.is_null()) {
+    static char const *cache_name = "binary.ByteString/bytes";
+
+    context &cx = current_context();
+    bytes = cx.cache(cache_name);
+    if (bytes.is_null()) {
+      root_object cache(flusspferd::create<array>());
+      for (unsigned i = 0; i < 256; ++i) {
+        element_type b = element_type(i);
+        array(cache).set_element(i, create(&b, 1));
+      }
+      cx.set_cache(cache_name, cache);
+      bytes = cache;
+    }
+  }
+  return array(bytes).get_element(e);
+}
+
+void byte_string::trace(tracer &trc) {
+  if (!bytes.is_null())
+    trc("ByteString one-byte cache", bytes);
+}
+
+void byte_string::property_op(property_mode mode, value const &id, value &x) {
+  // ByteStrings are immutable, and element() hands out shared one-byte
+  // instances
+  if (mode == property_set && id.is_int())
+    throw exception("Cannot assign to elements of a ByteString", "TypeError");
+  binary::property_op(mode, id, x);
 }
 
 std::string byte_string::to_string() {
@@ -509,7 +1051,7 @@ object byte_string::to_byte_string() {
 
 object byte_string::substr(int start, boost::optional<int> length) {
   std::pair<std::size_t, std::size_t> x = length_range(start, length);
-  return create(&get_data()[x.first], x.second - x.first);
+  return sub_range(x.first, x.second);
 }
 
 object byte_string::substring(int first, boost::optional<int> last_) {
@@ -524,17 +1066,14 @@ object byte_string::substring(int first, boost::optional<int> last_) {
     last = get_length();
   if (last < first)
     std::swap(first, last);
-  return create(&get_data()[first], last - first);
+  return sub_range(first, last);
 }
 
 std::string byte_string::to_source() {
   std::ostringstream out;
   out << "(ByteString([";
-  for (vector_type::iterator it = get_data().begin();
-      it != get_data().end();
-      ++it)
-  {
-    if (it != get_data().begin())
+  for (element_type const *it = const_begin(); it != const_end(); ++it) {
+    if (it != const_begin())
       out << ",";
     out << int(*it);
   }
@@ -573,10 +1112,23 @@ byte_array::byte_array(object const &o, element_type const *p, std::size_t n)
   : base_type(o, p, n)
 {}
 
+byte_array::byte_array(
+    object const &o, storage_ptr const &s, std::size_t offset, std::size_t n)
+  : base_type(o, s, offset, n)
+{}
+
 binary &byte_array::create(element_type const *p, std::size_t n) {
   return flusspferd::create<byte_array>(fusion::make_vector(p, n));
 }
 
+binary &byte_array::create_view(
+    storage_ptr const &s, std::size_t offset, std::size_t n)
+{
+  return flusspferd::create<byte_array>(
+    fusion::vector3<storage_ptr const &, std::size_t, std::size_t>(
+      s, offset, n));
+}
+
 value byte_array::element(element_type e) {
   return value(e);
 }
@@ -600,7 +1152,7 @@ void byte_array::append(call_context &x) {
 }
 
 int byte_array::pop() {
-  if (get_data().empty())
+  if (get_length() == 0)
     throw exception("Cannot pop() from empty ByteArray");
   int result = get_data().back();
   get_data().pop_back();
@@ -608,6 +1160,7 @@ int byte_array::pop() {
 }
 
 void byte_array::prepend(call_context &x) {
+  memory_update update(*this);
   vector_type tmp;
   tmp.swap(get_data());
   do_append(x.arg);
@@ -616,7 +1169,7 @@ void byte_array::prepend(call_context &x) {
 }
 
 int byte_array::shift() {
-  if (get_data().empty())
+  if (get_length() == 0)
     throw exception("Cannot pop() from empty ByteArray");
   int result = get_data().front();
   get_data().erase(get_data().begin());
@@ -656,6 +1209,7 @@ int byte_array::erase(int begin, boost::optional<int> end) {
 }
 
 void byte_array::displace(call_context &x) {
+  memory_update update(*this);
   int begin = x.arg[0].to_number();
   boost::optional<int> end;
   if (!x.arg[1].is_undefined_or_null())
@@ -692,7 +1246,7 @@ void byte_array::splice(call_context &x) {
   if (!x.arg[1].is_undefined_or_null())
     length = x.arg[1].to_number();
   std::pair<std::size_t, std::size_t> r = length_range(begin, length);
-  root_object o(create(&get_data()[r.first], r.second - r.first));
+  root_object o(create(const_begin() + r.first, r.second - r.first));
   x.arg[0] = int(r.first);
   x.arg[1] = int(r.second);
   displace(x);
@@ -707,12 +1261,14 @@ byte_array &byte_array::filter(object callback, object thisObj) {
     flusspferd::create<byte_array>(
       fusion::vector2<element_type*, std::size_t>(0, 0));
   root_object root_obj(result);
-
-  vector_type &v = get_data();
-
-  for (std::size_t i = 0; i < v.size(); ++i) {
-    if (callback.call(thisObj, v[i], i, *this).to_boolean())
-      result.get_data().push_back(v[i]);
+  memory_update update(result);
+
+  // The callback may modify this blob, so the bytes are looked up again on
+  // every step
+  for (std::size_t i = 0; i < get_length(); ++i) {
+    element_type byte = const_begin()[i];
+    if (callback.call(thisObj, byte, i, *this).to_boolean())
+      result.get_data().push_back(byte);
   }
 
   return result;
@@ -722,20 +1278,16 @@ void byte_array::for_each(object callback, object thisObj) {
   if (thisObj.is_null())
     thisObj = flusspferd::scope_chain();
 
-  vector_type &v = get_data();
-
-  for (std::size_t i = 0; i < v.size(); ++i)
-    callback.call(thisObj, v[i], i, *this);
+  for (std::size_t i = 0; i < get_length(); ++i)
+    callback.call(thisObj, const_begin()[i], i, *this);
 }
 
 bool byte_array::every(object callback, object thisObj) {
   if (thisObj.is_null())
     thisObj = flusspferd::scope_chain();
 
-  vector_type &v = get_data();
-
-  for (std::size_t i = 0; i < v.size(); ++i)
-    if (!callback.call(thisObj, v[i], i, *this).to_boolean())
+  for (std::size_t i = 0; i < get_length(); ++i)
+    if (!callback.call(thisObj, const_begin()[i], i, *this).to_boolean())
       return false;
 
   return true;
@@ -745,25 +1297,27 @@ bool byte_array::some(object callback, object thisObj) {
   if (thisObj.is_null())
     thisObj = flusspferd::scope_chain();
 
-  vector_type &v = get_data();
-
-  for (std::size_t i = 0; i < v.size(); ++i)
-    if (callback.call(thisObj, v[i], i, *this).to_boolean())
+  for (std::size_t i = 0; i < get_length(); ++i)
+    if (callback.call(thisObj, const_begin()[i], i, *this).to_boolean())
       return true;
 
   return false;
 }
 
-int byte_array::count(object callback, object thisObj) {
+int byte_array::count(value callback_, object thisObj) {
+  // count(byte) and count(sequence) are inherited from Binary
+  if (!callback_.is_function())
+    return count_sequence(callback_, boost::none, boost::none);
+
+  object callback = callback_.get_object();
+
   if (thisObj.is_null())
     thisObj = flusspferd::scope_chain();
 
-  vector_type &v = get_data();
-
   int n = 0;
 
-  for (std::size_t i = 0; i < v.size(); ++i)
-    if (callback.call(thisObj, v[i], i, *this).to_boolean())
+  for (std::size_t i = 0; i < get_length(); ++i)
+    if (callback.call(thisObj, const_begin()[i], i, *this).to_boolean())
       ++n;
 
   return n;
@@ -778,14 +1332,12 @@ byte_array &byte_array::map(object callback, object thisObj) {
       fusion::vector2<element_type*, std::size_t>(0, 0));
   root_object root_obj(result);
 
-  vector_type &v = get_data();
-
-  result.get_data().reserve(v.size());
+  result.get_data().reserve(get_length());
 
   root_value x;
 
-  for (std::size_t i = 0; i < v.size(); ++i) {
-    x = callback.call(thisObj, v[i], i, *this);
+  for (std::size_t i = 0; i < get_length(); ++i) {
+    x = callback.call(thisObj, const_begin()[i], i, *this);
     arguments arg;
     arg.push_back(x);
     result.do_append(arg);
@@ -797,11 +1349,10 @@ byte_array &byte_array::map(object callback, object thisObj) {
 value byte_array::reduce(object callback, value initial_value) {
   root_value result(initial_value);
 
-  vector_type &v = get_data();
   object obj = flusspferd::scope_chain();
 
-  for (std::size_t i = 0; i < v.size(); ++i)
-    result = callback.call(obj, result, v[i], i, *this);
+  for (std::size_t i = 0; i < get_length(); ++i)
+    result = callback.call(obj, result, const_begin()[i], i, *this);
 
   return result;
 }
@@ -809,13 +1360,13 @@ value byte_array::reduce(object callback, value initial_value) {
 value byte_array::reduce_right(object callback, value initial_value) {
   root_value result(initial_value);
 
-  vector_type &v = get_data();
   object obj = flusspferd::scope_chain();
 
-  std::size_t i = v.size();
+  std::size_t i = get_length();
 
   while (i--)
-    result = callback.call(obj, result, v[i], i, *this);
+    if (i < get_length())
+      result = callback.call(obj, result, const_begin()[i], i, *this);
 
   return result;
 }
@@ -823,11 +1374,8 @@ value byte_array::reduce_right(object callback, value initial_value) {
 std::string byte_array::to_source() {
   std::ostringstream out;
   out << "(ByteArray([";
-  for (vector_type::iterator it = get_data().begin();
-      it != get_data().end();
-      ++it)
-  {
-    if (it != get_data().begin())
+  for (element_type const *it = const_begin(); it != const_end(); ++it) {
+    if (it != const_begin())
       out << ",";
     out << int(*it);
   }
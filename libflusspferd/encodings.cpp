@@ -26,10 +26,14 @@ THE SOFTWARE.
 
 #include "flusspferd/binary.hpp"
 #include "flusspferd/encodings.hpp"
+#include "flusspferd/external_memory.hpp"
 #include "flusspferd/create/native_object.hpp"
 #include <iconv.h>
 #include <errno.h>
 #include <sstream>
+#include <vector>
+#include <cctype>
+#include <algorithm>
 #include <boost/algorithm/string.hpp>
 #include <boost/ref.hpp>
 #include <boost/fusion/include/make_vector.hpp>
@@ -67,10 +71,234 @@ static char const * const native_charset = bom_le == bom_native
                                          ? "utf-16le" : "utf-16be";
 
 
+// FAST PATHS
+//
+// UTF-8 and Latin-1 are by far the most common encodings (every module is
+// loaded through convert_to_string), so they are converted directly instead of
+// going through iconv.
+
+namespace {
+  typedef binary::element_type const *const_pointer;
+  typedef std::vector<js_char16_t> utf16_buffer;
+
+  enum charset_kind { charset_other, charset_utf8, charset_latin1 };
+
+  charset_kind classify_charset(std::string const &enc) {
+    std::string name;
+    for (std::string::const_iterator it = enc.begin(); it != enc.end(); ++it)
+      if (std::isalnum(static_cast<unsigned char>(*it)))
+        name += char(std::tolower(static_cast<unsigned char>(*it)));
+
+    if (name == "utf8")
+      return charset_utf8;
+    if (name == "iso88591" || name == "latin1")
+      return charset_latin1;
+    return charset_other;
+  }
+
+  void invalid_sequence() {
+    throw exception("Invalid multi-byte sequence in input");
+  }
+
+  // Returns the number of bytes used. Unless final, an incomplete sequence at
+  // the end is left for the next call.
+  std::size_t decode_utf8(
+    const_pointer const begin, const_pointer e, utf16_buffer &out,
+    bool final = true)
+  {
+    const_pointer p = begin;
+    out.reserve(out.size() + (e - p));
+
+    while (p < e) {
+      // Plain ASCII
+      while (p < e && *p < 0x80)
+        out.push_back(*p++);
+      if (p == e)
+        break;
+
+      unsigned c = *p;
+      std::size_t len;
+      unsigned long cp, min;
+
+      if ((c & 0xe0) == 0xc0) {
+        len = 2; cp = c & 0x1f; min = 0x80;
+      } else if ((c & 0xf0) == 0xe0) {
+        len = 3; cp = c & 0x0f; min = 0x800;
+      } else if ((c & 0xf8) == 0xf0) {
+        len = 4; cp = c & 0x07; min = 0x10000;
+      } else {
+        invalid_sequence();
+        return 0; // not reached
+      }
+
+      std::size_t avail = std::min(len, std::size_t(e - p));
+      for (std::size_t i = 1; i < avail; ++i) {
+        if ((p[i] & 0xc0) != 0x80)
+          invalid_sequence();
+        cp = (cp << 6) | (p[i] & 0x3f);
+      }
+
+      if (avail < len) {
+        if (!final)
+          break;
+        throw exception("Invalid multibyte sequence at the end of input");
+      }
+
+      if (cp < min || cp > 0x10ffff || (cp >= 0xd800 && cp <= 0xdfff))
+        invalid_sequence();
+
+      if (cp >= 0x10000) {
+        cp -= 0x10000;
+        out.push_back(js_char16_t(0xd800 + (cp >> 10)));
+        out.push_back(js_char16_t(0xdc00 + (cp & 0x3ff)));
+      } else {
+        out.push_back(js_char16_t(cp));
+      }
+
+      p += len;
+    }
+
+    return p - begin;
+  }
+
+  void encode_utf8(
+    js_char16_t const *p, js_char16_t const *e, binary::vector_type &out)
+  {
+    out.reserve(out.size() + (e - p) + (e - p) / 2);
+
+    while (p < e) {
+      unsigned long c = *p++;
+
+      if (c < 0x80) {
+        out.push_back(c);
+      } else if (c < 0x800) {
+        out.push_back(0xc0 | (c >> 6));
+        out.push_back(0x80 | (c & 0x3f));
+      } else if (c >= 0xd800 && c <= 0xdfff) {
+        if (c >= 0xdc00 || p == e || *p < 0xdc00 || *p > 0xdfff)
+          invalid_sequence();
+        c = 0x10000 + ((c - 0xd800) << 10) + (*p++ - 0xdc00);
+        out.push_back(0xf0 | (c >> 18));
+        out.push_back(0x80 | ((c >> 12) & 0x3f));
+        out.push_back(0x80 | ((c >> 6) & 0x3f));
+        out.push_back(0x80 | (c & 0x3f));
+      } else {
+        out.push_back(0xe0 | (c >> 12));
+        out.push_back(0x80 | ((c >> 6) & 0x3f));
+        out.push_back(0x80 | (c & 0x3f));
+      }
+    }
+  }
+
+  void decode_latin1(const_pointer p, const_pointer e, utf16_buffer &out) {
+    out.insert(out.end(), p, e);
+  }
+
+  void encode_latin1(
+    js_char16_t const *p, js_char16_t const *e, binary::vector_type &out)
+  {
+    out.reserve(out.size() + (e - p));
+    for (; p < e; ++p) {
+      if (*p > 0xff)
+        invalid_sequence();
+      out.push_back(binary::element_type(*p));
+    }
+  }
+}
+
+// TEXT CODEC
+
+class encodings::text_codec::impl {
+public:
+  impl(std::string const &charset)
+    : charset(charset), kind(classify_charset(charset))
+  {
+    if (kind == charset_other) {
+      encoder.reset(new converter(native_charset, charset));
+      decoder.reset(new converter(charset, native_charset));
+    }
+  }
+
+  std::string charset;
+  charset_kind kind;
+  boost::scoped_ptr<converter> encoder;
+  boost::scoped_ptr<converter> decoder;
+  binary::vector_type utf16;
+};
+
+encodings::text_codec::text_codec(std::string const &charset)
+  : p(new impl(charset))
+{}
+
+encodings::text_codec::~text_codec() {}
+
+std::string const &encodings::text_codec::charset() const {
+  return p->charset;
+}
+
+void encodings::text_codec::encode(
+  js_char16_t const *begin, js_char16_t const *end, binary::vector_type &out)
+{
+  switch (p->kind) {
+  case charset_utf8:
+    encode_utf8(begin, end, out);
+    break;
+  case charset_latin1:
+    encode_latin1(begin, end, out);
+    break;
+  default:
+    p->encoder->push(
+      reinterpret_cast<const_pointer>(begin),
+      (end - begin) * sizeof(js_char16_t),
+      out);
+  }
+}
+
+std::size_t encodings::text_codec::decode(
+  const_pointer begin, const_pointer end, std::vector<js_char16_t> &out,
+  bool final)
+{
+  switch (p->kind) {
+  case charset_utf8:
+    return decode_utf8(begin, end, out, final);
+  case charset_latin1:
+    decode_latin1(begin, end, out);
+    return end - begin;
+  default:
+    {
+      binary::vector_type &utf16 = p->utf16;
+      utf16.clear();
+      p->decoder->push(begin, end - begin, utf16);
+      if (final) {
+        // Reports an incomplete sequence and starts over
+        p->decoder->close(utf16);
+        p->decoder.reset(new converter(p->charset, native_charset));
+      }
+      js_char16_t const *chars =
+        reinterpret_cast<js_char16_t const *>(utf16.empty() ? 0 : &utf16[0]);
+      out.insert(out.end(), chars, chars + utf16.size() / sizeof(js_char16_t));
+      return end - begin;
+    }
+  }
+}
+
 // JAVASCRIPT METHODS
 
 flusspferd::string
 encodings::convert_to_string(std::string const &enc_, binary &source_binary) {
+  charset_kind kind = classify_charset(enc_);
+
+  if (kind != charset_other) {
+    utf16_buffer buf;
+    if (kind == charset_utf8)
+      decode_utf8(source_binary.const_begin(), source_binary.const_end(), buf);
+    else
+      decode_latin1(source_binary.const_begin(), source_binary.const_end(), buf);
+    if (buf.empty())
+      return flusspferd::string();
+    return flusspferd::string(&buf[0], buf.size());
+  }
+
   transcoder &trans =
     create<transcoder>(
       vector2<std::string const&, std::string const&>(enc_, native_charset));
@@ -81,12 +309,27 @@ encodings::convert_to_string(std::string const &enc_, binary &source_binary) {
   binary &out = trans.close(boost::none);
 
   return flusspferd::string(
-    reinterpret_cast<js_char16_t const *>(&out.get_data()[0]),
+    reinterpret_cast<js_char16_t const *>(out.const_begin()),
     out.get_length() / sizeof(js_char16_t));
 }
 
 object encodings::convert_from_string(std::string const &enc, string const &str)
 {
+  charset_kind kind = classify_charset(enc);
+
+  if (kind != charset_other) {
+    binary::vector_type buf;
+    js_char16_t const *data = str.data();
+    if (kind == charset_utf8)
+      encode_utf8(data, data + str.size(), buf);
+    else
+      encode_latin1(data, data + str.size(), buf);
+    std::size_t n = buf.size();
+    return create<byte_string>(
+      vector3<binary::storage_ptr const &, std::size_t, std::size_t>(
+        binary::adopt_storage(buf), 0, n));
+  }
+
   transcoder &trans =
     create<transcoder>(
       vector2<std::string const&, std::string const&>(native_charset, enc));
@@ -115,9 +358,15 @@ object encodings::convert(
   return trans.close(boost::none);
 }
 
-// TRANSCODER
+// CONVERTER
 
-class encodings::transcoder::impl {
+#ifdef ICONV_ACCEPTS_NONCONST_INPUT
+typedef char *iconv_input;
+#else
+typedef char const *iconv_input;
+#endif
+
+class encodings::converter::impl {
 public:
   impl()
   : conv(iconv_t(-1))
@@ -128,12 +377,159 @@ public:
       iconv_close(conv);
   }
 
-  binary::vector_type accumulator;
+  std::size_t convert(
+    const_pointer in, std::size_t n, binary::vector_type &out);
+
+  void grow(binary::vector_type &out, std::size_t n);
+
+  // Bytes of an incomplete multi-byte sequence from the last push.
   binary::vector_type multibyte_part;
 
   iconv_t conv;
 };
 
+encodings::converter::converter(std::string const &from, std::string const &to)
+: p(new impl)
+{
+  p->conv = iconv_open(to.c_str(), from.c_str());
+
+  if (p->conv == iconv_t(-1)) {
+    std::ostringstream message;
+    message << "Could not create Transcoder (iconv) "
+            << "from charset \"" << from << "\" "
+            << "to charset \"" << to << "\"";
+    throw exception(message.str());
+  }
+}
+
+encodings::converter::~converter() {
+}
+
+bool encodings::converter::is_closed() const {
+  return p->conv == iconv_t(-1);
+}
+
+// Make room for n more bytes at the end of out. Growing geometrically keeps
+// the number of reallocations (and copies) logarithmic.
+void encodings::converter::impl::grow(binary::vector_type &out, std::size_t n)
+{
+  std::size_t needed = out.size() + n;
+  if (needed > out.capacity())
+    out.reserve(std::max(needed, out.capacity() * 2));
+  out.resize(needed);
+}
+
+// Convert as much of the input as possible and return the number of bytes
+// consumed. Conversion stops early only at an incomplete multi-byte sequence.
+std::size_t encodings::converter::impl::convert(
+  const_pointer in, std::size_t n, binary::vector_type &out)
+{
+  iconv_input inbuf = const_cast<char *>(reinterpret_cast<char const *>(in));
+  std::size_t inbytesleft = n;
+
+  while (inbytesleft > 0) {
+    // A rough guess how much space might be needed for the new characters.
+    std::size_t out_estimate = inbytesleft + inbytesleft/16 + 32;
+
+    std::size_t out_start = out.size();
+    grow(out, out_estimate);
+
+    char *outbuf = reinterpret_cast<char*>(&out[out_start]);
+    std::size_t outbytesleft = out_estimate;
+
+    std::size_t n_chars = iconv(
+      conv,
+      &inbuf, &inbytesleft,
+      &outbuf, &outbytesleft);
+
+    out.resize(out.size() - outbytesleft);
+
+    if (n_chars == std::size_t(-1)) {
+      switch (errno) {
+      case EILSEQ:
+        throw exception("Invalid multi-byte sequence in input");
+
+      case E2BIG:
+        // iconv has advanced inbuf past everything it converted, so simply
+        // continue from there with more output space.
+        break;
+
+      case EINVAL:
+        return n - inbytesleft;
+
+      default:
+        throw exception("Unknown error in character conversion");
+      }
+    }
+  }
+
+  return n;
+}
+
+void encodings::converter::push(
+  const_pointer in, std::size_t n, binary::vector_type &out)
+{
+  if (is_closed())
+    throw exception("Transcoder is already closed");
+
+  binary::vector_type &part = p->multibyte_part;
+
+  // Complete the sequence left over from the last push byte by byte. It is
+  // at most a few bytes long, so this avoids copying the whole input.
+  while (!part.empty() && n > 0) {
+    part.push_back(*in++);
+    --n;
+    std::size_t used = p->convert(&part[0], part.size(), out);
+    part.erase(part.begin(), part.begin() + used);
+  }
+
+  if (n == 0)
+    return;
+
+  std::size_t used = p->convert(in, n, out);
+  part.assign(in + used, in + n);
+}
+
+void encodings::converter::close(binary::vector_type &out) {
+  if (is_closed())
+    return;
+
+  if (!p->multibyte_part.empty())
+    throw exception("Invalid multibyte sequence at the end of input");
+
+  // 32 bytes should suffice for the initial state shift
+  std::size_t start = out.size();
+  std::size_t outlen = 32;
+  p->grow(out, outlen);
+  char *outbuf = reinterpret_cast<char*>(&out[start]);
+  if (iconv(p->conv, 0, 0, &outbuf, &outlen) == std::size_t(-1))
+    throw exception("Adding closing character sequence failed");
+  out.resize(out.size() - outlen);
+
+  iconv_t conv = p->conv;
+  p->conv = iconv_t(-1);
+
+  if (iconv_close(conv) == -1)
+    throw exception("Closing character set conversion descriptor failed");
+}
+
+// TRANSCODER
+
+class encodings::transcoder::impl {
+public:
+  impl(std::string const &from, std::string const &to)
+  : conv(from, to), accumulated(0), memory("transcoder")
+  {}
+
+  converter conv;
+
+  // Output of pushAccumulate, kept as separate chunks so that earlier output
+  // never has to be copied when more is added.
+  std::vector<binary::vector_type> accumulator;
+  std::size_t accumulated;
+  external_memory memory;
+};
+
 void encodings::transcoder::trace(tracer &) {
 }
 
@@ -155,7 +551,7 @@ encodings::transcoder::~transcoder() {
 
 void encodings::transcoder::init(std::string const &from, std::string const &to)
 {
-  boost::scoped_ptr<impl> p(new impl);
+  boost::scoped_ptr<impl> p(new impl(from, to));
 
   define_property(
     "sourceCharset",
@@ -167,16 +563,6 @@ void encodings::transcoder::init(std::string const &from, std::string const &to)
     flusspferd::value(to),
     property_attributes(read_only_property | permanent_property));
 
-  p->conv = iconv_open(to.c_str(), from.c_str());
-
-  if (p->conv == iconv_t(-1)) {
-    std::ostringstream message;
-    message << "Could not create Transcoder (iconv) "
-            << "from charset \"" << from << "\" "
-            << "to charset \"" << to << "\"";
-    throw exception(message.str());
-  }
-
   this->p.swap(p);
 }
 
@@ -189,42 +575,32 @@ binary &encodings::transcoder::push(
 
   append_accumulator(output);
   do_push(input, output.get_data());
+  output.update_memory();
 
   return output;
 }
 
 void encodings::transcoder::push_accumulate(binary &input) {
-  do_push(input, p->accumulator);
+  p->accumulator.push_back(binary::vector_type());
+  binary::vector_type &chunk = p->accumulator.back();
+  do_push(input, chunk);
+  p->accumulated += chunk.size();
+  if (chunk.empty())
+    p->accumulator.pop_back();
+  p->memory.resize(p->accumulated);
 }
 
 binary &encodings::transcoder::close(
   boost::optional<byte_array&> const &output_)
 {
-  if (!p->multibyte_part.empty())
-    throw exception("Invalid multibyte sequence at the end of input");
-
   binary &output = get_output_binary(output_);
 
   root_object root_obj(output);
 
   append_accumulator(output);
 
-  if (p->conv != iconv_t(-1)) {
-    binary::vector_type &out_v = output.get_data();
-    std::size_t start = out_v.size();
-    // 32 bytes should suffice for the initial state shift
-    std::size_t outlen = 32;
-    out_v.resize(out_v.size() + outlen);
-    char *outbuf = reinterpret_cast<char*>(&out_v[start]);
-    if (iconv(p->conv, 0, 0, &outbuf, &outlen) == std::size_t(-1))
-      throw exception("Adding closing character sequence failed");
-    out_v.resize(out_v.size() - outlen);
-
-    if (iconv_close(p->conv) == -1)
-      throw exception("Closing character set conversion descriptor failed");
-
-    p->conv = iconv_t(-1);
-  }
+  p->conv.close(output.get_data());
+  output.update_memory();
 
   return output;
 }
@@ -241,72 +617,25 @@ binary &encodings::transcoder::get_output_binary(
 
 
 void encodings::transcoder::do_push(binary &input, binary::vector_type &out_v) {
-  binary::vector_type &in_v =
-    p->multibyte_part.empty() ? input.get_data() : p->multibyte_part;
-
-  if (!p->multibyte_part.empty())
-    in_v.insert(in_v.end(), input.get_data().begin(), input.get_data().end());
-
-  // A rough guess how much space might be needed for the new characters.
-  std::size_t out_estimate = in_v.size() + in_v.size()/16 + 32;
-
-  std::size_t out_start = out_v.size();
-
-  for (;;) {
-    out_v.resize(out_v.size() + out_estimate);
-
-#ifdef ICONV_ACCEPTS_NONCONST_INPUT
-    char *inbuf;
-#else
-    char const *inbuf;
-#endif
-
-    inbuf = reinterpret_cast<char *>(&in_v[0]);
-
-    char *outbuf = reinterpret_cast<char*>(&out_v[out_start]);
-
-    std::size_t inbytesleft = in_v.size();
-    std::size_t outbytesleft = out_estimate;
-
-    std::size_t n_chars = iconv(
-      p->conv,
-      &inbuf, &inbytesleft,
-      &outbuf, &outbytesleft);
-
-    if (n_chars == std::size_t(-1)) {
-      switch (errno) {
-      case EILSEQ:
-        throw exception("Invalid multi-byte sequence in input");
-
-      case E2BIG:
-        out_v.resize(out_v.size() - out_estimate);
-        out_estimate *= 2;
-        break;
-
-      case EINVAL:
-        p->multibyte_part.assign(outbuf, outbuf + outbytesleft);
-        out_v.resize(out_v.size() - outbytesleft);
-        return;
-
-      default:
-        throw exception("Unknown error in character conversion");
-      }
-    } else {
-      out_v.resize(out_v.size() - outbytesleft);
-      return;
-    }
-  }
+  p->conv.push(input.const_begin(), input.get_length(), out_v);
 }
 
 void encodings::transcoder::append_accumulator(binary &output) {
+  if (p->accumulator.empty())
+    return;
+
   binary::vector_type &out_v = output.get_data();
 
-  if (!p->accumulator.empty()) {
-    if (!out_v.empty()) {
-      out_v.insert(out_v.end(), p->accumulator.begin(), p->accumulator.end());
-      binary::vector_type().swap(p->accumulator);
-    } else {
-      out_v.swap(p->accumulator);
-    }
+  if (out_v.empty() && p->accumulator.size() == 1) {
+    out_v.swap(p->accumulator.front());
+  } else {
+    out_v.reserve(out_v.size() + p->accumulated);
+    for (std::size_t i = 0; i < p->accumulator.size(); ++i)
+      out_v.insert(
+        out_v.end(), p->accumulator[i].begin(), p->accumulator[i].end());
   }
+
+  std::vector<binary::vector_type>().swap(p->accumulator);
+  p->accumulated = 0;
+  p->memory.resize(0);
 }
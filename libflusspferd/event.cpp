@@ -0,0 +1,359 @@
+// vim:ts=2:sw=2:expandtab:autoindent:filetype=cpp:
+/*
+The MIT License
+
+Copyright (c) 2008, 2009 Flusspferd contributors (see "CONTRIBUTORS" or
+                                       http://flusspferd.org/contributors.txt)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include "flusspferd/event.hpp"
+#include "flusspferd/class_description.hpp"
+#include "flusspferd/create/object.hpp"
+#include "flusspferd/create/function.hpp"
+#include "flusspferd/create/native_object.hpp"
+#include "flusspferd/arguments.hpp"
+#include "flusspferd/call_context.hpp"
+#include "flusspferd/tracer.hpp"
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/system/system_error.hpp>
+#include <map>
+#include <vector>
+#include <cerrno>
+
+#ifdef BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR
+#include <unistd.h>
+#endif
+
+using namespace flusspferd;
+namespace ba = boost::asio;
+using boost::system::error_code;
+
+namespace {
+
+class callbacks;
+
+// The event loop of one thread
+struct loop_state {
+  loop_state() : registry(0), depth(0) {}
+
+  ba::io_service service;
+
+  // The Javascript side, once the event module is loaded
+  callbacks *registry;
+
+  // Nesting level of run() calls
+  int depth;
+};
+
+boost::thread_specific_ptr<loop_state> current_loop;
+
+loop_state &get_loop() {
+  if (!current_loop.get())
+    current_loop.reset(new loop_state);
+  return *current_loop;
+}
+
+// Keeps the callbacks of timers and fd watchers alive. The asio handlers only
+// know the id of their entry, so they do nothing once it is removed.
+FLUSSPFERD_CLASS_DESCRIPTION(
+  callbacks,
+  (full_name, "event.$callbacks")
+  (constructor_name, "")
+  (constructible, false))
+{
+public:
+  callbacks(object const &o) : base_type(o), next_id(1) {}
+  ~callbacks();
+
+  int add_timer(call_context &x, bool repeat);
+  int add_watcher(int fd, std::string const &mode, object const &callback);
+  void remove(int id);
+  void clear();
+
+protected:
+  void trace(tracer &trc);
+
+private:
+  struct entry {
+    entry() : interval(-1), write(false) {}
+
+    object callback;
+    std::vector<value> args;
+
+    boost::shared_ptr<ba::deadline_timer> timer;
+    long interval; // milliseconds; negative for one-shot timers
+
+#ifdef BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR
+    boost::shared_ptr<ba::posix::stream_descriptor> fd;
+#endif
+    bool write;
+  };
+
+  typedef std::map<int, entry> entry_map;
+  entry_map entries;
+  int next_id;
+
+  void wait(int id, entry &e);
+  void fire(int id, entry_map::iterator it);
+
+  static void timer_expired(int id, error_code const &ec);
+  static void fd_ready(int id, error_code const &ec);
+};
+
+callbacks::~callbacks() {
+  loop_state *loop = current_loop.get();
+  if (loop && loop->registry == this)
+    loop->registry = 0;
+}
+
+void callbacks::trace(tracer &trc) {
+  for (entry_map::iterator it = entries.begin(); it != entries.end(); ++it) {
+    trc("event callback", it->second.callback);
+    for (std::size_t i = 0; i < it->second.args.size(); ++i)
+      trc("event callback argument", it->second.args[i]);
+  }
+}
+
+namespace {
+  // 2^31 - 1 ms, a bit less than 25 days
+  long const MAX_DELAY = 2147483647L;
+}
+
+int callbacks::add_timer(call_context &x, bool repeat) {
+  if (!x.arg[0].is_function())
+    throw exception("Timer callback is not a function", "TypeError");
+
+  // A zero interval would re-arm in the past and never let the loop wait, so
+  // NaN and anything below 1 count as 1. Long delays are capped before the
+  // conversion, which also keeps the deadline from overflowing.
+  double const delay = x.arg.size() > 1 ? x.arg[1].to_number() : 0;
+  long ms;
+  if (!(delay >= 1))
+    ms = 1;
+  else if (delay > MAX_DELAY)
+    ms = MAX_DELAY;
+  else
+    ms = long(delay);
+
+  int const id = next_id++;
+  entry &e = entries[id];
+  e.callback = x.arg[0].get_object();
+  for (std::size_t i = 2; i < x.arg.size(); ++i)
+    e.args.push_back(x.arg[i]);
+  e.interval = repeat ? ms : -1;
+  e.timer.reset(new ba::deadline_timer(get_loop().service));
+  e.timer->expires_from_now(boost::posix_time::milliseconds(ms));
+  wait(id, e);
+  return id;
+}
+
+int callbacks::add_watcher(int fd, std::string const &mode, object const &callback) {
+#ifdef BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR
+  if (mode != "r" && mode != "w")
+    throw exception("event.watch: mode must be 'r' or 'w'", "TypeError");
+  if (!callback.is_function())
+    throw exception("event.watch: callback is not a function", "TypeError");
+
+  // The descriptor closes its fd when it is destroyed, so give it a copy
+  int copy = ::dup(fd);
+  if (copy < 0)
+    throw boost::system::system_error(
+      error_code(errno, boost::system::get_system_category()), "event.watch");
+
+  int const id = next_id++;
+  entry &e = entries[id];
+  e.callback = callback;
+  e.write = mode == "w";
+  e.fd.reset(new ba::posix::stream_descriptor(get_loop().service, copy));
+  wait(id, e);
+  return id;
+#else
+  throw exception("event.watch is not supported on this platform");
+#endif
+}
+
+void callbacks::remove(int id) {
+  // Destroying the timer or descriptor cancels its pending wait
+  entries.erase(id);
+}
+
+void callbacks::clear() {
+  entries.clear();
+}
+
+void callbacks::wait(int id, entry &e) {
+  if (e.timer) {
+    e.timer->async_wait(boost::bind(&callbacks::timer_expired, id, _1));
+    return;
+  }
+#ifdef BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR
+  if (e.write)
+    e.fd->async_write_some(
+      ba::null_buffers(), boost::bind(&callbacks::fd_ready, id, _1));
+  else
+    e.fd->async_read_some(
+      ba::null_buffers(), boost::bind(&callbacks::fd_ready, id, _1));
+#endif
+}
+
+void callbacks::fire(int id, entry_map::iterator it) {
+  root_object callback(it->second.callback);
+  arguments args;
+  for (std::size_t i = 0; i < it->second.args.size(); ++i)
+    args.push_root(it->second.args[i]);
+
+  // Re-arm before calling, so the callback may remove the entry
+  if (it->second.interval >= 0 || !it->second.timer) {
+    entry &e = it->second;
+    if (e.timer)
+      e.timer->expires_at(
+        e.timer->expires_at() + boost::posix_time::milliseconds(e.interval));
+    wait(id, e);
+  } else {
+    entries.erase(it);
+  }
+
+  callback.call(args);
+}
+
+void callbacks::timer_expired(int id, error_code const &ec) {
+  if (ec == ba::error::operation_aborted)
+    return;
+
+  callbacks *self = get_loop().registry;
+  if (!self)
+    return;
+  entry_map::iterator it = self->entries.find(id);
+  if (it == self->entries.end())
+    return;
+
+  self->fire(id, it);
+}
+
+void callbacks::fd_ready(int id, error_code const &ec) {
+  if (ec == ba::error::operation_aborted)
+    return;
+
+  callbacks *self = get_loop().registry;
+  if (!self)
+    return;
+  entry_map::iterator it = self->entries.find(id);
+  if (it == self->entries.end())
+    return;
+
+  if (ec) {
+    self->entries.erase(it);
+    throw boost::system::system_error(ec, "event.watch");
+  }
+
+  self->fire(id, it);
+}
+
+callbacks &get_registry() {
+  callbacks *registry = get_loop().registry;
+  if (!registry)
+    throw exception("The event module is not loaded");
+  return *registry;
+}
+
+void set_timeout(call_context &x) {
+  x.result = value(get_registry().add_timer(x, false));
+}
+
+void set_interval(call_context &x) {
+  x.result = value(get_registry().add_timer(x, true));
+}
+
+void clear_timer(int id) {
+  get_registry().remove(id);
+}
+
+int watch(int fd, std::string const &mode, object callback) {
+  return get_registry().add_watcher(fd, mode, callback);
+}
+
+// reset() may only be called when no run() is active
+struct run_scope {
+  run_scope(loop_state &loop) : loop(loop) {
+    if (loop.depth++ == 0)
+      loop.service.reset();
+  }
+
+  ~run_scope() {
+    --loop.depth;
+  }
+
+  loop_state &loop;
+};
+
+}
+
+ba::io_service &event::io_service() {
+  return get_loop().service;
+}
+
+std::size_t event::run() {
+  loop_state &loop = get_loop();
+  run_scope scope(loop);
+  return loop.service.run();
+}
+
+std::size_t event::run_once() {
+  loop_state &loop = get_loop();
+  run_scope scope(loop);
+  return loop.service.run_one();
+}
+
+void event::shutdown() {
+  // The timers and descriptors of the registry refer to the io_service, so
+  // destroy them first. The registry itself is finalized with the context.
+  loop_state *loop = current_loop.get();
+  if (loop && loop->registry) {
+    loop->registry->clear();
+    loop->registry = 0;
+  }
+  current_loop.reset();
+}
+
+void flusspferd::load_event_module(object container) {
+  object exports = container.get_property_object("exports");
+
+  // The module may be loaded again, e.g. after require.module_cache was
+  // cleared. Keep the callbacks registered so far.
+  loop_state &loop = get_loop();
+  if (!loop.registry)
+    loop.registry = &create<callbacks>(
+      param::_prototype = create<object>().prototype());
+  exports.define_property("$callbacks", *loop.registry, dont_enumerate);
+
+  create<function>("setTimeout", &set_timeout, param::_container = exports);
+  create<function>("setInterval", &set_interval, param::_container = exports);
+  create<function>("clearTimeout", &clear_timer, param::_container = exports);
+  create<function>("clearInterval", &clear_timer, param::_container = exports);
+  create<function>("watch", &watch, param::_container = exports);
+  create<function>("unwatch", &clear_timer, param::_container = exports);
+  create<function>("run", &event::run, param::_container = exports);
+  create<function>("runOnce", &event::run_once, param::_container = exports);
+}
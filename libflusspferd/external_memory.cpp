@@ -0,0 +1,89 @@
+// vim:ts=2:sw=2:expandtab:autoindent:filetype=cpp:
+/*
+The MIT License
+
+Copyright (c) 2008, 2009 Flusspferd contributors (see "CONTRIBUTORS" or
+                                       http://flusspferd.org/contributors.txt)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include "flusspferd/external_memory.hpp"
+#include "flusspferd/context.hpp"
+#include "flusspferd/init.hpp"
+#include <boost/thread/mutex.hpp>
+#include <cstring>
+
+using namespace flusspferd;
+
+namespace {
+  struct category_less {
+    bool operator()(char const *a, char const *b) const {
+      return std::strcmp(a, b) < 0;
+    }
+  };
+
+  typedef std::map<char const *, std::size_t, category_less> category_map;
+
+  boost::mutex totals_mutex;
+  category_map category_totals;
+}
+
+external_memory::external_memory(char const *category, std::size_t bytes)
+  : category(category), bytes(0)
+{
+  resize(bytes);
+}
+
+external_memory::~external_memory() {
+  resize(0);
+}
+
+void external_memory::resize(std::size_t n) {
+  if (n == bytes)
+    return;
+
+  if (n > bytes) {
+    context &cx = current_context();
+    if (cx.is_valid())
+      cx.report_external_alloc(n - bytes, category);
+    else
+      update_total(category, n - bytes, 0);
+  } else {
+    // Freeing never needs the context, so this is safe during finalization
+    update_total(category, 0, bytes - n);
+  }
+
+  bytes = n;
+}
+
+void external_memory::update_total(
+  char const *category, std::size_t added, std::size_t removed)
+{
+  boost::mutex::scoped_lock lock(totals_mutex);
+  std::size_t &total = category_totals[category];
+  total += added;
+  total -= removed < total ? removed : total;
+}
+
+external_memory::totals_map external_memory::totals() {
+  boost::mutex::scoped_lock lock(totals_mutex);
+  return totals_map(category_totals.begin(), category_totals.end());
+}
@@ -27,6 +27,9 @@ THE SOFTWARE.
 #include "flusspferd/version.hpp"
 #include "flusspferd/load_core.hpp"
 #include "flusspferd/io/filesystem-base.hpp"
+#include "flusspferd/external_memory.hpp"
+#include "flusspferd/create/function.hpp"
+#include "flusspferd/create/object.hpp"
 #include <boost/algorithm/string.hpp>
 #include <boost/foreach.hpp>
 #include <boost/optional.hpp>
@@ -39,6 +42,7 @@ namespace fs = boost::filesystem;
 using boost::optional;
 static optional<std::string> get_exe_name();
 static fs::path get_exe_name_from_argv(std::string const &argv0);
+static object external_memory_totals();
 
 void flusspferd::load_flusspferd_module(object container, std::string const &argv0) {
   object exports = container.get_property_object("exports");
@@ -89,6 +93,19 @@ void flusspferd::load_flusspferd_module(object container, std::string const &arg
     value( (prefix / REL_MODULES_PATH).string()),
     read_only_property | permanent_property);
 
+  create<function>(
+    "externalMemory", &external_memory_totals,
+    param::_container = exports);
+}
+
+object external_memory_totals() {
+  object result = create<object>();
+  BOOST_FOREACH(external_memory::totals_map::value_type const &t,
+                external_memory::totals())
+  {
+    result.set_property(t.first, value(double(t.second)));
+  }
+  return result;
 }
 
 bool flusspferd::is_relocatable() {
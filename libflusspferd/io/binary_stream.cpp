@@ -40,7 +40,7 @@ struct binary_device :
     boost::iostreams::bidirectional_seekable>
 {
   explicit binary_device(binary &binary_)
-    : v(binary_.get_data()), pos_read(0), pos_write(0), read_only(true)
+    : b(binary_), pos_read(0), pos_write(0), read_only(true)
   {}
 
   std::streamsize read(char *s, std::streamsize n);
@@ -50,7 +50,9 @@ struct binary_device :
     std::ios::seekdir way,
     std::ios::openmode which);
 
-  std::vector<unsigned char> &v;
+  // Keep a reference to the blob rather than its vector, so that reading
+  // does not force shared storage to be copied.
+  binary &b;
   std::size_t pos_read;
   std::size_t pos_write;
 
@@ -97,14 +99,15 @@ binary &binary_stream::get_binary() {
 }
 
 std::streamsize binary_device::read(char *data, std::streamsize n) {
-  if (pos_read >= v.size())
+  std::size_t size = b.get_length();
+  if (pos_read >= size)
     return -1;
-  std::size_t n_left = v.size() - pos_read;
+  std::size_t n_left = size - pos_read;
   if (n < 0)
     n = 0;
   if (std::size_t(n) > n_left)
     n = n_left;
-  std::memcpy(data, &v[pos_read], n);
+  std::memcpy(data, b.const_begin() + pos_read, n);
   pos_read += n;
   return n;
 }
@@ -115,8 +118,11 @@ std::streamsize binary_device::write(char const *data, std::streamsize n) {
 
   if (n < 0)
     n = 0;
-  if (pos_write + n >= v.size())
+  binary::vector_type &v = b.get_data();
+  if (pos_write + n >= v.size()) {
     v.resize(pos_write + n);
+    b.update_memory();
+  }
   std::memcpy(&v[pos_write], data, n);
   pos_write += n;
   return n;
@@ -140,7 +146,7 @@ std::streampos binary_device::seek(
     *p_pos += off;
     break;
   case std::ios_base::end:
-    *p_pos = v.size() + off;
+    *p_pos = b.get_length() + off;
     break;
   default:
     assert(false && "strange stdlib behaviour. (_S_ios_seekdir_end)");
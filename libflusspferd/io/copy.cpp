@@ -0,0 +1,217 @@
+// vim:ts=2:sw=2:expandtab:autoindent:filetype=cpp:
+/*
+The MIT License
+
+Copyright (c) 2008, 2009 Flusspferd contributors (see "CONTRIBUTORS" or
+                                       http://flusspferd.org/contributors.txt)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "flusspferd/io/copy.hpp"
+#include "flusspferd/io/fd_streambuf.hpp"
+#include "flusspferd/exception.hpp"
+#include <algorithm>
+#include <cstring>
+#include <errno.h>
+
+#ifdef WIN32
+#include <io.h>
+
+#define read _read
+#define write _write
+#else
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+
+using namespace flusspferd;
+using namespace flusspferd::io;
+
+std::size_t const copier::default_buffer_size;
+
+namespace {
+  void copy_error(char const *what) {
+    throw exception(std::string(what) + ": " + std::strerror(errno));
+  }
+
+#ifdef __linux__
+  // Largest amount handed to the kernel in one call
+  std::size_t const chunk_size = std::size_t(1) << 30;
+
+  // Call transfer until it reports the end of the input. Returns false if
+  // the kernel cannot do the transfer for these file descriptors, so that
+  // the caller falls back to a slower way; what was copied so far stays
+  // copied, as the file offsets have been advanced.
+  template<typename Transfer>
+  bool transfer_all(Transfer transfer, boost::uint64_t &total) {
+    for (;;) {
+      ssize_t n = transfer();
+      if (n > 0) {
+        total += n;
+        continue;
+      }
+      if (n == 0)
+        return true;
+
+      switch (errno) {
+      case EINTR:
+        continue;
+      case EINVAL:
+      case ENOSYS:
+      case EXDEV:
+      case EBADF:
+      case EOPNOTSUPP:
+        return false;
+      default:
+        copy_error("Could not copy");
+      }
+    }
+  }
+
+  struct splice_transfer {
+    int in, out;
+    ssize_t operator()() const {
+      return splice(in, 0, out, 0, chunk_size, SPLICE_F_MOVE | SPLICE_F_MORE);
+    }
+  };
+
+#ifdef SYS_copy_file_range
+  struct copy_file_range_transfer {
+    int in, out;
+    ssize_t operator()() const {
+      // Through syscall(), as older C libraries have no wrapper
+      return syscall(SYS_copy_file_range, in, 0, out, 0, chunk_size, 0);
+    }
+  };
+#endif
+
+  struct sendfile_transfer {
+    int in, out;
+    ssize_t operator()() const {
+      return sendfile(out, in, 0, chunk_size);
+    }
+  };
+#endif
+}
+
+copier::copier(std::size_t buffer_size)
+  : buffer(std::max(buffer_size, std::size_t(1)))
+{}
+
+boost::uint64_t copier::copy(int in, int out) {
+  boost::uint64_t total = 0;
+
+#ifdef __linux__
+  struct stat in_st, out_st;
+  if (fstat(in, &in_st) != 0 || fstat(out, &out_st) != 0)
+    copy_error("Could not copy");
+
+  if (S_ISFIFO(in_st.st_mode) || S_ISFIFO(out_st.st_mode)) {
+    splice_transfer transfer = { in, out };
+    if (transfer_all(transfer, total))
+      return total;
+  }
+
+#ifdef SYS_copy_file_range
+  if (S_ISREG(in_st.st_mode) && S_ISREG(out_st.st_mode)) {
+    copy_file_range_transfer transfer = { in, out };
+    if (transfer_all(transfer, total))
+      return total;
+  }
+#endif
+
+  if (S_ISREG(in_st.st_mode)) {
+    sendfile_transfer transfer = { in, out };
+    if (transfer_all(transfer, total))
+      return total;
+  }
+#endif
+
+  for (;;) {
+    ssize_t n = read(in, &buffer[0], buffer.size());
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      copy_error("Could not read");
+    }
+    if (n == 0)
+      break;
+
+    char const *data = &buffer[0];
+    while (n > 0) {
+      ssize_t written = write(out, data, n);
+      if (written < 0) {
+        if (errno == EINTR)
+          continue;
+        copy_error("Could not write");
+      }
+      data += written;
+      n -= written;
+      total += written;
+    }
+  }
+
+  return total;
+}
+
+boost::uint64_t copier::copy(std::streambuf &in, std::streambuf &out) {
+  boost::uint64_t total = 0;
+
+  fd_streambuf *in_fd = dynamic_cast<fd_streambuf*>(&in);
+  fd_streambuf *out_fd = dynamic_cast<fd_streambuf*>(&out);
+
+  if (in_fd && out_fd) {
+    // Hand over what has been read ahead already
+    std::streamsize avail;
+    while ((avail = in.in_avail()) > 0) {
+      std::streamsize n = in.sgetn(
+        &buffer[0], std::min(avail, std::streamsize(buffer.size())));
+      if (n <= 0)
+        break;
+      if (out.sputn(&buffer[0], n) != n)
+        throw exception("Could not write to stream");
+      total += n;
+    }
+
+    if (out_fd->release() && in_fd->release())
+      return total + copy(in_fd->fd(), out_fd->fd());
+  }
+
+  for (;;) {
+    std::streamsize n = in.sgetn(&buffer[0], buffer.size());
+    if (n <= 0)
+      break;
+    if (out.sputn(&buffer[0], n) != n)
+      throw exception("Could not write to stream");
+    total += n;
+  }
+
+  if (out.pubsync() == -1)
+    throw exception("Could not flush stream");
+
+  return total;
+}
@@ -0,0 +1,453 @@
+// vim:ts=2:sw=2:expandtab:autoindent:filetype=cpp:
+/*
+The MIT License
+
+Copyright (c) 2008, 2009 Flusspferd contributors (see "CONTRIBUTORS" or
+                                       http://flusspferd.org/contributors.txt)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "flusspferd/io/fd_streambuf.hpp"
+#include "flusspferd/exception.hpp"
+#include <algorithm>
+#include <new>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+
+#ifdef WIN32
+#include <io.h>
+
+#define read _read
+#define write _write
+#define close _close
+#define isatty _isatty
+#define lseek _lseeki64
+#else
+#include <unistd.h>
+#endif
+
+using namespace flusspferd;
+using namespace flusspferd::io;
+
+std::size_t const fd_streambuf::default_size;
+
+namespace {
+#ifdef O_DIRECT
+  // Clears O_DIRECT while in scope, for transfers the kernel rejects as
+  // unaligned.
+  class without_direct {
+  public:
+    explicit without_direct(int fd) : fd(fd), flags(fcntl(fd, F_GETFL)) {
+      if (flags != -1)
+        fcntl(fd, F_SETFL, flags & ~O_DIRECT);
+    }
+
+    ~without_direct() {
+      if (flags != -1)
+        fcntl(fd, F_SETFL, flags);
+    }
+
+  private:
+    int fd;
+    int flags;
+  };
+#endif
+
+  std::size_t round_up(std::size_t n, std::size_t alignment) {
+    if (!alignment)
+      return n;
+    return (n + alignment - 1) / alignment * alignment;
+  }
+}
+
+fd_streambuf::buffer::~buffer() {
+  std::free(data);
+}
+
+void fd_streambuf::buffer::reset(std::size_t n, std::size_t alignment) {
+  std::free(data);
+  data = 0;
+  size = 0;
+
+  if (n == 0)
+    return;
+
+#ifndef WIN32
+  if (alignment) {
+    void *p;
+    if (posix_memalign(&p, alignment, n) != 0)
+      throw std::bad_alloc();
+    data = static_cast<char*>(p);
+  } else
+#endif
+  {
+    data = static_cast<char*>(std::malloc(n));
+    if (!data)
+      throw std::bad_alloc();
+  }
+
+  size = n;
+}
+
+fd_streambuf::fd_streambuf(
+    int fd, bool own, buffer_mode mode, std::size_t size)
+  : fd_(fd), own(own), tty(isatty(fd)), mode_(buffer_none), size_(0),
+    alignment(0), tied(0)
+{
+  set_buffering(mode, size);
+}
+
+fd_streambuf::~fd_streambuf() {
+  write_out();
+  if (own)
+    close(fd_);
+}
+
+void fd_streambuf::set_buffering(buffer_mode mode, std::size_t size) {
+  if (size == 0)
+    throw exception("Buffer size must be positive", "RangeError");
+
+  write_out();
+
+  if (mode == buffer_auto)
+    mode = tty ? buffer_line : buffer_full;
+
+  mode_ = mode;
+  size_ = round_up(size, alignment);
+
+  allocate();
+}
+
+void fd_streambuf::set_alignment(std::size_t alignment_) {
+  write_out();
+  drop_input();
+
+  alignment = alignment_;
+  size_ = round_up(size_, alignment);
+
+  in.reset(0, 0);
+  allocate();
+}
+
+void fd_streambuf::allocate() {
+  if (mode_ == buffer_none) {
+    out.reset(0, 0);
+    setp(0, 0);
+  } else {
+    if (out.size != size_)
+      out.reset(size_, alignment);
+    setp(out.data, out.data + out.size);
+  }
+
+  // Input that is already buffered stays available; the new size is used
+  // for the next read.
+}
+
+bool fd_streambuf::direct_rejected(int error) {
+#ifdef O_DIRECT
+  return error == EINVAL && alignment;
+#else
+  (void)error;
+  return false;
+#endif
+}
+
+bool fd_streambuf::write_fd(char const *data, std::size_t n) {
+  while (n > 0) {
+    ssize_t written = write(fd_, data, n);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+#ifdef O_DIRECT
+      if (direct_rejected(errno)) {
+        without_direct scope(fd_);
+        std::size_t saved = alignment;
+        alignment = 0;
+        bool ok = write_fd(data, n);
+        alignment = saved;
+        return ok;
+      }
+#endif
+      return false;
+    }
+    data += written;
+    n -= written;
+  }
+  return true;
+}
+
+std::streamsize fd_streambuf::read_fd(char *data, std::size_t n) {
+  for (;;) {
+    ssize_t length = read(fd_, data, n);
+    if (length >= 0)
+      return length;
+    if (errno == EINTR)
+      continue;
+#ifdef O_DIRECT
+    if (direct_rejected(errno)) {
+      without_direct scope(fd_);
+      std::size_t saved = alignment;
+      alignment = 0;
+      std::streamsize result = read_fd(data, n);
+      alignment = saved;
+      return result;
+    }
+#endif
+    return -1;
+  }
+}
+
+bool fd_streambuf::write_out() {
+  if (pbase() == pptr())
+    return true;
+  bool ok = write_fd(pbase(), pptr() - pbase());
+  setp(pbase(), epptr());
+  return ok;
+}
+
+void fd_streambuf::drop_input() {
+  if (gptr() == egptr())
+    return;
+
+  // The file position is ahead of what has been read. If it cannot be moved
+  // back (pipes, terminals), reading and writing are independent anyway.
+  if (lseek(fd_, -off_type(egptr() - gptr()), SEEK_CUR) >= 0)
+    setg(0, 0, 0);
+}
+
+bool fd_streambuf::release() {
+  if (!write_out())
+    return false;
+  drop_input();
+  return gptr() == egptr();
+}
+
+fd_streambuf::int_type fd_streambuf::overflow(int_type ch) {
+  drop_input();
+
+  if (!write_out())
+    return traits_type::eof();
+
+  if (traits_type::eq_int_type(ch, traits_type::eof()))
+    return traits_type::not_eof(ch);
+
+  char c = traits_type::to_char_type(ch);
+
+  if (mode_ == buffer_none)
+    return write_fd(&c, 1) ? ch : traits_type::eof();
+
+  *pptr() = c;
+  pbump(1);
+
+  if (mode_ == buffer_line && c == '\n' && !write_out())
+    return traits_type::eof();
+
+  return ch;
+}
+
+std::streamsize fd_streambuf::xsputn(char const *s, std::streamsize n) {
+  drop_input();
+
+  // Large writes go straight to the file descriptor, unless the buffer is
+  // needed for alignment
+  if (mode_ == buffer_none || (std::size_t(n) >= size_ && !alignment)) {
+    if (!write_out() || !write_fd(s, n))
+      return 0;
+    return n;
+  }
+
+  char const *p = s;
+  std::size_t left = n;
+  for (;;) {
+    std::size_t part = std::min(left, std::size_t(epptr() - pptr()));
+    std::memcpy(pptr(), p, part);
+    pbump(int(part));
+    p += part;
+    left -= part;
+    if (left == 0)
+      break;
+    if (!write_out())
+      return 0;
+  }
+
+  if (mode_ == buffer_line && std::memchr(s, '\n', n) && !write_out())
+    return 0;
+
+  return n;
+}
+
+int fd_streambuf::sync() {
+  return write_out() ? 0 : -1;
+}
+
+fd_streambuf::int_type fd_streambuf::underflow() {
+  if (gptr() < egptr())
+    return traits_type::to_int_type(*gptr());
+
+  if (tied)
+    tied->pubsync();
+
+  // Output pending on the same descriptor (a file, or a terminal or socket
+  // opened for both) is written before reading.
+  write_out();
+
+  if (in.size != size_)
+    in.reset(size_, alignment);
+
+  std::streamsize n = read_fd(in.data, in.size);
+
+  if (n <= 0) {
+    setg(0, 0, 0);
+    return traits_type::eof();
+  }
+
+  setg(in.data, in.data, in.data + n);
+  return traits_type::to_int_type(*gptr());
+}
+
+fd_streambuf::pos_type fd_streambuf::seekoff(
+  off_type off, std::ios::seekdir dir, std::ios::openmode)
+{
+  if (dir == std::ios::cur && off == 0) {
+    // tell(), which keeps the buffers
+    off_type pos = lseek(fd_, 0, SEEK_CUR);
+    if (pos < 0)
+      return pos_type(off_type(-1));
+    return pos_type(pos - (egptr() - gptr()) + (pptr() - pbase()));
+  }
+
+  if (!write_out())
+    return pos_type(off_type(-1));
+
+  if (dir == std::ios::cur)
+    off -= egptr() - gptr();
+  setg(0, 0, 0);
+
+  int whence = dir == std::ios::beg ? SEEK_SET
+             : dir == std::ios::cur ? SEEK_CUR
+             : SEEK_END;
+
+  off_type pos = lseek(fd_, off, whence);
+  if (pos < 0)
+    return pos_type(off_type(-1));
+  return pos_type(pos);
+}
+
+fd_streambuf::pos_type fd_streambuf::seekpos(
+  pos_type pos, std::ios::openmode which)
+{
+  return seekoff(off_type(pos), std::ios::beg, which);
+}
+
+#ifndef WIN32
+
+std::streamsize fd_streambuf::read_at(
+  std::streamoff offset, char *data, std::size_t n)
+{
+  if (!write_out())
+    return -1;
+
+  // O_DIRECT needs an aligned destination
+  buffer bounce;
+  char *target = data;
+  if (alignment) {
+    bounce.reset(round_up(n, alignment), alignment);
+    target = bounce.data;
+  }
+
+  ssize_t length;
+  do
+    length = pread(fd_, target, alignment ? bounce.size : n, offset);
+  while (length < 0 && errno == EINTR);
+
+#ifdef O_DIRECT
+  if (length < 0 && direct_rejected(errno)) {
+    without_direct scope(fd_);
+    do
+      length = pread(fd_, data, n, offset);
+    while (length < 0 && errno == EINTR);
+    return length;
+  }
+#endif
+
+  if (length > 0 && target != data) {
+    length = std::min(std::size_t(length), n);
+    std::memcpy(data, target, length);
+  }
+
+  return length;
+}
+
+bool fd_streambuf::write_at(
+  std::streamoff offset, char const *data, std::size_t n)
+{
+  if (!write_out())
+    return false;
+
+  // The data might be buffered already
+  drop_input();
+
+  buffer bounce;
+  if (alignment) {
+    bounce.reset(n, alignment);
+    std::memcpy(bounce.data, data, n);
+    data = bounce.data;
+  }
+
+  while (n > 0) {
+    ssize_t written = pwrite(fd_, data, n, offset);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+#ifdef O_DIRECT
+      if (direct_rejected(errno)) {
+        without_direct scope(fd_);
+        std::size_t saved = alignment;
+        alignment = 0;
+        bool ok = write_at(offset, data, n);
+        alignment = saved;
+        return ok;
+      }
+#endif
+      return false;
+    }
+    data += written;
+    offset += written;
+    n -= written;
+  }
+
+  return true;
+}
+
+#else
+
+std::streamsize fd_streambuf::read_at(std::streamoff, char *, std::size_t) {
+  errno = ENOSYS;
+  return -1;
+}
+
+bool fd_streambuf::write_at(std::streamoff, char const *, std::size_t) {
+  errno = ENOSYS;
+  return false;
+}
+
+#endif
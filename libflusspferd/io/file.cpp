@@ -25,16 +25,20 @@ THE SOFTWARE.
 */
 
 #include "flusspferd/io/file.hpp"
+#include "flusspferd/io/fd_streambuf.hpp"
 #include "flusspferd/security.hpp"
 #include "flusspferd/local_root_scope.hpp"
 #include "flusspferd/create.hpp"
 #include "flusspferd/string.hpp"
 #include "flusspferd/string_io.hpp"
 #include "flusspferd/create.hpp"
+#include "flusspferd/binary.hpp"
+#include "flusspferd/root.hpp"
 #include <boost/scoped_array.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
-#include <fstream>
+#include <boost/fusion/include/make_vector.hpp>
+#include <algorithm>
 #include <iostream>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -92,13 +96,17 @@ using namespace boost;
 
 class file::impl {
 public:
-  std::fstream stream;
+  // A closed file reads and writes an invalid descriptor, so every access
+  // fails without special cases.
+  impl() : buf(new fd_streambuf(-1)) {}
+
+  boost::scoped_ptr<fd_streambuf> buf;
 };
 
 file::file(object const &obj, call_context &x)
   : base_type(obj, (std::streambuf*)0), p(new impl)
 {
-  set_streambuf(p->stream.rdbuf());
+  set_streambuf(p->buf.get());
   if (!x.arg.empty()) {
     call("open", x.arg);
   }
@@ -108,7 +116,7 @@ file::file(object const &obj, call_context &x)
 file::file(object const &obj, char const* name, value mode)
   : base_type(obj, (std::streambuf*)0), p(new impl)
 {
-  set_streambuf(p->stream.rdbuf());
+  set_streambuf(p->buf.get());
   open(name, mode);
 }
 
@@ -126,7 +134,7 @@ void file::open(char const *name, value options) {
 
   std::ios::openmode open_mode = std::ios::openmode();
 
-  bool exclusive = false, create = false;
+  bool exclusive = false, create = false, direct = false;
 
   if (options.is_string()) {
     // String modes always set create
@@ -177,6 +185,7 @@ void file::open(char const *name, value options) {
         throw exception("File.open: exclusive mode can only be used with create");
       exclusive = create = true;
     }
+    direct = obj.get_property("direct").to_boolean();
 
   }else if (options.is_undefined_or_null()) {
     open_mode = std::ios::in;
@@ -196,33 +205,213 @@ void file::open(char const *name, value options) {
     );
   }
 
-  if (create) {
-    // C++ streams don't support O_EXCL|O_CREAT modes. Fall back to open
-    unsigned o_mode = exclusive
-                    ? O_CREAT|O_EXCL
-                    : O_CREAT;
-    int fd = ::open(name, o_mode, 0666);
-    if (fd == -1)
-      throw exception(compose_error_message("File.open: couldn't create file", name));
+  bool in = open_mode & std::ios::in;
+  bool out = open_mode & std::ios::out;
+  bool append = open_mode & std::ios::app;
+
+  int flags = in && out ? O_RDWR : out ? O_WRONLY : O_RDONLY;
+
+  // Like std::fstream (and fopen): writing without reading truncates, and
+  // writing, appending or truncating creates the file.
+  if ((open_mode & std::ios::trunc) || (out && !in && !append))
+    flags |= O_TRUNC;
+  if (append)
+    flags |= O_APPEND;
+  if (create || append || (flags & O_TRUNC))
+    flags |= O_CREAT;
+  if (exclusive)
+    flags |= O_EXCL;
+
+  if (direct) {
+#ifdef O_DIRECT
+    flags |= O_DIRECT;
+#else
+    throw exception("File.open: direct mode is not supported on this platform");
+#endif
+  }
 
-    // Done  - got the file (exclusively) created.
-    ::close(fd);
+  int fd = ::open(name, flags, 0666);
+  if (fd == -1) {
+    if (create)
+      throw exception(compose_error_message("File.open: couldn't create file", name));
+    throw exception(compose_error_message("Could not open file", name));
   }
 
-  p->stream.open(name, open_mode);
+  boost::scoped_ptr<fd_streambuf> buf(new fd_streambuf(fd, true));
 
-  if (!p->stream)
-    throw exception(compose_error_message("Could not open file", name));
+  if (direct) {
+    // Align the buffers to the file system block size
+    struct stat st;
+    std::size_t alignment = 4096;
+    if (::fstat(fd, &st) == 0 && st.st_blksize > 0)
+      alignment = std::max(alignment, std::size_t(st.st_blksize));
+    buf->set_alignment(alignment);
+  }
+
+  p->buf.swap(buf);
+  set_streambuf(p->buf.get());
 
   define_property("fileName", string(name),
                   permanent_property | read_only_property );
 }
 
 void file::close() {
-  p->stream.close();
+  p->buf.reset(new fd_streambuf(-1));
+  set_streambuf(p->buf.get());
   delete_property("fileName");
 }
 
+double file::seek(double offset, boost::optional<std::string> const &whence_) {
+  std::string whence = whence_.get_value_or("set");
+
+  std::ios::seekdir dir;
+  if (whence == "set")
+    dir = std::ios::beg;
+  else if (whence == "cur")
+    dir = std::ios::cur;
+  else if (whence == "end")
+    dir = std::ios::end;
+  else
+    throw exception("File.seek: whence must be 'set', 'cur' or 'end'");
+
+  std::streampos pos = p->buf->pubseekoff(std::streamoff(offset), dir);
+  if (pos == std::streampos(std::streamoff(-1)))
+    throw exception(compose_error_message("File.seek: could not seek"));
+
+  return double(std::streamoff(pos));
+}
+
+double file::tell() {
+  std::streampos pos = p->buf->pubseekoff(0, std::ios::cur);
+  if (pos == std::streampos(std::streamoff(-1)))
+    throw exception(compose_error_message("File.tell: could not get position"));
+
+  return double(std::streamoff(pos));
+}
+
+object file::read_at(
+  double offset, unsigned size, boost::optional<byte_array&> output_)
+{
+  binary &output =
+    output_
+    ? static_cast<binary&>(output_.get())
+    : static_cast<binary&>(
+        flusspferd::create<byte_string>(
+          boost::fusion::vector2<binary::element_type*, std::size_t>(0, 0)));
+  root_object root_obj(output);
+
+  binary::vector_type &data = output.get_data();
+  std::size_t old_size = data.size();
+
+  data.resize(old_size + size);
+  output.update_memory();
+
+  std::streamsize length = p->buf->read_at(
+    std::streamoff(offset),
+    reinterpret_cast<char *>(size ? &data[old_size] : 0),
+    size);
+
+  if (length < 0) {
+    data.resize(old_size);
+    throw exception(compose_error_message("File.readAt: could not read"));
+  }
+
+  data.resize(old_size + length);
+
+  return output;
+}
+
+void file::write_at(double offset, value data) {
+  binary::vector_type encoded;
+  char const *bytes;
+  std::size_t n;
+
+  if (data.is_string()) {
+    encode_text(data.get_string(), encoded);
+    bytes = reinterpret_cast<char const *>(encoded.empty() ? 0 : &encoded[0]);
+    n = encoded.size();
+  } else if (data.is_object()) {
+    binary &b = flusspferd::get_native<binary>(data.get_object());
+    bytes = reinterpret_cast<char const *>(b.const_begin());
+    n = b.get_length();
+  } else {
+    throw exception("File.writeAt: data must be a string or Binary", "TypeError");
+  }
+
+  if (!p->buf->write_at(std::streamoff(offset), bytes, n))
+    throw exception(compose_error_message("File.writeAt: could not write"));
+}
+
+void file::advise(
+  std::string const &advice, boost::optional<double> offset,
+  boost::optional<double> length)
+{
+#ifdef POSIX_FADV_NORMAL
+  int flag;
+  if (advice == "normal")
+    flag = POSIX_FADV_NORMAL;
+  else if (advice == "sequential")
+    flag = POSIX_FADV_SEQUENTIAL;
+  else if (advice == "random")
+    flag = POSIX_FADV_RANDOM;
+  else if (advice == "willneed")
+    flag = POSIX_FADV_WILLNEED;
+  else if (advice == "dontneed")
+    flag = POSIX_FADV_DONTNEED;
+  else if (advice == "noreuse")
+    flag = POSIX_FADV_NOREUSE;
+  else
+    throw exception("File.advise: unknown advice '" + advice + "'");
+
+  // Written data can only be dropped from the cache once it reached it
+  if (flag == POSIX_FADV_DONTNEED)
+    p->buf->pubsync();
+
+  int error = posix_fadvise(
+    p->buf->fd(), off_t(offset.get_value_or(0)),
+    off_t(length.get_value_or(0)), flag);
+  if (error) {
+    errno = error;
+    throw exception(compose_error_message("File.advise: failed"));
+  }
+#else
+  // Only a hint, so there is nothing to do where it is not supported
+  (void)advice; (void)offset; (void)length;
+#endif
+}
+
+void file::preallocate(
+  double length, boost::optional<double> offset,
+  boost::optional<bool> keep_size)
+{
+#if !defined(WIN32) && !defined(__APPLE__)
+  int fd = p->buf->fd();
+  int error;
+
+  if (keep_size.get_value_or(false)) {
+#ifdef FALLOC_FL_KEEP_SIZE
+    error = ::fallocate(
+      fd, FALLOC_FL_KEEP_SIZE, off_t(offset.get_value_or(0)), off_t(length))
+      ? errno : 0;
+#else
+    throw exception(
+      "File.preallocate: keeping the size is not supported on this platform");
+#endif
+  } else {
+    error = posix_fallocate(
+      fd, off_t(offset.get_value_or(0)), off_t(length));
+  }
+
+  if (error) {
+    errno = error;
+    throw exception(compose_error_message("File.preallocate: failed"));
+  }
+#else
+  (void)length; (void)offset; (void)keep_size;
+  throw exception("File.preallocate: not supported on this platform");
+#endif
+}
+
 void file::create(char const *name, boost::optional<int> mode) {
   security &sec = security::get();
 
@@ -26,12 +26,24 @@ THE SOFTWARE.
 
 #include "flusspferd/io/filesystem-base.hpp"
 #include "flusspferd/io/file.hpp"
+#include "flusspferd/io/copy.hpp"
+#include "flusspferd/io/walk.hpp"
 #include "flusspferd.hpp"
 #include <boost/foreach.hpp>
 #include <boost/format.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/fusion/include/make_vector.hpp>
+#include <algorithm>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
 
 #ifdef WIN32
 #include <stdio.h>
@@ -65,6 +77,7 @@ void flusspferd::load_filesystem_base_module(object container) {
   // rawOpen is the old incorrectly named one
   create<function>("rawOpen", &fs_base::raw_open, param::_container = exports);
   create<function>("openRaw", &fs_base::raw_open, param::_container = exports);
+  create<function>("mapFile", &fs_base::map_file, param::_container = exports);
 
   create<function>("canonical", &fs_base::canonical, param::_container = exports);
   create<function>("lastModified", &fs_base::last_modified, param::_container = exports);
@@ -96,6 +109,8 @@ void flusspferd::load_filesystem_base_module(object container) {
 
 
   create<function>("move", &fs_base::move, param::_container = exports);
+  create<function>("copy", &fs_base::copy, param::_container = exports);
+  create<function>("copyTree", &fs_base::copy_tree, param::_container = exports);
   create<function>("remove", &fs_base::remove, param::_container = exports);
 
 
@@ -107,6 +122,12 @@ void flusspferd::load_filesystem_base_module(object container) {
 
   create<function>("list", &fs_base::list, param::_container = exports);
 
+#ifdef FLUSSPFERD_HAVE_POSIX
+  load_class<io::walker>(exports);
+  create<function>("walk", &fs_base::walk, param::_container = exports);
+  create<function>("glob", &fs_base::glob, param::_container = exports);
+#endif
+
 #ifdef FLUSSPFERD_HAVE_POSIX
   create<function>("owner", &fs_base::owner, param::_container = exports);
 #endif
@@ -120,6 +141,18 @@ object fs_base::raw_open(char const* name, value mode, value perms) {
   return create<io::file>(fusion::make_vector(name, mode));
 }
 
+object fs_base::map_file(std::string const &path) {
+  if (!security::get().check_path(path, security::READ)) {
+    throw exception(format(error_sec) % "mapFile" % path);
+  }
+
+  binary::storage_ptr storage = binary::map_file(path);
+
+  return create<byte_string>(
+    fusion::vector3<binary::storage_ptr const &, std::size_t, std::size_t>(
+      storage, 0, storage->size()));
+}
+
 string fs_base::canonical(std::string const &path) {
   if (!security::get().check_path(path, security::ACCESS)) {
     throw exception(format(error_sec) % "canonical" % path);
@@ -411,6 +444,150 @@ void fs_base::move(std::string const &source, std::string const &target) {
   fs::rename(source, target);
 }
 
+namespace {
+  struct scoped_fd {
+    int fd;
+    explicit scoped_fd(int fd) : fd(fd) {}
+    ~scoped_fd() { if (fd >= 0) ::close(fd); }
+  };
+
+  // Copy the contents and permissions of one file. The copier is passed in
+  // so that copying a whole tree reuses its buffer.
+  void copy_file(char const *fn_name, std::string const &source,
+                 std::string const &target, io::copier &c)
+  {
+    security &sec = security::get();
+    if (!sec.check_path(source, security::READ)) {
+      throw exception(format(error_sec) % fn_name % source);
+    }
+    if (!sec.check_path(target, security::WRITE|security::CREATE)) {
+      throw exception(format(error_sec) % fn_name % target);
+    }
+
+    scoped_fd in(::open(source.c_str(), O_RDONLY | O_BINARY));
+    struct stat st;
+    if (in.fd < 0 || fstat(in.fd, &st) != 0) {
+      throw exception(format(error_fmt)
+                       % fn_name
+                       % std::strerror(errno)
+                       % source);
+    }
+    if (S_ISDIR(st.st_mode))
+      throw exception(std::string(fn_name) + ": " + source + " is a directory");
+
+    // Opening the target truncates it, so refuse to copy a file onto itself
+    // before that
+#ifndef WIN32
+    struct stat target_st;
+    if (::stat(target.c_str(), &target_st) == 0 &&
+        target_st.st_dev == st.st_dev && target_st.st_ino == st.st_ino)
+#else
+    if (fs::exists(target) && fs::equivalent(source, target))
+#endif
+    {
+      throw exception(std::string(fn_name) + ": " + source + " and " +
+                      target + " are the same file");
+    }
+
+    scoped_fd out(::open(target.c_str(),
+                         O_WRONLY | O_CREAT | O_TRUNC | O_BINARY,
+                         st.st_mode & 0777));
+    if (out.fd < 0) {
+      throw exception(format(error_fmt)
+                       % fn_name
+                       % std::strerror(errno)
+                       % target);
+    }
+
+    c.copy(in.fd, out.fd);
+
+    int result = ::close(out.fd);
+    out.fd = -1;
+    if (result != 0) {
+      throw exception(format(error_fmt)
+                       % fn_name
+                       % std::strerror(errno)
+                       % target);
+    }
+  }
+
+  // Whether @p inner is @p outer or below it. Both must be canonical.
+  bool path_within(fs::path const &outer, fs::path const &inner) {
+    fs::path::iterator o = outer.begin(), i = inner.begin();
+    for (;;) {
+      while (o != outer.end() && (o->empty() || *o == "."))
+        ++o;
+      while (i != inner.end() && (i->empty() || *i == "."))
+        ++i;
+      if (o == outer.end())
+        return true;
+      if (i == inner.end() || *o != *i)
+        return false;
+      ++o;
+      ++i;
+    }
+  }
+
+  void copy_tree_entry(fs::path const &source, fs::path const &target,
+                       io::copier &c)
+  {
+#ifndef WIN32
+    if (fs::is_symlink(source)) {
+      fs_base::link(fs_base::read_link(source.string()).to_string(),
+                    target.string());
+      return;
+    }
+#endif
+
+    if (!fs::is_directory(source)) {
+      copy_file("copyTree", source.string(), target.string(), c);
+      return;
+    }
+
+    if (!security::get().check_path(target.string(), security::CREATE)) {
+      throw exception(format(error_sec) % "copyTree" % target.string());
+    }
+    fs::create_directory(target);
+
+    fs::directory_iterator end;
+    for (fs::directory_iterator it(source); it != end; ++it)
+      copy_tree_entry(it->path(), target / it->path().filename(), c);
+
+#ifndef WIN32
+    struct stat st;
+    if (::stat(source.string().c_str(), &st) == 0)
+      ::chmod(target.string().c_str(), st.st_mode & 07777);
+#endif
+  }
+}
+
+void fs_base::copy(std::string const &source, std::string const &target) {
+  io::copier c;
+  copy_file("copy", source, target, c);
+}
+
+void fs_base::copy_tree(std::string const &source, std::string const &target) {
+  if (!security::get().check_path(source, security::ACCESS)) {
+    throw exception(format(error_sec) % "copyTree" % source);
+  }
+  if (fs::exists(target))
+    throw exception("copyTree: " + target + " already exists");
+
+  // The copy would otherwise recurse into itself
+  fs::path target_path(target);
+  fs::path target_parent = target_path.parent_path();
+  if (target_parent.empty())
+    target_parent = ".";
+  if (path_within(canonicalize(source),
+                  canonicalize(target_parent) / target_path.filename()))
+  {
+    throw exception("copyTree: " + target + " is inside " + source);
+  }
+
+  io::copier c;
+  copy_tree_entry(source, target, c);
+}
+
 void fs_base::remove(std::string const &path) {
   if (!security::get().check_path(path, security::WRITE)) {
     throw exception(format(error_sec) % "remove" % path);
@@ -455,6 +632,110 @@ array fs_base::list(std::string const &dir) {
   return ret;
 }
 
+object fs_base::walk(std::string const &root, value options) {
+  if (!security::get().check_path(root, security::ACCESS)) {
+    throw exception(format(error_sec) % "walk" % root);
+  }
+
+  io::walker::options opts;
+
+  if (options.is_object()) {
+    object obj = options.get_object();
+
+    opts.follow_links = obj.get_property("followLinks").to_boolean();
+
+    value stat = obj.get_property("stat");
+    if (!stat.is_undefined())
+      opts.stat = stat.to_boolean();
+
+    value depth = obj.get_property("maxDepth");
+    if (!depth.is_undefined_or_null()) {
+      double n = depth.to_number();
+      if (!(n >= 1))
+        throw exception("walk: maxDepth must be positive", "RangeError");
+      if (n < opts.max_depth)
+        opts.max_depth = unsigned(n);
+    }
+
+    value threads = obj.get_property("statThreads");
+    if (!threads.is_undefined_or_null()) {
+      double n = threads.to_number();
+      if (!(n >= 0))
+        throw exception("walk: statThreads must not be negative", "RangeError");
+      opts.stat_threads = unsigned(std::min(n, 64.0));
+    }
+
+    value batch = obj.get_property("batchSize");
+    if (!batch.is_undefined_or_null()) {
+      double n = batch.to_number();
+      if (!(n >= 1))
+        throw exception("walk: batchSize must be positive", "RangeError");
+      opts.batch_size = std::size_t(n);
+    }
+
+    value glob = obj.get_property("glob");
+    if (!glob.is_undefined_or_null())
+      opts.glob = glob.to_std_string();
+
+    opts.filter = obj.get_property("filter");
+    if (!opts.filter.is_undefined_or_null() && !opts.filter.is_function())
+      throw exception("walk: filter must be a function", "TypeError");
+  } else if (!options.is_undefined_or_null()) {
+    throw exception("walk: Invalid options argument", "TypeError");
+  }
+
+  return create<io::walker>(
+    fusion::vector2<std::string, io::walker::options>(root, opts));
+}
+
+array fs_base::glob(std::string const &pattern) {
+  root_array ret(create<array>());
+
+  // Start the walk at the directory named by the leading components without
+  // wildcards; the rest is matched while walking
+  std::string::size_type wild = pattern.find_first_of("*?[\\");
+  std::string::size_type slash =
+    wild == std::string::npos ? wild : pattern.rfind('/', wild);
+
+  std::string root, rest;
+  if (wild == std::string::npos) {
+    if (!security::get().check_path(pattern, security::ACCESS)) {
+      throw exception(format(error_sec) % "glob" % pattern);
+    }
+    if (fs::exists(pattern))
+      ret.push(pattern);
+    return ret;
+  } else if (slash == std::string::npos) {
+    rest = pattern;
+  } else {
+    root = pattern.substr(0, slash == 0 ? 1 : slash);
+    rest = pattern.substr(slash + 1);
+  }
+
+  if (!security::get().check_path(root.empty() ? "." : root,
+                                  security::ACCESS)) {
+    throw exception(format(error_sec) % "glob" % root);
+  }
+  if (!root.empty() && !fs::is_directory(root))
+    return ret;
+
+  io::walker::options opts;
+  opts.stat = false;
+  opts.batch_size = 4096;
+  opts.glob = rest;
+  opts.paths_only = true;
+
+  root_object w(create<io::walker>(
+    fusion::vector2<std::string, io::walker::options>(root, opts)));
+  io::walker &walker = get_native<io::walker>(w);
+
+  while (walker.next_batch(ret))
+    ;
+
+  ret.call("sort");
+  return ret;
+}
+
 #ifdef FLUSSPFERD_HAVE_POSIX
 #include <sys/stat.h>
 #include <errno.h>
@@ -27,6 +27,7 @@ THE SOFTWARE.
 #include "flusspferd/io/io.hpp"
 #include "flusspferd/io/file.hpp"
 #include "flusspferd/io/binary_stream.hpp"
+#include "flusspferd/io/transcoding_stream.hpp"
 #include "flusspferd/local_root_scope.hpp"
 #include "flusspferd/class.hpp"
 #include "flusspferd/modules.hpp"
@@ -42,8 +43,10 @@ object flusspferd::io::load_io_module(object container) {
   object IO = container.get_property_object("exports");
 
   load_class<stream>(IO);
+  load_class<line_iterator>(IO);
   load_class<file>(IO);
   load_class<binary_stream>(IO);
+  load_class<transcoding_stream>(IO);
 
   return IO;
 }
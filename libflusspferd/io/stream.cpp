@@ -25,6 +25,9 @@ THE SOFTWARE.
 */
 
 #include "flusspferd/io/stream.hpp"
+#include "flusspferd/io/fd_streambuf.hpp"
+#include "flusspferd/io/copy.hpp"
+#include "flusspferd/encodings.hpp"
 #include "flusspferd/local_root_scope.hpp"
 #include "flusspferd/create/native_object.hpp"
 #include "flusspferd/string.hpp"
@@ -32,16 +35,42 @@ THE SOFTWARE.
 #include "flusspferd/create.hpp"
 #include "flusspferd/binary.hpp"
 #include "flusspferd/array.hpp"
+#include "flusspferd/context.hpp"
+#include "flusspferd/tracer.hpp"
+#include "flusspferd/create/array.hpp"
 #include <boost/scoped_array.hpp>
 #include <boost/fusion/include/make_vector.hpp>
 #include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <vector>
 
 using namespace flusspferd;
 using namespace flusspferd::io;
 namespace fusion = boost::fusion;
 
+namespace {
+  typedef std::basic_string<js_char16_t> utf16_string;
+
+  utf16_string utf16(char const *ascii) {
+    return utf16_string(ascii, ascii + std::strlen(ascii));
+  }
+
+  binary::element_type const *as_bytes(char const *p) {
+    return reinterpret_cast<binary::element_type const *>(p);
+  }
+
+  string make_string(std::vector<js_char16_t> const &chars) {
+    if (chars.empty())
+      return string();
+    return string(&chars[0], chars.size());
+  }
+}
+
 stream::stream(object const &o, std::streambuf *p)
-  : base_type(o), streambuf_(p)
+  : base_type(o), streambuf_(p), codec(new encodings::text_codec("UTF-8")),
+    field_separator(utf16(" ")), record_separator(utf16("\n")),
+    auto_flush(false), flush_on_print(true)
 {
 }
 
@@ -57,19 +86,25 @@ std::streambuf *stream::streambuf() {
 }
 
 string stream::read_whole() {
-  std::string data;
-  char buf[4096];
+  std::vector<js_char16_t> chars;
+  char buf[16384];
+  std::size_t left = 0;
 
-  std::streamsize length;
+  for (;;) {
+    std::streamsize length = streambuf_->sgetn(buf + left, sizeof(buf) - left);
+    if (length <= 0)
+      break;
 
-  do { 
-    length = streambuf_->sgetn(buf, sizeof(buf));
-    if (length < 0)
-      length = 0;
-    data.append(buf, length);
-  } while (length > 0);
+    // A sequence cut off at the end of the buffer is decoded with the next
+    std::size_t n = left + length;
+    std::size_t used = codec->decode(as_bytes(buf), as_bytes(buf + n), chars, false);
+    left = n - used;
+    std::memmove(buf, buf + used, left);
+  }
+
+  codec->decode(as_bytes(buf), as_bytes(buf + left), chars, true);
 
-  return string(data);
+  return make_string(chars);
 }
 
 object stream::read_whole_binary(boost::optional<byte_array&> output_) {
@@ -97,20 +132,40 @@ object stream::read_whole_binary(boost::optional<byte_array&> output_) {
     data.resize(data.size() - N + length);
   } while (length > 0);
 
+  output.update_memory();
+
   return output;
 }
 
 string stream::read(boost::optional<unsigned> size_opt) {
   unsigned size = size_opt.get_value_or(4096);
 
-  boost::scoped_array<char> buf(new char[size + 1]);
+  boost::scoped_array<char> buf(new char[size]);
 
   std::streamsize length = streambuf_->sgetn(buf.get(), size);
   if (length < 0)
     length = 0;
-  buf[length] = '\0';
 
-  return string(buf.get());
+  std::vector<js_char16_t> chars;
+  std::size_t used = codec->decode(
+    as_bytes(buf.get()), as_bytes(buf.get() + length), chars, false);
+
+  // Read the rest of a multi-byte sequence cut off by size
+  std::string rest(buf.get() + used, buf.get() + length);
+  while (!rest.empty() && rest.size() < 4) {
+    int ch = streambuf_->sbumpc();
+    if (ch == std::char_traits<char>::eof())
+      break;
+    rest += std::char_traits<char>::to_char_type(ch);
+    used = codec->decode(
+      as_bytes(rest.data()), as_bytes(rest.data() + rest.size()), chars, false);
+    rest.erase(0, used);
+  }
+
+  codec->decode(
+    as_bytes(rest.data()), as_bytes(rest.data() + rest.size()), chars, true);
+
+  return make_string(chars);
 }
 
 object stream::read_binary(boost::optional<unsigned> size_opt, boost::optional<byte_array&> output_)
@@ -128,6 +183,7 @@ object stream::read_binary(boost::optional<unsigned> size_opt, boost::optional<b
   binary::vector_type &data = output.get_data();
 
   data.resize(data.size() + size);
+  output.update_memory();
 
   std::streamsize length = streambuf_->sgetn(
     reinterpret_cast<char *>(&data[data.size() - size]),
@@ -143,19 +199,60 @@ object stream::read_binary(boost::optional<unsigned> size_opt, boost::optional<b
 void stream::write(value const &data) {
   if (data.is_string()) {
     string text = data.get_string();
-    char const *str = text.c_str();
-    streambuf_->sputn(text.c_str(), std::strlen(str));
+    write_text(text.data(), text.length());
   } else if (data.is_object()) {
     binary &b = flusspferd::get_native<binary>(data.get_object());
-    streambuf_->sputn((char const*) &b.get_data()[0], b.get_length());
+    streambuf_->sputn((char const*) b.const_begin(), b.get_length());
   } else {
     throw exception("Cannot write non-object non-string value to Stream");
   }
-  //TODO slow?
-  if (get_property("autoFlush").to_boolean())
+  if (auto_flush)
     flush();
 }
 
+void stream::write_text(js_char16_t const *data, std::size_t n) {
+  // Encoding a chunk at a time bounds the extra memory, and passing each
+  // chunk through sputn keeps streambufs that act on writes (line buffering,
+  // transcoding) working.
+  std::size_t const chunk_size = 4096;
+
+  binary::vector_type out;
+  out.reserve(chunk_size * 3);
+
+  js_char16_t const *end = data + n;
+  while (data < end) {
+    js_char16_t const *stop =
+      data + std::min(chunk_size, std::size_t(end - data));
+
+    // Keep surrogate pairs together
+    if (stop < end && stop[-1] >= 0xd800 && stop[-1] <= 0xdbff)
+      ++stop;
+
+    out.clear();
+    codec->encode(data, stop, out);
+    if (!out.empty())
+      streambuf_->sputn(
+        reinterpret_cast<char const *>(&out[0]), out.size());
+
+    data = stop;
+  }
+}
+
+void stream::write_text(utf16_string const &text) {
+  write_text(text.data(), text.size());
+}
+
+void stream::encode_text(string const &text, binary::vector_type &out) {
+  js_char16_t const *data = text.data();
+  codec->encode(data, data + text.length(), out);
+}
+
+string stream::decode_text(char const *data, std::size_t n) {
+  std::vector<js_char16_t> chars;
+  codec->decode(as_bytes(data), as_bytes(data + n), chars, true);
+  return make_string(chars);
+}
+
 void stream::flush() {
   streambuf_->pubsync();
 }
@@ -163,69 +260,287 @@ void stream::flush() {
 void stream::print(call_context &x) {
   local_root_scope scope;
 
-  value delim_v = get_property("fieldSeparator");
-  string delim;
-  if (!delim_v.is_undefined_or_null())
-    delim = delim_v.to_string();
-
   std::size_t n = x.arg.size();
   for (std::size_t i = 0; i < n; ++i) {
-    value p = x.arg[i];
-
-    if (p.is_object() && p.get_object().is_array()) {
-      value recordSep = get_property("recordSeparator");
-
-      array arr = p.get_object();
-      arguments arg;
-      std::size_t length = arr.length();
-      for (std::size_t i = 0; i < length; ++i)
-        arg.push_back(arr.get_element(i));
-
-      set_property("recordSeparator", value());
-      call("print", arg);
-      set_property("recordSeparator", recordSep);
-    } else {
-      write(p.to_string());
+    print_value(x.arg[i]);
+
+    if (i < n - 1 && field_separator)
+      write_text(*field_separator);
+  }
+
+  if (record_separator)
+    write_text(*record_separator);
+
+  if (auto_flush || flush_on_print)
+    flush();
+}
+
+void stream::print_value(value const &v) {
+  if (v.is_object() && v.get_object().is_array()) {
+    // Arrays are expanded, without a record separator of their own
+    array arr = v.get_object();
+    std::size_t length = arr.length();
+    for (std::size_t i = 0; i < length; ++i) {
+      print_value(arr.get_element(i));
+
+      if (i < length - 1 && field_separator)
+        write_text(*field_separator);
     }
+  } else {
+    string text = v.to_string();
+    write_text(text.data(), text.length());
+  }
+}
 
-    if (i < n - 1)
-      write(delim);
+namespace {
+  boost::optional<utf16_string> separator_setting(value const &sep) {
+    if (sep.is_undefined_or_null())
+      return boost::none;
+    return sep.to_string().to_utf16_string();
   }
 
-  value record_v = get_property("recordSeparator");
-  if (!record_v.is_undefined_or_null())
-    write(record_v.to_string());
+  value separator_value(boost::optional<utf16_string> const &sep) {
+    if (!sep)
+      return value();
+    return string(*sep);
+  }
+}
 
-  flush();
+value stream::get_field_separator() {
+  return separator_value(field_separator);
 }
 
-string stream::read_line(value sep_) {
-  local_root_scope scope;
+void stream::set_field_separator(value sep) {
+  field_separator = separator_setting(sep);
+}
 
-  if (sep_.is_undefined_or_null())
-    sep_ = string("\n");
+value stream::get_record_separator() {
+  return separator_value(record_separator);
+}
 
-  string sep = sep_.to_string();
+void stream::set_record_separator(value sep) {
+  record_separator = separator_setting(sep);
+}
 
-  if (sep.length() != 1)
-    throw exception("Line separators with size other than 1 are not supported");
+bool stream::get_auto_flush() {
+  return auto_flush;
+}
 
-  int sepc = sep.data()[0];
+void stream::set_auto_flush(bool flush) {
+  auto_flush = flush;
+}
 
-  if (sepc >= 128)
-    throw exception("Non-ASCII line separators are not supported");
+void stream::set_flush_on_print(bool flush) {
+  flush_on_print = flush;
+}
 
-  std::string line;
+std::string stream::get_charset() {
+  return codec->charset();
+}
+
+void stream::set_charset(std::string const &charset) {
+  codec.reset(new encodings::text_codec(charset));
+}
+
+void stream::set_buffering(
+  std::string const &mode_name, boost::optional<unsigned> size)
+{
+  fd_streambuf *buf = dynamic_cast<fd_streambuf*>(streambuf_);
+  if (!buf)
+    throw exception("Stream is not backed by a file descriptor");
+
+  fd_streambuf::buffer_mode mode;
+  if (mode_name == "auto")
+    mode = fd_streambuf::buffer_auto;
+  else if (mode_name == "none")
+    mode = fd_streambuf::buffer_none;
+  else if (mode_name == "line")
+    mode = fd_streambuf::buffer_line;
+  else if (mode_name == "full")
+    mode = fd_streambuf::buffer_full;
+  else
+    throw exception("Unknown buffering mode: " + mode_name);
+
+  buf->set_buffering(mode, size.get_value_or(buf->size()));
+}
+
+bool stream::isatty() {
+  fd_streambuf *buf = dynamic_cast<fd_streambuf*>(streambuf_);
+  return buf && buf->is_tty();
+}
+
+double stream::pipe_to(stream &target, value options) {
+  std::size_t buffer_size = copier::default_buffer_size;
+
+  if (options.is_object()) {
+    value size = options.get_object().get_property("bufferSize");
+    if (!size.is_undefined_or_null()) {
+      double n = size.to_number();
+      if (!(n >= 1))
+        throw exception("Stream.pipeTo: bufferSize must be positive",
+                        "RangeError");
+      buffer_size = std::size_t(n);
+    }
+  } else if (!options.is_undefined_or_null()) {
+    throw exception("Stream.pipeTo: Invalid options argument", "TypeError");
+  }
+
+  std::streambuf *in = streambuf();
+  std::streambuf *out = target.streambuf();
+  if (!in || !out)
+    throw exception("Stream.pipeTo: Stream is closed");
+
+  copier c(buffer_size);
+  return double(c.copy(*in, *out));
+}
+
+namespace {
+  // The get area of any streambuf. Naming the protected members through a
+  // derived class makes them accessible as member pointers.
+  class get_area : public std::streambuf {
+  public:
+    static char const *begin(std::streambuf *b) {
+      return (b->*&get_area::gptr)();
+    }
+
+    static std::size_t available(std::streambuf *b) {
+      char const *p = begin(b);
+      return p ? (b->*&get_area::egptr)() - p : 0;
+    }
+
+    static void consume(std::streambuf *b, std::size_t n) {
+      (b->*&get_area::gbump)(int(n));
+    }
+  };
+
+  bool ends_with(std::string const &s, std::string const &suffix) {
+    return s.size() >= suffix.size() &&
+      s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+  }
+}
+
+std::string stream::separator_bytes(value sep) {
+  std::string bytes;
+
+  if (sep.is_undefined_or_null())
+    bytes = "\n";
+  else if (sep.is_object() && is_native<binary>(sep.get_object())) {
+    binary &b = get_native<binary>(sep.get_object());
+    bytes.assign(b.const_begin(), b.const_end());
+  }
+  else {
+    binary::vector_type encoded;
+    encode_text(sep.to_string(), encoded);
+    bytes.assign(encoded.begin(), encoded.end());
+  }
+
+  if (bytes.empty())
+    throw exception("Line separator must not be empty");
+
+  return bytes;
+}
+
+bool stream::read_line_bytes(std::string const &sep, std::string &line) {
+  char const last = sep[sep.size() - 1];
+  bool any = false;
 
   for (;;) {
-    int ch = streambuf_->sbumpc();
-    if (ch == std::char_traits<char>::eof())
-      break;
-    line += ch;
-    if (ch == sepc)
-      break;
+    std::size_t avail = get_area::available(streambuf_);
+
+    if (avail == 0) {
+      if (streambuf_->sgetc() == std::char_traits<char>::eof())
+        return any;
+      avail = get_area::available(streambuf_);
+    }
+
+    any = true;
+
+    if (avail == 0) {
+      // Unbuffered streambuf: go one character at a time
+      char ch = std::char_traits<char>::to_char_type(streambuf_->sbumpc());
+      line += ch;
+      if (ch == last && ends_with(line, sep))
+        return true;
+      continue;
+    }
+
+    // Look for the last byte of the separator with memchr, which the C
+    // library vectorizes, then check the bytes before it (which may have
+    // been read from an earlier buffer).
+    char const *begin = get_area::begin(streambuf_);
+    char const *end = begin + avail;
+    char const *pos = begin;
+
+    while (char const *hit =
+             static_cast<char const *>(std::memchr(pos, last, end - pos)))
+    {
+      line.append(pos, hit + 1);
+      pos = hit + 1;
+      if (ends_with(line, sep)) {
+        get_area::consume(streambuf_, pos - begin);
+        return true;
+      }
+    }
+
+    line.append(pos, end);
+    get_area::consume(streambuf_, avail);
   }
+}
+
+string stream::read_line(value sep) {
+  std::string line;
+  read_line_bytes(separator_bytes(sep), line);
+  return decode_text(line.data(), line.size());
+}
 
-  return line;
+object stream::read_line_binary(value sep) {
+  std::string line;
+  read_line_bytes(separator_bytes(sep), line);
+  return create<byte_string>(fusion::make_vector(
+    reinterpret_cast<binary::element_type const *>(line.data()),
+    line.size()));
 }
 
+object stream::lines(value sep, boost::optional<unsigned> batch_size) {
+  std::size_t n = batch_size.get_value_or(1024);
+  if (n == 0)
+    throw exception("Batch size must be positive", "RangeError");
+
+  return create<line_iterator>(
+    fusion::vector3<stream &, std::string, std::size_t>(
+      *this, separator_bytes(sep), n));
+}
+
+// -- line_iterator ---------------------------------------------------------
+
+line_iterator::line_iterator(
+    object const &o, stream &source, std::string const &sep,
+    std::size_t batch_size)
+  : base_type(o), source(&source), sep(sep), batch_size(batch_size)
+{}
+
+void line_iterator::trace(tracer &trc) {
+  trc("source", *static_cast<object*>(source));
+}
+
+object line_iterator::iterator() {
+  return *this;
+}
+
+object line_iterator::next() {
+  root_array batch(create<array>());
+
+  std::string line;
+  std::size_t i = 0;
+  for (; i < batch_size; ++i) {
+    line.clear();
+    if (!source->read_line_bytes(sep, line))
+      break;
+    batch.set_element(i, source->decode_text(line.data(), line.size()));
+  }
+
+  if (i == 0)
+    throw exception(current_context().global().get_property("StopIteration"));
+
+  return batch;
+}
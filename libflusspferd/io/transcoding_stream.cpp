@@ -0,0 +1,223 @@
+// vim:ts=2:sw=2:expandtab:autoindent:filetype=cpp:
+/*
+The MIT License
+
+Copyright (c) 2008, 2009 Flusspferd contributors (see "CONTRIBUTORS" or
+                                       http://flusspferd.org/contributors.txt)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "flusspferd/io/transcoding_stream.hpp"
+#include "flusspferd/encodings.hpp"
+#include "flusspferd/tracer.hpp"
+#include "flusspferd/root.hpp"
+#include <streambuf>
+#include <vector>
+
+using namespace flusspferd;
+using namespace flusspferd::io;
+
+namespace {
+
+// Stream buffer converting between the charset of an underlying stream and
+// the charset seen by the reader. Input is decoded chunk by chunk as it is
+// read, output is buffered and encoded on sync. Pending output is written
+// when the buffer is closed or destroyed.
+class transcoding_buf : public std::streambuf {
+public:
+  transcoding_buf(
+    std::streambuf *source, std::string const &from, std::string const &to)
+  : source(source), decoder(from, to), encoder(to, from), at_eof(false),
+    closed(false)
+  {}
+
+  ~transcoding_buf() {
+    try {
+      close();
+    } catch (...) {
+    }
+  }
+
+  // Write pending output and end the encoded data (e.g. the final shift
+  // sequence of a stateful charset). Nothing can be written afterwards.
+  void close();
+
+protected:
+  int_type underflow();
+  int_type overflow(int_type c);
+  std::streamsize xsputn(char const *s, std::streamsize n);
+  int sync();
+
+private:
+  void flush_output();
+
+  enum { CHUNK_SIZE = 16384 };
+
+  std::streambuf *source;
+
+  encodings::converter decoder;
+  encodings::converter encoder;
+
+  std::vector<char> raw;
+  binary::vector_type decoded;
+  binary::vector_type pending_output;
+  binary::vector_type encoded;
+
+  bool at_eof;
+  bool closed;
+};
+
+transcoding_buf::int_type transcoding_buf::underflow() {
+  while (gptr() == egptr()) {
+    if (at_eof)
+      return traits_type::eof();
+
+    raw.resize(CHUNK_SIZE);
+    std::streamsize n = source->sgetn(&raw[0], CHUNK_SIZE);
+
+    decoded.clear();
+    if (n <= 0) {
+      at_eof = true;
+      decoder.close(decoded);
+    } else {
+      decoder.push(
+        reinterpret_cast<binary::element_type const *>(&raw[0]), n, decoded);
+    }
+
+    if (!decoded.empty()) {
+      char *p = reinterpret_cast<char *>(&decoded[0]);
+      setg(p, p, p + decoded.size());
+    }
+  }
+
+  return traits_type::to_int_type(*gptr());
+}
+
+transcoding_buf::int_type transcoding_buf::overflow(int_type c) {
+  if (closed)
+    return traits_type::eof();
+  if (!traits_type::eq_int_type(c, traits_type::eof())) {
+    pending_output.push_back(traits_type::to_char_type(c));
+    if (pending_output.size() >= CHUNK_SIZE)
+      flush_output();
+  }
+  return traits_type::not_eof(c);
+}
+
+std::streamsize transcoding_buf::xsputn(char const *s, std::streamsize n) {
+  if (closed)
+    return 0;
+  pending_output.insert(pending_output.end(), s, s + n);
+  if (pending_output.size() >= CHUNK_SIZE)
+    flush_output();
+  return n;
+}
+
+int transcoding_buf::sync() {
+  flush_output();
+  return source->pubsync();
+}
+
+void transcoding_buf::close() {
+  if (closed)
+    return;
+  closed = true;
+
+  flush_output();
+
+  encoded.clear();
+  encoder.close(encoded);
+  if (!encoded.empty())
+    source->sputn(
+      reinterpret_cast<char const *>(&encoded[0]), encoded.size());
+
+  source->pubsync();
+}
+
+void transcoding_buf::flush_output() {
+  if (pending_output.empty())
+    return;
+
+  encoded.clear();
+  encoder.push(&pending_output[0], pending_output.size(), encoded);
+  pending_output.clear();
+
+  if (!encoded.empty())
+    source->sputn(
+      reinterpret_cast<char const *>(&encoded[0]), encoded.size());
+}
+
+}
+
+class transcoding_stream::impl {
+public:
+  impl(stream &source_, std::string const &from, std::string const &to)
+    : source_root(source_), source(source_),
+      buf(source_.streambuf(), from, to)
+  {}
+
+  // The wrapped stream is kept alive until the buffer has written its
+  // pending output, even if both become garbage in the same collection.
+  root_object source_root;
+  stream &source;
+  transcoding_buf buf;
+};
+
+static stream &get_source(call_context &x) {
+  if (!x.arg[0].is_object() || x.arg[0].is_null())
+    throw exception("Could not create TranscodingStream without Stream");
+  object obj = x.arg[0].get_object();
+  return flusspferd::get_native<stream>(obj);
+}
+
+transcoding_stream::transcoding_stream(object const &obj, call_context &x)
+  : base_type(obj, (std::streambuf*)0)
+{
+  stream &source = get_source(x);
+
+  if (x.arg[1].is_undefined_or_null())
+    throw exception("Could not create TranscodingStream without charset");
+
+  std::string from = x.arg[1].to_std_string();
+  std::string to =
+    x.arg[2].is_undefined_or_null() ? "UTF-8" : x.arg[2].to_std_string();
+
+  p.reset(new impl(source, from, to));
+
+  set_streambuf(&p->buf);
+
+  // Text is written to and read from the buffer in the stream charset
+  set_charset(to);
+}
+
+transcoding_stream::~transcoding_stream()
+{}
+
+void transcoding_stream::trace(tracer &trc) {
+  trc("stream", p->source);
+}
+
+stream &transcoding_stream::get_stream() {
+  return p->source;
+}
+
+void transcoding_stream::close() {
+  p->buf.close();
+}
@@ -0,0 +1,687 @@
+// vim:ts=2:sw=2:expandtab:autoindent:filetype=cpp:
+/*
+The MIT License
+
+Copyright (c) 2008, 2009 Flusspferd contributors (see "CONTRIBUTORS" or
+                                       http://flusspferd.org/contributors.txt)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "flusspferd/io/walk.hpp"
+#include "flusspferd/security.hpp"
+#include "flusspferd/exception.hpp"
+#include "flusspferd/create.hpp"
+#include "flusspferd/context.hpp"
+#include "flusspferd/tracer.hpp"
+#include "flusspferd/root.hpp"
+#include "flusspferd/string.hpp"
+#include "flusspferd/arguments.hpp"
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/bind.hpp>
+#include <algorithm>
+#include <limits>
+#include <cstring>
+#include <errno.h>
+
+#ifdef FLUSSPFERD_HAVE_POSIX
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+using namespace flusspferd;
+using namespace flusspferd::io;
+
+namespace {
+  void add_state(glob_matcher::state_type &state, unsigned k) {
+    if (std::find(state.begin(), state.end(), k) == state.end())
+      state.push_back(k);
+  }
+
+  // Match the pattern element at p against c. Returns the rest of the
+  // pattern, or 0 if c does not match.
+  char const *match_one(char const *p, char c) {
+    unsigned char ch = c;
+
+    if (*p == '?')
+      return p + 1;
+
+    if (*p == '[') {
+      char const *q = p + 1;
+      bool negate = *q == '!' || *q == '^';
+      if (negate)
+        ++q;
+
+      // A ']' right at the start is part of the set
+      char const *first = q;
+      bool found = false;
+      while (*q && (*q != ']' || q == first)) {
+        if (q[1] == '-' && q[2] && q[2] != ']') {
+          if ((unsigned char)q[0] <= ch && ch <= (unsigned char)q[2])
+            found = true;
+          q += 3;
+        } else {
+          if (*q == c)
+            found = true;
+          ++q;
+        }
+      }
+
+      // Without a closing bracket, '[' is an ordinary character
+      if (!*q)
+        return c == '[' ? p + 1 : 0;
+
+      return found != negate ? q + 1 : 0;
+    }
+
+    if (*p == '\\' && p[1])
+      ++p;
+
+    return *p == c ? p + 1 : 0;
+  }
+}
+
+glob_matcher::glob_matcher(std::string const &pattern) {
+  std::string::size_type begin = 0;
+  while (begin <= pattern.size()) {
+    std::string::size_type end = pattern.find('/', begin);
+    if (end == std::string::npos)
+      end = pattern.size();
+
+    std::string component(pattern, begin, end - begin);
+
+    // Empty components (from double or trailing slashes) and "." change
+    // nothing, and neither do several "**" in a row
+    if (!component.empty() && component != "." &&
+        !(component == "**" && !components.empty() &&
+          components.back() == "**"))
+      components.push_back(component);
+
+    begin = end + 1;
+  }
+}
+
+glob_matcher::state_type glob_matcher::closure(state_type const &state) const {
+  // "**" also matches no directory at all
+  state_type result(state);
+  for (std::size_t i = 0; i < result.size(); ++i) {
+    unsigned k = result[i];
+    if (k < components.size() && components[k] == "**")
+      add_state(result, k + 1);
+  }
+  return result;
+}
+
+glob_matcher::state_type glob_matcher::start() const {
+  return closure(state_type(1, 0));
+}
+
+glob_matcher::state_type glob_matcher::step(
+  state_type const &state, std::string const &name) const
+{
+  state_type next;
+  for (state_type::const_iterator it = state.begin(); it != state.end(); ++it) {
+    unsigned k = *it;
+    if (k >= components.size())
+      continue;
+
+    if (components[k] == "**") {
+      if (name[0] != '.')
+        add_state(next, k);
+    } else if (match_component(components[k].c_str(), name.c_str())) {
+      add_state(next, k + 1);
+    }
+  }
+  return closure(next);
+}
+
+bool glob_matcher::matches(state_type const &state) const {
+  return std::find(state.begin(), state.end(), unsigned(components.size()))
+    != state.end();
+}
+
+bool glob_matcher::can_descend(state_type const &state) const {
+  for (state_type::const_iterator it = state.begin(); it != state.end(); ++it)
+    if (*it < components.size())
+      return true;
+  return false;
+}
+
+bool glob_matcher::match_component(char const *p, char const *s) {
+  if (*s == '.' && *p != '.')
+    return false;
+
+  char const *star_p = 0;
+  char const *star_s = 0;
+
+  while (*s) {
+    if (*p == '*') {
+      star_p = ++p;
+      star_s = s;
+      continue;
+    }
+
+    if (*p) {
+      if (char const *rest = match_one(p, *s)) {
+        p = rest;
+        ++s;
+        continue;
+      }
+    }
+
+    // Let the last '*' take one more character
+    if (!star_p)
+      return false;
+    p = star_p;
+    s = ++star_s;
+  }
+
+  while (*p == '*')
+    ++p;
+
+  return !*p;
+}
+
+bool glob_matcher::is_literal(std::string const &component) {
+  return component.find_first_of("*?[\\") == std::string::npos;
+}
+
+walker::options::options()
+  : follow_links(false),
+    max_depth(std::numeric_limits<unsigned>::max()),
+    stat(true),
+    stat_threads(0),
+    batch_size(1024),
+    paths_only(false)
+{}
+
+#ifdef FLUSSPFERD_HAVE_POSIX
+
+namespace {
+  // A directory entry on its way to becoming a walk entry
+  struct raw_entry {
+    int dir_fd;
+    std::string name;
+    unsigned char d_type;
+    bool wants_stat;
+    bool have_stat;
+    struct stat st;
+  };
+
+  void stat_entry(raw_entry &e, bool follow_links) {
+    if (!e.wants_stat)
+      return;
+    e.have_stat = fstatat(e.dir_fd, e.name.c_str(), &e.st,
+                          follow_links ? 0 : AT_SYMLINK_NOFOLLOW) == 0;
+  }
+
+  // A few threads that stat directory entries in parallel. The thread that
+  // hands out the work takes part in it, and waits until all of it is done.
+  class stat_pool : boost::noncopyable {
+  public:
+    stat_pool(unsigned threads, bool follow_links)
+      : follow_links(follow_links), entries(0), next(0), threads(threads),
+        finished(0), generation(0), quit(false)
+    {
+      for (unsigned i = 0; i < threads; ++i)
+        workers.create_thread(boost::bind(&stat_pool::work, this));
+    }
+
+    ~stat_pool() {
+      {
+        boost::mutex::scoped_lock lock(mutex);
+        quit = true;
+      }
+      wake.notify_all();
+      workers.join_all();
+    }
+
+    void run(std::vector<raw_entry> &work) {
+      {
+        boost::mutex::scoped_lock lock(mutex);
+        entries = &work;
+        next = 0;
+        finished = 0;
+        ++generation;
+      }
+      wake.notify_all();
+
+      process();
+
+      // Every worker has to be done with this generation, not just the busy
+      // ones: one that was woken but has not run yet would otherwise look at
+      // the entries of the next call.
+      boost::mutex::scoped_lock lock(mutex);
+      while (finished < threads)
+        done.wait(lock);
+    }
+
+  private:
+    // Entries are handed out in chunks to keep the locking cheap
+    static std::size_t const chunk_size = 32;
+
+    void work() {
+      unsigned seen = 0;
+      boost::mutex::scoped_lock lock(mutex);
+      for (;;) {
+        while (!quit && generation == seen)
+          wake.wait(lock);
+        if (quit)
+          return;
+
+        seen = generation;
+        lock.unlock();
+        process();
+        lock.lock();
+        if (++finished == threads)
+          done.notify_all();
+      }
+    }
+
+    void process() {
+      for (;;) {
+        std::size_t begin, end;
+        {
+          boost::mutex::scoped_lock lock(mutex);
+          if (next >= entries->size())
+            return;
+          begin = next;
+          end = std::min(entries->size(), next + chunk_size);
+          next = end;
+        }
+
+        for (std::size_t i = begin; i < end; ++i)
+          stat_entry((*entries)[i], follow_links);
+      }
+    }
+
+    bool follow_links;
+
+    boost::mutex mutex;
+    boost::condition_variable wake;
+    boost::condition_variable done;
+    std::vector<raw_entry> *entries;
+    std::size_t next;
+    unsigned threads;
+    unsigned finished; // workers done with the current generation
+    unsigned generation;
+    bool quit;
+
+    boost::thread_group workers;
+  };
+
+  // Below this, starting the other threads costs more than it saves
+  std::size_t const min_parallel_stat = 64;
+
+  std::string join(std::string const &dir, std::string const &name) {
+    if (dir.empty())
+      return name;
+    if (dir[dir.size() - 1] == '/')
+      return dir + name;
+    return dir + '/' + name;
+  }
+
+  char const *entry_type(raw_entry const &e) {
+    if (e.have_stat) {
+      if (S_ISREG(e.st.st_mode))
+        return "file";
+      if (S_ISDIR(e.st.st_mode))
+        return "directory";
+      if (S_ISLNK(e.st.st_mode))
+        return "link";
+      return "other";
+    }
+
+#ifdef DT_UNKNOWN
+    switch (e.d_type) {
+    case DT_REG:
+      return "file";
+    case DT_DIR:
+      return "directory";
+    case DT_LNK:
+      return "link";
+    case DT_UNKNOWN:
+      return 0;
+    default:
+      return "other";
+    }
+#else
+    return 0;
+#endif
+  }
+}
+
+class walker::impl {
+public:
+  impl(std::string const &root, options const &opts);
+  ~impl();
+
+  struct frame {
+    DIR *dir;
+    std::size_t parent; // index into the stack, npos for the root
+    std::string name;   // relative to the parent
+    std::string path;
+    unsigned depth;
+    glob_matcher::state_type state;
+    dev_t dev;
+    ino_t ino;
+    bool done;
+  };
+
+  static std::size_t const npos = std::size_t(-1);
+
+  bool open(frame &f);
+  void read(frame &f, std::size_t max);
+  void stat_entries();
+
+  options opts;
+  boost::optional<glob_matcher> glob;
+  std::vector<frame> stack;
+  std::vector<raw_entry> entries;
+  boost::scoped_ptr<stat_pool> pool;
+
+  // Set while a batch is read. The filter could otherwise call next() and
+  // change the stack and entries that are being walked.
+  bool busy;
+};
+
+walker::impl::impl(std::string const &root, options const &opts)
+  : opts(opts), busy(false)
+{
+  if (opts.glob)
+    glob = glob_matcher(*opts.glob);
+
+  frame f;
+  f.dir = 0;
+  f.parent = npos;
+  f.name = root.empty() ? "." : root;
+  f.path = root;
+  f.depth = 0;
+  if (glob)
+    f.state = glob->start();
+  f.done = false;
+
+  if (!open(f)) {
+    throw exception("walk: " + std::string(std::strerror(errno)) +
+                    " \"" + root + "\"");
+  }
+  stack.push_back(f);
+
+  if (opts.stat_threads > 0)
+    pool.reset(new stat_pool(opts.stat_threads, opts.follow_links));
+}
+
+walker::impl::~impl() {
+  for (std::vector<frame>::iterator it = stack.begin(); it != stack.end(); ++it)
+    if (it->dir)
+      closedir(it->dir);
+}
+
+bool walker::impl::open(frame &f) {
+  int parent_fd = AT_FDCWD;
+  int flags = O_RDONLY | O_DIRECTORY;
+#ifdef O_CLOEXEC
+  flags |= O_CLOEXEC;
+#endif
+
+  if (f.parent != npos) {
+    parent_fd = dirfd(stack[f.parent].dir);
+    if (!opts.follow_links)
+      flags |= O_NOFOLLOW;
+  }
+
+  int fd = openat(parent_fd, f.name.c_str(), flags);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    ::close(fd);
+    return false;
+  }
+  f.dev = st.st_dev;
+  f.ino = st.st_ino;
+
+  // Do not follow a link back up the tree
+  if (opts.follow_links) {
+    for (std::size_t i = f.parent; i != npos; i = stack[i].parent) {
+      if (stack[i].dev == f.dev && stack[i].ino == f.ino) {
+        ::close(fd);
+        errno = ELOOP;
+        return false;
+      }
+    }
+  }
+
+  f.dir = fdopendir(fd);
+  if (!f.dir) {
+    ::close(fd);
+    return false;
+  }
+  return true;
+}
+
+void walker::impl::read(frame &f, std::size_t max) {
+  entries.clear();
+
+  while (entries.size() < max) {
+    struct dirent *d = readdir(f.dir);
+    if (!d) {
+      f.done = true;
+      break;
+    }
+
+    if (!std::strcmp(d->d_name, ".") || !std::strcmp(d->d_name, ".."))
+      continue;
+
+    raw_entry e;
+    e.dir_fd = dirfd(f.dir);
+    e.name = d->d_name;
+    e.have_stat = false;
+#ifdef DT_UNKNOWN
+    e.d_type = d->d_type;
+    // The type from readdir is enough, unless it is unknown or would have to
+    // be looked up through a link
+    e.wants_stat = opts.stat || e.d_type == DT_UNKNOWN ||
+                   (e.d_type == DT_LNK && opts.follow_links);
+#else
+    e.d_type = 0;
+    e.wants_stat = true;
+#endif
+    entries.push_back(e);
+  }
+}
+
+void walker::impl::stat_entries() {
+  if (pool && entries.size() >= min_parallel_stat) {
+    pool->run(entries);
+    return;
+  }
+
+  for (std::vector<raw_entry>::iterator it = entries.begin();
+       it != entries.end();
+       ++it)
+    stat_entry(*it, opts.follow_links);
+}
+
+#else
+
+class walker::impl {
+public:
+  options opts;
+};
+
+#endif
+
+walker::walker(object const &o, std::string const &root, options const &opts)
+  : base_type(o)
+#ifdef FLUSSPFERD_HAVE_POSIX
+  , p(new impl(root, opts))
+#endif
+{
+#ifndef FLUSSPFERD_HAVE_POSIX
+  throw exception("walk: not supported on this platform");
+#endif
+}
+
+walker::~walker()
+{}
+
+void walker::trace(tracer &trc) {
+  if (p)
+    trc("filter", p->opts.filter);
+}
+
+object walker::iterator() {
+  return *this;
+}
+
+object walker::next() {
+  root_array batch(create<array>());
+
+  if (!next_batch(batch))
+    throw exception(current_context().global().get_property("StopIteration"));
+
+  return batch;
+}
+
+#ifdef FLUSSPFERD_HAVE_POSIX
+namespace {
+  class busy_scope : boost::noncopyable {
+  public:
+    explicit busy_scope(bool &busy) : busy(busy) {
+      if (busy)
+        throw exception("walk: next() called from the filter", "TypeError");
+      busy = true;
+    }
+    ~busy_scope() { busy = false; }
+
+  private:
+    bool &busy;
+  };
+}
+#endif
+
+bool walker::next_batch(array &out) {
+#ifdef FLUSSPFERD_HAVE_POSIX
+  busy_scope busy(p->busy);
+  options const &opts = p->opts;
+  std::vector<impl::frame> &stack = p->stack;
+  bool filtered = !opts.filter.is_undefined_or_null();
+  std::size_t yielded = 0;
+
+  while (yielded < opts.batch_size && !stack.empty()) {
+    impl::frame &f = stack.back();
+    if (f.done) {
+      closedir(f.dir);
+      stack.pop_back();
+      continue;
+    }
+
+    if (!f.dir && !p->open(f)) {
+      stack.pop_back();
+      continue;
+    }
+
+    p->read(f, opts.batch_size - yielded);
+    p->stat_entries();
+
+    std::size_t const parent = stack.size() - 1;
+    std::vector<impl::frame> children;
+
+    for (std::vector<raw_entry>::iterator e = p->entries.begin();
+         e != p->entries.end();
+         ++e)
+    {
+      // Vanished since it was listed, or cannot be looked at
+      char const *type = entry_type(*e);
+      if (!type)
+        continue;
+
+      std::string path = join(f.path, e->name);
+      glob_matcher::state_type state;
+      if (p->glob)
+        state = p->glob->step(f.state, e->name);
+
+      bool match = !p->glob || p->glob->matches(state);
+      bool descend =
+        !std::strcmp(type, "directory") &&
+        f.depth + 1 < opts.max_depth &&
+        (!p->glob || p->glob->can_descend(state)) &&
+        security::get().check_path(path, security::ACCESS);
+
+      if (!match && !descend)
+        continue;
+
+      root_value entry;
+      if (match || filtered) {
+        if (opts.paths_only) {
+          entry = string(path);
+        } else {
+          root_object o(create<object>());
+          o.set_property("path", string(path));
+          o.set_property("type", string(type));
+          if (e->have_stat) {
+            o.set_property("size", double(e->st.st_size));
+            o.set_property("mtime", e->st.st_mtime * 1000.0);
+          }
+          entry = o;
+        }
+      }
+
+      if (filtered) {
+        arguments args;
+        args.push_root(entry);
+        if (!opts.filter.get_object().call(args).to_boolean())
+          continue;
+      }
+
+      if (match) {
+        out.push(value(entry));
+        ++yielded;
+      }
+
+      if (descend) {
+        impl::frame child;
+        child.dir = 0;
+        child.parent = parent;
+        child.name = e->name;
+        child.path = path;
+        child.depth = f.depth + 1;
+        child.state = state;
+        child.done = false;
+        children.push_back(child);
+      }
+    }
+
+    // Walk the subdirectories before going on with this one, in order
+    stack.insert(stack.end(), children.rbegin(), children.rend());
+  }
+
+  return yielded > 0;
+#else
+  return false;
+#endif
+}
@@ -30,7 +30,9 @@ THE SOFTWARE.
 #include "flusspferd/properties_functions.hpp"
 #include "flusspferd/binary.hpp"
 #include "flusspferd/encodings.hpp"
+#include "flusspferd/event.hpp"
 #include "flusspferd/system.hpp"
+#include "flusspferd/worker.hpp"
 #include "flusspferd/getopt.hpp"
 #include "flusspferd/io/io.hpp"
 #include "flusspferd/io/filesystem-base.hpp"
@@ -78,6 +80,11 @@ void flusspferd::load_core(object const &scope_, std::string const &argv0) {
     &flusspferd::load_encodings_module,
     _container = preload);
 
+  flusspferd::create<method>(
+    "event",
+    &flusspferd::load_event_module,
+    _container = preload);
+
   flusspferd::create<method>(
     "io",
     &flusspferd::io::load_io_module,
@@ -106,4 +113,11 @@ void flusspferd::load_core(object const &scope_, std::string const &argv0) {
     phoenix::bind(&flusspferd::load_flusspferd_module, args::arg1, argv0),
     _signature = param::type<void (object)>(),
     _container = preload);
+
+  // Workers need argv[0] to set up their own core modules
+  flusspferd::create<method>(
+    "worker",
+    phoenix::bind(&flusspferd::load_worker_module, args::arg1, argv0),
+    _signature = param::type<void (object)>(),
+    _container = preload);
 }
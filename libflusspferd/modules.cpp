@@ -36,6 +36,7 @@ THE SOFTWARE.
 #include "flusspferd/io/filesystem-base.hpp"
 #include "flusspferd/binary.hpp"
 #include "flusspferd/encodings.hpp"
+#include "flusspferd/xdr.hpp"
 #include <boost/filesystem/fstream.hpp>
 #include <boost/foreach.hpp>
 #include <boost/format.hpp>
@@ -44,14 +45,27 @@ THE SOFTWARE.
 #include <boost/spirit/include/phoenix.hpp>
 #include <boost/xpressive/xpressive.hpp>
 #include <boost/scope_exit.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/detail/atomic_count.hpp>
+#include <boost/thread/thread.hpp>
 #include <algorithm>
+#include <map>
+#include <set>
 #include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <sstream>
 
 #ifdef WIN32
 #include <windows.h>
 #else
 #define SHLIBPREFIX "lib"
 #include <dlfcn.h>
+#include <unistd.h>
 #endif
 
 
@@ -76,9 +90,159 @@ static object module_resource(const fs::path &module_dir, std::string const &x_,
 // This function based largley on one from boost/program_options. See end of file for its license
 static array split_args_string(const value& input);
 
+static std::string default_compile_cache_dir();
+static fs::path compile_cache_file(std::string const &dir, std::string const &source);
+static object read_compiled_module(
+  fs::path const &cache_file, std::string const &source,
+  std::time_t mtime, boost::uintmax_t size, require::module_options &options);
+static void write_compiled_module(
+  fs::path const &cache_file, std::string const &source,
+  std::time_t mtime, boost::uintmax_t size,
+  require::module_options const &options, object const &fn);
+
+static std::string parse_module_header(
+  binary::element_type const *begin, binary::element_type const *end,
+  require::module_options &options);
+static string decode_module_text(binary &blob, require::module_options &options);
+static object compile_module_function(string const &text, std::string const &fname);
+static fs::path normalize_path(fs::path const &p);
+
 static const format load_error_fmt("Unable to load module '%1%': %2%");
+static const format bundle_error_fmt("Unable to load module bundle '%1%': %2%");
 }
 
+// A module in a bundle. The source and bytecode stay in the mapped bundle
+// file.
+struct require::bundle_entry {
+  bundle_entry()
+    : source_offset(0), source_size(0), bytecode_offset(0), bytecode_size(0)
+  {}
+
+  std::string id;     // canonical id, "file:///path/to/module.js"
+  std::string native; // path of the DSO loaded along with the module, or ""
+  module_options options;
+
+  binary::storage_ptr storage;
+  std::size_t source_offset;
+  std::size_t source_size;
+  std::size_t bytecode_offset;
+  std::size_t bytecode_size; // 0 if not present or for another engine version
+};
+
+// What searching require.paths found. Results are only valid for the paths
+// they were computed with; any change to require.paths starts a new
+// generation with empty caches.
+struct require::resolution_state {
+  resolution_state() : generation(0) {}
+
+  std::vector<std::string> paths;
+  unsigned long generation;
+
+  // file name -> existing canonical candidates, in search order. Only
+  // names that were found are kept, so that modules created later are seen.
+  typedef std::map<std::string, std::vector<fs::path> > result_map;
+  result_map results;
+
+  // The names of the entries of a directory. A name that is missing is only
+  // believed while the directory is unchanged since it was read.
+  struct listing {
+    listing() : mtime(0), read_at(0) {}
+
+    std::time_t mtime;
+    std::time_t read_at;
+    std::set<std::string> names;
+  };
+
+  // directory -> its listing, so that looking for a file costs at most one
+  // stat of the directory instead of one per candidate
+  typedef std::map<std::string, listing> listing_map;
+  listing_map listings;
+
+  // Start a new generation if require.paths was changed
+  void sync(array const &current) {
+    std::size_t const len = current.length();
+    bool same = len == paths.size();
+    for (std::size_t i = 0; same && i < len; ++i)
+      same = current.get_element(i).to_std_string() == paths[i];
+    if (same)
+      return;
+
+    paths.clear();
+    for (std::size_t i = 0; i < len; ++i)
+      paths.push_back(current.get_element(i).to_std_string());
+    ++generation;
+    results.clear();
+    listings.clear();
+  }
+
+  // The contents of the files in require.bundles, indexed by canonical id
+  // and top-level name. Earlier bundles take precedence.
+  std::vector<std::string> bundle_files;
+  typedef std::map<std::string, bundle_entry> bundle_map;
+  bundle_map bundled;
+  std::map<std::string, std::string> bundled_names;
+
+  // Reload the bundles if require.bundles was changed
+  void sync_bundles(array const &current) {
+    std::size_t const len = current.length();
+    bool same = len == bundle_files.size();
+    for (std::size_t i = 0; same && i < len; ++i)
+      same = current.get_element(i).to_std_string() == bundle_files[i];
+    if (same)
+      return;
+
+    std::vector<std::string> files;
+    bundle_map entries;
+    std::map<std::string, std::string> names;
+    for (std::size_t i = 0; i < len; ++i) {
+      files.push_back(current.get_element(i).to_std_string());
+      read_bundle(files.back(), entries, names);
+    }
+
+    bundle_files.swap(files);
+    bundled.swap(entries);
+    bundled_names.swap(names);
+  }
+
+  static void read_bundle(std::string const &file, bundle_map &entries,
+                          std::map<std::string, std::string> &names);
+
+  bool exists(fs::path const &p) {
+    std::string const dir = p.parent_path().string();
+    std::pair<listing_map::iterator, bool> ins =
+      listings.insert(listing_map::value_type(dir, listing()));
+    listing &l = ins.first->second;
+
+    if (!ins.second && l.names.count(p.filename()))
+      return true;
+
+    std::time_t mtime = 0;
+    try {
+      mtime = fs::last_write_time(dir);
+    } catch (fs::filesystem_error &) {
+      // missing or unreadable directories are treated as empty
+    }
+
+    // Directory times have a resolution of a second, so a listing read in
+    // the second of the last change may already be out of date
+    if (ins.second || mtime != l.mtime || mtime >= l.read_at) {
+      l.mtime = mtime;
+      l.read_at = std::time(0);
+      l.names.clear();
+      try {
+        if (fs::is_directory(dir)) {
+          fs::directory_iterator end;
+          for (fs::directory_iterator di(dir); di != end; ++di)
+            l.names.insert(di->path().filename());
+        }
+      } catch (fs::filesystem_error &) {
+      }
+    }
+
+    return l.names.count(p.filename()) > 0;
+  }
+};
+
 // Create |require| function on container.
 void flusspferd::load_require_function(object container) {
   container.set_property("require", require::create_require());
@@ -86,7 +250,8 @@ void flusspferd::load_require_function(object container) {
 
 
 require::require(object const &fun)
-  : native_function_base(fun)
+  : native_function_base(fun),
+    resolution(new resolution_state)
 { }
 
 // Copy constructor. Keep the same JS objects for the state variables
@@ -96,7 +261,11 @@ require::require(object const &fun, require const &rhs)
     paths(rhs.paths),
     alias(rhs.alias),
     preload(rhs.preload),
-    main(rhs.main)
+    main(rhs.main),
+    compile_cache(rhs.compile_cache),
+    resolve_cache(rhs.resolve_cache),
+    bundles(rhs.bundles),
+    resolution(rhs.resolution)
 { }
 
 require::~require() {}
@@ -123,11 +292,34 @@ object require::create_require() {
   root_object main(create<object>());
   r->main = main;
 
+  root_object compile_cache(create<object>());
+  r->compile_cache = compile_cache;
+
+  std::string cache_dir = default_compile_cache_dir();
+  compile_cache.set_property("enabled", !cache_dir.empty());
+  compile_cache.set_property("directory", cache_dir);
+  compile_cache.set_property("hits", 0);
+  compile_cache.set_property("misses", 0);
+
+  root_object resolve_cache(create<object>());
+  r->resolve_cache = resolve_cache;
+
+  resolve_cache.set_property("enabled", true);
+  resolve_cache.set_property("hits", 0);
+  resolve_cache.set_property("misses", 0);
+
+  root_array bundles(create<array>());
+  r->bundles = bundles;
+
   fn.define_property("module_cache", module_cache, perm_ro);
   fn.define_property("paths", paths, perm_ro);
   fn.define_property("alias", alias, perm_ro);
   fn.define_property("preload", preload, perm_ro);
   fn.define_property("main", main, perm_ro);
+  fn.define_property("compileCache", compile_cache, perm_ro);
+  fn.define_property("resolveCache", resolve_cache, perm_ro);
+  fn.define_property("bundles", bundles, perm_ro);
+  fn.set_property("gcPolicy", "maybe");
 
   return fn;
 }
@@ -157,7 +349,11 @@ void require::set_main_module(std::string const &id_) {
 
   fs::path mod;
   if (type == top_level) {
-    boost::optional<fs::path> mod_ = find_top_level_js_module(id_, true);
+    boost::optional<fs::path> mod_;
+    if (bundle_entry const *bundled = find_bundled(id_, true))
+      mod_ = fs::path(bundled->id.substr(sizeof("file://")-1));
+    else
+      mod_ = find_top_level_js_module(id_, true);
 
     if (!mod_) {
       throw exception(format("unable to find top level module when setting require.main: \"%s\"") % id_);
@@ -186,7 +382,13 @@ void require::call(call_context &x) {
   std::string id = x.arg[0].to_std_string();
   x.result = call_helper(id).get_property("exports");
 
-  gc(true); // maybe-gc
+  // Loading a module leaves a lot of garbage behind. require.gcPolicy is
+  // one of "maybe" (let the engine decide), "always" or "never".
+  std::string const policy = get_property("gcPolicy").to_std_string();
+  if (policy == "always")
+    gc();
+  else if (policy != "never")
+    gc(true); // maybe-gc
 }
 
 // Helper method that returns the cache object. Doing this makes various code
@@ -212,6 +414,14 @@ object require::call_helper(std::string const &id_) {
 
 
 string require::load_module_text(fs::path filename, boost::optional<object> opts) {
+  module_options options;
+  root_string text(read_module_text(filename, options));
+  if (opts)
+    set_module_options(*opts, options);
+  return text;
+}
+
+string require::read_module_text(fs::path filename, module_options &options) {
   root_string read_only("r");
 
   io::file &f = create<io::file>(
@@ -227,9 +437,7 @@ string require::load_module_text(fs::path filename, boost::optional<object> opts
   // Look for a shebang line
   f.read_binary(2, blob);
 
-  binary::vector_type::iterator i, s;
-
-  if (buf[0] == '#' && buf[1] == '!') {
+  if (buf.size() == 2 && buf[0] == '#' && buf[1] == '!') {
     // Shebang line - skip the line, but insert a comment line here to keep
     // source line numbers right
     buf.clear();
@@ -238,99 +446,42 @@ string require::load_module_text(fs::path filename, boost::optional<object> opts
   }
   f.read_whole_binary(blob);
 
+  return decode_module_text(blob, options);
+}
 
-  // Look for coding and option lines. An coding line looks like one of
-  // "// -*- coding:utf-8 -*-"
-  // "// vim:fileencoding=utf-8:"
-  //
-  // An option line looks like
-  // "// flusspferd: -xboo"
-  //
-  // We continue looking until we see a blank comment or a non comment line
-
-  using namespace boost::xpressive;
-  sregex opt_re = sregex::compile("^\\s*([-\\w.]+):\\s*(.*)$");
-  sregex coding_re = sregex::compile("^.*coding[:=]\\s*([-\\w.]+)");
-  sregex empty_line_re = bos >> *_s >> eos;
-
-  // We only want to look for a coding comment on line 1 or 2
-  int look_for_coding = 2;
-  std::string encoding = "UTF-8";
-
-  for (i = buf.begin(); i != buf.end(); ++i) {
-    if (*(i++) != '/' || *(i++) != '/') {
-      // Not a comment line - stop!
-      break;
-    }
-    binary::vector_type::iterator e;
-    e = std::find(i, buf.end(), '\n');
-    if (e == buf.end())
-      break;
-
-    std::string line( reinterpret_cast<char const *>(&*i), std::size_t(e-i) );
-
-    // Move onto next line
-    i = e;
-
-    smatch m;
-    if (look_for_coding-- && regex_match(line, m, coding_re)) {
-      // Huzzah! We have an encoding!
-      encoding = m[1];
-      look_for_coding = 0;
-
-      continue;
-    }
-
-    // Empty comment line - stop looking
-    if (regex_match(line, empty_line_re))
-      break;
-
-    if (opts && regex_match(line, m, opt_re)) {
-      // A line we are interested in, and we have somewhere to store the result
-      opts->set_property(m[1].str(), m[2].str());
-    }
+void require::set_module_options(object opts, module_options const &options) {
+  for (module_options::const_iterator it = options.begin();
+       it != options.end();
+       ++it)
+  {
+    opts.set_property(it->first, it->second);
   }
 
   // If we have "flusspferd" or "warnings" in the option, split them on
   // whitespace like shells do. TODO: Should we just split everything?
-  if (opts) {
-    value v = opts->get_property("flusspferd");
-    if (v.is_string()) {
-      opts->set_property( "flusspferd", split_args_string(v) );
-    }
-
-    v = opts->get_property("warnings");
-    if (v.is_string()) {
-      opts->set_property( "warnings", split_args_string(v) );
-    }
+  value v = opts.get_property("flusspferd");
+  if (v.is_string()) {
+    opts.set_property( "flusspferd", split_args_string(v) );
   }
 
-  return encodings::convert_to_string(encoding, blob);
-
+  v = opts.get_property("warnings");
+  if (v.is_string()) {
+    opts.set_property( "warnings", split_args_string(v) );
+  }
 }
 
 /// Load the given @c filename as a module
-void require::require_js(fs::path filename, std::string const &id, object cache) {
+void require::require_js(fs::path filename, std::string const &id,
+                         object cache, bundle_entry const *bundled)
+{
   bool const old_strict = flusspferd::current_context().set_strict(true);
   BOOST_SCOPE_EXIT((old_strict)) {
     // Reset the strict mode when we leave (the REPL might have it off)
     flusspferd::current_context().set_strict(old_strict);
   } BOOST_SCOPE_EXIT_END;
 
-  root_string module_text(load_module_text(filename, cache.get_property_object("options")));
-
-  std::vector<std::string> argnames;
-  argnames.push_back("exports");
-  argnames.push_back("require");
-  argnames.push_back("module");
-
-  std::string fname = filename.string();
-  root_object fn(create<function>(
-      _name = fname,
-      _argument_names = argnames,
-      _function = module_text,
-      _file = fname.c_str(),
-      _line = 1ul));
+  root_object fn(compile_module(
+    filename, cache.get_property_object("options"), bundled));
 
   root_object module;
 
@@ -350,6 +501,83 @@ void require::require_js(fs::path filename, std::string const &id, object cache)
   fn.call(fn, cache.get_property("exports"), require, module);
 }
 
+/// Compile the module function for @c filename. Compiled functions are kept
+/// in the directory require.compileCache.directory, keyed by path, mtime, size
+/// and engine version, so that unchanged modules are not compiled again.
+/// Bundled modules are taken from the bundle and never touch the filesystem.
+object require::compile_module(
+  fs::path const &filename, object options, bundle_entry const *bundled)
+{
+  std::string fname = filename.string();
+
+  if (bundled) {
+    set_module_options(options, bundled->options);
+
+    binary::element_type const *data = bundled->storage->data();
+    if (bundled->bytecode_size > 0) {
+      root_object fn(deserialize_function(
+        data + bundled->bytecode_offset, bundled->bytecode_size));
+      if (!fn.is_null())
+        return fn;
+    }
+
+    // The source is a view of the mapped bundle, so it is not copied before
+    // decoding
+    byte_string &source = create<byte_string>(
+      fusion::vector3<binary::storage_ptr const &, std::size_t, std::size_t>(
+        bundled->storage, bundled->source_offset, bundled->source_size));
+    root_object s_o(source);
+
+    module_options ignored;
+    root_string module_text(decode_module_text(source, ignored));
+    return compile_module_function(module_text, fname);
+  }
+
+  bool use_cache = compile_cache.get_property("enabled").to_boolean();
+  fs::path cache_file;
+  std::time_t mtime = 0;
+  boost::uintmax_t size = 0;
+
+  if (use_cache) {
+    value dir = compile_cache.get_property("directory");
+    try {
+      use_cache = dir.is_string();
+      if (use_cache) {
+        mtime = fs::last_write_time(filename);
+        size = fs::file_size(filename);
+        cache_file = compile_cache_file(dir.to_std_string(), fname);
+      }
+    } catch (fs::filesystem_error &) {
+      use_cache = false;
+    }
+  }
+
+  module_options opts;
+
+  if (use_cache) {
+    root_object fn(read_compiled_module(cache_file, fname, mtime, size, opts));
+    if (!fn.is_null()) {
+      compile_cache.set_property(
+        "hits", compile_cache.get_property("hits").to_number() + 1);
+      set_module_options(options, opts);
+      return fn;
+    }
+    compile_cache.set_property(
+      "misses", compile_cache.get_property("misses").to_number() + 1);
+    opts.clear();
+  }
+
+  root_string module_text(read_module_text(filename, opts));
+  set_module_options(options, opts);
+
+  root_object fn(compile_module_function(module_text, fname));
+
+  if (use_cache)
+    write_compiled_module(cache_file, fname, mtime, size, opts, fn);
+
+  return fn;
+}
+
 /// What type of require id is @c id
 require::id_classification require::classify_id(std::string const &id) {
   if (algo::starts_with(id, "./") || algo::starts_with(id, "../"))
@@ -386,6 +614,12 @@ object require::load_relative_module(std::string id) {
 
   fs::path module(current_id().substr(sizeof("file://")-1));
 
+  bundle_entry const *bundled = find_bundled(
+    "file://" + normalize_path(module.parent_path() / (id + ".js")).string(),
+    false);
+  if (bundled)
+    return load_bundled_module(*bundled);
+
   module = io::fs_base::canonicalize( module.parent_path() / (id + ".js") );
   id = module.string();
   fs::path dso_path = make_dsoname(module.string());
@@ -472,7 +706,6 @@ static void load_native_module(fs::path const &dso_name, object exports) {
 // We need to check alias and prelaod, and also search the require paths for
 // .js files and DSOs
 object require::load_top_level_module(std::string const &id) {
-  root_array paths(this->paths);
 
   if (alias.has_own_property(id)) {
     std::string const new_id = alias.get_property(id).to_std_string();
@@ -489,6 +722,17 @@ object require::load_top_level_module(std::string const &id) {
     return e;
   }
 
+  // Bundled modules are found without searching require.paths. Preloaded
+  // modules still take precedence.
+  if (preload.is_null() || !preload.get_property(id).is_object()) {
+    if (bundle_entry const *bundled = find_bundled(id, true)) {
+      object cache = load_bundled_module(*bundled);
+      // Cache it under the top level name
+      module_cache.set_property(id, cache);
+      return cache;
+    }
+  }
+
   security &sec = security::get();
 
   ExportsScopeGuard scope_guard(module_cache, id);
@@ -514,15 +758,11 @@ object require::load_top_level_module(std::string const &id) {
     }
   }
 
-  std::size_t const len = paths.length();
   bool found = false;
 
   fs::path dso_name = make_dsoname(id);
 
-  for (std::size_t i = 0; i < len; i++) {
-    fs::path path = paths.get_element(i).to_std_string();
-    fs::path native_path = io::fs_base::canonicalize( path / dso_name );
-
+  BOOST_FOREACH(fs::path const &native_path, find_in_paths(dso_name)) {
     std::string new_id = "file://" + native_path.string();
     if (module_cache.has_own_property(new_id)) {
       // This dso is already cached.
@@ -533,9 +773,7 @@ object require::load_top_level_module(std::string const &id) {
       scope_guard.exit_cleanly();
       return cache;
     }
-    else if (sec.check_path(native_path.string(), security::READ) &&
-        fs::exists(native_path) )
-    {
+    else if (sec.check_path(native_path.string(), security::READ)) {
       found = true;
       dso_name = native_path;
       load_native_module(native_path, cache.get_property_object("exports"));
@@ -576,25 +814,17 @@ object require::load_top_level_module(std::string const &id) {
 
 boost::optional<fs::path>
 require::find_top_level_js_module(std::string const &id, bool fatal) {
-  root_array paths(this->paths);
-
-  fs::path js_name = fs::path(id + ".js");
-
-  std::size_t const len = paths.length();
+  fs::path const js_name(id + ".js");
 
-  for (std::size_t i = 0; i < len; i++) {
-    fs::path path = paths.get_element(i).to_std_string();
+  std::vector<fs::path> found = find_in_paths(js_name);
+  if (!found.empty())
+    return found.front();
 
-    fs::path js_path = io::fs_base::canonicalize( path / js_name );
-
-    // Check if we loaded something by this name previously, even if the file
-    // doesn't exist anymore
-    std::string const new_id = "file://" + js_path.string();
-    if (module_cache.has_own_property(new_id)) {
-      return js_path;
-    }
-
-    if ( fs::exists(js_path) )
+  // Check if we loaded something by this name previously, even if the file
+  // doesn't exist anymore
+  BOOST_FOREACH(std::string const &dir, resolution->paths) {
+    fs::path js_path = io::fs_base::canonicalize(fs::path(dir) / js_name);
+    if (module_cache.has_own_property("file://" + js_path.string()))
       return js_path;
   }
 
@@ -607,6 +837,83 @@ require::find_top_level_js_module(std::string const &id, bool fatal) {
   return boost::none;
 }
 
+std::vector<fs::path> require::find_in_paths(fs::path const &name) {
+  resolution_state &r = *resolution;
+  r.sync(array(paths));
+
+  bool const enabled = resolve_cache.get_property("enabled").to_boolean();
+
+  if (enabled) {
+    resolution_state::result_map::const_iterator it =
+      r.results.find(name.string());
+    if (it != r.results.end() && !it->second.empty()) {
+      resolve_cache.set_property(
+        "hits", resolve_cache.get_property("hits").to_number() + 1);
+      return it->second;
+    }
+    resolve_cache.set_property(
+      "misses", resolve_cache.get_property("misses").to_number() + 1);
+  }
+
+  std::vector<fs::path> found;
+  BOOST_FOREACH(std::string const &dir, r.paths) {
+    fs::path candidate = fs::path(dir) / name;
+    if (enabled ? r.exists(candidate) : fs::exists(candidate))
+      found.push_back(io::fs_base::canonicalize(candidate));
+  }
+
+  if (enabled && !found.empty())
+    r.results[name.string()] = found;
+
+  return found;
+}
+
+require::bundle_entry const *
+require::find_bundled(std::string const &id, bool top_level_name) {
+  resolution_state &r = *resolution;
+  r.sync_bundles(array(bundles));
+
+  if (r.bundled.empty())
+    return 0;
+
+  std::string key = id;
+  if (top_level_name) {
+    std::map<std::string, std::string>::const_iterator it =
+      r.bundled_names.find(id);
+    if (it == r.bundled_names.end())
+      return 0;
+    key = it->second;
+  }
+
+  resolution_state::bundle_map::const_iterator it = r.bundled.find(key);
+  return it == r.bundled.end() ? 0 : &it->second;
+}
+
+object require::load_bundled_module(bundle_entry const &entry) {
+  if (module_cache.has_own_property(entry.id))
+    return module_cache.get_property_object(entry.id);
+
+  // The module may change require.bundles, so don't refer to the index
+  bundle_entry const bundled(entry);
+
+  ExportsScopeGuard scope_guard(module_cache, bundled.id);
+
+  // The object we store in module_cache
+  object cache = create_cache_entry(bundled.id);
+
+  if (!bundled.native.empty()) {
+    if (!security::get().check_path(bundled.native, security::READ))
+      throw exception(format(load_error_fmt) % bundled.native % "access denied");
+    load_native_module(bundled.native, cache.get_property_object("exports"));
+  }
+
+  require_js(bundled.id.substr(sizeof("file://")-1), bundled.id, cache, &bundled);
+
+  scope_guard.exit_cleanly();
+
+  return cache;
+}
+
 object require::create_cache_entry(std::string const &id) {
 
   // module_cache[id] = {};
@@ -646,6 +953,12 @@ object require::load_absolute_module(std::string id) {
   security &sec = security::get();
 
   id = id.substr(sizeof("file://")-1);
+
+  bundle_entry const *bundled =
+    find_bundled("file://" + normalize_path(id).string(), false);
+  if (bundled)
+    return load_bundled_module(*bundled);
+
   fs::path path = io::fs_base::canonicalize( id );
   id = "file://" + id;
 
@@ -672,6 +985,513 @@ object require::load_absolute_module(std::string id) {
 }
 
 namespace {
+// -- compiled module cache --------------------------------------------------
+//
+// A cache file contains the source path, mtime and size, the bytecode
+// version, the option lines of the module and the serialized function. Any
+// mismatch or error is treated as a cache miss.
+
+static char const compile_cache_magic[] = "flusspferd-compiled-module-1";
+
+// Numbers the temporary files cache entries are written to
+static boost::detail::atomic_count compile_cache_tmp_counter(0);
+
+class cache_writer {
+public:
+  void put_number(boost::uint64_t n) {
+    for (int i = 0; i < 8; ++i)
+      data += char((n >> (8 * i)) & 0xff);
+  }
+
+  void put_string(std::string const &s) {
+    put_number(s.size());
+    data += s;
+  }
+
+  std::string data;
+};
+
+class cache_reader {
+public:
+  cache_reader(std::vector<unsigned char> const &buf)
+    : p(buf.empty() ? 0 : &buf[0]), e(p + buf.size())
+  {}
+
+  cache_reader(unsigned char const *begin, unsigned char const *end)
+    : p(begin), e(end)
+  {}
+
+  bool get_number(boost::uint64_t &n) {
+    if (e - p < 8)
+      return false;
+    n = 0;
+    for (int i = 0; i < 8; ++i)
+      n |= boost::uint64_t(p[i]) << (8 * i);
+    p += 8;
+    return true;
+  }
+
+  bool get_string(std::string &s) {
+    boost::uint64_t n;
+    if (!get_number(n) || boost::uint64_t(e - p) < n)
+      return false;
+    s.assign(reinterpret_cast<char const *>(p), std::size_t(n));
+    p += n;
+    return true;
+  }
+
+  unsigned char const *p;
+  unsigned char const *e;
+};
+
+static std::string default_compile_cache_dir() {
+  // An empty $FLUSSPFERD_COMPILE_CACHE disables the cache
+  char const *dir = std::getenv("FLUSSPFERD_COMPILE_CACHE");
+  if (dir)
+    return dir;
+
+  dir = std::getenv("XDG_CACHE_HOME");
+  if (dir && *dir)
+    return (fs::path(dir) / "flusspferd").string();
+
+  dir = std::getenv("HOME");
+  if (dir && *dir)
+    return (fs::path(dir) / ".cache" / "flusspferd").string();
+
+  return std::string();
+}
+
+static fs::path compile_cache_file(
+  std::string const &dir, std::string const &source)
+{
+  // 64 bit FNV-1a hash of the path
+  boost::uint64_t hash = 14695981039346656037ULL;
+  for (std::string::const_iterator it = source.begin(); it != source.end(); ++it)
+  {
+    hash ^= static_cast<unsigned char>(*it);
+    hash *= 1099511628211ULL;
+  }
+
+  char name[32];
+  std::sprintf(name, "%016llx.jsc", static_cast<unsigned long long>(hash));
+  return fs::path(dir) / name;
+}
+
+static object read_compiled_module(
+  fs::path const &cache_file, std::string const &source,
+  std::time_t mtime, boost::uintmax_t size, require::module_options &options)
+{
+  std::ifstream in(cache_file.string().c_str(), std::ios::in | std::ios::binary);
+  if (!in)
+    return object();
+
+  std::vector<unsigned char> buf(
+    (std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+  cache_reader r(buf);
+  std::string s;
+  boost::uint64_t n;
+
+  if (!r.get_string(s) || s != compile_cache_magic)
+    return object();
+  if (!r.get_string(s) || s != bytecode_version())
+    return object();
+  if (!r.get_string(s) || s != source)
+    return object();
+  if (!r.get_number(n) || n != boost::uint64_t(mtime))
+    return object();
+  if (!r.get_number(n) || n != boost::uint64_t(size))
+    return object();
+
+  if (!r.get_number(n))
+    return object();
+  for (; n > 0; --n) {
+    std::string name, value;
+    if (!r.get_string(name) || !r.get_string(value))
+      return object();
+    options.push_back(std::make_pair(name, value));
+  }
+
+  return deserialize_function(r.p, r.e - r.p);
+}
+
+static void write_compiled_module(
+  fs::path const &cache_file, std::string const &source,
+  std::time_t mtime, boost::uintmax_t size,
+  require::module_options const &options, object const &fn)
+{
+  std::vector<unsigned char> bytecode;
+  if (!serialize_function(fn, bytecode))
+    return;
+
+  cache_writer w;
+  w.put_string(compile_cache_magic);
+  w.put_string(bytecode_version());
+  w.put_string(source);
+  w.put_number(mtime);
+  w.put_number(size);
+  w.put_number(options.size());
+  for (require::module_options::const_iterator it = options.begin();
+       it != options.end();
+       ++it)
+  {
+    w.put_string(it->first);
+    w.put_string(it->second);
+  }
+  w.data.append(bytecode.begin(), bytecode.end());
+
+  // Write to a temporary file and rename it, so that other processes never
+  // see a partially written cache file. Failing to write the cache is not an
+  // error.
+  try {
+    fs::create_directories(cache_file.parent_path());
+
+    // Workers in the same process may write the same module at the same
+    // time, so the name is unique per writer
+    std::ostringstream tmp_name;
+    tmp_name << cache_file.string() << ".tmp";
+#ifndef WIN32
+    tmp_name << getpid() << '.';
+#endif
+    tmp_name << boost::this_thread::get_id() << '.'
+             << ++compile_cache_tmp_counter;
+    std::string tmp = tmp_name.str();
+
+    {
+      std::ofstream out(tmp.c_str(), std::ios::out | std::ios::binary);
+      out.write(w.data.data(), w.data.size());
+      out.close();
+      if (!out) {
+        fs::remove(tmp);
+        return;
+      }
+    }
+
+    fs::rename(tmp, cache_file);
+  } catch (fs::filesystem_error &) {
+  }
+}
+
+// -- module bundles ---------------------------------------------------------
+//
+// A bundle starts with an index: the magic string, the bytecode version and
+// the number of modules, then for every module its canonical id, the DSO to
+// load along with it, the top-level names it can be required by, its option
+// lines, and the offset and size of its source and bytecode. Offsets count
+// from the end of the index. The sources have their shebang line replaced
+// already.
+
+static char const bundle_magic[] = "flusspferd-bundle-1";
+}
+
+void require::resolution_state::read_bundle(
+  std::string const &file, bundle_map &entries,
+  std::map<std::string, std::string> &names)
+{
+  if (!security::get().check_path(file, security::READ))
+    throw exception(format(bundle_error_fmt) % file % "access denied");
+
+  binary::storage_ptr storage(binary::map_file(file));
+  cache_reader r(storage->data(), storage->data() + storage->size());
+
+  std::string s, version;
+  boost::uint64_t count;
+
+  if (!r.get_string(s) || s != bundle_magic)
+    throw exception(format(bundle_error_fmt) % file % "not a module bundle");
+  if (!r.get_string(version) || !r.get_number(count))
+    throw exception(format(bundle_error_fmt) % file % "truncated index");
+
+  std::vector<bundle_entry> modules;
+  std::vector<std::vector<std::string> > module_names;
+  std::vector<boost::uint64_t> offsets;
+
+  for (; count > 0; --count) {
+    bundle_entry e;
+    std::vector<std::string> n_;
+    boost::uint64_t n = 0;
+
+    bool ok = r.get_string(e.id) && r.get_string(e.native) && r.get_number(n);
+    for (; ok && n > 0; --n) {
+      ok = r.get_string(s);
+      n_.push_back(s);
+    }
+    ok = ok && r.get_number(n);
+    for (; ok && n > 0; --n) {
+      std::string name, value;
+      ok = r.get_string(name) && r.get_string(value);
+      e.options.push_back(std::make_pair(name, value));
+    }
+    for (int i = 0; ok && i < 4; ++i) {
+      ok = r.get_number(n);
+      offsets.push_back(n);
+    }
+    if (!ok)
+      throw exception(format(bundle_error_fmt) % file % "truncated index");
+
+    modules.push_back(e);
+    module_names.push_back(n_);
+  }
+
+  std::size_t const base = r.p - storage->data();
+  boost::uint64_t const size = r.e - r.p;
+  bool const use_bytecode = version == bytecode_version();
+
+  for (std::size_t i = 0; i < modules.size(); ++i) {
+    boost::uint64_t const *o = &offsets[4 * i];
+    if (o[0] > size || o[1] > size - o[0] || o[2] > size || o[3] > size - o[2])
+      throw exception(format(bundle_error_fmt) % file % "corrupt module data");
+
+    bundle_entry &e = modules[i];
+    e.storage = storage;
+    e.source_offset = base + std::size_t(o[0]);
+    e.source_size = std::size_t(o[1]);
+    e.bytecode_offset = base + std::size_t(o[2]);
+    e.bytecode_size = use_bytecode ? std::size_t(o[3]) : 0;
+
+    if (!entries.insert(bundle_map::value_type(e.id, e)).second)
+      continue;
+    BOOST_FOREACH(std::string const &name, module_names[i])
+      names.insert(std::make_pair(name, e.id));
+  }
+}
+
+void require::write_bundle(
+  std::vector<std::string> const &roots, std::string const &output)
+{
+  using namespace boost::xpressive;
+  static sregex const require_re = sregex::compile(
+    "\\brequire\\s*\\(\\s*(?:'([^'\\\\\\n]*)'|\"([^\"\\\\\\n]*)\")\\s*\\)");
+
+  if (!security::get().check_path(output, security::WRITE))
+    throw exception("Unable to write module bundle '" + output + "': access denied");
+
+  // Modules in the order they were found, the top-level names they were
+  // required by and the DSOs that go with them
+  std::vector<std::string> found;
+  std::set<std::string> seen;
+  std::map<std::string, std::set<std::string> > names;
+  std::map<std::string, std::string> natives;
+
+  // Ids still to resolve, with the directory of the module requiring them
+  std::vector<std::pair<std::string, fs::path> > todo;
+  BOOST_FOREACH(std::string const &root, roots)
+    todo.push_back(std::make_pair(root, fs::path()));
+
+  for (std::size_t i = 0; i < todo.size(); ++i) {
+    std::string id = todo[i].first;
+    fs::path const dir = todo[i].second;
+    std::string name;
+    fs::path js, dso;
+
+    switch (classify_id(id)) {
+    case relative:
+      if (dir.empty())
+        throw exception("Cannot bundle relative module id '" + id + "'");
+      js = dir / (id + ".js");
+      dso = make_dsoname(js.string());
+      break;
+    case fully_qualified:
+      js = id.substr(sizeof("file://")-1);
+      break;
+    case top_level:
+    default:
+      // Resolve like load_top_level_module, but don't loop forever
+      for (int n = 0; n < 100 && alias.has_own_property(id); ++n)
+        id = alias.get_property(id).to_std_string();
+      if (classify_id(id) != top_level)
+        continue;
+      if (!preload.is_null() && preload.get_property(id).is_object())
+        continue;
+
+      name = id;
+      std::vector<fs::path> candidates = find_in_paths(fs::path(id + ".js"));
+      if (candidates.empty())
+        continue;
+      js = candidates.front();
+      candidates = find_in_paths(make_dsoname(id));
+      if (!candidates.empty())
+        dso = candidates.front();
+      break;
+    }
+
+    // Ids that can't be resolved now (optional or native-only modules, or
+    // no require call at all) are left to the filesystem at runtime
+    if (js.extension() == FLUSSPFERD_MODULE_SUFFIX || !fs::exists(js))
+      continue;
+
+    std::string const path = io::fs_base::canonicalize(js).string();
+    if (!dso.empty() && fs::exists(dso))
+      natives[path] = io::fs_base::canonicalize(dso).string();
+    if (!name.empty())
+      names[path].insert(name);
+
+    if (!seen.insert(path).second)
+      continue;
+    found.push_back(path);
+
+    std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+    std::string const text(
+      (std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    fs::path const module_dir = fs::path(path).parent_path();
+    sregex_iterator const end;
+    for (sregex_iterator m(text.begin(), text.end(), require_re); m != end; ++m)
+    {
+      std::string const dep = (*m)[1].matched ? (*m)[1].str() : (*m)[2].str();
+      todo.push_back(std::make_pair(dep, module_dir));
+    }
+  }
+
+  cache_writer index, data;
+  index.put_string(bundle_magic);
+  index.put_string(bytecode_version());
+  index.put_number(found.size());
+
+  BOOST_FOREACH(std::string const &path, found) {
+    module_options options;
+    root_string text(read_module_text(path, options));
+
+    // Modules the engine can't serialize are stored as source only
+    std::vector<unsigned char> bytecode;
+    root_object fn(compile_module_function(text, path));
+    serialize_function(fn, bytecode);
+
+    std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+    std::string source(
+      (std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (source.size() >= 2 && source[0] == '#' && source[1] == '!')
+      source.replace(0, 2, "//");
+
+    index.put_string("file://" + path);
+    index.put_string(natives[path]);
+
+    std::set<std::string> const &n = names[path];
+    index.put_number(n.size());
+    BOOST_FOREACH(std::string const &name, n)
+      index.put_string(name);
+
+    index.put_number(options.size());
+    for (module_options::const_iterator it = options.begin();
+         it != options.end();
+         ++it)
+    {
+      index.put_string(it->first);
+      index.put_string(it->second);
+    }
+
+    index.put_number(data.data.size());
+    index.put_number(source.size());
+    data.data += source;
+
+    index.put_number(data.data.size());
+    index.put_number(bytecode.size());
+    data.data.append(bytecode.begin(), bytecode.end());
+  }
+
+  std::ofstream out(output.c_str(), std::ios::out | std::ios::binary);
+  out.write(index.data.data(), index.data.size());
+  out.write(data.data.data(), data.data.size());
+  out.close();
+  if (!out)
+    throw exception("Unable to write module bundle '" + output + "'");
+}
+
+namespace {
+static string decode_module_text(binary &blob, require::module_options &options) {
+  std::string const encoding =
+    parse_module_header(blob.const_begin(), blob.const_end(), options);
+  return encodings::convert_to_string(encoding, blob);
+}
+
+static std::string parse_module_header(
+  binary::element_type const *begin, binary::element_type const *end,
+  require::module_options &options)
+{
+  // Look for coding and option lines. An coding line looks like one of
+  // "// -*- coding:utf-8 -*-"
+  // "// vim:fileencoding=utf-8:"
+  //
+  // An option line looks like
+  // "// flusspferd: -xboo"
+  //
+  // We continue looking until we see a blank comment or a non comment line
+
+  using namespace boost::xpressive;
+  static sregex const opt_re = sregex::compile("^\\s*([-\\w.]+):\\s*(.*)$");
+  static sregex const coding_re = sregex::compile("^.*coding[:=]\\s*([-\\w.]+)");
+  static sregex const empty_line_re = bos >> *_s >> eos;
+
+  // We only want to look for a coding comment on line 1 or 2
+  int look_for_coding = 2;
+  std::string encoding = "UTF-8";
+
+  for (binary::element_type const *i = begin; i != end; ++i) {
+    if (end - i < 2 || i[0] != '/' || i[1] != '/') {
+      // Not a comment line - stop!
+      break;
+    }
+    i += 2;
+
+    binary::element_type const *e = std::find(i, end, '\n');
+    if (e == end)
+      break;
+
+    std::string line( reinterpret_cast<char const *>(i), std::size_t(e-i) );
+
+    // Move onto next line
+    i = e;
+
+    smatch m;
+    if (look_for_coding-- && regex_match(line, m, coding_re)) {
+      // Huzzah! We have an encoding!
+      encoding = m[1];
+      look_for_coding = 0;
+
+      continue;
+    }
+
+    // Empty comment line - stop looking
+    if (regex_match(line, empty_line_re))
+      break;
+
+    if (regex_match(line, m, opt_re)) {
+      // A line we are interested in
+      options.push_back(std::make_pair(m[1].str(), m[2].str()));
+    }
+  }
+
+  return encoding;
+}
+
+static object compile_module_function(string const &text, std::string const &fname) {
+  std::vector<std::string> argnames;
+  argnames.push_back("exports");
+  argnames.push_back("require");
+  argnames.push_back("module");
+
+  return create<function>(
+      _name = fname,
+      _argument_names = argnames,
+      _function = text,
+      _file = fname.c_str(),
+      _line = 1ul);
+}
+
+// Remove "." and ".." segments without looking at the filesystem
+static fs::path normalize_path(fs::path const &p) {
+  fs::path result;
+  BOOST_FOREACH(fs::path seg, p) {
+    if (seg == ".")
+      continue;
+    if (seg == "..")
+      result = result.parent_path();
+    else
+      result /= seg;
+  }
+  return result;
+}
+
 static fs::path make_dsoname(std::string const &id) {
   fs::path p(id);
 
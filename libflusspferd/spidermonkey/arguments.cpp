@@ -28,51 +28,80 @@ THE SOFTWARE.
 #include "flusspferd/exception.hpp"
 #include "flusspferd/object.hpp"
 #include "flusspferd/value.hpp"
+#include "flusspferd/spidermonkey/init.hpp"
 #include <boost/foreach.hpp>
+#include <algorithm>
 #include <cassert>
 #include <js/jsapi.h>
 
 using namespace flusspferd;
 
 Impl::arguments_impl::arguments_impl(std::vector<value> const &vals)
-  : n(vals.size()), argv(0)
+  : n(0), argv(inline_values), user(true), root_prev(0), root_next(0)
 {
-  values.reserve(n);
-  if (n > 0) {
-    BOOST_FOREACH(value const &v, vals) {
-      values.push_back(get_jsval(v));
-    }
-    argv = &values[0];
+  BOOST_FOREACH(value const &v, vals) {
+    push(get_jsval(v));
   }
 }
 
 Impl::arguments_impl::arguments_impl(Impl::arguments_impl const &o)
-  : values(o.values), n(o.n),
-    argv(o.is_userprovided() ? 0 : o.argv)
+  : n(0), argv(inline_values), user(true), root_prev(0), root_next(0)
 {
-  if (!argv)
-    reset_argv();
+  assign(o);
 }
 
 Impl::arguments_impl &Impl::arguments_impl::operator=(arguments_impl const &o) {
   if(&o != this) {
-    n = o.n;
-    if(o.is_userprovided()) {
-      values = o.values;
-      reset_argv();
-    }
-    else {
-      values.clear();
-      argv = o.argv;
-    }
+    remove_root();
+    spill.clear();
+    assign(o);
   }
   return *this;
 }
 
-void Impl::arguments_impl::reset_argv() {
-  //assert(is_userprovided());
-  n = values.size();
-  argv = n >  0 ? &values[0] : 0;
+void Impl::arguments_impl::assign(arguments_impl const &o) {
+  user = o.user;
+  n = o.n;
+  if (!user) {
+    argv = o.argv;
+    return;
+  }
+  if (n <= inline_capacity) {
+    std::copy(o.argv, o.argv + n, inline_values);
+    argv = inline_values;
+  } else {
+    spill.assign(o.argv, o.argv + n);
+    argv = &spill[0];
+  }
+  if (o.root_prev)
+    add_root();
+}
+
+void Impl::arguments_impl::push_spill(jsval v) {
+  if (spill.empty()) {
+    spill.reserve(2 * inline_capacity);
+    spill.assign(inline_values, inline_values + n);
+  }
+  spill.push_back(v);
+  ++n;
+  argv = &spill[0];
+}
+
+void Impl::arguments_impl::add_root() {
+  if (root_prev)
+    return;
+  arguments_impl *&first = get_arguments_roots();
+  root_next = first;
+  root_prev = &first;
+  if (first)
+    first->root_prev = &root_next;
+  first = this;
+}
+
+void Impl::trace_arguments_roots(JSTracer *trc, arguments_impl *p) {
+  for (; p; p = p->root_next)
+    for (std::size_t i = 0; i < p->n; ++i)
+      JS_CALL_VALUE_TRACER(trc, p->argv[i], "arguments");
 }
 
 arguments::arguments(std::vector<value> const &v)
@@ -96,16 +125,14 @@ value arguments::operator[](std::size_t i) {
 void arguments::push_back(value const &v) {
   if(!is_userprovided())
     throw exception("trying to push data into system provided argument list");
-  data().push_back(Impl::get_jsval(v));
-  reset_argv();
+  push(Impl::get_jsval(v));
 }
 
 void arguments::push_root(value const &v) {
   if(!is_userprovided())
     throw exception("trying to push data into system provided argument list");
-  roots.push_back(boost::shared_ptr<root_value>(new root_value(v)));
-  data().push_back(Impl::get_jsval(v));
-  reset_argv();
+  push(Impl::get_jsval(v));
+  add_root();
 }
     
 value arguments::back() {
@@ -27,6 +27,7 @@ THE SOFTWARE.
 #include "flusspferd/context.hpp"
 #include "flusspferd/object.hpp"
 #include "flusspferd/exception.hpp"
+#include "flusspferd/external_memory.hpp"
 #include "flusspferd/local_root_scope.hpp"
 #include "flusspferd/create/object.hpp"
 #include "flusspferd/spidermonkey/context.hpp"
@@ -37,6 +38,7 @@ THE SOFTWARE.
 #include <boost/foreach.hpp>
 #include <boost/unordered_map.hpp>
 #include <boost/thread/tss.hpp>
+#include <boost/thread/mutex.hpp>
 #include <cstring>
 #include <cstdio>
 #include <iostream>
@@ -66,10 +68,17 @@ namespace {
 }
 
 struct context::context_private {
+  context_private() : interrupted(false) {}
+
   typedef boost::shared_ptr<root_object> root_object_ptr;
   boost::unordered_map<std::string, root_object_ptr> prototypes;
   boost::unordered_map<std::string, root_object_ptr> constructors;
+  boost::unordered_map<std::string, root_object_ptr> caches;
   size_t stack_limit_bytes;
+
+  // Set from other threads by context::interrupt
+  boost::mutex interrupt_mutex;
+  bool interrupted;
 };
 
 /// impl provides the hidden implementation part
@@ -113,6 +122,7 @@ public:
       throw exception("Could not initialize Global Object");
 
     JS_SetContextPrivate(context, static_cast<void*>(new context_private));
+    JS_SetOperationCallback(context, &operation_callback);
   }
 
   explicit impl(JSContext *context)
@@ -135,6 +145,16 @@ public:
     return static_cast<context_private*>(JS_GetContextPrivate(context));
   }
 
+  // Returning false terminates the running script without an exception
+  static JSBool operation_callback(JSContext *cx) {
+    context_private *priv =
+      static_cast<context_private*>(JS_GetContextPrivate(cx));
+    if (!priv)
+      return JS_TRUE;
+    boost::mutex::scoped_lock lock(priv->interrupt_mutex);
+    return priv->interrupted ? JS_FALSE : JS_TRUE;
+  }
+
   static void spidermonkey_error_reporter(JSContext *cx, char const *message, JSErrorReport *report) {
     if (!report || JSREPORT_IS_EXCEPTION(report->flags)) {
       return;
@@ -270,6 +290,16 @@ object context::prototype(std::string const &name) const {
   return ptr ? *ptr : object();
 }
 
+void context::set_cache(std::string const &name, object const &obj) {
+  p->get_private()->caches[name] =
+    context_private::root_object_ptr(new root_object(obj));
+}
+
+object context::cache(std::string const &name) const {
+  context_private::root_object_ptr ptr = p->get_private()->caches[name];
+  return ptr ? *ptr : object();
+}
+
 void context::add_constructor(std::string const &name, object const &ctor) {
   p->get_private()->constructors[name] =
     context_private::root_object_ptr(new root_object(ctor));
@@ -287,6 +317,26 @@ void context::gc(bool maybe) {
     JS_MaybeGC(p->context);
 }
 
+void context::report_external_alloc(std::size_t bytes, char const *category) {
+  external_memory::update_total(category, bytes, 0);
+  JS_updateMallocCounter(p->context, bytes);
+}
+
+void context::report_external_free(std::size_t bytes, char const *category) {
+  // SpiderMonkey has no way to lower the malloc counter, it is reset by the
+  // next collection anyway.
+  external_memory::update_total(category, 0, bytes);
+}
+
+void context::interrupt() {
+  context_private *priv = p->get_private();
+  {
+    boost::mutex::scoped_lock lock(priv->interrupt_mutex);
+    priv->interrupted = true;
+  }
+  JS_TriggerOperationCallback(p->context);
+}
+
 void context::set_thread() {
 #ifdef JS_THREADSAFE
   assert(JS_SetContextThread(p->context) == 0);
@@ -29,6 +29,7 @@ THE SOFTWARE.
 #include "flusspferd/context.hpp"
 #include "flusspferd/object.hpp"
 #include "flusspferd/spidermonkey/init.hpp"
+#include "flusspferd/spidermonkey/arguments.hpp"
 #include <boost/thread/tss.hpp>
 #include <boost/thread/once.hpp>
 #include <js/jsapi.h>
@@ -42,12 +43,22 @@ using namespace flusspferd;
 
 static boost::thread_specific_ptr<init> p_instance;
 
+#ifdef FLUSSPFERD_HAVE_THREAD_KEYWORD
+// JSContext of the current context of this thread. Native callbacks read it
+// on every call, so it is kept in a plain TLS slot rather than behind the
+// thread_specific_ptr above. FLUSSPFERD_HAVE_THREAD_KEYWORD is set by the
+// build when the compiler accepts __thread.
+static __thread JSContext *p_current_context = 0;
+#define FLUSSPFERD_HAVE_TLS
+#endif
+
 static boost::once_flag runtime_created = BOOST_ONCE_INIT;
 
 class init::impl {
 public:
   // we use a single JS_Runtime for each thread!
   impl()
+    : arguments_roots(0)
   {
     boost::call_once(runtime_created, JS_SetCStringsAreUTF8);
 
@@ -58,13 +69,21 @@ public:
     if (!runtime) {
       throw std::runtime_error("Could not create Spidermonkey Runtime");
     }
+
+    JS_SetExtraGCRoots(runtime, &trace_extra_roots, this);
   }
   ~impl() {
     JS_DestroyRuntime(runtime);
   }
 
+  static void trace_extra_roots(JSTracer *trc, void *data) {
+    Impl::trace_arguments_roots(
+      trc, static_cast<impl*>(data)->arguments_roots);
+  }
+
   JSRuntime *runtime;
   context current_context;
+  Impl::arguments_impl *arguments_roots;
 
 };
 
@@ -72,12 +91,28 @@ struct init::detail {
   static JSRuntime *get(init &in) {
     return in.p->runtime;
   }
+
+  static Impl::arguments_impl *&get_arguments_roots(init &in) {
+    return in.p->arguments_roots;
+  }
 };
 
+JSContext *Impl::current_context() {
+#ifdef FLUSSPFERD_HAVE_TLS
+  return p_current_context;
+#else
+  return get_context(flusspferd::current_context());
+#endif
+}
+
 JSRuntime *Impl::get_runtime() {
   return init::detail::get(init::initialize());
 }
 
+Impl::arguments_impl *&Impl::get_arguments_roots() {
+  return init::detail::get_arguments_roots(init::initialize());
+}
+
 init &init::initialize() {
   if (!p_instance.get())
     p_instance.reset(new init);
@@ -90,12 +125,18 @@ init::~init() {}
 context init::enter_current_context(context const &c) {
   context old = p->current_context;
   p->current_context = c;
+#ifdef FLUSSPFERD_HAVE_TLS
+  p_current_context = c.is_valid() ? Impl::get_context(p->current_context) : 0;
+#endif
   return old;
 }
 
 bool init::leave_current_context(context const &c) {
   if (c == p->current_context) {
     p->current_context = context();
+#ifdef FLUSSPFERD_HAVE_TLS
+    p_current_context = 0;
+#endif
     return true;
   } else {
     return !p->current_context.is_valid();
@@ -32,7 +32,6 @@ THE SOFTWARE.
 #include "flusspferd/tracer.hpp"
 #include "flusspferd/spidermonkey/init.hpp"
 #include "flusspferd/spidermonkey/context.hpp"
-#include "flusspferd/current_context_scope.hpp"
 #include <boost/foreach.hpp>
 #include <js/jsapi.h>
 
@@ -135,7 +134,7 @@ JSBool native_function_base::impl::call_helper(
     JSContext *ctx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
 {
   FLUSSPFERD_CALLBACK_BEGIN {
-    current_context_scope scope(Impl::wrap_context(ctx));
+    Impl::callback_context_scope scope(ctx);
 
     JSObject *function = JSVAL_TO_OBJECT(argv[-2]);
 
@@ -189,14 +188,14 @@ void native_function_base::impl::trace_op(
   }
 
   if (self) {
-    current_context_scope scope(Impl::wrap_context(ctx));
+    Impl::callback_context_scope scope(ctx);
     tracer tracer_(trc);
     self->trace(tracer_);
   }
 }
 
 void native_function_base::impl::finalize(JSContext *ctx, JSObject *priv) {
-  current_context_scope scope(Impl::wrap_context(ctx));
+  Impl::callback_context_scope scope(ctx);
 
   native_function_base *self = (native_function_base *)
     JS_GetInstancePrivate(ctx, priv, &function_priv_class, 0);
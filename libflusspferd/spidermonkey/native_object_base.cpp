@@ -31,14 +31,35 @@ THE SOFTWARE.
 #include "flusspferd/call_context.hpp"
 #include "flusspferd/root.hpp"
 #include "flusspferd/exception.hpp"
-#include "flusspferd/current_context_scope.hpp"
 #include "flusspferd/spidermonkey/init.hpp"
 #include "flusspferd/spidermonkey/jsid.hpp"
 #include <boost/unordered_map.hpp>
 #include <boost/variant.hpp>
+#include <js/jsdbgapi.h>
+#include <js/jsopcode.h>
 
 using namespace flusspferd;
 
+namespace {
+  // Whether the property is looked up by the "in" operator or by native code,
+  // rather than read or written by the current script operation. Natives
+  // like hasOwnProperty run without a frame of their own, so the script is
+  // then at the call.
+  bool testing_lookup(JSContext *ctx) {
+    JSStackFrame *iter = 0;
+    JSStackFrame *fp = JS_FrameIterator(ctx, &iter);
+    if (!fp || JS_IsNativeFrame(ctx, fp))
+      return true;
+
+    jsbytecode *pc = JS_GetFramePC(ctx, fp);
+    if (!pc)
+      return true;
+
+    JSOp op = JSOp(*pc);
+    return op == JSOP_IN || (js_CodeSpec[op].format & JOF_INVOKE);
+  }
+}
+
 class native_object_base::impl {
 public:
   static void finalize(JSContext *ctx, JSObject *obj);
@@ -58,6 +79,23 @@ public:
   static JSBool new_enumerate(JSContext *cx, JSObject *obj,
     JSIterateOp enum_op, jsval *statep, jsid *idp);
 
+  // The native object stored in obj, or 0 if obj is not a native object.
+  // Checks the class directly, without wrapping obj or throwing.
+  static native_object_base *lookup(JSContext *ctx, JSObject *obj) {
+    JSClass *classp = JS_GET_CLASS(ctx, obj);
+    if (!classp || classp->finalize != &impl::finalize)
+      return 0;
+    return static_cast<native_object_base*>(JS_GetPrivate(ctx, obj));
+  }
+
+  // Like lookup, but throws if obj is not a native object.
+  static native_object_base &get(JSContext *ctx, JSObject *obj) {
+    native_object_base *self = lookup(ctx, obj);
+    if (!self)
+      throw exception("Object is not native");
+    return *self;
+  }
+
 public:
   static JSClass native_object_class;
   static JSClass native_enumerable_object_class;
@@ -141,18 +179,7 @@ bool native_object_base::is_object_native(object const &o_) {
   if (o.is_null())
     return false;
 
-  JSContext *ctx = Impl::current_context();
-  JSObject *jso = Impl::get_object(o);
-  JSClass *classp = JS_GET_CLASS(ctx, jso);
-
-  if (!classp || classp->finalize != &native_object_base::impl::finalize)
-    return false;
-
-  void *priv = JS_GetPrivate(ctx, jso);
-  if (!priv)
-    return false;
-
-  return true;
+  return impl::lookup(Impl::current_context(), Impl::get_object(o));
 }
 
 native_object_base &native_object_base::get_native(object const &o_) {
@@ -161,18 +188,7 @@ native_object_base &native_object_base::get_native(object const &o_) {
   if (o.is_null())
     throw exception("Can not interpret 'null' as native object");
 
-  JSContext *ctx = Impl::current_context();
-  JSObject *jso = Impl::get_object(o);
-  JSClass *classp = JS_GET_CLASS(ctx, jso);
-
-  if (!classp || classp->finalize != &native_object_base::impl::finalize)
-    throw exception("Object is not native");
-
-  void *priv = JS_GetPrivate(ctx, jso);
-  if (!priv)
-    throw exception("Object is not native");
-
-  return *static_cast<native_object_base*>(priv);
+  return impl::get(Impl::current_context(), Impl::get_object(o));
 }
 
 object native_object_base::do_create_object(
@@ -217,7 +233,7 @@ void native_object_base::impl::finalize(JSContext *ctx, JSObject *obj) {
   void *p = JS_GetPrivate(ctx, obj);
 
   if (p) {
-    current_context_scope scope(Impl::wrap_context(ctx));
+    Impl::callback_context_scope scope(ctx);
     delete static_cast<native_object_base*>(p);
   }
 }
@@ -226,17 +242,15 @@ JSBool native_object_base::impl::call_helper(
     JSContext *ctx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
 {
   FLUSSPFERD_CALLBACK_BEGIN {
-    current_context_scope scope(Impl::wrap_context(ctx));
+    Impl::callback_context_scope scope(ctx);
 
     JSObject *function = JSVAL_TO_OBJECT(argv[-2]);
 
-    native_object_base *self = 0;
-    
-    try {
-      self = &native_object_base::get_native(Impl::wrap_object(obj));
-    } catch (exception &) {
-      self = &native_object_base::get_native(Impl::wrap_object(function));
-    }
+    // Either the object itself is called, or it is the private of a
+    // function object (the constructor of a native class).
+    native_object_base *self = obj ? lookup(ctx, obj) : 0;
+    if (!self)
+      self = &get(ctx, function);
 
     call_context x;
 
@@ -260,10 +274,9 @@ JSBool native_object_base::impl::property_op(
 #endif
 {
   FLUSSPFERD_CALLBACK_BEGIN {
-    current_context_scope scope(Impl::wrap_context(ctx));
+    Impl::callback_context_scope scope(ctx);
 
-    native_object_base &self =
-      native_object_base::get_native(Impl::wrap_object(obj));
+    native_object_base &self = get(ctx, obj);
 
     value data(Impl::wrap_jsvalp(vp));
     self.property_op(mode, Impl::wrap_jsid(id), data);
@@ -274,10 +287,9 @@ JSBool native_object_base::impl::new_resolve(
     JSContext *ctx, JSObject *obj, jsval id, uintN sm_flags, JSObject **objp)
 {
   FLUSSPFERD_CALLBACK_BEGIN {
-    current_context_scope scope(Impl::wrap_context(ctx));
+    Impl::callback_context_scope scope(ctx);
 
-    native_object_base &self =
-      native_object_base::get_native(Impl::wrap_object(obj));
+    native_object_base &self = get(ctx, obj);
 
     unsigned flags = 0;
 
@@ -291,6 +303,8 @@ JSBool native_object_base::impl::new_resolve(
       flags |= property_declaring;
     if (sm_flags & JSRESOLVE_CLASSNAME)
       flags |= property_classname;
+    if (!(flags & property_assigning) && testing_lookup(ctx))
+      flags |= property_testing;
 
     *objp = 0;
     if (self.property_resolve(Impl::wrap_jsval(id), flags))
@@ -302,10 +316,9 @@ JSBool native_object_base::impl::new_enumerate(
     JSContext *ctx, JSObject *obj, JSIterateOp enum_op, jsval *statep, jsid *idp)
 {
   FLUSSPFERD_CALLBACK_BEGIN {
-    current_context_scope scope(Impl::wrap_context(ctx));
+    Impl::callback_context_scope scope(ctx);
 
-    native_object_base &self =
-      native_object_base::get_native(Impl::wrap_object(obj));
+    native_object_base &self = get(ctx, obj);
 
     
     boost::any *iter;
@@ -349,10 +362,9 @@ JSBool native_object_base::impl::new_enumerate(
 void native_object_base::impl::trace_op(
     JSTracer *trc, JSObject *obj)
 {
-  current_context_scope scope(Impl::wrap_context(trc->context));
+  Impl::callback_context_scope scope(trc->context);
 
-  native_object_base &self =
-    native_object_base::get_native(Impl::wrap_object(obj));
+  native_object_base &self = get(trc->context, obj);
 
   tracer tracer_(trc);
   self.trace(tracer_);
@@ -300,7 +300,7 @@ bool object::is_null() const {
   return !get_const();
 }
 
-value object::apply(object const &fn, arguments const &arg_) {
+value object::apply(object const &fn, arguments const &arg) {
   if (is_null())
     throw exception("Could not apply function (object is null)");
 
@@ -310,8 +310,6 @@ value object::apply(object const &fn, arguments const &arg_) {
   value fnv(fn);
   root_value result((value()));
 
-  arguments arg(arg_);
-
   JSContext *cx = Impl::current_context();
 
   JSBool status = JS_CallFunctionValue(
@@ -357,14 +355,12 @@ unsigned object::function_arity() const {
   return arity;
 }
 
-value object::call(char const *fn, arguments const &arg_) {
+value object::call(char const *fn, arguments const &arg) {
   if (is_null())
     throw exception("Could not call function (object is null)");
 
   root_value result((value()));
 
-  arguments arg(arg_);
-
   JSContext *cx = Impl::current_context();
 
   JSBool status = JS_CallFunctionName(
@@ -140,6 +140,15 @@ string string::substr(size_t start, size_t length) const {
   return Impl::wrap_string(new_string);
 }
 
+string string::intern() const {
+  JSString *str = get_string(*this);
+  JSString *interned = JS_InternUCStringN(
+    Impl::current_context(), JS_GetStringChars(str), JS_GetStringLength(str));
+  if (!interned)
+    throw exception("Could not intern string");
+  return Impl::wrap_string(interned);
+}
+
 string string::concat(string const &a, string const &b) {
   JSContext *ctx = Impl::current_context();
   JSString *left = get_string(a);
@@ -0,0 +1,107 @@
+// vim:ts=2:sw=2:expandtab:autoindent:filetype=cpp:
+/*
+The MIT License
+
+Copyright (c) 2008, 2009 Flusspferd contributors (see "CONTRIBUTORS" or
+                                       http://flusspferd.org/contributors.txt)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "flusspferd/xdr.hpp"
+#include "flusspferd/exception.hpp"
+#include "flusspferd/spidermonkey/init.hpp"
+#include "flusspferd/spidermonkey/object.hpp"
+#include <js/jsapi.h>
+#include <js/jsxdrapi.h>
+#include <sstream>
+
+using namespace flusspferd;
+
+namespace {
+  class xdr_state {
+  public:
+    xdr_state(JSXDRMode mode)
+      : xdr(JS_XDRNewMem(Impl::current_context(), mode))
+    {
+      if (!xdr)
+        throw exception("Could not create XDR state");
+    }
+
+    ~xdr_state() {
+      JS_XDRDestroy(xdr);
+    }
+
+    JSXDRState *xdr;
+  };
+}
+
+bool flusspferd::serialize_function(
+  object const &fun, std::vector<unsigned char> &out)
+{
+  if (fun.is_null() || !fun.is_function())
+    return false;
+
+  xdr_state state(JSXDR_ENCODE);
+
+  jsval v = OBJECT_TO_JSVAL(Impl::get_object(fun));
+  if (!JS_XDRValue(state.xdr, &v)) {
+    JS_ClearPendingException(Impl::current_context());
+    return false;
+  }
+
+  uint32 length;
+  void *data = JS_XDRMemGetData(state.xdr, &length);
+  if (!data)
+    return false;
+
+  unsigned char const *p = static_cast<unsigned char const *>(data);
+  out.insert(out.end(), p, p + length);
+  return true;
+}
+
+object flusspferd::deserialize_function(unsigned char const *data, std::size_t n)
+{
+  xdr_state state(JSXDR_DECODE);
+
+  JS_XDRMemSetData(state.xdr, const_cast<unsigned char *>(data), n);
+
+  jsval v = JSVAL_NULL;
+  JSBool ok = JS_XDRValue(state.xdr, &v);
+
+  // The data belongs to the caller, do not let JS_XDRDestroy free it.
+  JS_XDRMemSetData(state.xdr, 0, 0);
+
+  if (!ok) {
+    JS_ClearPendingException(Impl::current_context());
+    return object();
+  }
+
+  if (!JSVAL_IS_OBJECT(v) || JSVAL_IS_NULL(v) ||
+      !JS_ObjectIsFunction(Impl::current_context(), JSVAL_TO_OBJECT(v)))
+    return object();
+
+  return Impl::wrap_object(JSVAL_TO_OBJECT(v));
+}
+
+std::string flusspferd::bytecode_version() {
+  std::ostringstream out;
+  out << JS_GetImplementationVersion() << "/xdr-" << JSXDR_BYTECODE_VERSION;
+  return out.str();
+}
@@ -31,9 +31,12 @@ THE SOFTWARE.
 #include "flusspferd/create/native_object.hpp"
 #include "flusspferd/version.hpp"
 #include "flusspferd/io/stream.hpp"
+#include "flusspferd/io/fd_streambuf.hpp"
 #include <boost/fusion/include/make_vector.hpp>
-#include <iostream>
-#include <ostream>
+#include <boost/thread/tss.hpp>
+#include <boost/thread/once.hpp>
+#include <cstdlib>
+#include <cstring>
 
 
 #if defined(__APPLE__)
@@ -72,24 +75,84 @@ protected:
 };
 
 
+namespace {
+  // Buffers for the standard streams, shared by all contexts of a thread.
+  // Terminals are line buffered, pipes and files fully buffered. Output is
+  // written when the thread ends, or by the exit hook for the main thread.
+  // (system.stderr flushes after every write and print.)
+  struct standard_streams {
+    standard_streams()
+      : in(0), out(1), err(2)
+    {
+      // Like C stdio, show pending output before waiting for input
+      in.tie(&out);
+    }
+
+    void flush() {
+      out.pubsync();
+      err.pubsync();
+    }
+
+    io::fd_streambuf in;
+    io::fd_streambuf out;
+    io::fd_streambuf err;
+  };
+
+  boost::thread_specific_ptr<standard_streams> p_standard_streams;
+  boost::once_flag exit_hook_registered = BOOST_ONCE_INIT;
+
+  void exit_hook() {
+    flusspferd::flush_standard_streams();
+  }
+
+  void register_exit_hook() {
+    std::atexit(&exit_hook);
+  }
+
+  standard_streams &get_standard_streams() {
+    if (!p_standard_streams.get()) {
+      boost::call_once(exit_hook_registered, &register_exit_hook);
+      p_standard_streams.reset(new standard_streams);
+    }
+    return *p_standard_streams;
+  }
+}
+
+void flusspferd::flush_standard_streams() {
+  if (p_standard_streams.get())
+    p_standard_streams->flush();
+}
+
 void flusspferd::load_system_module(object &context) {
   object exports = context.get_property_object("exports");
 
   context.call("require", "io");
 
+  standard_streams &streams = get_standard_streams();
+
+  // The fd_streambuf decides when stdout is written, not print
+  io::stream &out = create<io::stream>(fusion::make_vector(
+    static_cast<std::streambuf*>(&streams.out)));
+  out.set_flush_on_print(false);
+
   exports.define_property(
     "stdout",
-    create<io::stream>(fusion::make_vector(std::cout.rdbuf())),
+    out,
     read_only_property | permanent_property);
 
+  io::stream &err = create<io::stream>(fusion::make_vector(
+    static_cast<std::streambuf*>(&streams.err)));
+  err.set_auto_flush(true);
+
   exports.define_property(
     "stderr",
-    create<io::stream>(fusion::make_vector(std::cerr.rdbuf())),
+    err,
     read_only_property | permanent_property);
 
   exports.define_property(
     "stdin",
-    create<io::stream>(fusion::make_vector(std::cin.rdbuf())),
+    create<io::stream>(fusion::make_vector(
+      static_cast<std::streambuf*>(&streams.in))),
     read_only_property | permanent_property);
 
 
@@ -0,0 +1,805 @@
+// vim:ts=2:sw=2:expandtab:autoindent:filetype=cpp:
+/*
+The MIT License
+
+Copyright (c) 2008, 2009 Flusspferd contributors (see "CONTRIBUTORS" or
+                                       http://flusspferd.org/contributors.txt)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include "flusspferd/worker.hpp"
+#include "flusspferd/event.hpp"
+#include "flusspferd/load_core.hpp"
+#include "flusspferd/modules.hpp"
+#include "flusspferd/binary.hpp"
+#include "flusspferd/class_description.hpp"
+#include "flusspferd/context.hpp"
+#include "flusspferd/current_context_scope.hpp"
+#include "flusspferd/property_iterator.hpp"
+#include "flusspferd/root.hpp"
+#include "flusspferd/create/object.hpp"
+#include "flusspferd/create/array.hpp"
+#include "flusspferd/create/native_object.hpp"
+#include "flusspferd/spidermonkey/object.hpp"
+#include <boost/fusion/include/make_vector.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/optional.hpp>
+#include <boost/foreach.hpp>
+#include <boost/bind.hpp>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <set>
+
+using namespace flusspferd;
+namespace fusion = boost::fusion;
+
+// -- structured_clone ------------------------------------------------------
+//
+// The serialized form is a sequence of tagged values. Strings are stored as
+// UTF-16 code units. Arrays, objects and binaries are numbered in the order
+// they are first seen; seeing one again writes a reference to that number.
+
+namespace {
+  enum clone_tag {
+    tag_undefined = 'u',
+    tag_null = 'n',
+    tag_true = 't',
+    tag_false = 'f',
+    tag_number = 'd',
+    tag_string = 's',
+    tag_array = 'a',
+    tag_object = 'o',
+    tag_object_end = 'e',
+    tag_byte_string = 'B',
+    tag_byte_array = 'A',
+    tag_reference = 'r'
+  };
+}
+
+class structured_clone::writer {
+public:
+  writer(structured_clone &out, object const &transfer)
+    : out(out), next_id(0)
+  {
+    if (transfer.is_null())
+      return;
+    array list(transfer);
+    for (std::size_t i = 0; i < list.length(); ++i) {
+      value v = list.get_element(i);
+      if (v.is_object() && !v.is_null())
+        transferred.insert(Impl::get_object(v.get_object()));
+    }
+  }
+
+  void write(value const &v) {
+    if (v.is_undefined())
+      put_tag(tag_undefined);
+    else if (v.is_null())
+      put_tag(tag_null);
+    else if (v.is_boolean())
+      put_tag(v.get_boolean() ? tag_true : tag_false);
+    else if (v.is_number()) {
+      put_tag(tag_number);
+      double d = v.to_number();
+      put_bytes(&d, sizeof(d));
+    }
+    else if (v.is_string()) {
+      put_tag(tag_string);
+      put_string(v.get_string());
+    }
+    else
+      write_object(v.get_object());
+  }
+
+private:
+  void write_object(object const &o) {
+    JSObject *key = Impl::get_object(o);
+    std::map<JSObject*, std::size_t>::const_iterator it = seen.find(key);
+    if (it != seen.end()) {
+      put_tag(tag_reference);
+      put_size(it->second);
+      return;
+    }
+    seen.insert(std::make_pair(key, next_id++));
+
+    if (o.is_function())
+      throw exception("Functions cannot be cloned", "TypeError");
+
+    if (native_object_base::is_object_native(o)) {
+      if (!is_native<binary>(o))
+        throw exception("Native objects cannot be cloned", "TypeError");
+
+      binary &b = get_native<binary>(o);
+      bool const is_array = is_native<byte_array>(o);
+      structured_clone::blob blob;
+      blob.storage = b.share_storage(
+        blob.offset, blob.length, is_array && transferred.count(key));
+
+      put_tag(is_array ? tag_byte_array : tag_byte_string);
+      put_size(out.blobs.size());
+      out.blobs.push_back(blob);
+      return;
+    }
+
+    if (o.is_array()) {
+      array a(o);
+      std::size_t const n = a.length();
+      put_tag(tag_array);
+      put_size(n);
+      for (std::size_t i = 0; i < n; ++i)
+        write(a.get_element(i));
+      return;
+    }
+
+    put_tag(tag_object);
+    for (property_iterator it = o.begin(); it != o.end(); ++it) {
+      put_tag(tag_string);
+      put_string(it->to_string());
+      write(o.get_property(*it));
+    }
+    put_tag(tag_object_end);
+  }
+
+  void put_tag(clone_tag t) {
+    out.data.push_back(static_cast<unsigned char>(t));
+  }
+
+  void put_bytes(void const *p, std::size_t n) {
+    unsigned char const *b = static_cast<unsigned char const *>(p);
+    out.data.insert(out.data.end(), b, b + n);
+  }
+
+  void put_size(std::size_t n) {
+    put_bytes(&n, sizeof(n));
+  }
+
+  void put_string(string const &s) {
+    put_size(s.length());
+    put_bytes(s.data(), s.length() * sizeof(js_char16_t));
+  }
+
+  structured_clone &out;
+  std::map<JSObject*, std::size_t> seen;
+  std::set<JSObject*> transferred;
+  std::size_t next_id;
+};
+
+class structured_clone::reader {
+public:
+  reader(structured_clone const &in)
+    : in(in), pos(0), objects(create<array>())
+  {}
+
+  value read() {
+    switch (get_tag()) {
+    case tag_undefined:
+      return value();
+    case tag_null:
+      return object();
+    case tag_true:
+      return value(true);
+    case tag_false:
+      return value(false);
+    case tag_number: {
+      double d;
+      get_bytes(&d, sizeof(d));
+      return value(d);
+    }
+    case tag_string:
+      return get_string();
+    case tag_reference:
+      return objects.get_element(get_size());
+    case tag_array: {
+      std::size_t const n = get_size();
+      array a = create<array>();
+      objects.push(a);
+      for (std::size_t i = 0; i < n; ++i)
+        a.set_element(i, read());
+      return a;
+    }
+    case tag_object: {
+      object o = create<object>();
+      objects.push(o);
+      while (in.data[pos] != tag_object_end) {
+        get_tag();
+        root_string name(get_string());
+        o.set_property(value(name), read());
+      }
+      ++pos;
+      return o;
+    }
+    case tag_byte_string:
+    case tag_byte_array: {
+      bool const is_array = in.data[pos - 1] == tag_byte_array;
+      structured_clone::blob const &b = in.blobs[get_size()];
+      object o;
+      if (is_array)
+        o = create<byte_array>(
+          fusion::vector3<binary::storage_ptr const &, std::size_t, std::size_t>(
+            b.storage, b.offset, b.length));
+      else
+        o = create<byte_string>(
+          fusion::vector3<binary::storage_ptr const &, std::size_t, std::size_t>(
+            b.storage, b.offset, b.length));
+      objects.push(o);
+      return o;
+    }
+    default:
+      throw exception("Corrupt structured clone data");
+    }
+  }
+
+private:
+  clone_tag get_tag() {
+    return static_cast<clone_tag>(in.data[pos++]);
+  }
+
+  void get_bytes(void *p, std::size_t n) {
+    std::memcpy(p, &in.data[pos], n);
+    pos += n;
+  }
+
+  std::size_t get_size() {
+    std::size_t n;
+    get_bytes(&n, sizeof(n));
+    return n;
+  }
+
+  string get_string() {
+    std::size_t const n = get_size();
+    std::vector<js_char16_t> buf(n);
+    if (n)
+      get_bytes(&buf[0], n * sizeof(js_char16_t));
+    return string(n ? &buf[0] : 0, n);
+  }
+
+  structured_clone const &in;
+  std::size_t pos;
+
+  // Every object created so far, by number. Also keeps them rooted.
+  root_array objects;
+};
+
+structured_clone::structured_clone() {
+  data.push_back(tag_undefined);
+}
+
+structured_clone::structured_clone(value const &v, object const &transfer) {
+  writer w(*this, transfer);
+  w.write(v);
+}
+
+value structured_clone::restore() const {
+  reader r(*this);
+  return r.read();
+}
+
+// -- channel ---------------------------------------------------------------
+
+class message_port;
+
+namespace {
+  struct message {
+    structured_clone data;
+    std::string error; // set for errors reported by the worker
+  };
+
+  typedef boost::shared_ptr<message> message_ptr;
+
+  // Shared between a Worker object and its thread. All members are protected
+  // by the mutex.
+  struct worker_channel
+    : boost::noncopyable, boost::enable_shared_from_this<worker_channel>
+  {
+    worker_channel()
+      : closing(false), finished(false),
+        parent_service(0), worker_service(0),
+        parent_port(0), worker_port(0)
+    {}
+
+    boost::mutex mutex;
+    boost::condition_variable cond;
+
+    std::deque<message_ptr> to_worker;
+    std::deque<message_ptr> to_parent;
+
+    bool closing;  // the worker should stop
+    bool finished; // the worker thread has ended
+
+    // The context of the worker thread while it runs, for interrupting it
+    context worker_context;
+
+    // The event loops messages are delivered through, while they exist
+    boost::asio::io_service *parent_service;
+    boost::asio::io_service *worker_service;
+
+    // Keeps the parent's event loop running while the worker runs
+    boost::scoped_ptr<boost::asio::io_service::work> parent_work;
+
+    // The MessagePort objects of both sides, while they exist
+    message_port *parent_port;
+    message_port *worker_port;
+
+    // Queue @p m for one side and have its event loop deliver it. The mutex
+    // must be held.
+    void push(bool parent, message_ptr const &m);
+
+    // Make the worker's event loop return. The mutex must be held.
+    void stop_worker() {
+      closing = true;
+      // Posted rather than calling stop(), so that it isn't lost if the
+      // worker has not started running its loop yet
+      if (worker_service)
+        worker_service->post(
+          boost::bind(&boost::asio::io_service::stop, worker_service));
+      cond.notify_all();
+    }
+
+    // Wait for a message in @p queue. Returns an empty pointer if the other
+    // side went away or the timeout (in ms, negative for none) expired.
+    message_ptr pop(std::deque<message_ptr> &queue, int timeout, bool parent) {
+      boost::mutex::scoped_lock lock(mutex);
+      boost::system_time const deadline =
+        boost::get_system_time() + boost::posix_time::milliseconds(timeout);
+
+      while (queue.empty() && !(parent ? finished : closing)) {
+        if (timeout < 0)
+          cond.wait(lock);
+        else if (!cond.timed_wait(lock, deadline))
+          break;
+      }
+
+      if (queue.empty())
+        return message_ptr();
+      message_ptr m = queue.front();
+      queue.pop_front();
+      return m;
+    }
+  };
+
+  typedef boost::shared_ptr<worker_channel> channel_ptr;
+
+  void deliver_queued(boost::weak_ptr<worker_channel> const &channel, bool parent);
+
+  void worker_channel::push(bool parent, message_ptr const &m) {
+    (parent ? to_parent : to_worker).push_back(m);
+
+    boost::asio::io_service *service = parent ? parent_service : worker_service;
+    if (service)
+      service->post(boost::bind(
+        &deliver_queued, boost::weak_ptr<worker_channel>(shared_from_this()),
+        parent));
+
+    cond.notify_all();
+  }
+
+  // The channel to the parent in worker threads
+  boost::thread_specific_ptr<channel_ptr> parent_channel;
+
+  // Passed on to load_core in worker threads
+  boost::mutex argv0_mutex;
+  std::string worker_argv0;
+}
+
+// -- MessagePort -----------------------------------------------------------
+
+FLUSSPFERD_CLASS_DESCRIPTION(
+  message_port,
+  (full_name, "worker.MessagePort")
+  (constructor_name, "MessagePort")
+  (constructible, false)
+  (methods,
+    ("postMessage", bind, post_message)
+    ("receive", bind, receive)
+    ("dispatch", bind, dispatch)
+    ("close", bind, close)))
+{
+public:
+  message_port(object const &o, channel_ptr const &channel, bool parent_side);
+  message_port(object const &o, call_context &);
+  ~message_port();
+
+  void post_message(value data, value transfer);
+  value receive(boost::optional<int> timeout);
+  int dispatch(boost::optional<int> timeout);
+  void close();
+
+  // Call onmessage (or onerror) for @p m
+  void deliver(message_ptr const &m);
+
+protected:
+  channel_ptr channel;
+  bool parent_side;
+
+  std::deque<message_ptr> &incoming() {
+    return parent_side ? channel->to_parent : channel->to_worker;
+  }
+
+private:
+  void register_port();
+};
+
+message_port::message_port(
+    object const &o, channel_ptr const &channel, bool parent_side)
+  : base_type(o), channel(channel), parent_side(parent_side)
+{
+  register_port();
+}
+
+message_port::message_port(object const &o, call_context &)
+  : base_type(o), channel(new worker_channel), parent_side(true)
+{
+  register_port();
+}
+
+message_port::~message_port() {
+  boost::mutex::scoped_lock lock(channel->mutex);
+  message_port *&port = parent_side ? channel->parent_port : channel->worker_port;
+  if (port == this)
+    port = 0;
+}
+
+void message_port::register_port() {
+  boost::mutex::scoped_lock lock(channel->mutex);
+  (parent_side ? channel->parent_port : channel->worker_port) = this;
+}
+
+void message_port::post_message(value data, value transfer) {
+  message_ptr m(new message);
+  m->data = structured_clone(
+    data, transfer.is_object() ? transfer.get_object() : object());
+
+  boost::mutex::scoped_lock lock(channel->mutex);
+  if (channel->closing || channel->finished)
+    throw exception("Cannot post message: worker has ended");
+  channel->push(!parent_side, m);
+}
+
+value message_port::receive(boost::optional<int> timeout) {
+  message_ptr m = channel->pop(incoming(), timeout.get_value_or(-1), parent_side);
+  if (!m)
+    return value();
+  if (!m->error.empty())
+    throw exception("Error in worker: " + m->error);
+  return m->data.restore();
+}
+
+int message_port::dispatch(boost::optional<int> timeout) {
+  int n = 0;
+  for (message_ptr m = channel->pop(incoming(), timeout.get_value_or(0), parent_side);
+       m;
+       m = channel->pop(incoming(), 0, parent_side))
+  {
+    deliver(m);
+    ++n;
+  }
+  return n;
+}
+
+void message_port::deliver(message_ptr const &m) {
+  root_object event(create<object>());
+
+  if (!m->error.empty()) {
+    value handler = get_property("onerror");
+    if (!handler.is_object() || !handler.get_object().is_function())
+      throw exception("Error in worker: " + m->error);
+    event.set_property("message", m->error);
+    apply(handler.get_object(), event);
+    return;
+  }
+
+  value handler = get_property("onmessage");
+  if (!handler.is_object() || !handler.get_object().is_function())
+    return;
+  event.set_property("data", m->data.restore());
+  apply(handler.get_object(), event);
+}
+
+void message_port::close() {
+  boost::mutex::scoped_lock lock(channel->mutex);
+  channel->stop_worker();
+}
+
+namespace {
+  // Runs in the event loop of the receiving side
+  void deliver_queued(boost::weak_ptr<worker_channel> const &weak, bool parent) {
+    channel_ptr channel = weak.lock();
+    if (!channel)
+      return;
+
+    message_port *port;
+    {
+      boost::mutex::scoped_lock lock(channel->mutex);
+      port = parent ? channel->parent_port : channel->worker_port;
+    }
+
+    // The port is only destroyed on this thread, so it can be used unlocked.
+    // onmessage may drop the last reference to it, so it is rooted until
+    // dispatch returns.
+    if (port) {
+      root_object root_port(*port);
+      port->dispatch(boost::optional<int>(0));
+    }
+  }
+}
+
+// -- Worker ----------------------------------------------------------------
+
+FLUSSPFERD_CLASS_DESCRIPTION(
+  worker,
+  (base, message_port)
+  (full_name, "worker.Worker")
+  (constructor_name, "Worker")
+  (methods,
+    ("terminate", bind, terminate)
+    ("join", bind, join))
+  (properties,
+    ("running", getter, is_running)))
+{
+public:
+  worker(object const &o, call_context &x);
+  ~worker();
+
+  void terminate();
+  void join();
+  bool is_running();
+
+private:
+  boost::shared_ptr<boost::thread> thread;
+};
+
+namespace {
+  // What a worker thread needs to know from its parent
+  struct worker_setup {
+    std::string id;
+    std::string argv0;
+    std::vector<std::string> paths;
+    std::vector<std::string> bundles;
+    std::vector<std::pair<std::string, std::string> > aliases;
+  };
+
+  void copy_strings(array const &from, std::vector<std::string> &to) {
+    for (std::size_t i = 0; i < from.length(); ++i)
+      to.push_back(from.get_element(i).to_std_string());
+  }
+
+  void push_strings(std::vector<std::string> const &from, object to) {
+    array a(to);
+    BOOST_FOREACH(std::string const &s, from)
+      a.push(s);
+  }
+
+  // Makes the worker's event loop known to the channel while it exists
+  struct service_registration {
+    service_registration(channel_ptr const &channel)
+      : channel(channel)
+    {
+      boost::mutex::scoped_lock lock(channel->mutex);
+      channel->worker_service = &event::io_service();
+    }
+
+    ~service_registration() {
+      boost::mutex::scoped_lock lock(channel->mutex);
+      channel->worker_service = 0;
+    }
+
+    channel_ptr channel;
+  };
+
+  // Destroys the event loop of the worker thread before its context
+  struct loop_guard {
+    ~loop_guard() {
+      event::shutdown();
+    }
+  };
+
+  // Clears the channel's reference to the worker context before the context
+  // is destroyed
+  struct context_registration {
+    context_registration(channel_ptr const &channel, context const &c)
+      : channel(channel)
+    {
+      boost::mutex::scoped_lock lock(channel->mutex);
+      channel->worker_context = c;
+    }
+
+    ~context_registration() {
+      boost::mutex::scoped_lock lock(channel->mutex);
+      channel->worker_context = context();
+    }
+
+    channel_ptr channel;
+  };
+
+  void run_worker_module(channel_ptr const &channel, worker_setup const &setup) {
+    root_object global(current_context().global());
+    load_core(global, setup.argv0);
+
+    root_object require_fn(global.get_property_object("require"));
+    push_strings(setup.paths, require_fn.get_property_object("paths"));
+    push_strings(setup.bundles, require_fn.get_property_object("bundles"));
+    object alias = require_fn.get_property_object("alias");
+    for (std::size_t i = 0; i < setup.aliases.size(); ++i)
+      alias.set_property(setup.aliases[i].first, setup.aliases[i].second);
+
+    root_object port(
+      global.call("require", "worker").to_object().get_property_object("parent"));
+    message_port &p = get_native<message_port>(port);
+
+    global.call("require", setup.id);
+
+    // Run the event loop until either side closes the channel. Messages
+    // that arrived before it was registered are delivered first.
+    service_registration registration(channel);
+    boost::asio::io_service::work keep_alive(event::io_service());
+    bool backlog = true;
+
+    for (;;) {
+      try {
+        {
+          boost::mutex::scoped_lock lock(channel->mutex);
+          if (channel->closing)
+            break;
+        }
+        if (backlog) {
+          backlog = false;
+          p.dispatch(boost::optional<int>(0));
+        }
+        event::run();
+      } catch (exception &e) {
+        message_ptr error(new message);
+        error->error = e.what();
+        boost::mutex::scoped_lock lock(channel->mutex);
+        if (channel->closing)
+          break;
+        channel->push(true, error);
+      }
+    }
+  }
+
+  void run_worker(channel_ptr channel, worker_setup setup) {
+    parent_channel.reset(new channel_ptr(channel));
+
+    std::string error;
+    try {
+      context co(context::create());
+      current_context_scope scope(co);
+      context_registration registration(channel, co);
+      loop_guard loop;
+
+      run_worker_module(channel, setup);
+    } catch (std::exception &e) {
+      error = e.what();
+    } catch (...) {
+      error = "unknown error";
+    }
+
+    boost::mutex::scoped_lock lock(channel->mutex);
+    channel->finished = true;
+    if (!error.empty() && !channel->closing) {
+      message_ptr m(new message);
+      m->error = error;
+      channel->push(true, m);
+    }
+    channel->parent_work.reset();
+    channel->cond.notify_all();
+  }
+}
+
+worker::worker(object const &o, call_context &x)
+  : base_type(o, x)
+{
+  worker_setup setup;
+  setup.id = x.arg[0].to_std_string();
+
+  if (boost::algorithm::starts_with(setup.id, "./") ||
+      boost::algorithm::starts_with(setup.id, "../"))
+    throw exception(
+      "Worker needs a top-level or file:// module id, not '" + setup.id + "'",
+      "TypeError");
+
+  {
+    boost::mutex::scoped_lock lock(argv0_mutex);
+    setup.argv0 = worker_argv0;
+  }
+
+  // The worker searches for modules the same way as its parent
+  object require_fn = current_context().global().get_property_object("require");
+  copy_strings(require_fn.get_property_object("paths"), setup.paths);
+  copy_strings(require_fn.get_property_object("bundles"), setup.bundles);
+  object alias = require_fn.get_property_object("alias");
+  for (property_iterator it = alias.begin(); it != alias.end(); ++it)
+    setup.aliases.push_back(std::make_pair(
+      it->to_std_string(), alias.get_property(*it).to_std_string()));
+
+  // Messages from the worker are delivered by this thread's event loop,
+  // which keeps running until the worker ends
+  {
+    boost::mutex::scoped_lock lock(channel->mutex);
+    channel->parent_service = &event::io_service();
+    channel->parent_work.reset(
+      new boost::asio::io_service::work(*channel->parent_service));
+  }
+
+  thread.reset(new boost::thread(boost::bind(&run_worker, channel, setup)));
+}
+
+worker::~worker() {
+  // Nothing can talk to the worker anymore. Stop it, but don't wait for it.
+  terminate();
+
+  {
+    boost::mutex::scoped_lock lock(channel->mutex);
+    channel->parent_service = 0;
+    channel->parent_work.reset();
+  }
+
+  if (thread)
+    thread->detach();
+}
+
+void worker::terminate() {
+  boost::mutex::scoped_lock lock(channel->mutex);
+  channel->to_worker.clear();
+  if (channel->worker_context.is_valid())
+    channel->worker_context.interrupt();
+  channel->stop_worker();
+}
+
+void worker::join() {
+  if (thread)
+    thread->join();
+}
+
+bool worker::is_running() {
+  boost::mutex::scoped_lock lock(channel->mutex);
+  return !channel->finished;
+}
+
+void flusspferd::load_worker_module(object container, std::string const &argv0) {
+  object exports = container.get_property_object("exports");
+
+  {
+    boost::mutex::scoped_lock lock(argv0_mutex);
+    worker_argv0 = argv0;
+  }
+
+  load_class<message_port>(exports);
+  load_class<worker>(exports);
+
+  if (parent_channel.get()) {
+    exports.define_property(
+      "parent",
+      create<message_port>(
+        fusion::vector2<channel_ptr const &, bool>(*parent_channel, false)),
+      read_only_property | permanent_property);
+  }
+}
@@ -29,19 +29,41 @@
 #include "exception.hpp"
 #include "flusspferd/binary.hpp"
 #include "flusspferd/tracer.hpp"
+#include "flusspferd/security.hpp"
+#include "flusspferd/io/stream.hpp"
 
 using curl::Easy;
 
+// The ByteArray passed to write and header callbacks
+flusspferd::byte_array &Easy::chunk(void *ptr, size_t n) {
+  flusspferd::byte_array::element_type *p =
+    reinterpret_cast<flusspferd::byte_array::element_type*>(ptr);
+
+  if (!reuse_buffer) {
+    return flusspferd::create<flusspferd::byte_array>(
+        boost::fusion::make_vector(p, n));
+  }
+
+  if (callback_buffer.is_null()) {
+    callback_buffer = flusspferd::create<flusspferd::byte_array>(
+        boost::fusion::make_vector(p, n));
+    return flusspferd::get_native<flusspferd::byte_array>(callback_buffer);
+  }
+
+  flusspferd::byte_array &buf =
+    flusspferd::get_native<flusspferd::byte_array>(callback_buffer);
+  buf.get_data().assign(p, p + n);
+  buf.update_memory();
+  return buf;
+}
+
 size_t Easy::writefunction(void *ptr, size_t size, size_t nmemb, void *stream) {
   assert(stream);
   Easy &self = *reinterpret_cast<Easy*>(stream);
   if (self.writefunction_callback.is_null()) {
     return 0;
   } else {
-    flusspferd::byte_array &data = flusspferd::create<flusspferd::byte_array>(
-        boost::fusion::make_vector(
-            reinterpret_cast<flusspferd::byte_array::element_type*>(ptr),
-            size*nmemb));
+    flusspferd::byte_array &data = self.chunk(ptr, size*nmemb);
     flusspferd::root_object d(data);
     flusspferd::arguments arg;
     arg.push_back(flusspferd::value(data));
@@ -69,7 +91,7 @@ size_t Easy::readfunction(void *ptr, size_t size, size_t nmemb, void *stream) {
     if(data.get_length() > size*nmemb) {
       throw curl::exception("Out of Range");
     }
-    std::copy(data.get_data().begin(), data.get_data().end(),
+    std::copy(data.const_begin(), data.const_end(),
               static_cast<flusspferd::binary::element_type*>(ptr));
     return v.to_number();
   }
@@ -95,10 +117,7 @@ size_t Easy::headerfunction(void *ptr, size_t size, size_t nmemb, void *stream)
   if (self.headerfunction_callback.is_null()) {
     return 0;
   } else {
-    flusspferd::byte_array &data = flusspferd::create<flusspferd::byte_array>(
-        boost::fusion::make_vector(
-            reinterpret_cast<flusspferd::byte_array::element_type*>(ptr),
-            size*nmemb));
+    flusspferd::byte_array &data = self.chunk(ptr, size*nmemb);
     flusspferd::root_object d(data);
     flusspferd::arguments arg;
     arg.push_back(flusspferd::value(data));
@@ -145,6 +164,91 @@ int Easy::debugfunction(CURL *hnd, curl_infotype i, char *buf, size_t len, void
   }
 }
 
+Easy::sink::sink()
+  : array(0x0), stream(0x0)
+{ }
+
+void Easy::sink::set(flusspferd::value const &t) {
+  array = 0x0;
+  stream = 0x0;
+  file.reset();
+  target = flusspferd::value();
+
+  if (t.is_undefined_or_null()) {
+    return;
+  }
+  else if (t.is_string()) {
+    std::string path = t.to_std_string();
+    if (!flusspferd::security::get().check_path(path, flusspferd::security::WRITE)) {
+      throw curl::exception("Could not open file (security)");
+    }
+    file.reset(new std::ofstream(
+        path.c_str(), std::ios::out | std::ios::trunc | std::ios::binary));
+    if (!*file) {
+      file.reset();
+      throw curl::exception("Could not open file " + path);
+    }
+  }
+  else if (t.is_object() && flusspferd::is_native<flusspferd::byte_array>(t.get_object())) {
+    array = &flusspferd::get_native<flusspferd::byte_array>(t.get_object());
+  }
+  else if (t.is_object() && flusspferd::is_native<flusspferd::io::stream>(t.get_object())) {
+    stream = &flusspferd::get_native<flusspferd::io::stream>(t.get_object());
+  }
+  else {
+    throw curl::exception(
+      "target must be a ByteArray, an IO.Stream or a file name", "TypeError");
+  }
+  target = t;
+}
+
+void Easy::sink::flush() {
+  if (file) {
+    file->flush();
+  }
+  else if (stream && stream->streambuf()) {
+    stream->streambuf()->pubsync();
+  }
+}
+
+size_t Easy::sinkfunction(void *ptr, size_t size, size_t nmemb, void *stream) {
+  assert(stream);
+  sink &self = *reinterpret_cast<sink*>(stream);
+  std::size_t const n = size*nmemb;
+  char const *p = static_cast<char const*>(ptr);
+
+  if (self.array) {
+    flusspferd::binary::vector_type &v = self.array->get_data();
+    v.insert(v.end(), p, p + n);
+    self.array->update_memory();
+    return n;
+  }
+  else if (self.stream) {
+    std::streambuf *buf = self.stream->streambuf();
+    return buf ? buf->sputn(p, n) : 0;
+  }
+  else if (self.file) {
+    self.file->write(p, n);
+    return *self.file ? n : 0;
+  }
+  return 0;
+}
+
+void Easy::flush_sinks() {
+  write_sink.flush();
+  header_sink.flush();
+}
+
+bool Easy::get_reuse_buffer() {
+  return reuse_buffer;
+}
+
+void Easy::set_reuse_buffer(bool reuse) {
+  reuse_buffer = reuse;
+  if (!reuse)
+    callback_buffer = object();
+}
+
 void Easy::trace(flusspferd::tracer &trc) {
   trc("options", opt);
   trc("writeFunction", writefunction_callback);
@@ -153,6 +257,9 @@ void Easy::trace(flusspferd::tracer &trc) {
   trc("progressFunction", progressfunction_callback);
   trc("headerFunction", headerfunction_callback);
   trc("debugFunction", debugfunction_callback);
+  trc("writeTarget", write_sink.target);
+  trc("headerTarget", header_sink.target);
+  trc("callbackBuffer", callback_buffer);
 }
 
 CURL *Easy::data() {
@@ -174,14 +281,16 @@ curl::EasyOpt &Easy::get_opt() {
 }
 
 Easy::Easy(flusspferd::object const &self, flusspferd::call_context&)
-  : base_type(self), handle(curl_easy_init()), opt(EasyOpt::create(*this))
+  : base_type(self), handle(curl_easy_init()), opt(EasyOpt::create(*this)),
+    reuse_buffer(false)
 {
   if(!handle)
     throw curl::exception("curl_easy_init");
 }
 
 Easy::Easy(flusspferd::object const &self, CURL *hnd)
-  : base_type(self), handle(hnd), opt(EasyOpt::create(*this))
+  : base_type(self), handle(hnd), opt(EasyOpt::create(*this)),
+    reuse_buffer(false)
 {
   assert(handle);
 }
@@ -199,6 +308,7 @@ Easy::~Easy() {
 
 void Easy::perform() {
   CURLcode res = curl_easy_perform(get());
+  flush_sinks();
   if(res != 0) {
     throw curl::exception("curl_easy_perform") << curlcode_info(res);
   }
@@ -207,6 +317,8 @@ void Easy::perform() {
 void Easy::reset() {
   curl_easy_reset(get());
   opt.clear();
+  write_sink.set(flusspferd::value());
+  header_sink.set(flusspferd::value());
 }
 
 std::string Easy::unescape(char const *input) {
@@ -28,7 +28,14 @@
 
 #include "exception.hpp"
 #include "flusspferd/class_description.hpp"
+#include "flusspferd/binary.hpp"
+#include <boost/shared_ptr.hpp>
 #include <curl/curl.h>
+#include <fstream>
+
+namespace flusspferd { namespace io {
+  class stream;
+}}
 
 namespace curl {
   class EasyOpt;
@@ -46,7 +53,8 @@ namespace curl {
        ("unescape", bind, unescape)
        ("valid",    bind, valid))
       (properties,
-       ("options", getter, get_opt))
+       ("options", getter, get_opt)
+       ("reuseBuffer", getter_setter, (get_reuse_buffer, set_reuse_buffer)))
   )
   {
     CURL *handle;
@@ -84,6 +92,33 @@ namespace curl {
     static int debugfunction(
         CURL *hnd, curl_infotype i, char *buf, size_t len, void *p);
 
+    /*
+     * Native targets for received data (options.writeTarget and
+     * options.headerTarget). Data is appended in C++ without calling into
+     * JavaScript. The target is a ByteArray, an IO.Stream or a file name.
+     */
+    struct sink {
+      sink();
+      void set(flusspferd::value const &target);
+      void flush();
+
+      flusspferd::value target;
+      flusspferd::byte_array *array;
+      flusspferd::io::stream *stream;
+      boost::shared_ptr<std::ofstream> file;
+    };
+    sink write_sink;
+    sink header_sink;
+    static size_t sinkfunction(void *ptr, size_t size, size_t nmemb, void *stream);
+
+    /*
+     * If reuse_buffer is set, write and header callbacks get the same
+     * ByteArray for every chunk instead of a new one.
+     */
+    bool reuse_buffer;
+    object callback_buffer;
+    flusspferd::byte_array &chunk(void *ptr, size_t n);
+
   protected:
     void trace(flusspferd::tracer &trc);
 
@@ -103,6 +138,12 @@ namespace curl {
 
     void perform();
 
+    // Flush file targets, called when a transfer finished
+    void flush_sinks();
+
+    bool get_reuse_buffer();
+    void set_reuse_buffer(bool reuse);
+
     void reset();
 
     std::string unescape(char const *input);
@@ -0,0 +1,236 @@
+// -*- mode:c++;coding:utf-8; -*- vim:ts=2:sw=2:expandtab:autoindent:filetype=cpp:enc=utf-8:
+/*
+  The MIT License
+
+  Copyright (c) 2008, 2009 Flusspferd contributors (see "CONTRIBUTORS" or
+  http://flusspferd.org/contributors.txt)
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#include "defines.hpp"
+#include "Multi.hpp"
+#include "Easy.hpp"
+#include "exception.hpp"
+#include "flusspferd/tracer.hpp"
+#include "flusspferd/arguments.hpp"
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/select.h>
+#endif
+
+using curl::Multi;
+
+void Multi::trace(flusspferd::tracer &trc) {
+  for(transfer_map::iterator it = transfers.begin(); it != transfers.end(); ++it) {
+    trc("easy", *it->second.easy);
+    trc("callback", it->second.callback);
+  }
+}
+
+Multi::Multi(flusspferd::object const &self, flusspferd::call_context&)
+  : base_type(self), handle(curl_multi_init()), running(0),
+    max_connections(0), max_host_connections(0)
+{
+  if(!handle)
+    throw curl::exception("curl_multi_init");
+}
+
+Multi::~Multi() {
+  cleanup();
+}
+
+CURLM *Multi::get() {
+  if (!handle)
+    throw curl::exception("CURLM handle not valid!");
+  return handle;
+}
+
+bool Multi::valid() {
+  return handle;
+}
+
+void Multi::cleanup() {
+  if(handle) {
+    // curl_multi_cleanup detaches the easy handles which are still added,
+    // they remain usable on their own.
+    curl_multi_cleanup(handle);
+    handle = 0x0;
+    transfers.clear();
+    running = 0;
+  }
+}
+
+void Multi::add(Easy &easy, boost::optional<flusspferd::object> callback) {
+  CURL *hnd = easy.get();
+  if(transfers.find(hnd) != transfers.end()) {
+    throw curl::exception("cURL.Easy handle already added to this cURL.Multi");
+  }
+  CURLMcode res = curl_multi_add_handle(get(), hnd);
+  if(res != CURLM_OK) {
+    throw curl::exception("curl_multi_add_handle") << curlmcode_info(res);
+  }
+  transfer t;
+  t.easy = &easy;
+  if(callback)
+    t.callback = *callback;
+  transfers.insert(transfer_map::value_type(hnd, t));
+}
+
+void Multi::remove(Easy &easy) {
+  // Look the handle up by object, so that handles which were cleaned up in
+  // the meantime can still be removed.
+  for(transfer_map::iterator it = transfers.begin(); it != transfers.end(); ++it) {
+    if(it->second.easy == &easy) {
+      if(easy.valid()) {
+        CURLMcode res = curl_multi_remove_handle(get(), it->first);
+        if(res != CURLM_OK) {
+          throw curl::exception("curl_multi_remove_handle") << curlmcode_info(res);
+        }
+      }
+      transfers.erase(it);
+      return;
+    }
+  }
+}
+
+int Multi::perform() {
+  CURLMcode res;
+  do {
+    res = curl_multi_perform(get(), &running);
+  } while(res == CURLM_CALL_MULTI_PERFORM);
+
+  if(res != CURLM_OK) {
+    throw curl::exception("curl_multi_perform") << curlmcode_info(res);
+  }
+
+  read_info();
+  return running;
+}
+
+// Remove finished transfers and call their completion callbacks
+void Multi::read_info() {
+  int left;
+  while(CURLMsg *msg = curl_multi_info_read(get(), &left)) {
+    if(msg->msg != CURLMSG_DONE) {
+      continue;
+    }
+
+    // msg is invalidated by curl_multi_remove_handle
+    CURL *hnd = msg->easy_handle;
+    CURLcode code = msg->data.result;
+    curl_multi_remove_handle(handle, hnd);
+
+    transfer_map::iterator it = transfers.find(hnd);
+    if(it == transfers.end()) {
+      continue;
+    }
+
+    flusspferd::root_object easy(*it->second.easy);
+    flusspferd::root_object callback(it->second.callback);
+    it->second.easy->flush_sinks();
+    transfers.erase(it);
+
+    if(!callback.is_null()) {
+      flusspferd::arguments arg;
+      arg.push_back(flusspferd::value(easy));
+      arg.push_back(flusspferd::value(static_cast<int>(code)));
+      if(code == CURLE_OK)
+        arg.push_back(flusspferd::value(flusspferd::object()));
+      else
+        arg.push_back(flusspferd::value(std::string(curl_easy_strerror(code))));
+      callback.call(arg);
+    }
+  }
+}
+
+int Multi::wait(boost::optional<int> timeout_ms) {
+  long timeout = timeout_ms ? *timeout_ms : 1000;
+  if(timeout < 0)
+    timeout = 0;
+
+  // Do not sleep longer than libcurl's own timeouts allow
+  long curl_timeout = -1;
+  curl_multi_timeout(get(), &curl_timeout);
+  if(curl_timeout >= 0 && curl_timeout < timeout)
+    timeout = curl_timeout;
+
+#if LIBCURL_VERSION_NUM >= 0x071c00
+  int numfds = 0;
+  CURLMcode res = curl_multi_wait(handle, 0x0, 0, timeout, &numfds);
+  if(res != CURLM_OK) {
+    throw curl::exception("curl_multi_wait") << curlmcode_info(res);
+  }
+  return numfds;
+#else
+  fd_set readfds, writefds, exceptfds;
+  FD_ZERO(&readfds);
+  FD_ZERO(&writefds);
+  FD_ZERO(&exceptfds);
+  int maxfd = -1;
+  CURLMcode res = curl_multi_fdset(handle, &readfds, &writefds, &exceptfds, &maxfd);
+  if(res != CURLM_OK) {
+    throw curl::exception("curl_multi_fdset") << curlmcode_info(res);
+  }
+
+  if(maxfd < 0) {
+    // Nothing to wait for yet (e.g. name resolution in progress)
+    if(timeout > 100)
+      timeout = 100;
+#ifdef WIN32
+    Sleep(timeout);
+    return 0;
+#endif
+  }
+
+  struct timeval tv;
+  tv.tv_sec = timeout / 1000;
+  tv.tv_usec = (timeout % 1000) * 1000;
+  int n = select(maxfd + 1, &readfds, &writefds, &exceptfds, &tv);
+  return n < 0 ? 0 : n;
+#endif
+}
+
+int Multi::get_running() {
+  return running;
+}
+
+int Multi::get_max_connections() {
+  return max_connections;
+}
+
+void Multi::set_max_connections(int n) {
+  do_setopt(CURLMOPT_MAXCONNECTS, static_cast<long>(n));
+  max_connections = n;
+}
+
+int Multi::get_max_host_connections() {
+  return max_host_connections;
+}
+
+void Multi::set_max_host_connections(int n) {
+#if LIBCURL_VERSION_NUM >= 0x071e00
+  do_setopt(CURLMOPT_MAX_HOST_CONNECTIONS, static_cast<long>(n));
+  max_host_connections = n;
+#else
+  (void)n;
+  throw curl::exception("maxHostConnections requires libcurl 7.30.0 or newer");
+#endif
+}
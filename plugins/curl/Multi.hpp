@@ -0,0 +1,109 @@
+// -*- mode:c++;coding:utf-8; -*- vim:ts=2:sw=2:expandtab:autoindent:filetype=cpp:enc=utf-8:
+/*
+  The MIT License
+
+  Copyright (c) 2008, 2009 Flusspferd contributors (see "CONTRIBUTORS" or
+  http://flusspferd.org/contributors.txt)
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#ifndef FLUSSPFERD_PLUGIN_CURL_MULTI_HPP
+#define FLUSSPFERD_PLUGIN_CURL_MULTI_HPP
+
+#include "exception.hpp"
+#include "flusspferd/class_description.hpp"
+#include <boost/optional.hpp>
+#include <curl/curl.h>
+#include <map>
+
+namespace curl {
+  class Easy;
+
+  FLUSSPFERD_CLASS_DESCRIPTION
+  (
+      Multi,
+      (constructor_name, "Multi")
+      (full_name, "cURL.Multi")
+      (methods,
+       ("add",     bind, add)
+       ("remove",  bind, remove)
+       ("perform", bind, perform)
+       ("wait",    bind, wait)
+       ("cleanup", bind, cleanup)
+       ("valid",   bind, valid))
+      (properties,
+       ("running", getter, get_running)
+       ("maxConnections", getter_setter,
+        (get_max_connections, set_max_connections))
+       ("maxHostConnections", getter_setter,
+        (get_max_host_connections, set_max_host_connections)))
+  )
+  {
+    CURLM *handle;
+
+    /*
+     * Easy handles currently added, with their completion callback. The Easy
+     * objects are traced so they stay alive while transfers are running.
+     */
+    struct transfer {
+      Easy *easy;
+      flusspferd::object callback;
+    };
+    typedef std::map<CURL*, transfer> transfer_map;
+    transfer_map transfers;
+
+    int running;
+    long max_connections;
+    long max_host_connections;
+
+    void read_info();
+
+  protected:
+    void trace(flusspferd::tracer &trc);
+
+  public:
+    Multi(flusspferd::object const &self, flusspferd::call_context&);
+    ~Multi();
+
+    CURLM *get();
+    bool valid();
+    void cleanup();
+
+    void add(Easy &easy, boost::optional<flusspferd::object> callback);
+    void remove(Easy &easy);
+    int perform();
+    int wait(boost::optional<int> timeout_ms);
+
+    int get_running();
+    int get_max_connections();
+    void set_max_connections(int n);
+    int get_max_host_connections();
+    void set_max_host_connections(int n);
+
+    template<typename T>
+    void do_setopt(CURLMoption what, T data) {
+      CURLMcode res = curl_multi_setopt(get(), what, data);
+      if(res != CURLM_OK) {
+        throw curl::exception("curl_multi_setopt") << curlmcode_info(res);
+      }
+    }
+  };
+}
+
+#endif
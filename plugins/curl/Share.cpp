@@ -0,0 +1,112 @@
+// -*- mode:c++;coding:utf-8; -*- vim:ts=2:sw=2:expandtab:autoindent:filetype=cpp:enc=utf-8:
+/*
+  The MIT License
+
+  Copyright (c) 2008, 2009 Flusspferd contributors (see "CONTRIBUTORS" or
+  http://flusspferd.org/contributors.txt)
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#include "Share.hpp"
+#include "exception.hpp"
+
+using curl::Share;
+
+void Share::lockfunction(
+    CURL *, curl_lock_data data, curl_lock_access, void *userptr)
+{
+  assert(userptr);
+  Share &self = *reinterpret_cast<Share*>(userptr);
+  if(data >= 0 && data < CURL_LOCK_DATA_LAST)
+    self.locks[data].lock();
+}
+
+void Share::unlockfunction(CURL *, curl_lock_data data, void *userptr) {
+  assert(userptr);
+  Share &self = *reinterpret_cast<Share*>(userptr);
+  if(data >= 0 && data < CURL_LOCK_DATA_LAST)
+    self.locks[data].unlock();
+}
+
+Share::Share(flusspferd::object const &self, flusspferd::call_context &x)
+  : base_type(self), handle(curl_share_init())
+{
+  if(!handle)
+    throw curl::exception("curl_share_init");
+
+  do_setopt(CURLSHOPT_LOCKFUNC, &Share::lockfunction);
+  do_setopt(CURLSHOPT_UNLOCKFUNC, &Share::unlockfunction);
+  do_setopt(CURLSHOPT_USERDATA, static_cast<void*>(this));
+
+  if(x.arg.empty() || x.arg[0].is_undefined_or_null()) {
+    // Share everything libcurl knows how to share
+    share(CURL_LOCK_DATA_COOKIE);
+    share(CURL_LOCK_DATA_DNS);
+#if LIBCURL_VERSION_NUM >= 0x071700
+    share(CURL_LOCK_DATA_SSL_SESSION);
+#endif
+#if LIBCURL_VERSION_NUM >= 0x073900
+    share(CURL_LOCK_DATA_CONNECT);
+#endif
+  }
+  else if(x.arg[0].is_object() && x.arg[0].get_object().is_array()) {
+    flusspferd::array data(x.arg[0].get_object());
+    for(std::size_t i = 0; i < data.length(); ++i)
+      share(static_cast<int>(data.get_element(i).to_integral_number(32, false)));
+  }
+  else {
+    throw curl::exception("cURL.Share expects an array of cURL.LOCK_DATA_* values",
+                          "TypeError");
+  }
+}
+
+Share::~Share() {
+  // Easy handles are finalized in arbitrary order. While one still uses the
+  // share, curl_share_cleanup returns CURLSHE_IN_USE and frees nothing.
+  if(handle)
+    curl_share_cleanup(handle);
+}
+
+CURLSH *Share::get() {
+  if(!handle)
+    throw curl::exception("CURLSH handle not valid!");
+  return handle;
+}
+
+bool Share::valid() {
+  return handle;
+}
+
+void Share::cleanup() {
+  if(handle) {
+    CURLSHcode res = curl_share_cleanup(handle);
+    if(res != CURLSHE_OK) {
+      throw curl::exception("curl_share_cleanup") << curlshcode_info(res);
+    }
+    handle = 0x0;
+  }
+}
+
+void Share::share(int data) {
+  do_setopt(CURLSHOPT_SHARE, static_cast<curl_lock_data>(data));
+}
+
+void Share::unshare(int data) {
+  do_setopt(CURLSHOPT_UNSHARE, static_cast<curl_lock_data>(data));
+}
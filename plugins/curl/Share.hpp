@@ -0,0 +1,80 @@
+// -*- mode:c++;coding:utf-8; -*- vim:ts=2:sw=2:expandtab:autoindent:filetype=cpp:enc=utf-8:
+/*
+  The MIT License
+
+  Copyright (c) 2008, 2009 Flusspferd contributors (see "CONTRIBUTORS" or
+  http://flusspferd.org/contributors.txt)
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#ifndef FLUSSPFERD_PLUGIN_CURL_SHARE_HPP
+#define FLUSSPFERD_PLUGIN_CURL_SHARE_HPP
+
+#include "exception.hpp"
+#include "flusspferd/class_description.hpp"
+#include <boost/thread/mutex.hpp>
+#include <curl/curl.h>
+
+namespace curl {
+  FLUSSPFERD_CLASS_DESCRIPTION
+  (
+      Share,
+      (constructor_name, "Share")
+      (full_name, "cURL.Share")
+      (methods,
+       ("share",   bind, share)
+       ("unshare", bind, unshare)
+       ("cleanup", bind, cleanup)
+       ("valid",   bind, valid))
+  )
+  {
+    CURLSH *handle;
+
+    /*
+     * libcurl calls lock/unlock around every access to shared data. One mutex
+     * per kind of data, so handles running in different threads stay correct.
+     */
+    boost::mutex locks[CURL_LOCK_DATA_LAST];
+
+    static void lockfunction(
+        CURL *hnd, curl_lock_data data, curl_lock_access access, void *userptr);
+    static void unlockfunction(CURL *hnd, curl_lock_data data, void *userptr);
+
+  public:
+    Share(flusspferd::object const &self, flusspferd::call_context &x);
+    ~Share();
+
+    CURLSH *get();
+    bool valid();
+    void cleanup();
+
+    void share(int data);
+    void unshare(int data);
+
+    template<typename T>
+    void do_setopt(CURLSHoption what, T data) {
+      CURLSHcode res = curl_share_setopt(get(), what, data);
+      if(res != CURLSHE_OK) {
+        throw curl::exception("curl_share_setopt") << curlshcode_info(res);
+      }
+    }
+  };
+}
+
+#endif
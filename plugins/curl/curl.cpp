@@ -27,6 +27,8 @@
 #include "defines.hpp"
 #include "EasyOpt.hpp"
 #include "Easy.hpp"
+#include "Multi.hpp"
+#include "Share.hpp"
 #include "curl_cookie.hpp"
 #include "flusspferd/class.hpp"
 #include "flusspferd/modules.hpp"
@@ -45,6 +47,8 @@ FLUSSPFERD_LOADER_SIMPLE(cURL) {
 
   load_class<curl::EasyOpt>(cURL);
   load_class<curl::Easy>(cURL);
+  load_class<curl::Multi>(cURL);
+  load_class<curl::Share>(cURL);
 
   cURL.define_properties(read_only_property | permanent_property)
     ("version", string(curl_version()))
@@ -114,5 +118,14 @@ FLUSSPFERD_LOADER_SIMPLE(cURL) {
     ("SSLVERSION_SSLv3", value(static_cast<int>(CURL_SSLVERSION_SSLv3)))
     ("SEEKFUNC_OK", value(CURL_SEEKFUNC_OK))
     ("SEEKFUNC_FAIL", value(CURL_SEEKFUNC_FAIL))
-    ("SEEKFUNC_CANTSEEK", value(CURL_SEEKFUNC_CANTSEEK));
+    ("SEEKFUNC_CANTSEEK", value(CURL_SEEKFUNC_CANTSEEK))
+    ("LOCK_DATA_COOKIE", value(static_cast<int>(CURL_LOCK_DATA_COOKIE)))
+    ("LOCK_DATA_DNS", value(static_cast<int>(CURL_LOCK_DATA_DNS)))
+#if LIBCURL_VERSION_NUM >= 0x071700
+    ("LOCK_DATA_SSL_SESSION", value(static_cast<int>(CURL_LOCK_DATA_SSL_SESSION)))
+#endif
+#if LIBCURL_VERSION_NUM >= 0x073900
+    ("LOCK_DATA_CONNECT", value(static_cast<int>(CURL_LOCK_DATA_CONNECT)))
+#endif
+    ;
 }
@@ -39,6 +39,20 @@ char const *curl::exception::what() const throw() {
       what_m += curl_easy_strerror(*code);
     }
     return what_m.c_str();
+  } else if (CURLMcode const *code = ::boost::get_error_info<curlmcode_info>(*this)) {
+    if(what_m.empty()) {
+      what_m = flusspferd::exception::what();
+      what_m += ": ";
+      what_m += curl_multi_strerror(*code);
+    }
+    return what_m.c_str();
+  } else if (CURLSHcode const *code = ::boost::get_error_info<curlshcode_info>(*this)) {
+    if(what_m.empty()) {
+      what_m = flusspferd::exception::what();
+      what_m += ": ";
+      what_m += curl_share_strerror(*code);
+    }
+    return what_m.c_str();
   } else {
     return flusspferd::exception::what();
   }
@@ -34,6 +34,8 @@
 
 namespace curl {
   typedef boost::error_info<struct tag_curlcode, CURLcode> curlcode_info;
+  typedef boost::error_info<struct tag_curlmcode, CURLMcode> curlmcode_info;
+  typedef boost::error_info<struct tag_curlshcode, CURLSHcode> curlshcode_info;
 
   struct exception
     : flusspferd::exception
@@ -29,6 +29,8 @@
 #include "list_option.hpp"
 #include "function_option.hpp"
 #include "http_post_option.hpp"
+#include "share_option.hpp"
+#include "target_option.hpp"
 #include <boost/assign/ptr_map_inserter.hpp>
 
 curl::options_map_t const &curl::get_options() {
@@ -85,6 +87,13 @@ curl::options_map_t const &curl::get_options() {
     ptr_map_insert< function_option<CURLOPT_WRITEFUNCTION,
       CURLOPT_WRITEDATA, &Easy::writefunction_callback> >(map)
       ("writefunction");
+    /* DOC{
+       + writeTarget, ByteArray|IO.Stream|string.
+       Received data is appended to the [[binary.ByteArray]], written to the stream or to the named file without calling into JavaScript. Replaces `writefunction`.
+       }DOC*/
+    ptr_map_insert< target_option<CURLOPT_WRITEFUNCTION,
+      CURLOPT_WRITEDATA, &Easy::write_sink> >(map)
+      ("writeTarget");
     /* DOC{
        + readfunction, function(buffer,size,nmemb). [CURLOPT_READFUNCTION](http://curl.haxx.se/libcurl/c/curl_easy_setopt.html#CURLOPT_READFUNCTION)
        }DOC*/
@@ -109,6 +118,13 @@ curl::options_map_t const &curl::get_options() {
     ptr_map_insert< function_option<CURLOPT_HEADERFUNCTION,
       CURLOPT_HEADERDATA, &Easy::headerfunction_callback> >(map)
       ("headerfunction");
+    /* DOC{
+       + headerTarget, ByteArray|IO.Stream|string.
+       Like `writeTarget` for the received headers. Replaces `headerfunction`.
+       }DOC*/
+    ptr_map_insert< target_option<CURLOPT_HEADERFUNCTION,
+      CURLOPT_HEADERDATA, &Easy::header_sink> >(map)
+      ("headerTarget");
     /* DOC{
        + debugfunction, function(infotype,buffer). [CURLOPT_DEBUGFUNCTION](http://curl.haxx.se/libcurl/c/curl_easy_setopt.html#CURLOPT_DEBUGFUNCTION)
        }DOC*/
@@ -237,6 +253,11 @@ curl::options_map_t const &curl::get_options() {
     ptr_map_insert< integer_option<CURLOPT_CONNECTTIMEOUT_MS> >(map)("connecttimeoutMS");
     ptr_map_insert< integer_option<CURLOPT_IPRESOLVE> >(map)("ipresolve"); // See cURL.IPRESOLVE_*
     ptr_map_insert< integer_option<CURLOPT_CONNECT_ONLY> >(map)("connectOnly");
+    /* DOC{
+       + share, cURL.Share [CURLOPT_SHARE](http://curl.haxx.se/libcurl/c/curl_easy_setopt.html#CURLOPT_SHARE)
+       Share cookies, DNS cache, SSL sessions and connections with other handles using the same [[cURL.Share]].
+       }DOC*/
+    ptr_map_insert< share_option >(map)("share");
     // SSL and SECURITY OPTIONS
     ptr_map_insert< string_option<CURLOPT_SSLCERT> >(map)("sslcert");
     ptr_map_insert< string_option<CURLOPT_SSLCERTTYPE> >(map)("sslcerttype");
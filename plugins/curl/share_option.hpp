@@ -0,0 +1,72 @@
+// -*- mode:c++;coding:utf-8; -*- vim:ts=2:sw=2:expandtab:autoindent:filetype=cpp:enc=utf-8:
+/*
+  The MIT License
+
+  Copyright (c) 2008, 2009 Flusspferd contributors (see "CONTRIBUTORS" or
+  http://flusspferd.org/contributors.txt)
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#ifndef FLUSSPFERD_PLUGIN_CURL_SHARE_OPTION_HPP
+#define FLUSSPFERD_PLUGIN_CURL_SHARE_OPTION_HPP
+
+#include "handle_option.hpp"
+#include "EasyOpt.hpp"
+#include "Easy.hpp"
+#include "Share.hpp"
+#include "flusspferd/create/function.hpp"
+#include "flusspferd/native_object_base.hpp"
+
+namespace curl {
+  // CURLOPT_SHARE. Keeps the cURL.Share object alive while it is attached.
+  struct share_option : handle_option {
+    flusspferd::object getter() const {
+      return flusspferd::create<flusspferd::method>("$get_share", &get);
+    }
+    flusspferd::object setter() const {
+      return flusspferd::create<flusspferd::method>("$set_share", &set);
+    }
+    boost::any data() const { return flusspferd::object(); }
+    CURLoption what() const { return CURLOPT_SHARE; }
+    void trace(boost::any const &data, flusspferd::tracer &trc) const {
+      trc("share", boost::any_cast<flusspferd::object const&>(data));
+    }
+  private:
+    static flusspferd::object get(EasyOpt *o) {
+      assert(o);
+      return boost::any_cast<flusspferd::object>(o->data[CURLOPT_SHARE]);
+    }
+    static void set(EasyOpt *o, flusspferd::object val) {
+      assert(o);
+      if(val.is_null()) {
+        o->parent.do_setopt(CURLOPT_SHARE, static_cast<CURLSH*>(0x0));
+      }
+      else if(flusspferd::is_native<Share>(val)) {
+        o->parent.do_setopt(CURLOPT_SHARE,
+                            flusspferd::get_native<Share>(val).get());
+      }
+      else {
+        throw curl::exception("share is not a cURL.Share", "TypeError");
+      }
+      o->data[CURLOPT_SHARE] = val;
+    }
+  };
+}
+
+#endif
@@ -27,6 +27,7 @@ THE SOFTWARE.
 #include "sqlite.hpp"
 #include <boost/assign/list_of.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/math/special_functions/fpclassify.hpp>
 #include <boost/fusion/include/make_vector.hpp>
 
 using namespace flusspferd;
@@ -51,7 +52,25 @@ sqlite3::sqlite3(object const &obj, call_context &x)
     }
     string dsn = x.arg[0];
 
-    // TODO: pull arguments from 2nd/options argument
+    // TODO: pull more arguments from 2nd/options argument
+    std::size_t cache_size = statement_cache::DEFAULT_CAPACITY;
+    if (x.arg.size() > 1 && x.arg[1].is_object() && !x.arg[1].is_null()) {
+        value size = x.arg[1].get_object().get_property("statementCacheSize");
+        if (!size.is_undefined()) {
+            double n = size.to_number();
+            if (!boost::math::isfinite(n)) {
+                throw exception("SQLite3: statementCacheSize must be a finite number",
+                                "RangeError");
+            }
+            if (n <= 0)
+                cache_size = 0;
+            else if (n >= statement_cache::MAX_CAPACITY)
+                cache_size = statement_cache::MAX_CAPACITY;
+            else
+                cache_size = std::size_t(n);
+        }
+    }
+
     if (sqlite3_open(dsn.c_str(), &db) != SQLITE_OK) {
         if (db) {
             raise_sqlite_error(db);
@@ -60,6 +79,8 @@ sqlite3::sqlite3(object const &obj, call_context &x)
             throw std::bad_alloc(); // out of memory. better way to signal this?
         }
     }
+
+    statements.reset(new statement_cache(db, cache_size));
 }
 ///////////////////////////
 sqlite3::~sqlite3()
@@ -71,6 +92,10 @@ sqlite3::~sqlite3()
 void sqlite3::close()
 {
     if (db) {
+        // Cursors still using statements finalize them when they are closed
+        if (statements) {
+            statements->close();
+        }
         sqlite3_close(db);
         db = NULL;
     }
@@ -164,32 +189,140 @@ int sqlite3::exec_internal( array arr ) {
         result.call("next");
 
         count += sqlite3_changes(db);
+
+        // Hand the statement back to the cache right away
+        get_native<sqlite3_cursor>(result).close();
     }
     
     return count;
 }
 
+namespace {
+    // Gives a statement back to the cache when going out of scope
+    class statement_lease {
+    public:
+        statement_lease(statement_cache &cache,
+                        statement_cache::key_type const &sql)
+        : cache(cache), sql(sql), tail_length(0), sth(cache.acquire(sql, tail_length))
+        {}
+
+        ~statement_lease() {
+            cache.release(sql, sth, tail_length);
+        }
+
+        statement_cache &cache;
+        statement_cache::key_type sql;
+        std::size_t tail_length;
+        sqlite3_stmt *sth;
+    };
+
+    // Wraps a block in a transaction unless one is already active
+    class implicit_transaction {
+    public:
+        implicit_transaction(::sqlite3 *db)
+        : db(db), active(sqlite3_get_autocommit(db) != 0)
+        {
+            if (active && sqlite3_exec(db, "BEGIN TRANSACTION", 0, 0, 0) != SQLITE_OK) {
+                raise_sqlite_error(db);
+            }
+        }
+
+        ~implicit_transaction() {
+            if (active) {
+                sqlite3_exec(db, "ROLLBACK TRANSACTION", 0, 0, 0);
+            }
+        }
+
+        void commit() {
+            if (active) {
+                active = false;
+                if (sqlite3_exec(db, "COMMIT TRANSACTION", 0, 0, 0) != SQLITE_OK) {
+                    raise_sqlite_error(db);
+                }
+            }
+        }
+
+    private:
+        ::sqlite3 *db;
+        bool active;
+    };
+}
+
 ///////////////////////////
-object sqlite3::compile(flusspferd::string sql_in, value bind ) {
+int sqlite3::exec_batch(string sql, array binds) {
     local_root_scope scope;
+    ensure_opened();
 
-    size_t n_bytes = sql_in.length() * 2;
-    sqlite3_stmt * sth = 0;
-    js_char16_t * tail = 0; // uncompiled part of the sql (when multiple stmts)
-    
-    if (sqlite3_prepare16_v2(db, sql_in.data(), n_bytes, &sth, (const void**)&tail) != SQLITE_OK)
-    {
-        raise_sqlite_error(db);
+    statement_lease stmt(*statements, sql.to_utf16_string());
+    if (!stmt.sth) {
+        throw exception("SQLite3.execBatch() requires an SQL statement");
     }
 
-    object cursor = create<sqlite3_cursor>(fusion::make_vector(sth));
+    std::size_t num_binds = sqlite3_bind_parameter_count(stmt.sth);
+    std::size_t length = binds.length();
+    int count = 0;
+
+    implicit_transaction txn(db);
+
+    for (std::size_t idx = 0; idx < length; ++idx) {
+        value row = binds.get_element(idx);
+
+        sqlite3_reset(stmt.sth);
+        sqlite3_clear_bindings(stmt.sth);
+
+        if (row.is_object() && !row.is_null() && row.get_object().is_array()) {
+            array a(row.get_object());
+            if (a.length() < num_binds) {
+                throw exception("SQLite3.execBatch(): not all placeholders bound"
+                                " in entry " + boost::lexical_cast<std::string>(idx));
+            }
+            for (std::size_t n = 1; n <= num_binds; ++n) {
+                bind_param(stmt.sth, n, a.get_element(n - 1));
+            }
+        } else if (num_binds == 1) {
+            bind_param(stmt.sth, 1, row);
+        } else if (num_binds != 0) {
+            throw exception("SQLite3.execBatch() expects an array of arrays");
+        }
 
-    string tail_str;
-    if (tail) {
-        tail_str = string(tail);
+        int code;
+        while ((code = sqlite3_step(stmt.sth)) == SQLITE_ROW)
+            ;
+        if (code != SQLITE_DONE) {
+            // With the legacy prepare interface the real error is only
+            // reported by reset
+            sqlite3_reset(stmt.sth);
+            raise_sqlite_error(db);
+        }
+
+        count += sqlite3_changes(db);
     }
-    
-    string sql = sql_in.substr( 0, sql_in.size() - tail_str.size() );
+
+    txn.commit();
+
+    return count;
+}
+
+///////////////////////////
+object sqlite3::compile(flusspferd::string sql_in, value bind ) {
+    local_root_scope scope;
+    ensure_opened();
+
+    statement_cache::key_type key = sql_in.to_utf16_string();
+    std::size_t tail_length = 0;
+    sqlite3_stmt * sth = statements->acquire(key, tail_length);
+
+    object cursor;
+    try {
+        cursor = create<sqlite3_cursor>(
+            fusion::make_vector(sth, statements, key, tail_length));
+    } catch (...) {
+        statements->release(key, sth, tail_length);
+        throw;
+    }
+
+    string sql = sql_in.substr( 0, sql_in.size() - tail_length );
+    string tail_str = sql_in.substr( sql_in.size() - tail_length, tail_length );
 
     cursor.define_property("sql", sql);
     cursor.define_property("tail", tail_str);        
@@ -210,6 +343,35 @@ void sqlite3::last_insert_id(call_context & x) {
 }
 
 
+///////////////////////////
+int sqlite3::get_statement_cache_size() {
+    return statements->capacity();
+}
+
+///////////////////////////
+void sqlite3::set_statement_cache_size(int n) {
+    if (n < 0)
+        n = 0;
+    else if (n > statement_cache::MAX_CAPACITY)
+        n = statement_cache::MAX_CAPACITY;
+    statements->set_capacity(n);
+}
+
+///////////////////////////
+double sqlite3::get_cache_hits() {
+    return statements->hits();
+}
+
+///////////////////////////
+double sqlite3::get_cache_misses() {
+    return statements->misses();
+}
+
+///////////////////////////
+double sqlite3::get_prepare_time_ms() {
+    return statements->prepare_time_ms();
+}
+
 ///////////////////////////
 void sqlite3::ensure_opened() {
     if (!db) {
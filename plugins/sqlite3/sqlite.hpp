@@ -28,7 +28,9 @@ THE SOFTWARE.
 
 #include "flusspferd.hpp"
 #include <sqlite3.h>
+#include <boost/shared_ptr.hpp>
 #include "sqlite_cursor.hpp"
+#include "statement_cache.hpp"
 
 namespace sqlite3_plugin{
 
@@ -42,11 +44,18 @@ FLUSSPFERD_CLASS_DESCRIPTION(
         ("query", bind, query)
         ("exec", bind, exec)
         ("execMany", bind, execMany)
+        ("execBatch", bind, exec_batch)
         ("close", bind, close)
         ("lastInsertID", bind, last_insert_id)
         ("begin", bind, begin)
         ("commit", bind, commit)
         ("rollback", bind, rollback))
+    (properties,
+        ("statementCacheSize", getter_setter,
+            (get_statement_cache_size, set_statement_cache_size))
+        ("cacheHits", getter, get_cache_hits)
+        ("cacheMisses", getter, get_cache_misses)
+        ("prepareTimeMs", getter, get_prepare_time_ms))
     (constructor_properties,
         ("version", constant, SQLITE_VERSION_NUMBER)
         ("versionStr", constant, SQLITE_VERSION)))
@@ -64,13 +73,22 @@ public: // JS methods
     void query(flusspferd::call_context &x);
     void exec(flusspferd::call_context & x);
     void execMany(flusspferd::call_context & x);
+    int exec_batch(flusspferd::string sql, flusspferd::array binds);
     void last_insert_id(flusspferd::call_context &x);
 
     void begin();
     void commit();
     void rollback();
 
+    int get_statement_cache_size();
+    void set_statement_cache_size(int n);
+    double get_cache_hits();
+    double get_cache_misses();
+    double get_prepare_time_ms();
+
 protected:
+    boost::shared_ptr<statement_cache> statements;
+
     int exec_internal( flusspferd::array arr );
     flusspferd::object compile(flusspferd::string sql, flusspferd::value bind);
     void ensure_opened();
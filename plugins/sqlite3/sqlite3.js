@@ -57,11 +57,44 @@ if(!exports.SQLite3) {
 var SQLite3 = exports.SQLite3;
 
 /**
- *  new sqlite3.SQLite3(dsn)
+ *  new sqlite3.SQLite3(dsn[, options])
  *  - dsn (String): Path to database file, or ':memory:'
+ *  - options (Object): connection options
  *
  *  Opens a handle to the database `dsn`, which will usually be a filename, but
  *  could also be ":memory:", or any other special string understood by SQLite3.
+ *
+ *  The only supported option is `statementCacheSize`, see
+ *  [[sqlite3.SQLite3#statementCacheSize]].
+ **/
+
+/**
+ *  sqlite3.SQLite3#statementCacheSize -> Number
+ *
+ *  Number of prepared statements kept for reuse (default: 32). Statements
+ *  passed to [[sqlite3.SQLite3#exec]], [[sqlite3.SQLite3#execMany]],
+ *  [[sqlite3.SQLite3#execBatch]] and [[sqlite3.SQLite3#query]] are looked up
+ *  by their SQL text; the least recently used ones are dropped when the cache
+ *  is full. A statement returns to the cache when its cursor is closed.
+ *  Setting this to 0 disables the cache; sizes above 4096 are reduced to 4096.
+ **/
+
+/**
+ *  sqlite3.SQLite3#cacheHits -> Number
+ *
+ *  Number of statements taken from the statement cache.
+ **/
+
+/**
+ *  sqlite3.SQLite3#cacheMisses -> Number
+ *
+ *  Number of statements that had to be prepared.
+ **/
+
+/**
+ *  sqlite3.SQLite3#prepareTimeMs -> Number
+ *
+ *  Total time in milliseconds spent preparing statements.
  **/
 
 /**
@@ -144,6 +177,23 @@ var SQLite3 = exports.SQLite3;
  *      ])
  **/
 
+/**
+ *  sqlite3.SQLite3#execBatch(sql, binds) -> Number
+ *  - sql (String): SQL statement to execute
+ *  - binds (Array): an Array of bind parameter Arrays
+ *
+ *  Executes `sql` once for every entry of `binds` and returns the total number
+ *  of rows affected. The statement is prepared once and, unless a transaction
+ *  is already active, all executions run in a single transaction which is
+ *  rolled back if one of them fails. Statements with a single placeholder
+ *  also accept plain values instead of Arrays.
+ *
+ *  ##### Example #
+ *
+ *      db.execBatch('INSERT INTO foobar VALUES(?,?,?)',
+ *                   [ [1,2,3], [4,5,6], [7,8,9] ]);
+ **/
+
 /**
  * sqlite3.SQLite3#begin() -> undefined
  *
@@ -207,6 +257,44 @@ var SQLite3 = exports.SQLite3;
  *  array.
  **/
 
+/**
+ *  sqlite3.SQLite3.Cursor#fetchMany(n[, options]) -> Array
+ *  - n (Number): maximum number of rows to fetch
+ *  - options (Object): `{ objects: true }` returns rows as Objects
+ *
+ *  Fetch up to `n` rows in one call. Rows are Arrays, or Objects keyed by
+ *  column name if `options.objects` is set. Returns an empty Array once all
+ *  rows have been read.
+ **/
+
+/**
+ *  sqlite3.SQLite3.Cursor#fetchAll([options]) -> Array
+ *  - options (Object): `{ objects: true }` returns rows as Objects
+ *
+ *  Fetch all remaining rows. See [[sqlite3.SQLite3.Cursor#fetchMany]].
+ **/
+
+/**
+ *  sqlite3.SQLite3.Cursor#fetchColumns([n[, options]]) -> Array
+ *  - n (Number): maximum number of rows to fetch, all if omitted
+ *  - options (Object): `{ packed: true }` packs numeric columns
+ *
+ *  Fetch up to `n` rows column by column. The result has one Array per column
+ *  holding that column's values. With `options.packed`, a column containing
+ *  only numbers is returned as a [[binary.ByteString]] of doubles in native
+ *  byte order, 8 bytes per row.
+ *
+ *  ##### Example #
+ *
+ *      var [ids, names] = db.query('SELECT id, name FROM t').fetchColumns();
+ **/
+
+/**
+ *  sqlite3.SQLite3.Cursor#columnNames() -> Array
+ *
+ *  Names of the result columns.
+ **/
+
 /**
  *  sqlite3.SQLite3.Cursor#close() -> undefined
  *
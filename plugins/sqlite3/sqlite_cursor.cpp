@@ -26,9 +26,12 @@ THE SOFTWARE.
 
 #include "sqlite_cursor.hpp"
 #include "sqlite.hpp"
+#include "statement_cache.hpp"
 #include <sstream>
+#include <cstring>
 #include <new>
 #include <boost/lexical_cast.hpp>
+#include <boost/math/special_functions/fpclassify.hpp>
 #include <boost/fusion/include/make_vector.hpp>
 
 using namespace flusspferd;
@@ -38,11 +41,18 @@ namespace sqlite3_plugin {
 
 ///////////////////////////
 // 'Private' constructor that is called from sqlite3::cursor
-sqlite3_cursor::sqlite3_cursor(object const &obj, sqlite3_stmt *_sth)
+sqlite3_cursor::sqlite3_cursor(object const &obj, sqlite3_stmt *_sth,
+                               boost::shared_ptr<statement_cache> const &cache,
+                               std::basic_string<js_char16_t> const &sql,
+                               std::size_t tail_length)
 : base_type(obj)
 , sth(_sth)
+, cache(cache)
+, sql(sql)
+, tail_length(tail_length)
 , state(CursorState_Init)
 , param_bound( sqlite3_bind_parameter_count(_sth), false )
+, memory("sqlite", statement_cache::memory_used(_sth))
 {        
 }
 
@@ -56,8 +66,13 @@ sqlite3_cursor::~sqlite3_cursor()
 ///////////////////////////
 void sqlite3_cursor::close() {
     if (sth) {
-        sqlite3_finalize(sth);
+        if (cache) {
+            cache->release(sql, sth, tail_length);
+        } else {
+            sqlite3_finalize(sth);
+        }
         sth = NULL;
+        memory.resize(0);
     }
 }
 
@@ -68,9 +83,8 @@ void sqlite3_cursor::reset() {
 }
 
 ///////////////////////////
-void sqlite3_cursor::next(call_context & x) {
-    local_root_scope scope;
-
+// Advance to the next row. Returns false once all rows have been seen
+bool sqlite3_cursor::step() {
     if (!sth){
         throw exception("SQLite3.Cursor.next called on closed cursor");
     }
@@ -79,8 +93,7 @@ void sqlite3_cursor::next(call_context & x) {
         case CursorState_Finished:
             // We've seen the last row, remember it and return the 
             // EOF indicator
-            x.result = object();
-            return;
+            return false;
         case CursorState_Errored:
             throw exception("SQLite3.Cursor: This cursor has seen an error and"
                             " needs to be reset");
@@ -94,8 +107,7 @@ void sqlite3_cursor::next(call_context & x) {
 
     if (code == SQLITE_DONE) {
         state = CursorState_Finished;
-        x.result = object();
-        return;
+        return false;
     } else if (code != SQLITE_ROW) {
         if (sqlite3_errcode( sqlite3_db_handle(sth) ) != SQLITE_OK) {
             state = CursorState_Errored;
@@ -107,6 +119,17 @@ void sqlite3_cursor::next(call_context & x) {
     }
 
     state = CursorState_InProgress;
+    return true;
+}
+
+///////////////////////////
+void sqlite3_cursor::next(call_context & x) {
+    local_root_scope scope;
+
+    if (!step()) {
+        x.result = object();
+        return;
+    }
 
     if ( x.arg.size() == 1 && x.arg[0].is_boolean() && x.arg[0].get_boolean() ) {
         x.result = create_result_object();
@@ -116,6 +139,168 @@ void sqlite3_cursor::next(call_context & x) {
     }
 }
 
+namespace {
+    // Accepts either a boolean or an options object with an 'objects' key
+    bool want_objects(call_context &x, std::size_t idx) {
+        if (x.arg.size() <= idx) {
+            return false;
+        }
+        value v = x.arg[idx];
+        if (v.is_object() && !v.is_null()) {
+            return v.get_object().get_property("objects").to_boolean();
+        }
+        return v.to_boolean();
+    }
+
+    // More rows than an Array can hold is as good as all of them
+    std::size_t const max_rows = 0xffffffffu;
+
+    std::size_t row_count(value const &v, char const *fn) {
+        double n = v.to_number();
+        if (!boost::math::isfinite(n)) {
+            throw exception(std::string("SQLite3.Cursor.") + fn +
+                            ": row count must be a finite number", "RangeError");
+        }
+        if (n <= 0)
+            return 0;
+        if (n >= double(max_rows))
+            return max_rows;
+        return std::size_t(n);
+    }
+}
+
+///////////////////////////
+array sqlite3_cursor::fetch_rows(std::size_t n, bool objects) {
+    array rows = create<array>();
+    std::size_t count = 0;
+
+    while (count < n && step()) {
+        rows.set_element(count++, objects ? create_result_object()
+                                          : create_result_array());
+    }
+    return rows;
+}
+
+///////////////////////////
+void sqlite3_cursor::fetch_many(call_context & x) {
+    local_root_scope scope;
+
+    if (x.arg.size() < 1) {
+        throw exception("SQLite3.Cursor.fetchMany requires at least 1 argument");
+    }
+
+    x.result = fetch_rows(row_count(x.arg[0], "fetchMany"), want_objects(x, 1));
+}
+
+///////////////////////////
+void sqlite3_cursor::fetch_all(call_context & x) {
+    local_root_scope scope;
+
+    x.result = fetch_rows(std::size_t(-1), want_objects(x, 0));
+}
+
+///////////////////////////
+// Read up to n rows into one array per column. With {packed: true},
+// columns containing only numbers become ByteStrings of native endian
+// doubles (8 bytes per row).
+void sqlite3_cursor::fetch_columns(call_context & x) {
+    local_root_scope scope;
+
+    std::size_t n = std::size_t(-1);
+    if (x.arg.size() > 0 && !x.arg[0].is_undefined_or_null()) {
+        n = row_count(x.arg[0], "fetchColumns");
+    }
+
+    bool packed = false;
+    if (x.arg.size() > 1 && x.arg[1].is_object() && !x.arg[1].is_null()) {
+        packed = x.arg[1].get_object().get_property("packed").to_boolean();
+    }
+
+    if (!sth) {
+        throw exception("SQLite3.Cursor.fetchColumns called on closed cursor");
+    }
+
+    int cols = sqlite3_column_count(sth);
+
+    array result = create<array>();
+    std::vector<array> columns;
+    for (int i = 0; i < cols; ++i) {
+        columns.push_back(create<array>());
+        result.set_element(i, columns.back());
+    }
+
+    // While a column is numeric its values are only kept here
+    std::vector<std::vector<double> > numbers(packed ? cols : 0);
+    std::vector<bool> numeric(cols, packed);
+
+    std::size_t count = 0;
+    while (count < n && step()) {
+        for (int i = 0; i < cols; ++i) {
+            if (numeric[i]) {
+                int type = sqlite3_column_type(sth, i);
+                if (type == SQLITE_INTEGER || type == SQLITE_FLOAT) {
+                    numbers[i].push_back(sqlite3_column_double(sth, i));
+                    continue;
+                }
+
+                // Not numeric after all, move what we have into the array
+                numeric[i] = false;
+                for (std::size_t j = 0; j < numbers[i].size(); ++j) {
+                    columns[i].set_element(j, value(numbers[i][j]));
+                }
+                std::vector<double>().swap(numbers[i]);
+            }
+            columns[i].set_element(count, get_column(i));
+        }
+        ++count;
+    }
+
+    for (int i = 0; i < cols; ++i) {
+        if (!numeric[i]) {
+            continue;
+        }
+
+        binary::vector_type bytes(numbers[i].size() * sizeof(double));
+        if (!bytes.empty()) {
+            std::memcpy(&bytes[0], &numbers[i][0], bytes.size());
+        }
+        binary::storage_ptr storage = binary::adopt_storage(bytes);
+        result.set_element(i, create<byte_string>(
+            fusion::vector3<binary::storage_ptr const &, std::size_t, std::size_t>(
+                storage, 0, storage->size())));
+    }
+
+    x.result = result;
+}
+
+///////////////////////////
+std::vector<string> const &sqlite3_cursor::get_names() {
+    if (names.empty() && sth) {
+        int cols = sqlite3_column_count(sth);
+        names.reserve(cols);
+        for (int i = 0; i < cols; ++i) {
+            js_char16_t const * name_str = reinterpret_cast<js_char16_t const *>( sqlite3_column_name16(sth, i) );
+            if ( !name_str ) {
+                throw exception("Couldn't retrieve column name for column");
+            }
+            string name = std::basic_string<js_char16_t>(name_str);
+            // Interned strings do not need to be rooted
+            names.push_back(name.intern());
+        }
+    }
+    return names;
+}
+
+///////////////////////////
+array sqlite3_cursor::column_names() {
+    std::vector<string> const &n = get_names();
+    array result = create<array>();
+    for (std::size_t i = 0; i < n.size(); ++i) {
+        result.set_element(i, n[i]);
+    }
+    return result;
+}
+
 ///////////////////////////
 object sqlite3_cursor::create_result_array() {
     local_root_scope scope;
@@ -133,16 +318,11 @@ object sqlite3_cursor::create_result_array() {
 object sqlite3_cursor::create_result_object() {
     local_root_scope scope;
     // Build up the row object.
-    int cols = sqlite3_column_count(sth);
+    std::vector<string> const &cols = get_names();
     object row = create<object>();
-    for (int i=0; i < cols; i++)
+    for (std::size_t i=0; i < cols.size(); i++)
     {
-        js_char16_t const * name_str = reinterpret_cast<js_char16_t const *>( sqlite3_column_name16(sth, i) );
-        if ( !name_str ) {
-            throw exception("Couldn't retrieve column name for column");
-        }
-        string name = std::basic_string<js_char16_t>(name_str);
-        row.set_property( name, get_column(i) );
+        row.set_property( cols[i], get_column(i) );
     }
     return row;    
 }
@@ -294,6 +474,16 @@ void sqlite3_cursor::bind_dict(object &o, size_t num_binds) {
 ///////////////////////////
 // Bind the actual para
 void sqlite3_cursor::do_bind_param(int n, value v) {
+    bind_param(sth, n, v);
+
+    if(n > 0 && size_t(n) <= param_bound.size())
+    {
+        param_bound[ size_t(n - 1) ] = true;
+    }
+}
+
+///////////////////////////
+void bind_param(sqlite3_stmt *sth, int n, value v) {
     int ok;
 
     if (v.is_undefined()){
@@ -310,8 +500,7 @@ void sqlite3_cursor::do_bind_param(int n, value v) {
         ok = sqlite3_bind_null(sth, n);                
     } else if ( v.is_object() && is_native<binary>(v.get_object()) ) {
         binary & b = flusspferd::get_native<binary>(v.get_object());        
-        binary::vector_type const & vec = b.get_const_data();
-        ok = sqlite3_bind_blob( sth, n, (vec.empty() ? 0 : &vec[0]), vec.size(), SQLITE_TRANSIENT );
+        ok = sqlite3_bind_blob( sth, n, b.const_begin(), b.get_length(), SQLITE_TRANSIENT );
     } else {
         // Default, stringify the object
         string bind = v.to_string();
@@ -319,12 +508,7 @@ void sqlite3_cursor::do_bind_param(int n, value v) {
     }    
 
     if (ok != SQLITE_OK) {
-        raise_sqlite_error(); 
-    }
-
-    if(n > 0 && size_t(n) <= param_bound.size())
-    {
-        param_bound[ size_t(n - 1) ] = true;
+        raise_sqlite_error( sqlite3_db_handle(sth) );
     }
 }
 
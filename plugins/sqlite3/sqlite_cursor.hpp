@@ -28,9 +28,15 @@ THE SOFTWARE.
 
 #include "flusspferd.hpp"
 #include <sqlite3.h>
+#include <boost/shared_ptr.hpp>
 
 namespace sqlite3_plugin {
 
+class statement_cache;
+
+// Bind a JS value to placeholder n (1-based) of sth
+void bind_param(sqlite3_stmt *sth, int n, flusspferd::value v);
+
 FLUSSPFERD_CLASS_DESCRIPTION(
     sqlite3_cursor,
     (constructible, false)
@@ -40,15 +46,27 @@ FLUSSPFERD_CLASS_DESCRIPTION(
         ("close", bind, close)
         ("reset", bind, reset)
         ("next", bind, next)
+        ("fetchMany", bind, fetch_many)
+        ("fetchAll", bind, fetch_all)
+        ("fetchColumns", bind, fetch_columns)
+        ("columnNames", bind, column_names)
         ("bind", bind, bind)))
 {
 public:
     sqlite3_cursor(flusspferd::object const &obj, 
-                   sqlite3_stmt *sth);
+                   sqlite3_stmt *sth,
+                   boost::shared_ptr<statement_cache> const &cache,
+                   std::basic_string<js_char16_t> const &sql,
+                   std::size_t tail_length);
     ~sqlite3_cursor();
 
 private:
     sqlite3_stmt *sth;
+
+    // The statement is given back to this cache when the cursor is closed
+    boost::shared_ptr<statement_cache> cache;
+    std::basic_string<js_char16_t> sql;
+    std::size_t tail_length;
   
     enum  {
         CursorState_Init = 0,
@@ -58,6 +76,12 @@ private:
     } state;
     std::vector<bool> param_bound;
 
+    // Interned column names, fetched once per statement
+    std::vector<flusspferd::string> names;
+
+    // Memory held by the statement while the cursor owns it
+    flusspferd::external_memory memory;
+
     // Methods that help wiht binding
     void bind_array(flusspferd::array &a, size_t num_binds);
     void bind_dict(flusspferd::object &o, size_t num_binds);
@@ -66,10 +90,17 @@ private:
     flusspferd::value get_column(int i);
     object create_result_array();
     object create_result_object();
+    bool step();
+    std::vector<flusspferd::string> const &get_names();
+    flusspferd::array fetch_rows(std::size_t n, bool objects);
 public: // JS methods
     void close();
     void reset();
     void next(flusspferd::call_context & x);
+    void fetch_many(flusspferd::call_context & x);
+    void fetch_all(flusspferd::call_context & x);
+    void fetch_columns(flusspferd::call_context & x);
+    flusspferd::array column_names();
     void bind(flusspferd::call_context &x);    
     bool all_params_bound() const;
     void ensure_all_params_bound() const;
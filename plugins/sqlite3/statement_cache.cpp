@@ -0,0 +1,161 @@
+// vim:ts=2:sw=2:expandtab:autoindent:filetype=cpp:
+/*
+The MIT License
+
+Copyright (c) 2008, 2009 Flusspferd contributors (see "CONTRIBUTORS" or
+                                       http://flusspferd.org/contributors.txt)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "statement_cache.hpp"
+#include "sqlite.hpp"
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <cstring>
+
+namespace pt = boost::posix_time;
+
+namespace sqlite3_plugin {
+
+statement_cache::statement_cache(::sqlite3 *db, std::size_t capacity)
+: db(db)
+, max_size(capacity)
+, closed(false)
+, n_hits(0)
+, n_misses(0)
+, prepare_time(0)
+, memory("sqlite")
+{
+}
+
+///////////////////////////
+statement_cache::~statement_cache()
+{
+    clear();
+}
+
+///////////////////////////
+sqlite3_stmt *statement_cache::acquire(key_type const &sql, std::size_t &tail_length)
+{
+    index_map::iterator it = index.find(sql);
+    if (it != index.end()) {
+        ++n_hits;
+        sqlite3_stmt *sth = it->second->sth;
+        tail_length = it->second->tail_length;
+        memory.resize(memory.size() - it->second->memory_used);
+        lru.erase(it->second);
+        index.erase(it);
+        return sth;
+    }
+
+    if (closed) {
+        throw flusspferd::exception("SQLite3 method called on a closed database handle");
+    }
+
+    ++n_misses;
+
+    sqlite3_stmt *sth = 0;
+    js_char16_t const *tail = 0; // uncompiled part of the sql (when multiple stmts)
+
+    pt::ptime start = pt::microsec_clock::universal_time();
+    int code = sqlite3_prepare16_v2(db, sql.data(), sql.size() * 2, &sth,
+                                    (const void**)&tail);
+    prepare_time += (pt::microsec_clock::universal_time() - start)
+                    .total_microseconds() / 1000.0;
+
+    if (code != SQLITE_OK) {
+        raise_sqlite_error(db);
+    }
+
+    tail_length = tail ? sql.size() - (tail - sql.data()) : 0;
+    return sth;
+}
+
+///////////////////////////
+void statement_cache::release(key_type const &sql, sqlite3_stmt *sth, std::size_t tail_length)
+{
+    if (!sth) {
+        return;
+    }
+
+    // An idle statement must not keep its read lock or bound blobs alive
+    sqlite3_reset(sth);
+    sqlite3_clear_bindings(sth);
+
+    if (closed || max_size == 0 || index.find(sql) != index.end()) {
+        sqlite3_finalize(sth);
+        return;
+    }
+
+    entry e = { sql, sth, tail_length, memory_used(sth) };
+    memory.resize(memory.size() + e.memory_used);
+    lru.push_front(e);
+    index.insert(index_map::value_type(sql, lru.begin()));
+
+    shrink(max_size);
+}
+
+///////////////////////////
+void statement_cache::clear()
+{
+    shrink(0);
+}
+
+///////////////////////////
+void statement_cache::close()
+{
+    clear();
+    closed = true;
+}
+
+///////////////////////////
+void statement_cache::set_capacity(std::size_t n)
+{
+    max_size = n;
+    shrink(max_size);
+}
+
+///////////////////////////
+void statement_cache::shrink(std::size_t n)
+{
+    while (index.size() > n) {
+        entry &e = lru.back();
+        memory.resize(memory.size() - e.memory_used);
+        sqlite3_finalize(e.sth);
+        index.erase(e.sql);
+        lru.pop_back();
+    }
+}
+
+///////////////////////////
+std::size_t statement_cache::memory_used(sqlite3_stmt *sth)
+{
+    if (!sth) {
+        return 0;
+    }
+#if SQLITE_VERSION_NUMBER >= 3020000
+    return sqlite3_stmt_status(sth, SQLITE_STMTSTATUS_MEMUSED, 0);
+#else
+    // Compiled programs are typically a few times the size of their SQL
+    char const *sql = sqlite3_sql(sth);
+    return 1024 + (sql ? 8 * std::strlen(sql) : 0);
+#endif
+}
+
+}
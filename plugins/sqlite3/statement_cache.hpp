@@ -0,0 +1,112 @@
+// vim:ts=2:sw=2:expandtab:autoindent:filetype=cpp:
+/*
+The MIT License
+
+Copyright (c) 2008, 2009 Flusspferd contributors (see "CONTRIBUTORS" or
+                                       http://flusspferd.org/contributors.txt)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef GUARD_FLUSSPFERD_PLUGINS_SQLITE3_STATEMENT_CACHE_HPP_INCLUDED
+#define GUARD_FLUSSPFERD_PLUGINS_SQLITE3_STATEMENT_CACHE_HPP_INCLUDED
+
+#include "flusspferd/string.hpp"
+#include "flusspferd/external_memory.hpp"
+#include <sqlite3.h>
+#include <boost/noncopyable.hpp>
+#include <list>
+#include <map>
+#include <string>
+
+namespace sqlite3_plugin {
+
+// Per-connection LRU cache of prepared statements, keyed by SQL text.
+//
+// Statements handed out by acquire() belong to the caller until they are
+// given back with release(); only idle statements are kept in the cache, so
+// a statement is never shared between two live cursors.
+class statement_cache : boost::noncopyable {
+public:
+    typedef std::basic_string<js_char16_t> key_type;
+
+    enum { DEFAULT_CAPACITY = 32, MAX_CAPACITY = 4096 };
+
+    statement_cache(::sqlite3 *db, std::size_t capacity = DEFAULT_CAPACITY);
+    ~statement_cache();
+
+    // Get a prepared statement for the first SQL statement in sql. Sets
+    // tail_length to the number of characters of sql that were not compiled.
+    // Returns 0 if sql does not contain a statement.
+    sqlite3_stmt *acquire(key_type const &sql, std::size_t &tail_length);
+
+    // Give back a statement obtained from acquire(). It is reset and kept for
+    // reuse, or finalized if the cache is disabled or closed.
+    void release(key_type const &sql, sqlite3_stmt *sth, std::size_t tail_length);
+
+    // Finalize all idle statements.
+    void clear();
+
+    // Finalize all idle statements and finalize any statement released later.
+    void close();
+
+    std::size_t capacity() const { return max_size; }
+    void set_capacity(std::size_t n);
+
+    std::size_t size() const { return index.size(); }
+
+    unsigned long hits() const { return n_hits; }
+    unsigned long misses() const { return n_misses; }
+    double prepare_time_ms() const { return prepare_time; }
+
+    // Memory used by a prepared statement, estimated where sqlite cannot
+    // tell.
+    static std::size_t memory_used(sqlite3_stmt *sth);
+
+private:
+    struct entry {
+        key_type sql;
+        sqlite3_stmt *sth;
+        std::size_t tail_length;
+        std::size_t memory_used;
+    };
+
+    typedef std::list<entry> lru_list;
+    typedef std::map<key_type, lru_list::iterator> index_map;
+
+    void shrink(std::size_t n);
+
+    ::sqlite3 *db;
+    std::size_t max_size;
+    bool closed;
+
+    // Most recently used first
+    lru_list lru;
+    index_map index;
+
+    unsigned long n_hits;
+    unsigned long n_misses;
+    double prepare_time;
+
+    // Memory held by the idle statements
+    flusspferd::external_memory memory;
+};
+
+}
+
+#endif //GUARD_FLUSSPFERD_PLUGINS_SQLITE3_STATEMENT_CACHE_HPP_INCLUDED
@@ -0,0 +1,79 @@
+/*
+The MIT License
+
+Copyright (c) 2010 Flusspferd contributors (see "CONTRIBUTORS" or
+                                     http://flusspferd.org/contributors.txt)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef FLUSSPFERD_PLUGIN_SUBPROCESS_COMMUNICATION_HPP
+#define FLUSSPFERD_PLUGIN_SUBPROCESS_COMMUNICATION_HPP
+
+#include "flusspferd/root.hpp"
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <limits>
+
+namespace subprocess {
+
+  // How output is captured from a child's pipes
+  struct capture_options {
+    capture_options()
+      : binary(false),
+        max_bytes(std::numeric_limits<std::size_t>::max()),
+        chunk_size(64 * 1024)
+    {}
+
+    // Read `binary', `maxBytes' and `chunkSize' from @p options
+    void read(flusspferd::object const &options);
+
+    bool binary;
+    std::size_t max_bytes;  // per stream; the rest is discarded
+    std::size_t chunk_size; // bytes read at a time
+  };
+
+  // The state of one exchange with a child's pipes. The output is stored in
+  // `result' as each pipe is finished.
+  struct communication : boost::noncopyable {
+    communication(flusspferd::object const &process, flusspferd::object const &result)
+      : pending(0), process(process), result(result)
+    {}
+
+    int pending; // pipes not yet finished
+    flusspferd::root_object process;
+    flusspferd::root_object result;
+    capture_options options;
+
+    // Called once all pipes are finished
+    boost::function<void ()> on_done;
+
+    void pipe_done() {
+      if (--pending == 0 && on_done)
+        on_done();
+    }
+  };
+
+  typedef boost::shared_ptr<communication> communication_ptr;
+
+} // namespace subprocess
+
+#endif
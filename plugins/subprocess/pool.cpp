@@ -0,0 +1,480 @@
+/*
+The MIT License
+
+Copyright (c) 2010 Flusspferd contributors (see "CONTRIBUTORS" or
+                                     http://flusspferd.org/contributors.txt)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "pool.hpp"
+#include "subprocess.hpp"
+#include "communication.hpp"
+
+#include <flusspferd/event.hpp>
+#include <flusspferd/arguments.hpp>
+#include <flusspferd/create/array.hpp>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <list>
+#include <vector>
+
+#if defined(BOOST_POSIX_API)
+# include <cerrno>
+# include <csignal>
+# include <fcntl.h>
+# include <sys/wait.h>
+# include <unistd.h>
+#endif
+
+namespace ba = ::boost::asio;
+namespace pt = ::boost::posix_time;
+
+using namespace flusspferd;
+using namespace subprocess;
+using boost::optional;
+using boost::system::error_code;
+
+#if defined(BOOST_POSIX_API)
+// -- SIGCHLD ---------------------------------------------------------------
+//
+// Every pool has a pipe that the SIGCHLD handler writes a byte to. The read
+// end is watched by the event loop, which then reaps the pool's children
+// with non-blocking waits.
+
+namespace {
+  int const max_pools = 32;
+
+  volatile sig_atomic_t wake_fds[max_pools];
+  struct sigaction previous_sigchld;
+  bool sigchld_installed = false;
+  boost::mutex wake_fds_mutex;
+
+  void on_sigchld(int sig, siginfo_t *info, void *context) {
+    int const saved_errno = errno;
+
+    for (int i = 0; i < max_pools; ++i) {
+      int fd = wake_fds[i];
+      if (fd >= 0) {
+        char c = 0;
+        // Non-blocking; a full pipe wakes up the pool all the same
+        if (::write(fd, &c, 1) < 0) {}
+      }
+    }
+
+    // Whoever had the signal before still gets it
+    if (previous_sigchld.sa_flags & SA_SIGINFO)
+      previous_sigchld.sa_sigaction(sig, info, context);
+    else if (previous_sigchld.sa_handler != SIG_DFL &&
+             previous_sigchld.sa_handler != SIG_IGN)
+      previous_sigchld.sa_handler(sig);
+
+    errno = saved_errno;
+  }
+
+  void throw_errno(char const *what) {
+    throw boost::system::system_error(
+      error_code(errno, boost::system::get_system_category()), what);
+  }
+
+  // Register @p fd to be written to on SIGCHLD. Returns the slot.
+  int add_wake_fd(int fd) {
+    boost::mutex::scoped_lock lock(wake_fds_mutex);
+
+    if (!sigchld_installed) {
+      for (int i = 0; i < max_pools; ++i)
+        wake_fds[i] = -1;
+
+      struct sigaction sa;
+      sa.sa_sigaction = &on_sigchld;
+      sigemptyset(&sa.sa_mask);
+      sa.sa_flags = SA_SIGINFO | SA_RESTART | SA_NOCLDSTOP;
+      if (::sigaction(SIGCHLD, &sa, &previous_sigchld) < 0)
+        throw_errno("subprocess.Pool: installing SIGCHLD handler");
+      sigchld_installed = true;
+    }
+
+    for (int i = 0; i < max_pools; ++i) {
+      if (wake_fds[i] < 0) {
+        wake_fds[i] = fd;
+        return i;
+      }
+    }
+    throw exception("subprocess.Pool: too many pools");
+  }
+
+  void remove_wake_fd(int slot) {
+    boost::mutex::scoped_lock lock(wake_fds_mutex);
+    wake_fds[slot] = -1;
+  }
+}
+#endif
+
+// -- Pool ------------------------------------------------------------------
+
+class Pool::impl : public boost::enable_shared_from_this<Pool::impl> {
+public:
+  impl(std::size_t concurrency);
+  ~impl();
+
+  typedef boost::shared_ptr<impl> ptr;
+  typedef boost::weak_ptr<impl> weak_ptr;
+
+  struct task {
+    task()
+      : index(0), pid(0), exited(false), pipes_done(false), reported(false)
+    {}
+
+    std::size_t index;
+    communication_ptr comm;
+    int pid;
+    bool exited;
+    bool pipes_done;
+    bool reported;
+    pt::ptime start;
+  };
+
+  typedef boost::shared_ptr<task> task_ptr;
+
+  std::size_t concurrency;
+  std::size_t next;             // index of the next spec to start
+  std::list<task_ptr> running;
+
+  // Traced by the Pool
+  object specs;
+  object options;
+  object results;
+  object on_result;
+
+  void start_next();
+  void check_finished(task_ptr const &t);
+
+  static void pipes_finished(weak_ptr self, boost::weak_ptr<task> t);
+
+#if defined(BOOST_POSIX_API)
+  int wake_pipe[2];
+  int wake_slot;
+  bool waiting; // for the wake pipe
+  boost::scoped_ptr<ba::posix::stream_descriptor> wake;
+  char wake_buf[64];
+
+  void wait_for_wake();
+  static void woken(weak_ptr self, error_code const &ec);
+  void reap();
+  task_ptr find_running(int pid);
+  void set_exited(task_ptr const &t, int status);
+#endif
+};
+
+Pool::impl::impl(std::size_t concurrency)
+  : concurrency(concurrency), next(0)
+{
+#if defined(BOOST_POSIX_API)
+  waiting = false;
+
+  if (::pipe(wake_pipe) < 0)
+    throw_errno("subprocess.Pool: creating pipe");
+
+  for (int i = 0; i < 2; ++i) {
+    ::fcntl(wake_pipe[i], F_SETFL, ::fcntl(wake_pipe[i], F_GETFL) | O_NONBLOCK);
+    ::fcntl(wake_pipe[i], F_SETFD, FD_CLOEXEC);
+  }
+
+  wake.reset(new ba::posix::stream_descriptor(
+    flusspferd::event::io_service(), wake_pipe[0]));
+
+  try {
+    wake_slot = add_wake_fd(wake_pipe[1]);
+  } catch (...) {
+    ::close(wake_pipe[1]);
+    throw;
+  }
+#else
+  throw exception("subprocess.Pool is not supported on this platform");
+#endif
+}
+
+Pool::impl::~impl() {
+#if defined(BOOST_POSIX_API)
+  remove_wake_fd(wake_slot);
+  ::close(wake_pipe[1]);
+  // The descriptor closes the read end
+#endif
+}
+
+void Pool::impl::start_next() {
+  array spec_array(specs);
+
+  while (running.size() < concurrency && next < spec_array.length()) {
+    task_ptr t(new task);
+    t->index = next++;
+    t->start = pt::microsec_clock::universal_time();
+
+    value spec = spec_array.get_element(t->index);
+    object process = launch(spec, "");
+    Subprocess &child = get_native<Subprocess>(process);
+
+    t->pid = child.get_pid();
+    t->comm.reset(new communication(process, create<object>()));
+    t->comm->options.read(options);
+    t->comm->on_done = boost::bind(
+      &impl::pipes_finished, weak_ptr(shared_from_this()), boost::weak_ptr<task>(t));
+    running.push_back(t);
+
+    value input;
+    if (spec.is_object() && !spec.get_object().is_array())
+      input = spec.get_object().get_property("input");
+
+    child.start_communication(t->comm, input, options);
+
+    // Nothing to read or write: the pipes are done already
+    if (t->comm->pending == 0)
+      t->pipes_done = true;
+  }
+
+#if defined(BOOST_POSIX_API)
+  // Children that exited before they were registered
+  reap();
+#endif
+}
+
+void Pool::impl::pipes_finished(weak_ptr weak_self, boost::weak_ptr<task> weak_t) {
+  ptr self = weak_self.lock();
+  task_ptr t = weak_t.lock();
+  if (!self || !t)
+    return;
+
+  t->pipes_done = true;
+  self->check_finished(t);
+}
+
+void Pool::impl::check_finished(task_ptr const &t) {
+  // The result callback may run the event loop, which can finish the same
+  // task again through pipes_finished
+  if (t->reported || !t->exited || !t->pipes_done)
+    return;
+
+  t->reported = true;
+  running.remove(t);
+
+  double ms = (pt::microsec_clock::universal_time() - t->start)
+    .total_microseconds() / 1000.0;
+
+  root_object result(t->comm->result);
+  result.set_property("time", ms);
+  array(results).set_element(t->index, result);
+
+  // Keep the pool full before handing out the result
+  start_next();
+
+#if defined(BOOST_POSIX_API)
+  // Don't keep the event loop busy without children
+  if (running.empty() && waiting)
+    wake->cancel();
+#endif
+
+  if (!on_result.is_null()) {
+    arguments arg;
+    arg.push_root(result);
+    arg.push_root(value(t->index));
+    on_result.call(arg);
+  }
+}
+
+#if defined(BOOST_POSIX_API)
+void Pool::impl::wait_for_wake() {
+  waiting = true;
+  wake->async_read_some(
+    ba::buffer(wake_buf),
+    boost::bind(&impl::woken, weak_ptr(shared_from_this()), ba::placeholders::error));
+}
+
+void Pool::impl::woken(weak_ptr weak_self, error_code const &ec) {
+  ptr self = weak_self.lock();
+  if (!self)
+    return;
+
+  self->waiting = false;
+  if (ec == ba::error::operation_aborted)
+    return;
+  if (ec)
+    throw boost::system::system_error(ec, "subprocess.Pool: waiting for SIGCHLD");
+
+  self->reap();
+
+  // If a result callback threw, Pool#run waits again when it is called next
+  if (!self->running.empty() && !self->waiting)
+    self->wait_for_wake();
+}
+
+Pool::impl::task_ptr Pool::impl::find_running(int pid) {
+  for (std::list<task_ptr>::iterator it = running.begin(); it != running.end(); ++it)
+    if ((*it)->pid == pid)
+      return *it;
+  return task_ptr();
+}
+
+void Pool::impl::set_exited(task_ptr const &t, int status) {
+  t->exited = true;
+  get_native<Subprocess>(t->comm->process).set_exit_status(status);
+}
+
+void Pool::impl::reap() {
+  // Ask which child exited without reaping it, so that children started
+  // outside the pool keep their exit status for whoever waits for them
+  for (;;) {
+    siginfo_t info;
+    info.si_pid = 0;
+    if (::waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT) < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == ECHILD)
+        break;
+      throw_errno("subprocess.Pool: waitid");
+    }
+    if (info.si_pid == 0)
+      break;
+
+    task_ptr t = find_running(info.si_pid);
+    if (!t || t->exited) {
+      // Not ours: it may hide our children, so look for each of them
+      for (std::list<task_ptr>::iterator it = running.begin();
+           it != running.end(); ++it)
+      {
+        if ((*it)->exited)
+          continue;
+        int status;
+        int r = ::waitpid((*it)->pid, &status, WNOHANG);
+        if (r == (*it)->pid)
+          set_exited(*it, status);
+        else if (r < 0 && errno != EINTR)
+          throw_errno("subprocess.Pool: waitpid");
+      }
+      break;
+    }
+
+    int status;
+    int r = ::waitpid(t->pid, &status, WNOHANG);
+    if (r == t->pid)
+      set_exited(t, status);
+    else if (r < 0 && errno != EINTR)
+      throw_errno("subprocess.Pool: waitpid");
+  }
+
+  // Report one task at a time and look again afterwards: the result callback
+  // may change the running tasks. If it throws, the tasks left are reported
+  // by the next reap.
+  for (;;) {
+    task_ptr done;
+    for (std::list<task_ptr>::iterator it = running.begin(); it != running.end(); ++it) {
+      if ((*it)->exited && (*it)->pipes_done && !(*it)->reported) {
+        done = *it;
+        break;
+      }
+    }
+    if (!done)
+      break;
+    check_finished(done);
+  }
+}
+#endif
+
+Pool::Pool( object const &o, call_context &x )
+  : base_type(o)
+{
+  object options;
+  if ( !x.arg[0].is_undefined_or_null() ) {
+    if ( !x.arg[0].is_object() )
+      throw exception("subprocess.Pool: options must be an object", "TypeError");
+    options = x.arg[0].get_object();
+  }
+
+  int concurrency = 4;
+  if ( !options.is_null() && options.has_property("concurrency") )
+    concurrency = int(options.get_property("concurrency").to_integral_number(32, true));
+  if ( concurrency < 1 )
+    throw exception("subprocess.Pool: concurrency must be at least 1", "RangeError");
+
+  p.reset( new impl(concurrency) );
+  p->specs = create<array>();
+  p->results = create<array>();
+  p->options = options;
+}
+
+Pool::~Pool() {
+}
+
+void Pool::trace( tracer &trc ) {
+  trc( "Pool#specs", p->specs );
+  trc( "Pool#results", p->results );
+  if ( !p->options.is_null() )
+    trc( "Pool#options", p->options );
+  if ( !p->on_result.is_null() )
+    trc( "Pool#onResult", p->on_result );
+}
+
+int Pool::get_concurrency() {
+  return p->concurrency;
+}
+
+int Pool::get_queued() {
+  return array(p->specs).length() - p->next;
+}
+
+int Pool::get_running() {
+  return p->running.size();
+}
+
+int Pool::add( value spec ) {
+  if ( !spec.is_string() && !(spec.is_object() && !spec.is_null()) )
+    throw exception("subprocess.Pool#add: spec must be a string, array or object", "TypeError");
+
+  array specs(p->specs);
+  specs.push(spec);
+  return specs.length() - 1;
+}
+
+object Pool::run( optional<object> on_result ) {
+  if ( on_result && !on_result->is_function() )
+    throw exception("subprocess.Pool#run: callback is not a function", "TypeError");
+
+  p->on_result = on_result ? *on_result : object();
+
+  p->start_next();
+
+#if defined(BOOST_POSIX_API)
+  if ( !p->running.empty() && !p->waiting )
+    p->wait_for_wake();
+#endif
+
+  // Other handlers in the event loop keep running while we wait
+  while ( !p->running.empty() ) {
+    if ( !flusspferd::event::run_once() )
+      break;
+  }
+
+  p->on_result = object();
+  return p->results;
+}
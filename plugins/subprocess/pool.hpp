@@ -0,0 +1,72 @@
+/*
+The MIT License
+
+Copyright (c) 2010 Flusspferd contributors (see "CONTRIBUTORS" or
+                                     http://flusspferd.org/contributors.txt)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef FLUSSPFERD_PLUGIN_SUBPROCESS_POOL_HPP
+#define FLUSSPFERD_PLUGIN_SUBPROCESS_POOL_HPP
+
+#include "flusspferd/tracer.hpp"
+#include "flusspferd/class_description.hpp"
+
+#include <boost/optional.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace subprocess {
+
+FLUSSPFERD_CLASS_DESCRIPTION(
+  Pool,
+  (constructor_name, "Pool")
+  (full_name, "subprocess.Pool")
+  (methods,
+    ("add", bind, add)
+    ("run", bind, run)
+  )
+  (properties,
+    ("concurrency", getter, get_concurrency)
+    ("queued", getter, get_queued)
+    ("running", getter, get_running)
+  )
+) {
+  public:
+    Pool( flusspferd::object const &o, flusspferd::call_context &x );
+    ~Pool();
+
+    int get_concurrency();
+    int get_queued();
+    int get_running();
+
+    int add( flusspferd::value spec );
+    flusspferd::object run( boost::optional<flusspferd::object> on_result );
+
+  protected:
+    void trace( flusspferd::tracer &trc );
+
+  private:
+    class impl;
+    boost::shared_ptr<impl> p;
+};
+
+} // namespace subprocess
+
+#endif
@@ -24,13 +24,25 @@ THE SOFTWARE.
 */
 
 #include "subprocess.hpp"
+#include "communication.hpp"
 
 #include <flusspferd/io/stream.hpp>
+#include <flusspferd/event.hpp>
+#include <flusspferd/arguments.hpp>
+#include <flusspferd/binary.hpp>
+#include <flusspferd/call_context.hpp>
+#include <flusspferd/create/native_object.hpp>
 
 #include <boost/asio.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/fusion/include/vector.hpp>
+#include <algorithm>
+#include <limits>
 #if defined(BOOST_POSIX_API)
 # include <boost/process/posix_status.hpp>
+# include <sys/wait.h>
 typedef boost::asio::posix::stream_descriptor asio_stream;
 #elif defined(BOOST_WINDOWS_API)
 # include <boost/process/win32_child.hpp>
@@ -166,51 +178,140 @@ value Subprocess::wait_impl(bool poll) {
   return ret;
 }
 
+#ifdef BOOST_POSIX_API
+value Subprocess::set_exit_status( int status ) {
+  value ret;
+  if (WIFSIGNALED(status))
+    ret = value(-WTERMSIG(status));
+  else if (WIFEXITED(status))
+    ret = value(WEXITSTATUS(status));
+  else
+    ret = object();
+
+  define_property("returncode", ret, read_only_property | permanent_property );
+  return ret;
+}
+#endif
+
 namespace {
-  ba::io_service &get_io_service() {
-    // TODO: ideally this wouldn't use its own io_service if there is one in the process already.
-    static ba::io_service svc;
-    return svc;
+  std::size_t size_option( object const &options, char const *name, std::size_t def ) {
+    if ( options.is_null() || !options.has_property(name) )
+      return def;
+
+    double n = options.get_property(name).to_number();
+    if ( !(n >= 0) )
+      throw exception(std::string("Subprocess#communicate: option '") + name +
+                      "' must be a non-negative number", "RangeError");
+    if ( n >= double(std::numeric_limits<std::size_t>::max()) )
+      return std::numeric_limits<std::size_t>::max();
+    return std::size_t(n);
   }
 }
 
-void Subprocess::handle_write( error_code const &ec, bool &done ) {
-  if (ec)
-    throw boost::system::system_error(ec, "Subprocess: writing to stdin");
+void capture_options::read( object const &options ) {
+  if ( options.is_null() )
+    return;
 
-  done = true;
+  binary = options.get_property("binary").to_boolean();
+  max_bytes = size_option( options, "maxBytes", max_bytes );
+  chunk_size = size_option( options, "chunkSize", chunk_size );
 }
 
 namespace {
+  struct writer_state {
+    asio_stream s;
+    communication_ptr comm;
+
+    // Either the bytes of a Binary, which are kept alive and unchanged by the
+    // storage, or the encoded input string
+    binary::storage_ptr storage;
+    std::size_t offset, length;
+    std::string text;
+
+    writer_state(bp::postream &s_, value const &input, communication_ptr comm_)
+      : s(flusspferd::event::io_service()),
+        comm(comm_),
+        offset(0),
+        length(0)
+    {
+      if ( input.is_object() && is_native<binary>(input.get_object()) )
+        storage = get_native<binary>(input.get_object()).share_storage(offset, length);
+      else
+        text = input.to_std_string();
+
+      s.assign( s_.handle().release() );
+      ++comm->pending;
+    }
+
+    ba::const_buffers_1 buffer() const {
+      if (storage)
+        return ba::buffer( storage->data() + offset, length );
+      return ba::buffer( text.data(), text.size() );
+    }
+
+    // Close the child's stdin once everything is written, so it sees EOF.
+    static void handle_write( boost::shared_ptr<writer_state> self, error_code const &ec ) {
+      self->s.close();
+      self->comm->pipe_done();
+
+      // The child may exit without reading all of its input
+      if (ec && ec != ba::error::broken_pipe)
+        throw boost::system::system_error(ec, "Subprocess: writing to stdin");
+    }
+
+    static void enqueue( boost::shared_ptr<writer_state> const &self ) {
+      ba::async_write( self->s, self->buffer(),
+        boost::bind( &writer_state::handle_write, self, ba::placeholders::error )
+      );
+    }
+  };
+
+  // Reads one output pipe into a buffer, which is turned into a String or
+  // ByteString once at the end, or passes it on to an io.Stream.
   struct reader_state : public boost::enable_shared_from_this<reader_state> {
-    boost::array<char, 4096> buff;
-    bool &done;
     boost::scoped_ptr<asio_stream> s;
-    string str;
-    object o;
+    communication_ptr comm;
     std::string prop;
 
-    reader_state(bp::pistream &s_, ba::io_service &svc, bool &done_, object o_, std::string const &prop_)
-      : done(done_),
-        s(new asio_stream(svc)),
-        o(o_),
-        prop(prop_)
+    binary::vector_type data;
+    std::size_t chunk_size;
+
+    // Where to write the output instead, if anywhere
+    boost::scoped_ptr<root_object> target;
+
+    reader_state(bp::pistream &s_, communication_ptr comm_, std::string const &prop_,
+                 object const &target_)
+      : s(new asio_stream(flusspferd::event::io_service())),
+        comm(comm_),
+        prop(prop_),
+        chunk_size(std::max<std::size_t>(comm_->options.chunk_size, 1))
     {
+      if (!target_.is_null())
+        target.reset(new root_object(target_));
       s->assign( s_.handle().release() );
-      o.set_property(prop, str);
-      done = false;
+      ++comm->pending;
     }
 
-    void handle_read( error_code const &ec, std::size_t n_read ) {
-      if (n_read) {
-        str = string::concat( str, string(buff.data(), n_read) );
-        o.set_property(prop, str);
+    void handle_read( error_code const &ec, std::size_t n_read, std::size_t start ) {
+      data.resize(start + n_read);
+
+      if (target) {
+        std::streambuf *buf = get_native<io::stream>(*target).streambuf();
+        if (n_read && buf->sputn(reinterpret_cast<char const*>(&data[0]), n_read)
+                        != std::streamsize(n_read))
+          throw exception("Subprocess: could not write " + prop + " to stream");
+        data.clear();
+      }
+      else if (data.size() > comm->options.max_bytes) {
+        data.resize(comm->options.max_bytes);
+        comm->result.set_property(prop + "Truncated", true);
       }
 
       // OSX gives EoF, Win32 gives EPIPE error.
       if (ec == ba::error::eof || ec == ba::error::broken_pipe) {
         s->close();
-        done = true;
+        done();
+        comm->pipe_done();
       }
       else if (ec)
         throw boost::system::system_error(ec, std::string("Subprocess: reading from ") + prop + " pipe");
@@ -218,70 +319,152 @@ namespace {
         enqueue();
     }
 
+    void done() {
+      if (target) {
+        get_native<io::stream>(*target).streambuf()->pubsync();
+        return;
+      }
+
+      if (comm->options.binary) {
+        std::size_t const n = data.size();
+        comm->result.set_property(prop, create<byte_string>(
+          boost::fusion::vector3<binary::storage_ptr const &, std::size_t, std::size_t>(
+            binary::adopt_storage(data), 0, n)));
+      }
+      else {
+        comm->result.set_property(prop, string(
+          reinterpret_cast<char const*>(data.empty() ? 0 : &data[0]), data.size()));
+      }
+    }
 
     void enqueue() {
-      ba::async_read(
-        *s, ba::buffer(buff),
+      // Read straight into the buffer, growing it geometrically. Once the
+      // limit is reached, keep reading into the same space so the child
+      // doesn't block.
+      std::size_t const start = data.size();
+      if (data.capacity() - start < chunk_size)
+        data.reserve(std::max(2 * data.capacity(), start + chunk_size));
+      data.resize(start + chunk_size);
+
+      s->async_read_some(
+        ba::buffer(&data[start], chunk_size),
         boost::bind( &reader_state::handle_read, shared_from_this(),
           boost::asio::placeholders::error,
-          boost::asio::placeholders::bytes_transferred )
+          boost::asio::placeholders::bytes_transferred,
+          start )
       );
     }
   };
+
+  // The io.Stream to redirect output to, if given in the options
+  object redirect_target( object const &options, char const *name ) {
+    if ( options.is_null() || !options.has_property(name) )
+      return object();
+
+    value v = options.get_property(name);
+    if ( !v.is_object() || v.is_null() || !is_native<io::stream>(v.get_object()) )
+      throw exception(std::string("Subprocess#communicate: option '") + name +
+                      "' is not an io.Stream", "TypeError");
+    return v.get_object();
+  }
+
+
 }
 
-object Subprocess::communicate( optional<value> input_ ) {
+namespace {
+  typedef boost::shared_ptr<root_object> root_object_ptr;
+
+  // Pass the result of an asynchronous Subprocess#communicate to its callback
+  void finish_communication( communication *comm, root_object_ptr callback ) {
+    comm->result.set_property("returncode",
+      get_native<Subprocess>(comm->process).wait());
 
-  // stupid non-copyable root<T> objects. Right PITA they are.
-  boost::scoped_ptr<root_string> root_input;
+    arguments arg;
+    arg.push_root(comm->result);
+    callback->call(arg);
+  }
 
-  ba::io_service &svc = get_io_service();
+  void finish_communication_later( communication_ptr comm, root_object_ptr callback ) {
+    finish_communication( comm.get(), callback );
+  }
+}
 
-  bool done_stdout = true, done_stderr = true, done_stdin = true;
+void Subprocess::communicate( call_context &x ) {
+  // communicate([input][, options][, callback])
+  std::size_t n = x.arg.size();
+  value callback;
+  if ( n > 0 && x.arg[n - 1].is_function() )
+    callback = x.arg[--n];
 
-  if ( input_ ) {
-    if ( stdin_ && stdin_->is_undefined() )
-      throw exception("Subprocess#communicate: input provided when child's stdin is closed");
+  value input = n > 0 ? x.arg[0] : value();
 
-    done_stdin = false;
+  object options;
+  if ( n > 1 && !x.arg[1].is_undefined_or_null() ) {
+    if ( !x.arg[1].is_object() )
+      throw exception("Subprocess#communicate: options must be an object", "TypeError");
+    options = x.arg[1].get_object();
+  }
 
-    // We need the string to be rooted until the async_write compeltes.
-    root_input.reset( new root_string( input_->to_string() ) );
-    std::string const &s = root_input->to_string();
+  communication_ptr comm(new communication(*this, create<object>()));
+  comm->options.read(options);
 
-    asio_stream in( svc );
-    in.assign( child_.get_stdin().handle().release() );
+  root_object_ptr root_callback;
+  if ( callback.is_object() ) {
+    root_callback.reset( new root_object( callback.get_object() ) );
+    comm->on_done = boost::bind( &finish_communication, comm.get(), root_callback );
+  }
 
-    ba::async_write( in, ba::buffer( s.data(), s.size() ),
-      boost::bind( &Subprocess::handle_write, this, ba::placeholders::error, done_stdin )
-    );
+  start_communication( comm, input, options );
+
+  if ( root_callback ) {
+    // Nothing to wait for: report from the event loop all the same
+    if ( comm->pending == 0 )
+      flusspferd::event::io_service().post( boost::bind(
+        &finish_communication_later, comm, root_callback ) );
+    return;
+  }
+
+  // Other handlers in the event loop, such as timers, keep running while we
+  // wait for the pipes.
+  while ( comm->pending > 0 ) {
+    if ( !flusspferd::event::run_once() )
+      break;
   }
 
-  object ret = create<object>();
-  root_object root_ret(ret);
+  comm->result.set_property("returncode", wait());
+  x.result = comm->result;
+}
+
+void Subprocess::start_communication( communication_ptr const &comm,
+                                      value const &input, object const &options )
+{
+  if ( !input.is_undefined_or_null() ) {
+    if ( stdin_ && stdin_->is_undefined() )
+      throw exception("Subprocess#communicate: input provided when child's stdin is closed");
+
+    boost::shared_ptr<writer_state> w(new writer_state(child_.get_stdin(), input, comm));
+    writer_state::enqueue(w);
+  }
+  else if ( !stdin_ ) {
+    // Nothing to write: let the child see EOF instead of waiting for input
+    child_.get_stdin().close();
+  }
 
   if ( !stdout_ || !stdout_->is_undefined() ) {
-    boost::shared_ptr<reader_state> r(new reader_state(child_.get_stdout(), svc, done_stdout, ret, "stdout"));
+    boost::shared_ptr<reader_state> r(new reader_state(
+      child_.get_stdout(), comm, "stdout", redirect_target(options, "stdout")));
     r->enqueue();
   }
   else {
-    ret.set_property("stdout", object());
+    comm->result.set_property("stdout", object());
   }
 
   if ( !stderr_ || !stderr_->is_undefined() ) {
-    boost::shared_ptr<reader_state> r(new reader_state(child_.get_stderr(), svc, done_stderr, ret, "stderr"));
+    boost::shared_ptr<reader_state> r(new reader_state(
+      child_.get_stderr(), comm, "stderr", redirect_target(options, "stderr")));
     r->enqueue();
   }
   else {
-    ret.set_property("stderr", object());
-  }
-
-  while (!done_stderr || !done_stdout || !done_stderr) {
-    svc.run();
+    comm->result.set_property("stderr", object());
   }
-  svc.reset();
-
-  ret.set_property("returncode", wait());
-
-  return ret;
 }
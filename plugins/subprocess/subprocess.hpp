@@ -39,6 +39,9 @@ THE SOFTWARE.
 namespace subprocess {
   namespace bp = boost::process;
 
+  struct communication;
+  typedef boost::shared_ptr<communication> communication_ptr;
+
 FLUSSPFERD_CLASS_DESCRIPTION(
   Subprocess,
   (constructor_name, "Subprocess")
@@ -90,11 +93,23 @@ FLUSSPFERD_CLASS_DESCRIPTION(
     flusspferd::value wait() { return wait_impl(false); }
     flusspferd::value poll() { return wait_impl(true); }
 
-    flusspferd::object communicate( boost::optional<flusspferd::value> stdin_ );
+    void communicate( flusspferd::call_context &x );
+
+    // Start writing @p input to the child and reading its output into
+    // comm->result, as configured by @p options (see Subprocess#communicate)
+    void start_communication( communication_ptr const &comm,
+                              flusspferd::value const &input,
+                              flusspferd::object const &options );
 
-    void handle_write( boost::system::error_code const &ec, bool &done );
+#ifdef BOOST_POSIX_API
+    // Store the status of a child reaped by someone else as returncode
+    flusspferd::value set_exit_status( int status );
+#endif
 };
 
+  // Start a child described like the first argument of subprocess.popen
+  flusspferd::object launch( flusspferd::value spec, std::string const &mode );
+
 } // namespace subprocess
 
 #endif
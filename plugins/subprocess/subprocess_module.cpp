@@ -31,6 +31,7 @@ THE SOFTWARE.
 #include "flusspferd/property_iterator.hpp"
 
 #include "subprocess.hpp"
+#include "pool.hpp"
 
 #ifndef WIN32
 # include <signal.h>
@@ -65,6 +66,7 @@ FLUSSPFERD_LOADER_SIMPLE(exports) {
      param::_container = exports);
 
   load_class<subprocess::Subprocess>(exports);
+  load_class<subprocess::Pool>(exports);
 
   exports.define_properties(read_only_property | permanent_property)
 #ifdef WIN32
@@ -230,13 +232,6 @@ namespace {
 }
 
 void subprocess::popen(flusspferd::call_context &x) {
-  bp::context ctx;
-
-  // Default stream behaviours:
-  ctx.stdin_behavior = bp::capture_stream();
-  ctx.stdout_behavior = bp::capture_stream();
-  ctx.stderr_behavior = bp::capture_stream();
-
   size_t n = x.arg.size();
 
   if (n < 1)
@@ -257,8 +252,17 @@ void subprocess::popen(flusspferd::call_context &x) {
     mode = s.to_string();
   }
 
+  x.result = launch( x.arg[0], mode );
+}
+
+object subprocess::launch(value v, std::string const &mode) {
+  bp::context ctx;
+
+  // Default stream behaviours:
+  ctx.stdin_behavior = bp::capture_stream();
+  ctx.stdout_behavior = bp::capture_stream();
+  ctx.stderr_behavior = bp::capture_stream();
 
-  value v = x.arg[0];
   if ( v.is_object() ) {
     object o = v.get_object();
 
@@ -273,12 +277,12 @@ void subprocess::popen(flusspferd::call_context &x) {
       bp::child c = bp::launch( args.front(), args, ctx );
 
       apply_mode_string( ctx, mode );
-      x.result = create<Subprocess>( boost::fusion::make_vector( c, ctx ) );
+      return create<Subprocess>( boost::fusion::make_vector( c, ctx ) );
     }
     else {
       //  popen( { ... } )
 
-      x.result = popen_from_obj( o, ctx );
+      return popen_from_obj( o, ctx ).get_object();
     }
   }
   else {
@@ -291,8 +295,6 @@ void subprocess::popen(flusspferd::call_context &x) {
     ctx.environment = bp::self::get_environment();
 
     bp::child child = bp::launch_shell(v.to_std_string(), ctx );
-    x.result = create<Subprocess>( boost::fusion::make_vector( child, ctx ) );
+    return create<Subprocess>( boost::fusion::make_vector( child, ctx ) );
   }
-
 }
-
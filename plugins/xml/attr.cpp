@@ -64,7 +64,9 @@ string_type attr::getValue() {
 
 void attr::setValue(string_type s) {
   XML_CB_TRY {
+    std::size_t old_size = estimate_dom_size(impl_);
     impl_.setValue(s);
+    dom_changed(old_size + estimate_dom_size(impl_));
   } XML_CB_CATCH
 }
 
@@ -59,7 +59,9 @@ string_type character_data::getData() {
 
 void character_data::setData(string_type s) {
   XML_CB_TRY {
+    std::size_t old_size = estimate_dom_size(impl_);
     impl_.setData(s);
+    dom_changed(old_size + estimate_dom_size(impl_));
   } XML_CB_CATCH
 }
 
@@ -71,25 +73,33 @@ string_type character_data::substringData(int offset, int count) {
 
 void character_data::appendData(string_type arg) {
   XML_CB_TRY {
+    std::size_t old_size = estimate_dom_size(impl_);
     impl_.appendData(arg);
+    dom_changed(old_size + estimate_dom_size(impl_));
   } XML_CB_CATCH
 }
 
 void character_data::insertData(int offset, string_type arg) {
   XML_CB_TRY {
+    std::size_t old_size = estimate_dom_size(impl_);
     impl_.insertData(offset, arg);
+    dom_changed(old_size + estimate_dom_size(impl_));
   } XML_CB_CATCH
 }
 
 void character_data::deleteData(int offset, int count) {
   XML_CB_TRY {
+    std::size_t old_size = estimate_dom_size(impl_);
     impl_.deleteData(offset, count);
+    dom_changed(old_size + estimate_dom_size(impl_));
   } XML_CB_CATCH
 }
 
 void character_data::replaceData(int offset, int count, string_type arg) {
   XML_CB_TRY {
+    std::size_t old_size = estimate_dom_size(impl_);
     impl_.replaceData(offset, count, arg);
+    dom_changed(old_size + estimate_dom_size(impl_));
   } XML_CB_CATCH
 }
 
@@ -102,7 +112,9 @@ text::text(object const &proto, wrapped_type const &node, weak_node_map map)
 
 object text::splitText(int offset) {
   XML_CB_TRY {
-    return get_node(static_cast<arabica_text&>(impl_).splitText(offset));
+    object o = get_node(static_cast<arabica_text&>(impl_).splitText(offset));
+    dom_changed(estimate_dom_size(impl_));
+    return o;
   } XML_CB_CATCH
 }
 
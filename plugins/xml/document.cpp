@@ -43,17 +43,36 @@ namespace xml_plugin {
 }
 
 document::document(object const &proto, call_context &)
-  : base_type(proto)
+  : base_type(proto),
+    memory_("xml"),
+    changed_(0)
 {
 }
 
 
 document::document(object const &proto, wrapped_type const &doc, weak_node_map map)
   : base_type(proto, doc, map),
-    doc_(doc)
+    doc_(doc),
+    memory_("xml", estimate_dom_size(doc)),
+    changed_(0)
 {
 }
 
+void document::update_memory(std::size_t touched) {
+  if (!doc_)
+    return;
+
+  // Walking the whole tree after every change would make building a document
+  // quadratic, so it is only estimated again once the changes add up to an
+  // eighth of the last estimate.
+  changed_ += touched;
+  if (changed_ <= memory_.size() / 8)
+    return;
+
+  memory_.resize(estimate_dom_size(doc_));
+  changed_ = 0;
+}
+
 document::~document() {
 }
 
@@ -88,8 +88,15 @@ public:
   object getElementsByTagNameNS(string_type ns_uri, string_type local_name);
   object getElementById(string_type id);
 
+  // Called by node::dom_changed
+  void update_memory(std::size_t touched);
+
 protected:
   wrapped_type doc_;
+
+  // Estimated size of the tree, and the bytes changed since it was taken
+  flusspferd::external_memory memory_;
+  std::size_t changed_;
 };
 
 
@@ -57,13 +57,18 @@ string_type element::getAttribute(string_type name) {
 
 void element::setAttribute(string_type name, string_type value) {
   XML_CB_TRY {
-    return element_.setAttribute(name, value);
+    std::size_t old_size =
+      estimate_dom_size(element_.getAttributeNode(name));
+    element_.setAttribute(name, value);
+    dom_changed(old_size + estimate_dom_size(element_.getAttributeNode(name)));
   } XML_CB_CATCH
 }
 
 void element::removeAttribute(string_type name) {
   XML_CB_TRY {
+    std::size_t touched = estimate_dom_size(element_.getAttributeNode(name));
     element_.removeAttribute(name);
+    dom_changed(touched);
   } XML_CB_CATCH
 }
 
@@ -75,17 +80,21 @@ object element::getAttributeNode(string_type name) {
 
 object element::setAttributeNode(attr &a) {
   XML_CB_TRY {
-    return get_node( element_.setAttributeNode(
+    arabica_attr old = element_.setAttributeNode(
       static_cast<arabica_attr>(a.underlying_impl())
-    ) );
+    );
+    dom_changed(estimate_dom_size(a.underlying_impl()) + estimate_dom_size(old));
+    return get_node(old);
   } XML_CB_CATCH
 }
 
 object element::removeAttributeNode(attr &a) {
   XML_CB_TRY {
-    return get_node( element_.removeAttributeNode(
+    arabica_attr old = element_.removeAttributeNode(
       static_cast<arabica_attr>(a.underlying_impl())
-    ) );
+    );
+    dom_changed(estimate_dom_size(old));
+    return get_node(old);
   } XML_CB_CATCH
 }
 
@@ -107,13 +116,20 @@ string_type element::getAttributeNS(string_type ns_uri, string_type local_name)
 
 void element::setAttributeNS(string_type ns_uri, string_type local_name, string_type value) {
   XML_CB_TRY {
+    std::size_t old_size =
+      estimate_dom_size(element_.getAttributeNodeNS(ns_uri, local_name));
     element_.setAttributeNS(ns_uri, local_name, value);
+    dom_changed(old_size +
+      estimate_dom_size(element_.getAttributeNodeNS(ns_uri, local_name)));
   } XML_CB_CATCH
 }
 
 void element::removeAttributeNS(string_type ns_uri, string_type local_name) {
   XML_CB_TRY {
+    std::size_t touched =
+      estimate_dom_size(element_.getAttributeNodeNS(ns_uri, local_name));
     element_.removeAttributeNS(ns_uri, local_name);
+    dom_changed(touched);
   } XML_CB_CATCH
 }
 
@@ -125,9 +141,11 @@ object element::getAttributeNodeNS(string_type ns_uri, string_type local_name) {
 
 object element::setAttributeNodeNS(attr &a) {
   XML_CB_TRY {
-    return get_node( element_.setAttributeNodeNS(
+    arabica_attr old = element_.setAttributeNodeNS(
       static_cast<arabica_attr>(a.underlying_impl())
-    ) );
+    );
+    dom_changed(estimate_dom_size(a.underlying_impl()) + estimate_dom_size(old));
+    return get_node(old);
   } XML_CB_CATCH
 }
 
@@ -114,13 +114,20 @@ object named_node_map::getNamedItem(string_type name) {
 
 object named_node_map::setNamedItem(node &arg) {
   XML_CB_TRY {
-    return get_node(impl_.setNamedItem(arg.underlying_impl()));
+    arabica_node old = impl_.setNamedItem(arg.underlying_impl());
+    arg.dom_changed(
+      estimate_dom_size(arg.underlying_impl()) + estimate_dom_size(old));
+    return get_node(old);
   } XML_CB_CATCH
 }
 
 object named_node_map::removeNamedItem(string_type name) {
   XML_CB_TRY {
-    return get_node(impl_.removeNamedItem(name));
+    arabica_node old = impl_.removeNamedItem(name);
+    object o = get_node(old);
+    if (!o.is_null())
+      flusspferd::get_native<node>(o).dom_changed(estimate_dom_size(old));
+    return o;
   } XML_CB_CATCH
 }
 
@@ -132,13 +139,20 @@ object named_node_map::getNamedItemNS(string_type ns_uri, string_type local_name
 
 object named_node_map::setNamedItemNS(node &arg) {
   XML_CB_TRY {
-    return get_node(impl_.setNamedItemNS(arg.underlying_impl()));
+    arabica_node old = impl_.setNamedItemNS(arg.underlying_impl());
+    arg.dom_changed(
+      estimate_dom_size(arg.underlying_impl()) + estimate_dom_size(old));
+    return get_node(old);
   } XML_CB_CATCH
 }
 
 object named_node_map::removeNamedItemNS(string_type ns_uri, string_type local_name) {
   XML_CB_TRY {
-    return get_node(impl_.removeNamedItemNS(ns_uri, local_name));
+    arabica_node old = impl_.removeNamedItemNS(ns_uri, local_name);
+    object o = get_node(old);
+    if (!o.is_null())
+      flusspferd::get_native<node>(o).dom_changed(estimate_dom_size(old));
+    return o;
   } XML_CB_CATCH
 }
 
@@ -27,6 +27,7 @@ THE SOFTWARE.
 #include <flusspferd/aliases.hpp>
 
 #include "node.hpp"
+#include "document.hpp"
 #include "node_list.hpp"
 #include "named_node_map.hpp"
 #include "dom_exception.hpp"
@@ -40,10 +41,49 @@ using namespace flusspferd;
 using namespace flusspferd::aliases;
 using namespace xml_plugin;
 
+namespace {
+  // Rough footprint of a DOM node apart from its strings.
+  std::size_t const NODE_OVERHEAD = 128;
+
+  std::size_t node_size(arabica_node const &n) {
+    return NODE_OVERHEAD + n.getNodeName().size() + n.getNodeValue().size();
+  }
+}
+
 namespace xml_plugin {
   void load_node(object &exports) {
     load_class<node>(exports);
   }
+
+  // Walk the tree in document order to estimate the memory it holds.
+  std::size_t estimate_dom_size(arabica_node const &root) {
+    if (!root)
+      return 0;
+
+    std::size_t total = 0;
+    arabica_node n = root;
+    for (;;) {
+      total += node_size(n);
+      if (n.hasAttributes()) {
+        Arabica::DOM::NamedNodeMap<string_type> attrs = n.getAttributes();
+        for (unsigned i = 0; i < attrs.getLength(); ++i)
+          total += node_size(attrs.item(i));
+      }
+
+      arabica_node next = n.getFirstChild();
+      while (!next) {
+        if (n == root)
+          return total;
+        next = n.getNextSibling();
+        if (!next) {
+          n = n.getParentNode();
+          if (!n)
+            return total;
+        }
+      }
+      n = next;
+    }
+  }
 }
 
 node::node(object const &proto)
@@ -100,7 +140,9 @@ value node::getNodeValue() {
 
 void node::setNodeValue(string_type const &s) {
   XML_CB_TRY {
+    std::size_t old_size = node_size(node_);
     node_.setNodeValue(s);
+    dom_changed(old_size + node_size(node_));
   } XML_CB_CATCH
 }
 
@@ -141,6 +183,21 @@ object node::get_node(wrapped_type const &n) {
   } XML_CB_CATCH
 }
 
+void node::dom_changed(std::size_t touched) {
+  node_map_ptr map = node_map_.lock();
+  if (!map || !node_)
+    return;
+
+  arabica_node doc =
+    node_.getNodeType() == Arabica::DOM::Node_base::DOCUMENT_NODE
+    ? node_
+    : arabica_node(node_.getOwnerDocument());
+  if (!doc)
+    return;
+
+  flusspferd::get_native<document>(map->get_node(doc)).update_memory(touched);
+}
+
 object node::getChildNodes() {
   XML_CB_TRY {
     return create<node_list>( make_vector(node_.getChildNodes(), node_map_) );
@@ -164,25 +221,38 @@ object node::getOwnerDocument() {
 
 object node::insertBefore(node &newChild, node &refChild) {
   XML_CB_TRY {
-    return get_node(node_.insertBefore(newChild.node_, refChild.node_));
+    // Measured first, a fragment is empty once its children are moved
+    std::size_t touched = estimate_dom_size(newChild.node_);
+    object o = get_node(node_.insertBefore(newChild.node_, refChild.node_));
+    dom_changed(touched);
+    return o;
   } XML_CB_CATCH
 }
 
 object node::replaceChild(node &newChild, node &oldChild) {
   XML_CB_TRY {
-    return get_node(node_.insertBefore(newChild.node_, oldChild.node_));
+    std::size_t touched =
+      estimate_dom_size(newChild.node_) + estimate_dom_size(oldChild.node_);
+    object o = get_node(node_.insertBefore(newChild.node_, oldChild.node_));
+    dom_changed(touched);
+    return o;
   } XML_CB_CATCH
 }
 
 object node::removeChild(node &oldChild) {
   XML_CB_TRY {
-    return get_node(node_.removeChild(oldChild.node_));
+    object o = get_node(node_.removeChild(oldChild.node_));
+    dom_changed(estimate_dom_size(oldChild.node_));
+    return o;
   } XML_CB_CATCH
 }
 
 object node::appendChild(node &newChild) {
   XML_CB_TRY {
-    return get_node(node_.appendChild(newChild.node_));
+    std::size_t touched = estimate_dom_size(newChild.node_);
+    object o = get_node(node_.appendChild(newChild.node_));
+    dom_changed(touched);
+    return o;
   } XML_CB_CATCH
 }
 
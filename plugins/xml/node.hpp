@@ -37,6 +37,9 @@ namespace xml_plugin {
 namespace phoenix = boost::phoenix;
 namespace args = phoenix::arg_names;
 
+// Rough memory held by the subtree at root, attributes included.
+std::size_t estimate_dom_size(arabica_node const &root);
+
 #define enum_prop(x) (#x, constant, int(Arabica::DOM::Node_base:: x))
 FLUSSPFERD_CLASS_DESCRIPTION(
     node,
@@ -132,6 +135,9 @@ public:
     { return node_.isSupported(feat, ver); }
   bool hasAttributes() { return node_.hasAttributes(); }
 
+  // Tell the owner document that roughly touched bytes of its tree changed
+  void dom_changed(std::size_t touched);
+
 protected:
 
   node(flusspferd::object const &proto);
@@ -38,6 +38,7 @@ THE SOFTWARE.
 #include <cctype>
 #include <string>
 #include <list>
+#include <vector>
 
 #ifdef HAVE_EDITLINE
 #include <editline/readline.h>
@@ -73,10 +74,13 @@ class flusspferd_repl {
 
   std::string history_file;
 
+  // Write a bundle of the modules instead of running them
+  std::string bundle_output;
+
   int argc;
   char ** argv;
 
-  enum Type { File, Expression, IncludePath, Module, MainModule };
+  enum Type { File, Expression, IncludePath, Module, MainModule, Bundle };
 
   typedef std::list<std::pair<std::string, Type> > RunableCommandLine;
   RunableCommandLine runnables;
@@ -93,6 +97,7 @@ class flusspferd_repl {
   void print_cmakefile();
   void add_runnable(std::string const &path, Type type, bool del_interactive);
   void set_gc_zeal(std::string const &s);
+  void disable_compile_cache();
   void load_config();
 
   // Handle options from "// flusspferd: opts" lines
@@ -168,9 +173,10 @@ int flusspferd_repl::run() {
     if (!interactive)
       throw;
   } catch (std::exception &e) {
-    if (interactive_set && interactive)
+    if (interactive_set && interactive) {
+      flusspferd::flush_standard_streams();
       std::cerr << "ERROR: " << e.what() << '\n';
-    else
+    } else
       throw;
   }
 
@@ -192,8 +198,29 @@ void flusspferd_repl::run_cmdline() {
 
   bool first = true;
 
+  // In bundle mode modules are collected rather than run
+  bool const bundling = !bundle_output.empty();
+  std::vector<std::string> bundle_roots;
+
   typedef std::list<std::pair<std::string, Type> >::const_iterator iter;
   for (iter i = runnables.begin(), e = runnables.end(); i != e; ++i) {
+    if (bundling) {
+      switch (i->second) {
+      case File:
+        bundle_roots.push_back(
+          "file://" + flusspferd::io::fs_base::canonicalize(i->first).string());
+        continue;
+      case Module:
+      case MainModule:
+        bundle_roots.push_back(i->first);
+        continue;
+      case Expression:
+        continue;
+      default:
+        break;
+      }
+    }
+
     switch (i->second) {
     case File:
     {
@@ -222,8 +249,18 @@ void flusspferd_repl::run_cmdline() {
       require.set_main_module(i->first);
       require_obj.call(flusspferd::global(), i->first);
       break;
+    case Bundle:
+      require_obj.get_property_object("bundles").call("push", i->first);
+      break;
     }
   }
+
+  if (bundling) {
+    if (bundle_roots.empty())
+      throw std::runtime_error("--write-bundle needs a file or module to bundle");
+    require.write_bundle(bundle_roots, bundle_output);
+    interactive = false;
+  }
 }
 
 void flusspferd_repl::repl_loop() {
@@ -269,11 +306,14 @@ void flusspferd_repl::repl_loop() {
 
     try {
       flusspferd::value v = flusspferd::evaluate(source, "[typein]", startline);
+      flusspferd::flush_standard_streams();
       if (!v.is_undefined()) {
         std::cout << v.to_source() << '\n';
+        std::cout.flush();
       }
     }
     catch(std::exception &e) {
+      flusspferd::flush_standard_streams();
       std::cerr << "ERROR: " << e.what() << '\n';
     }
 
@@ -361,6 +401,13 @@ void flusspferd_repl::set_gc_zeal(std::string const &s) {
 }
 
 
+void flusspferd_repl::disable_compile_cache() {
+  flusspferd::global()
+    .get_property_object("require")
+    .get_property_object("compileCache")
+    .set_property("enabled", false);
+}
+
 void flusspferd_repl::load_config() {
   // Define the prelude property so its not a strict warning to assign to it.
   co.global().set_property("prelude", flusspferd::value());
@@ -504,7 +551,30 @@ flusspferd::object flusspferd_repl::option_spec(bool for_main_repl) {
     flusspferd::param::_signature = flusspferd::param::type<void (flusspferd::value, std::string)>(),
     flusspferd::param::_container = module);
 
+  flusspferd::object bundle(flusspferd::create<flusspferd::object>());
+  spec.set_property("bundle", bundle);
+  bundle.set_property("alias", "B");
+  bundle.set_property("doc", "Load modules from bundle before searching the include path.");
+  bundle.set_property("argument", "required");
+  bundle.set_property("argument_type", "file");
+  flusspferd::create<flusspferd::function>(
+    "callback",
+    phoenix::bind(&flusspferd_repl::add_runnable, this, args::arg2, Bundle, false),
+    flusspferd::param::_signature = flusspferd::param::type<void (flusspferd::value, std::string)>(),
+    flusspferd::param::_container = bundle);
+
   if (for_main_repl) {
+    flusspferd::object write_bundle(flusspferd::create<flusspferd::object>());
+    spec.set_property("write-bundle", write_bundle);
+    write_bundle.set_property("doc", "Write the main module and its dependencies into a bundle instead of running them.");
+    write_bundle.set_property("argument", "required");
+    write_bundle.set_property("argument_type", "file");
+    flusspferd::create<flusspferd::function>(
+      "callback",
+      phoenix::ref(bundle_output) = args::arg2,
+      flusspferd::param::_signature = flusspferd::param::type<void (flusspferd::value, std::string)>(),
+      flusspferd::param::_container = write_bundle);
+
     flusspferd::object main_module(flusspferd::create<flusspferd::object>());
     spec.set_property("main", main_module);
     main_module.set_property("alias", "m");
@@ -547,6 +617,14 @@ flusspferd::object flusspferd_repl::option_spec(bool for_main_repl) {
     phoenix::bind(&flusspferd::context::set_jit, this->co, false),
     flusspferd::param::_container = no_jit_);
 
+  flusspferd::object no_compile_cache(flusspferd::create<flusspferd::object>());
+  spec.set_property("no-compile-cache", no_compile_cache);
+  no_compile_cache.set_property("doc", "Do not use or write the compiled module cache");
+  flusspferd::create<flusspferd::function>(
+    "callback",
+    phoenix::bind(&flusspferd_repl::disable_compile_cache, this),
+    flusspferd::param::_container = no_compile_cache);
+
   flusspferd::object gc_zeal(flusspferd::create<flusspferd::object>());
   spec.set_property("gc-zeal", gc_zeal);
   gc_zeal.set_property("doc", "Set zealous GC mode: 0, 1 or 2");
@@ -663,6 +741,7 @@ bool flusspferd_repl::getline(std::string &source, char const *prompt) {
   else
 #ifdef HAVE_EDITLINE
   if (interactive) {
+    flusspferd::flush_standard_streams();
     char* linep = readline(prompt);
     if (!linep) {
       std::cout << std::endl;
@@ -678,6 +757,7 @@ bool flusspferd_repl::getline(std::string &source, char const *prompt) {
   else
 #endif
   {
+    flusspferd::flush_standard_streams();
     std::cout << prompt;
     return std::getline(in, source);
   }
@@ -690,6 +770,7 @@ int main(int argc, char **argv) {
     return repl.run();
   } catch (flusspferd::js_quit&) {
   } catch (std::exception &e) {
+    flusspferd::flush_standard_streams();
     std::cerr << "ERROR: " << e.what() << '\n';
     return 1;
   }
@@ -0,0 +1,102 @@
+// vim:ts=2:sw=2:expandtab:autoindent:filetype=cpp:
+/*
+The MIT License
+
+Copyright (c) 2008, 2009 Flusspferd contributors (see "CONTRIBUTORS" or
+                                       http://flusspferd.org/contributors.txt)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Measures the cost of calling a Javascript function from C++, which is the
+// path every native callback (stream.print, ByteArray.map, cURL callbacks)
+// goes through. Build it on two revisions to compare numbers.
+
+#include "flusspferd/arguments.hpp"
+#include "flusspferd/context.hpp"
+#include "flusspferd/current_context_scope.hpp"
+#include "flusspferd/evaluate.hpp"
+#include "flusspferd/init.hpp"
+#include "flusspferd/object.hpp"
+#include "flusspferd/value.hpp"
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <cstdlib>
+#include <iostream>
+
+namespace pt = boost::posix_time;
+
+namespace {
+
+template<typename F>
+void run(char const *name, unsigned long count, F f) {
+  pt::ptime start = pt::microsec_clock::universal_time();
+  for (unsigned long i = 0; i < count; ++i)
+    f(i);
+  double secs = (pt::microsec_clock::universal_time() - start)
+    .total_microseconds() / 1e6;
+  std::cout << name << ": " << count << " calls in " << secs << "s, "
+            << (secs > 0 ? count / secs : 0) << " calls/sec\n";
+}
+
+struct build_only {
+  unsigned nargs;
+  void operator()(unsigned long i) const {
+    flusspferd::arguments arg;
+    for (unsigned j = 0; j < nargs; ++j)
+      arg.push_root(flusspferd::value(int(i + j)));
+  }
+};
+
+struct call_function {
+  flusspferd::object fn;
+  unsigned nargs;
+  void operator()(unsigned long i) const {
+    flusspferd::arguments arg;
+    for (unsigned j = 0; j < nargs; ++j)
+      arg.push_root(flusspferd::value(int(i + j)));
+    fn.call(arg);
+  }
+};
+
+}
+
+int main(int argc, char **argv) {
+  unsigned long count = argc > 1 ? std::strtoul(argv[1], 0, 10) : 1000000;
+
+  flusspferd::current_context_scope scope(flusspferd::context::create());
+
+  flusspferd::root_object fn(
+    flusspferd::evaluate("(function (a, b, c) { return a; })").to_object());
+
+  build_only b3 = { 3 };
+  run("build 3 args", count, b3);
+  build_only b12 = { 12 };
+  run("build 12 args", count, b12);
+
+  call_function c0 = { fn, 0 };
+  run("call with 0 args", count, c0);
+  call_function c3 = { fn, 3 };
+  run("call with 3 args", count, c3);
+  call_function c8 = { fn, 8 };
+  run("call with 8 args", count, c8);
+
+  flusspferd::gc();
+  return 0;
+}
@@ -0,0 +1,85 @@
+// vim:ts=2:sw=2:expandtab:autoindent:filetype=cpp:
+/*
+The MIT License
+
+Copyright (c) 2008, 2009 Flusspferd contributors (see "CONTRIBUTORS" or
+                                       http://flusspferd.org/contributors.txt)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Scans a large Binary by index and through its native iterators. Pass the
+// size in bytes as the first argument (default 100MB).
+
+#include "flusspferd/context.hpp"
+#include "flusspferd/current_context_scope.hpp"
+#include "flusspferd/evaluate.hpp"
+#include "flusspferd/init.hpp"
+#include "flusspferd/load_core.hpp"
+#include "flusspferd/security.hpp"
+#include "flusspferd/value.hpp"
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+namespace pt = boost::posix_time;
+
+namespace {
+
+void run(char const *name, unsigned long size, char const *source) {
+  pt::ptime start = pt::microsec_clock::universal_time();
+  flusspferd::value result = flusspferd::evaluate(source);
+  double secs = (pt::microsec_clock::universal_time() - start)
+    .total_microseconds() / 1e6;
+  std::cout << name << ": " << result.to_std_string() << " elements in "
+            << secs << "s, " << (secs > 0 ? size / secs / 1e6 : 0)
+            << " MB/sec\n";
+}
+
+}
+
+int main(int argc, char **argv) {
+  unsigned long size =
+    argc > 1 ? std::strtoul(argv[1], 0, 10) : 100ul * 1024 * 1024;
+
+  flusspferd::current_context_scope scope(flusspferd::context::create());
+  flusspferd::security::create(flusspferd::current_context().global());
+  flusspferd::load_core(flusspferd::current_context().global(), "bench");
+
+  std::ostringstream setup;
+  setup << "var binary = require('binary');"
+        << "var ba = new binary.ByteArray(" << size << ");"
+        << "var bs = ba.toByteString();";
+  flusspferd::evaluate(setup.str());
+
+  run("ByteArray[i]", size,
+      "var n = 0; for (var i = 0; i < ba.length; ++i) n += ba[i] ? 0 : 1; n");
+  run("ByteString[i]", size,
+      "var n = 0; var z = bs[0];"
+      "for (var i = 0; i < bs.length; ++i) n += bs[i] === z ? 1 : 0; n");
+  run("ByteArray.values()", size,
+      "var n = 0; for (var b in ba.values()) n += b ? 0 : 1; n");
+  run("ByteString.values()", size,
+      "var n = 0; for (var b in bs.values()) ++n; n");
+
+  flusspferd::gc();
+  return 0;
+}
@@ -0,0 +1,110 @@
+// vim:ts=2:sw=2:expandtab:autoindent:filetype=cpp:
+/*
+The MIT License
+
+Copyright (c) 2008, 2009 Flusspferd contributors (see "CONTRIBUTORS" or
+                                       http://flusspferd.org/contributors.txt)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Measures the overhead of calling from Javascript into native code: methods
+// and property getters of a native class, and plain native functions. Every
+// such call goes through the callback trampolines in
+// libflusspferd/spidermonkey/native_*_base.cpp. Build it on two revisions to
+// compare numbers.
+
+#include "flusspferd/call_context.hpp"
+#include "flusspferd/class.hpp"
+#include "flusspferd/class_description.hpp"
+#include "flusspferd/context.hpp"
+#include "flusspferd/create/function.hpp"
+#include "flusspferd/current_context_scope.hpp"
+#include "flusspferd/evaluate.hpp"
+#include "flusspferd/init.hpp"
+#include "flusspferd/object.hpp"
+#include "flusspferd/value.hpp"
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+namespace pt = boost::posix_time;
+
+namespace {
+
+FLUSSPFERD_CLASS_DESCRIPTION(
+  counter,
+  (full_name, "Counter")
+  (constructor_name, "Counter")
+  (methods,
+    ("tick", bind, tick))
+  (properties,
+    ("count", getter, get_count)))
+{
+public:
+  counter(flusspferd::object const &o, flusspferd::call_context &)
+    : base_type(o), count(0)
+  {}
+
+  void tick() { ++count; }
+  int get_count() { return count; }
+
+private:
+  int count;
+};
+
+int noop(int x) {
+  return x;
+}
+
+void run(char const *name, unsigned long count, std::string const &body) {
+  std::ostringstream source;
+  source << "(function () { var c = new Counter(); "
+         << "for (var i = 0; i < " << count << "; ++i) { " << body << "; } })()";
+
+  pt::ptime start = pt::microsec_clock::universal_time();
+  flusspferd::evaluate(source.str());
+  double secs = (pt::microsec_clock::universal_time() - start)
+    .total_microseconds() / 1e6;
+  std::cout << name << ": " << count << " calls in " << secs << "s, "
+            << (secs > 0 ? count / secs : 0) << " calls/sec\n";
+}
+
+}
+
+int main(int argc, char **argv) {
+  unsigned long count = argc > 1 ? std::strtoul(argv[1], 0, 10) : 1000000;
+
+  flusspferd::current_context_scope scope(flusspferd::context::create());
+
+  flusspferd::object global = flusspferd::global();
+  flusspferd::load_class<counter>(global);
+  flusspferd::create<flusspferd::function>("noop", &noop,
+    flusspferd::param::_container = global);
+
+  run("javascript baseline", count, "c.x = i");
+  run("native function", count, "noop(i)");
+  run("native method", count, "c.tick()");
+  run("native property get", count, "c.count");
+
+  flusspferd::gc();
+  return 0;
+}
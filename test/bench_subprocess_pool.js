@@ -0,0 +1,44 @@
+// Runs many short-lived children with subprocess.Pool and one at a time with
+// popen, for comparison. Run with
+//
+//     ./util/jsrepl.sh test/bench_subprocess_pool.js [count [concurrency]]
+//
+// Defaults: 10000 invocations of `true`, concurrency 16.
+
+const subprocess = require('subprocess'),
+      args = require('system').args;
+
+var count = Number(args[1] || 10000),
+    concurrency = Number(args[2] || 16);
+
+// Commands are started with execve, so they need a full path
+var fs = require('fs-base'),
+    TRUE = ["/bin/true", "/usr/bin/true"].filter(fs.exists)[0];
+
+function time(name, fn) {
+  var start = Date.now();
+  var failed = fn();
+  var secs = (Date.now() - start) / 1000;
+  print(name + ": " + count + " processes in " + secs + "s, " +
+        (secs > 0 ? Math.round(count / secs) : "-") + "/sec" +
+        (failed ? ", " + failed + " failed" : ""));
+}
+
+time("Pool(" + concurrency + ")", function() {
+  var pool = new subprocess.Pool({ concurrency: concurrency });
+  for (var i = 0; i < count; ++i)
+    pool.add([TRUE]);
+
+  var failed = 0;
+  pool.run(function(r) { if (r.returncode !== 0) ++failed });
+  return failed;
+});
+
+time("popen", function() {
+  var failed = 0;
+  for (var i = 0; i < count; ++i) {
+    if (subprocess.popen([TRUE]).communicate().returncode !== 0)
+      ++failed;
+  }
+  return failed;
+});
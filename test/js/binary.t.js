@@ -8,5 +8,112 @@ exports.test_decodeToString = function() {
 	asserts.same(b.decodeToString(), "AB");
 }
 
+exports.test_sliceShared = function() {
+  var a = [];
+  for (var i = 0; i < 200; ++i)
+    a.push(i);
+  var b = binary.ByteString(a);
+  var s = b.slice(10, 110);
+  asserts.same(s.length, 100);
+  asserts.same(s.get(0), 10);
+  asserts.same(s.substr(1, 70).get(0), 11);
+  asserts.same(s.substring(90, 10).length, 80);
+
+  // Modifying a ByteArray copy of the slice must not touch the original
+  var ba = binary.ByteArray(s);
+  ba[0] = 255;
+  asserts.same(ba.get(0), 255);
+  asserts.same(s.get(0), 10);
+  asserts.same(b.get(10), 10);
+}
+
+exports.test_search = function() {
+  var b = binary.ByteString("foo\nbar\r\nbaz\n", "ascii");
+  asserts.same(b.indexOf(10), 3);
+  asserts.same(b.indexOf(10, 4), 9);
+  asserts.same(b.lastIndexOf(10), 13);
+  asserts.same(b.lastIndexOf(10, 0, 12), 9);
+  asserts.same(b.indexOf(0), -1);
+  asserts.same(b.indexOfSequence([13, 10]), 8);
+  asserts.same(b.indexOfSequence(binary.ByteString("baz", "ascii")), 10);
+  asserts.same(b.indexOfSequence([98, 97, 122], 0, 11), -1);
+  asserts.same(b.count(10), 3);
+  asserts.same(b.count([98, 97]), 2);
+}
+
+exports.test_searchPastEnd = function() {
+  var b = binary.ByteString([1, 2, 3]);
+  asserts.same(b.indexOf(3, 3), -1);
+  asserts.same(b.indexOf(0, 10), -1, "start beyond the length");
+  asserts.same(b.lastIndexOf(0, 10), -1);
+  asserts.same(b.indexOfSequence([0], 10), -1);
+  asserts.same(b.count([0], 10), 0);
+}
+
+exports.test_splitMulti = function() {
+  var b = binary.ByteString("a,b;;c,", "ascii");
+  var parts = b.split([44, [59, 59]]);
+  asserts.same(parts.length, 4);
+  asserts.same(parts[0].decodeToString(), "a");
+  asserts.same(parts[1].decodeToString(), "b");
+  asserts.same(parts[2].decodeToString(), "c");
+  asserts.same(parts[3].length, 0);
+}
+
+exports.test_elementAccess = function() {
+  var b = binary.ByteString([1, 2, 3]);
+  asserts.same(b[1].get(0), 2);
+  asserts.ok(b[1] === binary.ByteString([7, 2])[1], "one-byte ByteStrings are shared");
+  asserts.throwsOk(function() { b[1] = 9 }, "ByteString elements are read-only");
+  asserts.same(b.get(1), 2);
+
+  var ba = binary.ByteArray([1, 2, 3]);
+  asserts.same(ba[2], 3);
+  ba[2] = 42;
+  asserts.same(ba[2], 42);
+  asserts.same(ba.get(2), 42);
+
+  asserts.ok(2 in ba, "in-range index is found");
+  asserts.ok(b.hasOwnProperty(0), "hasOwnProperty of an index");
+  asserts.ok(!(3 in ba), "index past the end is not found");
+  asserts.throwsOk(function() { delete ba[0] }, "elements cannot be deleted");
+  asserts.same(ba[0], 1);
+}
+
+exports.test_iterators = function() {
+  var ba = binary.ByteArray([5, 6, 7]);
+
+  var indices = [];
+  for (var i in ba)
+    indices.push(i);
+  asserts.same(indices, [0, 1, 2]);
+
+  var values = [];
+  for (var v in ba.values())
+    values.push(v);
+  asserts.same(values, [5, 6, 7]);
+
+  var pairs = [];
+  for (var p in ba.pairs())
+    pairs.push(p);
+  asserts.same(pairs, [[0, 5], [1, 6], [2, 7]]);
+
+  var n = 0;
+  for (var s in binary.ByteString([65, 66]).values()) {
+    asserts.same(s.decodeToString("ascii"), n ? "B" : "A");
+    ++n;
+  }
+  asserts.same(n, 2);
+}
+
+exports.test_externalMemory = function() {
+  var flusspferd = require('flusspferd');
+  var before = flusspferd.externalMemory().binary || 0;
+  var ba = binary.ByteArray(1 << 20);
+  asserts.ok(flusspferd.externalMemory().binary >= before + (1 << 20),
+             "ByteArray contents are reported");
+  asserts.same(ba.length, 1 << 20);
+}
+
 if (require.main === module)
   require('test').runner(exports);
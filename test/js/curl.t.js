@@ -38,6 +38,134 @@ exports.test_options = function() {
                  }, TypeError);
 };
 
+// file:// URLs stand in for a server: they go through the same multi
+// interface code paths without needing network access.
+exports.test_multi = function() {
+  const fs = require('fs-base');
+  var url = 'file://' + fs.canonical('test/fixtures/file1');
+
+  var multi = new cURL.Multi();
+  asserts.ok(multi.valid());
+  multi.maxConnections = 4;
+  asserts.same(multi.maxConnections, 4);
+
+  var bodies = [], done = [];
+  for (var i = 0; i < 3; ++i) {
+    let c = new cURL.Easy(), n = i;
+    bodies[n] = '';
+    c.options.url = url;
+    c.options.writefunction = function(data) {
+      bodies[n] += data.decodeToString();
+      return data.length;
+    };
+    multi.add(c, function(easy, code, error) {
+      asserts.same(easy, c);
+      done.push([n, code, error]);
+    });
+  }
+
+  while (multi.perform())
+    multi.wait(100);
+
+  asserts.same(multi.running, 0);
+  asserts.same(done.length, 3);
+  for (var i = 0; i < 3; ++i)
+    asserts.same(bodies[i], "foobar\nbaz\n");
+  done.forEach(function([n, code, error]) {
+    asserts.same(code, 0);
+    asserts.same(error, null);
+  });
+
+  multi.cleanup();
+  asserts.ok(!multi.valid());
+};
+
+exports.test_multiError = function() {
+  var multi = new cURL.Multi();
+  var c = new cURL.Easy();
+  c.options.url = 'file:///this/file/does/not/exist';
+  var result;
+  multi.add(c, function(easy, code, error) { result = [code, error]; });
+
+  while (multi.perform())
+    multi.wait(100);
+
+  asserts.ok(result[0] != 0, "failed transfer reports an error code");
+  asserts.same(typeof result[1], "string");
+};
+
+exports.test_writeTarget = function() {
+  const fs = require('fs-base'), binary = require('binary');
+  var url = 'file://' + fs.canonical('test/fixtures/file1');
+
+  var c = new cURL.Easy();
+  var buf = new binary.ByteArray();
+  c.options.url = url;
+  c.options.writeTarget = buf;
+  asserts.same(c.options.writeTarget, buf);
+  c.perform();
+  c.perform();
+  asserts.same(buf.decodeToString(), "foobar\nbaz\nfoobar\nbaz\n");
+
+  var path = 'test/curl-write-target.tmp';
+  c.options.writeTarget = path;
+  c.perform();
+  asserts.same(fs.rawOpen(path, 'r').readWhole(), "foobar\nbaz\n");
+  c.options.writeTarget = null;
+  fs.remove(path);
+
+  asserts.throwsOk(function() { c.options.writeTarget = 42; }, "rejects numbers");
+};
+
+exports.test_reuseBuffer = function() {
+  const fs = require('fs-base');
+  var c = new cURL.Easy();
+  c.reuseBuffer = true;
+  asserts.ok(c.reuseBuffer);
+  c.options.url = 'file://' + fs.canonical('test/fixtures/file1');
+
+  var buffers = [], body = '';
+  c.options.writefunction = function(data) {
+    buffers.push(data);
+    body += data.decodeToString();
+    return data.length;
+  };
+  c.perform();
+  c.perform();
+  asserts.same(body, "foobar\nbaz\nfoobar\nbaz\n");
+  asserts.ok(buffers[0] === buffers[buffers.length - 1], "same buffer object");
+};
+
+exports.test_share = function() {
+  const fs = require('fs-base');
+  var url = 'file://' + fs.canonical('test/fixtures/file1');
+
+  var share = new cURL.Share([cURL.LOCK_DATA_COOKIE, cURL.LOCK_DATA_DNS]);
+  asserts.ok(share.valid());
+
+  var body = '';
+  var c = new cURL.Easy();
+  c.options.share = share;
+  asserts.same(c.options.share, share);
+  c.options.url = url;
+  c.options.writefunction = function(data) {
+    body += data.decodeToString();
+    return data.length;
+  };
+  c.perform();
+  asserts.same(body, "foobar\nbaz\n");
+
+  asserts.throwsOk(function() { c.options.share = {}; }, "rejects non-Share objects");
+
+  // Cannot free a share which is still in use
+  asserts.throwsOk(function() { share.cleanup(); }, "share in use");
+  c.options.share = null;
+  share.cleanup();
+  asserts.ok(!share.valid());
+
+  asserts.ok(new cURL.Share().valid(), "default share");
+};
+
 } catch(e if e.message && e.message.match(/'curl'/)) {
   // this sucks we really should change the exception system (#44)
   exports.test_skip = function() {
@@ -152,5 +152,70 @@ exports.test_katakanaTranscoder_Chunks = function() {
   );
 }
 
+exports.test_splitMultibyteChunks = function() {
+  var c = new encodings.Transcoder("UTF-8", "UTF-16BE");
+  var a = new binary.ByteArray();
+
+  // Push an e-acute one byte at a time
+  c.push(e_accute_utf8.substr(0, 1), a);
+  asserts.same(a.length, 0, "incomplete sequence is held back");
+  c.push(e_accute_utf8.substr(1, 1), a);
+  c.close(a);
+
+  asserts.same(a.toArray(), [0x00, 0xE9]);
+}
+
+exports.test_fastPathSurrogates = function() {
+  // U+1D11E MUSICAL SYMBOL G CLEF
+  var clef = binary.ByteString([0xF0, 0x9D, 0x84, 0x9E]);
+  var str = encodings.convertToString("utf-8", clef);
+  asserts.same(str, "\uD834\uDD1E");
+  asserts.same(encodings.convertFromString("UTF8", str).toArray(),
+               clef.toArray());
+
+  asserts.throwsOk(function() {
+    encodings.convertToString("utf-8", binary.ByteString([0xC0, 0xAF]));
+  }, "overlong sequence is rejected");
+
+  asserts.same(encodings.convertToString("latin1", binary.ByteString([0xE9])),
+               "\xE9");
+}
+
+exports.test_transcodingStream = function() {
+  var io = require('io');
+  var latin1 = new io.BinaryStream(binary.ByteString([0x61, 0xE9, 0x0A, 0x62]));
+  var s = new io.TranscodingStream(latin1, "ISO-8859-1");
+  asserts.same(s.readLine(), "a\xE9\n");
+  asserts.same(s.readWhole(), "b");
+}
+
+exports.test_transcodingStreamOutput = function() {
+  var io = require('io');
+
+  var bytes = binary.ByteArray();
+  var s = new io.TranscodingStream(new io.BinaryStream(bytes), "ISO-8859-1");
+  s.write("a\xE9");
+  s.close();
+  asserts.same(bytes.toArray(), [0x61, 0xE9], "written on close");
+  s.write("b");
+  s.flush();
+  asserts.same(bytes.length, 2, "nothing is written after close");
+
+  // The final shift sequence back to ASCII is written as well
+  bytes = binary.ByteArray();
+  s = new io.TranscodingStream(new io.BinaryStream(bytes), "ISO-2022-JP");
+  s.write("\u65E5");
+  s.close();
+  asserts.same(bytes.toArray().slice(-3), [0x1B, 0x28, 0x42], "shift sequence");
+
+  bytes = binary.ByteArray();
+  (function() {
+    var s = new io.TranscodingStream(new io.BinaryStream(bytes), "ISO-8859-1");
+    s.write("\xE9");
+  })();
+  gc();
+  asserts.same(bytes.toArray(), [0xE9], "written when collected");
+}
+
 if (require.main === module)
   require('test').runner(exports);
@@ -0,0 +1,76 @@
+let test = require('test'),
+    asserts = test.asserts,
+    event = require('event');
+
+exports.test_timeouts = function() {
+  var order = [];
+  event.setTimeout(function(x) { order.push(x) }, 20, "b");
+  event.setTimeout(function(x) { order.push(x) }, 0, "a");
+  var cleared = event.setTimeout(function() { order.push("cleared") }, 10);
+  event.clearTimeout(cleared);
+
+  asserts.same(order, [], "nothing runs before the loop");
+  event.run();
+  asserts.same(order, ["a", "b"], "timeouts run in order, cleared one doesn't");
+}
+
+exports.test_oddDelays = function() {
+  var order = [];
+  event.setTimeout(function() { order.push("nan") }, "x");
+  event.setTimeout(function() { order.push("negative") }, -Infinity);
+  var far = event.setTimeout(function() { order.push("far") }, Infinity);
+
+  asserts.same(event.runOnce(), 1, "NaN delay runs right away");
+  asserts.same(event.runOnce(), 1, "negative delay runs right away");
+  event.clearTimeout(far);
+  event.run();
+  asserts.same(order, ["nan", "negative"], "infinite delay is still pending");
+}
+
+exports.test_interval = function() {
+  var n = 0, id = event.setInterval(function() {
+    if (++n == 3)
+      event.clearInterval(id);
+  }, 1);
+
+  event.run();
+  asserts.same(n, 3, "interval ran until cleared");
+}
+
+exports.test_runOnce = function() {
+  var ran = 0;
+  event.setTimeout(function() { ++ran }, 0);
+  event.setTimeout(function() { ++ran }, 0);
+
+  asserts.same(event.runOnce(), 1, "one handler run");
+  asserts.same(ran, 1, "first timeout ran");
+  event.run();
+  asserts.same(ran, 2, "second timeout ran");
+  asserts.same(event.runOnce(), 0, "no more work");
+}
+
+exports.test_exceptions = function() {
+  var after = false;
+  event.setTimeout(function() { throw new Error("from timer") }, 0);
+  event.setTimeout(function() { after = true }, 5);
+
+  asserts.throwsOk(function() { event.run() }, "exception passed on by run");
+  event.run();
+  asserts.ok(after, "loop can be run again");
+}
+
+exports.test_watch = function() {
+  // Standard output is normally writable right away
+  var calls = 0, id = event.watch(1, "w", function() {
+    ++calls;
+    event.unwatch(id);
+  });
+  event.run();
+  asserts.same(calls, 1, "watcher called once writable");
+
+  asserts.throwsOk(function() { event.watch(1, "x", function() {}) },
+                   "invalid mode");
+}
+
+if (require.main === module)
+  test.prove(module.id);
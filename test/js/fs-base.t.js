@@ -14,5 +14,130 @@ exports.test_canonical = function() {
   );
 }
 
+exports.test_mapFile = function() {
+  var b = fs.mapFile('test/fixtures/file1');
+  asserts.same(b.length, 11);
+  asserts.same(b.decodeToString(), "foobar\nbaz\n");
+  asserts.same(b.slice(7).decodeToString(), "baz\n");
+}
+
+exports.test_copy = function() {
+  var target = 'test/fixtures/fs-copy.tmp';
+  fs.copy('test/fixtures/file1', target);
+  try {
+    asserts.same(fs.size(target), 11);
+    asserts.same(fs.mapFile(target).decodeToString(), "foobar\nbaz\n");
+    asserts.throwsOk(function() { fs.copy('test/fixtures', target) },
+                     "directories need copyTree");
+    asserts.throwsOk(function() { fs.copy(target, target) },
+                     "copying a file onto itself");
+    asserts.throwsOk(function() { fs.copy(target, 'test/fixtures/../fixtures/fs-copy.tmp') },
+                     "copying a file onto itself by another name");
+    asserts.same(fs.size(target), 11, "file left intact");
+  }
+  finally {
+    fs.remove(target);
+  }
+}
+
+exports.test_copyTree = function() {
+  var source = 'test/fixtures/fs-tree.tmp',
+      target = 'test/fixtures/fs-tree-copy.tmp';
+  fs.makeDirectory(source);
+  fs.makeDirectory(source + '/sub');
+  fs.copy('test/fixtures/file1', source + '/sub/file1');
+  try {
+    fs.copyTree(source, target);
+    asserts.same(fs.list(target), ['sub']);
+    asserts.same(fs.mapFile(target + '/sub/file1').decodeToString(),
+                 "foobar\nbaz\n");
+    asserts.throwsOk(function() { fs.copyTree(source, target) },
+                     "target must not exist");
+    asserts.throwsOk(function() { fs.copyTree(source, source + '/sub/copy') },
+                     "target must not be inside the source");
+    asserts.ok(!fs.exists(source + '/sub/copy'), "nothing copied into the source");
+  }
+  finally {
+    [source, target].forEach(function(dir) {
+      if (fs.exists(dir + '/sub/file1'))
+        fs.remove(dir + '/sub/file1');
+      if (fs.exists(dir + '/sub'))
+        fs.removeDirectory(dir + '/sub');
+      if (fs.exists(dir))
+        fs.removeDirectory(dir);
+    });
+  }
+}
+
+// a/, a/b/, a/b/two.txt, a/one.js, three.js
+function withTree(fn) {
+  var root = 'test/fixtures/fs-walk.tmp',
+      files = ['a/b/two.txt', 'a/one.js', 'three.js'],
+      dirs = ['a/b', 'a', ''];
+  fs.makeDirectory(root);
+  fs.makeDirectory(root + '/a');
+  fs.makeDirectory(root + '/a/b');
+  files.forEach(function(f) { fs.copy('test/fixtures/file1', root + '/' + f) });
+  try {
+    fn(root);
+  }
+  finally {
+    files.forEach(function(f) { fs.remove(root + '/' + f) });
+    dirs.forEach(function(d) { fs.removeDirectory(root + '/' + d) });
+  }
+}
+
+function walked(root, options) {
+  var entries = [];
+  for (let batch in fs.walk(root, options))
+    entries = entries.concat(batch);
+  return entries.map(function(e) {
+    return e.path.substr(root.length + 1) + ':' + e.type;
+  }).sort();
+}
+
+exports.test_walk = function() {
+  withTree(function(root) {
+    asserts.same(walked(root),
+      ['a/b/two.txt:file', 'a/b:directory', 'a/one.js:file', 'a:directory',
+       'three.js:file']);
+    asserts.same(walked(root, { maxDepth: 1 }), ['a:directory', 'three.js:file']);
+    asserts.same(
+      walked(root, { filter: function(e) { return !/\/b$/.test(e.path) } }),
+      ['a/one.js:file', 'a:directory', 'three.js:file'],
+      "filter prunes subtrees");
+    asserts.same(walked(root, { glob: '**/*.js', stat: false, statThreads: 2 }),
+                 ['a/one.js:file', 'three.js:file']);
+
+    var batches = [];
+    for (let batch in fs.walk(root, { batchSize: 2 }))
+      batches.push(batch.length);
+    asserts.same(batches.reduce(function(a, b) { return a + b }), 5);
+    asserts.ok(batches.every(function(n) { return n <= 2 }), "batch size");
+
+    var reentrant = fs.walk(root, { filter: function() { reentrant.next() } });
+    asserts.throwsOk(function() { reentrant.next() }, "next() from the filter");
+    asserts.throwsOk(function() { fs.walk(root, { statThreads: -1 }) });
+    asserts.throwsOk(function() { fs.walk(root, { statThreads: "x" }) });
+
+    var file = fs.walk(root + '/a/b').next()[0];
+    asserts.same(file.size, 11);
+    asserts.same(typeof file.mtime, "number");
+
+    asserts.throwsOk(function() { fs.walk(root + '/three.js') },
+                     "root must be a directory");
+  });
+}
+
+exports.test_glob = function() {
+  withTree(function(root) {
+    asserts.same(fs.glob(root + '/**/*.js'), [root + '/a/one.js', root + '/three.js']);
+    asserts.same(fs.glob(root + '/*/[a-z]'), [root + '/a/b']);
+    asserts.same(fs.glob(root + '/a/?ne.*'), [root + '/a/one.js']);
+    asserts.same(fs.glob(root + '/three.js'), [root + '/three.js']);
+    asserts.same(fs.glob(root + '/nothing/*'), []);
+  });
+}
+
 if (require.main === module)
   require('test').runner(exports);
@@ -0,0 +1,217 @@
+const fs = require('filesystem-base'),
+      binary = require('binary'),
+      asserts = require('test').asserts;
+
+function withFile(contents, fn) {
+  var path = "test/fixtures/io-test.tmp",
+      f = fs.rawOpen(path, 'w');
+  f.write(contents);
+  f.close();
+  try {
+    f = fs.rawOpen(path, 'r');
+    fn(f);
+  }
+  finally {
+    fs.remove(path);
+  }
+}
+
+exports.test_readLine = function() {
+  var f = fs.rawOpen('test/fixtures/file1', 'r');
+  asserts.same(f.readLine(), "foobar\n");
+  asserts.same(f.readLine(), "baz\n");
+  asserts.same(f.readLine(), "", "empty string at EOF");
+}
+
+exports.test_readLineSeparators = function() {
+  withFile("a\r\nb\rc\r\nd", function(f) {
+    asserts.same(f.readLine("\r\n"), "a\r\n", "multi-character separator");
+    asserts.same(f.readLine("\r\n"), "b\rc\r\n", "partial separator is kept");
+    asserts.same(f.readLine("\r\n"), "d", "last line without separator");
+  });
+
+  withFile("eins§zwei", function(f) {
+    asserts.same(f.readLine("§"), "eins§", "non-ASCII separator");
+    asserts.same(f.readLine("§"), "zwei");
+  });
+
+  withFile("x", function(f) {
+    asserts.throwsOk(function() { f.readLine("") }, "empty separator");
+  });
+}
+
+exports.test_readLineBinary = function() {
+  withFile(binary.ByteString([0xff, 0x0a, 0x00, 0xfe]), function(f) {
+    var line = f.readLineBinary();
+    asserts.instanceOf(line, binary.ByteString);
+    asserts.same(line.toArray(), [0xff, 0x0a]);
+    asserts.same(f.readLineBinary(binary.ByteString([0x00])).toArray(), [0x00]);
+    asserts.same(f.readLineBinary().toArray(), [0xfe]);
+    asserts.same(f.readLineBinary().length, 0, "empty at EOF");
+  });
+}
+
+exports.test_lines = function() {
+  var text = "";
+  for (var i = 0; i < 5000; ++i)
+    text += "line " + i + "\n";
+
+  withFile(text, function(f) {
+    var lines = [], batches = 0;
+    for (let batch in f.lines("\n", 1000)) {
+      ++batches;
+      lines.push.apply(lines, batch);
+    }
+    asserts.same(lines.length, 5000, "all lines read");
+    asserts.same(lines.join(""), text, "lines are in order");
+    asserts.same(batches, 5, "in batches");
+  });
+}
+
+exports.test_printSettings = function() {
+  var path = "test/fixtures/io-test.tmp",
+      f = fs.rawOpen(path, 'w');
+  try {
+    asserts.same(f.fieldSeparator, " ");
+    asserts.same(f.recordSeparator, "\n");
+    asserts.same(f.autoFlush, false);
+
+    f.fieldSeparator = ", ";
+    f.print(1, [2, 3], 4);
+    f.recordSeparator = null;
+    asserts.same(f.recordSeparator, undefined);
+    f.print("end");
+    f.close();
+
+    asserts.same(fs.rawOpen(path, 'r').readWhole(), "1, 2, 3, 4\nend");
+  }
+  finally {
+    fs.remove(path);
+  }
+}
+
+exports.test_printFlushes = function() {
+  var path = "test/fixtures/io-test.tmp",
+      f = fs.rawOpen(path, 'w');
+  try {
+    f.print("line");
+    asserts.same(fs.rawOpen(path, 'r').readWhole(), "line\n",
+                 "print flushes without autoFlush");
+    f.close();
+  }
+  finally {
+    fs.remove(path);
+  }
+}
+
+exports.test_charset = function() {
+  var path = "test/fixtures/io-test.tmp",
+      text = "a\u0000b\u00e4\u20ac\ud83d\ude00\n",
+      f = fs.rawOpen(path, 'w');
+  try {
+    asserts.same(f.charset, "UTF-8");
+    f.write(text);
+    f.charset = "ISO-8859-1";
+    f.write("\u00e4\n");
+    f.close();
+
+    f = fs.rawOpen(path, 'r');
+    asserts.same(f.readLine(), text, "NUL and non-BMP characters survive");
+    asserts.same(f.readLineBinary().toArray(), [0xe4, 0x0a], "Latin-1 line");
+    f.close();
+
+    f = fs.rawOpen(path, 'r');
+    asserts.same(f.read(6), "a\u0000b\u00e4\u20ac",
+                 "read completes a sequence cut off by size");
+    f.close();
+
+    f = fs.rawOpen(path, 'r');
+    f.charset = "ISO-8859-1";
+    asserts.same(f.readWhole().length, 15, "every byte is a character");
+    asserts.throwsOk(function() { f.charset = "no-such-charset" },
+                     "unknown charset");
+  }
+  finally {
+    fs.remove(path);
+  }
+}
+
+exports.test_positionalIO = function() {
+  var path = "test/fixtures/io-test.tmp",
+      f = fs.rawOpen(path, { read: true, write: true, create: true });
+  try {
+    f.write("0123456789");
+    asserts.same(f.tell(), 10, "tell includes buffered output");
+
+    asserts.same(f.seek(2), 2);
+    asserts.same(f.read(3), "234");
+    asserts.same(f.tell(), 5);
+    asserts.same(f.seek(-2, "end"), 8);
+    asserts.same(f.read(), "89");
+
+    f.writeAt(4, "x");
+    asserts.same(f.readAt(3, 3).decodeToString(), "3x5");
+    asserts.same(f.tell(), 10, "readAt and writeAt keep the position");
+    asserts.same(f.readAt(8, 10).length, 2, "short read at the end");
+
+    var out = binary.ByteArray([0x41]);
+    f.readAt(0, 2, out);
+    asserts.same(out.decodeToString(), "A01", "readAt appends to a ByteArray");
+
+    f.advise("random");
+    asserts.throwsOk(function() { f.advise("bogus") }, "unknown advice");
+    f.preallocate(4096);
+    asserts.same(f.seek(0, "end"), 4096, "preallocate extends the file");
+
+    f.close();
+    asserts.same(fs.size(path), 4096);
+  }
+  finally {
+    fs.remove(path);
+  }
+}
+
+exports.test_pipeTo = function() {
+  var path = "test/fixtures/io-pipe.tmp";
+  withFile("first\nrest of the file\n", function(f) {
+    var out = fs.rawOpen(path, 'w');
+    try {
+      asserts.same(f.readLine(), "first\n");
+      asserts.same(f.pipeTo(out), 17, "bytes copied after read-ahead");
+      out.close();
+      asserts.same(fs.rawOpen(path, 'r').readWhole(), "rest of the file\n");
+
+      var b = new (require('io').BinaryStream)(
+            binary.ByteString([0x61, 0x62, 0x63, 0x64, 0x65, 0x66]));
+      out = fs.rawOpen(path, 'w');
+      asserts.same(b.pipeTo(out, { bufferSize: 2 }), 6, "from a memory stream");
+      out.close();
+      asserts.same(fs.rawOpen(path, 'r').readWhole(), "abcdef");
+
+      asserts.throwsOk(function() { f.pipeTo(out, { bufferSize: 0 }) },
+                       "bufferSize must be positive");
+    }
+    finally {
+      fs.remove(path);
+    }
+  });
+}
+
+exports.test_stdio = function() {
+  var system = require('system');
+  asserts.same(typeof system.stdout.isatty(), "boolean");
+  asserts.same(system.stderr.autoFlush, true, "stderr flushes every write");
+
+  asserts.throwsOk(function() { system.stdout.setBuffering("bogus") },
+                   "unknown mode");
+  system.stdout.setBuffering("full", 4096);
+  system.stdout.setBuffering("auto");
+
+  withFile("", function(f) {
+    asserts.same(f.isatty(), false);
+    f.setBuffering("line", 16);
+  });
+}
+
+if (require.main === module)
+  require('test').runner(exports);
@@ -0,0 +1,12 @@
+// Worker that posts every message back, with its bytes reversed for binaries
+var parent = require('worker').parent;
+
+parent.onmessage = function(e) {
+  if (e.data === "throw")
+    throw new Error("asked to throw");
+  if (e.data instanceof require('binary').ByteArray)
+    e.data.reverse();
+  parent.postMessage(e.data);
+};
+
+parent.postMessage("ready");
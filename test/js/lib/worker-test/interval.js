@@ -0,0 +1,9 @@
+// Worker that leaves a repeating timer pending when it is terminated
+var event = require('event'),
+    parent = require('worker').parent,
+    ticks = 0;
+
+event.setInterval(function() {
+  if (++ticks == 2)
+    parent.postMessage("ticking");
+}, 0);
@@ -67,5 +67,158 @@ exports.test_relative_dso = function() {
                "Can load " + m + " DSO by relative include");
 }
 
+exports.test_compileCache = function() {
+  var cc = require.compileCache;
+  asserts.same(typeof cc.enabled, "boolean", "compileCache.enabled");
+  asserts.same(typeof cc.hits, "number", "compileCache.hits");
+  asserts.same(typeof cc.misses, "number", "compileCache.misses");
+
+  if (!cc.enabled) {
+    asserts.ok(true, "SKIPPED: compiled module cache disabled");
+    return;
+  }
+
+  require('./lib/modules-test/a1');
+  for (var id in require.module_cache) {
+    if (/modules-test\/a1/.test(id))
+      delete require.module_cache[id];
+  }
+
+  var lookups = cc.hits + cc.misses;
+  var a1 = require('./lib/modules-test/a1');
+  asserts.same(cc.hits + cc.misses, lookups + 1, "reloading a1 consulted the cache");
+  asserts.same(a1.array(), [1,2,3], "module from cache works");
+}
+
+exports.test_resolveCache = function() {
+  var rc = require.resolveCache;
+  asserts.same(rc.enabled, true, "resolveCache.enabled");
+  asserts.same(require.gcPolicy, "maybe", "default gcPolicy");
+
+  require.paths.unshift(module.resource.resolve("lib"));
+  try {
+    var a1 = require('modules-test/a1');
+    delete require.module_cache['modules-test/a1'];
+
+    var hits = rc.hits;
+    asserts.same(require('modules-test/a1'), a1, "same module when resolved again");
+    asserts.ok(rc.hits > hits, "second resolution came from the cache");
+
+    asserts.throwsOk(function() { require('modules-test/no-such-module') },
+                     "missing module is still reported");
+  }
+  finally {
+    require.paths.shift();
+  }
+}
+
+exports.test_resolveCacheNewModule = function() {
+  var fs = require('fs-base'),
+      rc = require.resolveCache,
+      path = module.resource.resolve("lib/modules-test/late.js");
+
+  require.paths.unshift(module.resource.resolve("lib"));
+  try {
+    asserts.throwsOk(function() { require('modules-test/late') },
+                     "module does not exist yet");
+
+    var f = fs.rawOpen(path, 'w');
+    f.write("exports.value = 1;");
+    f.close();
+    asserts.same(require('modules-test/late').value, 1,
+                 "module created after a failed lookup is found");
+
+    // A module that is already loaded is returned even if its file is gone
+    fs.remove(path);
+    delete require.module_cache['modules-test/late'];
+    rc.enabled = false;
+    asserts.same(require('modules-test/late').value, 1,
+                 "loaded module whose file was removed");
+  }
+  finally {
+    rc.enabled = true;
+    require.paths.shift();
+    if (fs.exists(path))
+      fs.remove(path);
+  }
+}
+
+// Write a module bundle with the given source-only modules
+function writeBundle(path, modules) {
+  var bytes = [], data = "";
+
+  function number(n) {
+    for (var i = 0; i < 8; ++i) {
+      bytes.push(n % 256);
+      n = Math.floor(n / 256);
+    }
+  }
+  function string(s) {
+    number(s.length);
+    for (var i = 0; i < s.length; ++i)
+      bytes.push(s.charCodeAt(i));
+  }
+
+  string("flusspferd-bundle-1");
+  string("");
+  number(modules.length);
+  modules.forEach(function(m) {
+    string(m.id);
+    string("");
+    number(m.names.length);
+    m.names.forEach(function(n) { string(n) });
+    number(0);
+    number(data.length);
+    number(m.source.length);
+    data += m.source;
+    number(data.length);
+    number(0);
+  });
+  for (var i = 0; i < data.length; ++i)
+    bytes.push(data.charCodeAt(i));
+
+  var f = require('fs-base').rawOpen(path, 'w');
+  f.write(require('binary').ByteString(bytes));
+  f.close();
+}
+
+exports.test_bundles = function() {
+  asserts.same(require.bundles.length, 0, "no bundles by default");
+
+  var dir = module.resource.resolve("lib/modules-test"),
+      path = dir + "/test.bundle";
+
+  // Neither module exists on disk
+  writeBundle(path, [
+    { id: "file://" + dir + "/bundled.js", names: ["modules-test/bundled"],
+      source: "exports.value = require('./bundled-dep').value + 1;" },
+    { id: "file://" + dir + "/bundled-dep.js", names: [],
+      source: "exports.value = 41;" }
+  ]);
+
+  require.bundles.push(path);
+  try {
+    var m = require('modules-test/bundled');
+    asserts.same(m.value, 42, "module and its relative dependency come from the bundle");
+    asserts.same(require("file://" + dir + "/bundled.js"), m,
+                 "bundled module is cached under its canonical id");
+    asserts.throwsOk(function() { require('modules-test/not-bundled') },
+                     "modules missing from the bundle are still searched for");
+  }
+  finally {
+    require.bundles.pop();
+    require('fs-base').remove(path);
+  }
+
+  require.bundles.push(module.resource.resolve("modules.t.js"));
+  try {
+    asserts.throwsOk(function() { require('modules-test/other') },
+                     "invalid bundle is reported");
+  }
+  finally {
+    require.bundles.pop();
+  }
+}
+
 if (require.main === module)
   test.prove(module.id);
@@ -73,6 +73,145 @@ exports.test_communicate = function() {
     asserts.same(r.stderr, null, "stderr correct");
 };
 
+exports.test_communicate_async = function() {
+    var event = require('event');
+    var args = [ require('flusspferd').executableName, '-e',
+                 'const io = require("system"); io.stdout.write(io.stdin.read()); io.stdout.flush();',
+                 '-c', dev_null
+               ];
+
+    var p = subprocess.popen(args),
+        r = null,
+        ticks = 0;
+
+    var timer = event.setInterval(function() { ++ticks }, 1);
+    asserts.same(p.communicate("ping", function(res) {
+      r = res;
+      event.clearInterval(timer);
+    }), undefined, "returns at once with a callback");
+    asserts.same(r, null, "callback not called yet");
+
+    event.run();
+
+    asserts.ok(r !== null, "callback called from the event loop");
+    asserts.same(r.stdout, "ping", "stdin written and closed");
+    asserts.same(r.returncode, 0, "returncode is 0");
+    asserts.diag("timer ticks while waiting: " + ticks);
+};
+
+exports.test_communicate_binary = function() {
+    const binary = require('binary'),
+          fs = require('fs-base');
+    var echo = [ require('flusspferd').executableName, '-e',
+                 'const io = require("system"); io.stdout.write(io.stdin.read()); io.stdout.flush();',
+                 '-c', dev_null
+               ];
+
+    var r = subprocess.popen(echo).communicate(binary.ByteString("ping", "ascii"),
+                                               { binary: true, chunkSize: 1 });
+    asserts.ok(r.stdout instanceof binary.ByteString, "stdout is a ByteString");
+    asserts.same(r.stdout.decodeToString("ascii"), "ping", "Binary input written as is");
+    asserts.same(r.stdoutTruncated, undefined, "not truncated");
+
+    r = subprocess.popen(echo).communicate("0123456789", { binary: true, maxBytes: 4 });
+    asserts.same(r.stdout.decodeToString("ascii"), "0123", "output limited to maxBytes");
+    asserts.same(r.stdoutTruncated, true, "truncation reported");
+    asserts.same(r.returncode, 0, "child could write everything");
+
+    var path = "subprocess-redirect.tmp",
+        out = fs.rawOpen(path, "w");
+    try {
+      r = subprocess.popen(echo).communicate("to a file", { stdout: out });
+      out.close();
+      asserts.ok(!("stdout" in r), "no stdout property when redirected");
+      asserts.same(fs.rawOpen(path, "r").readWhole(), "to a file", "output written to stream");
+    }
+    finally {
+      fs.remove(path);
+    }
+};
+
+exports.test_pool = function() {
+    if (WIN32) {
+      asserts.ok(true, "SKIPPED: subprocess.Pool needs SIGCHLD");
+      return;
+    }
+
+    var flusspferd = require('flusspferd').executableName,
+        pool = new subprocess.Pool({ concurrency: 3 });
+    asserts.same(pool.concurrency, 3, "concurrency");
+
+    for (var i = 0; i < 10; ++i)
+      asserts.same(pool.add({ args: [ flusspferd, '-e', 'quit(' + i + ');', '-c', dev_null ] }), i,
+                   "add returns the index");
+    pool.add({ args: [ flusspferd, '-e',
+                       'const io = require("system"); io.stdout.write(io.stdin.read()); io.stdout.flush();',
+                       '-c', dev_null ],
+               input: "piped" });
+    asserts.same(pool.queued, 11, "all queued");
+
+    var seen = [], most = 0;
+    var results = pool.run(function(r, i) {
+      seen.push(i);
+      most = Math.max(most, pool.running);
+    });
+
+    asserts.same(results.length, 11, "a result per task");
+    for (var i = 0; i < 10; ++i)
+      asserts.same(results[i].returncode, i, "exit status of task " + i);
+    asserts.same(results[10].stdout, "piped", "input and output of a task");
+    asserts.ok(typeof results[3].time == "number" && results[3].time > 0, "wall time recorded");
+    asserts.same(seen.sort(function(a, b) { return a - b }).length, 11, "callback per task");
+    asserts.ok(most <= 3, "at most 'concurrency' children at once");
+    asserts.same(pool.running, 0, "nothing left running");
+    asserts.same(pool.queued, 0, "nothing left queued");
+};
+
+exports.test_pool_callbacks = function() {
+    if (WIN32) {
+      asserts.ok(true, "SKIPPED: subprocess.Pool needs SIGCHLD");
+      return;
+    }
+
+    var flusspferd = require('flusspferd').executableName,
+        event = require('event'),
+        pool = new subprocess.Pool({ concurrency: 4 });
+    for (var i = 0; i < 8; ++i)
+      pool.add({ args: [ flusspferd, '-e', 'quit(' + i + ');', '-c', dev_null ] });
+
+    // The callback runs the event loop, which may finish other tasks
+    var seen = {}, twice = 0, thrown = false;
+    function record(r, i) {
+      if (i in seen)
+        ++twice;
+      seen[i] = true;
+      event.runOnce();
+    }
+
+    try {
+      pool.run(function(r, i) {
+        record(r, i);
+        if (!thrown) {
+          thrown = true;
+          throw new Error("from the callback");
+        }
+      });
+    }
+    catch (e) {
+      asserts.matches(e.message, "from the callback", "callback error passed on");
+    }
+
+    var results = pool.run(record);
+    var count = 0;
+    for (var i in seen)
+      ++count;
+    asserts.same(count, 8, "every task reported after a callback threw");
+    asserts.same(twice, 0, "no task reported twice");
+    for (var i = 0; i < 8; ++i)
+      asserts.same(results[i].returncode, i, "exit status of task " + i);
+    asserts.same(pool.running, 0, "nothing left running");
+};
+
 exports.test_retcode = function() {
     const retval = 12;
     const args = [ require('flusspferd').executableName, '-e',
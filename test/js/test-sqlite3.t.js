@@ -151,6 +151,94 @@ exports.test_sqlite3_placeholder_query_row_object = function() {
     asserts.same(index, data.length);
 }
 
+exports.test_sqlite3_fetch = function() {
+    var db = sqlite_test_helper.get_db();
+    var data = sqlite_test_helper.get_test_statements();
+    db.execMany(data);
+
+    var cur = db.query("SELECT int_val, str_val FROM test_table");
+    asserts.same(cur.columnNames(), ["int_val", "str_val"]);
+
+    var rows = cur.fetchMany(3);
+    asserts.same(rows, [[1, "one"], [2, "two"], [3, "three"]]);
+
+    rows = cur.fetchMany(2, {objects: true});
+    asserts.same(rows, [{int_val: 4, str_val: "four"}, {int_val: 5, str_val: "five"}]);
+
+    rows = cur.fetchAll();
+    asserts.same(rows.length, 3);
+    asserts.same(rows[2], [8, "eight"]);
+
+    asserts.same(cur.fetchMany(10), []);
+    asserts.throwsOk(function() { cur.fetchMany(Infinity) }, "infinite row count");
+    asserts.throwsOk(function() { cur.fetchMany("x") }, "NaN row count");
+    cur.close();
+
+    cur = db.query("SELECT int_val, str_val FROM test_table");
+    var [ints, strs] = cur.fetchColumns(5);
+    asserts.same(ints, [1, 2, 3, 4, 5]);
+    asserts.same(strs, ["one", "two", "three", "four", "five"]);
+    cur.close();
+
+    cur = db.query("SELECT int_val, str_val FROM test_table");
+    [ints, strs] = cur.fetchColumns(null, {packed: true});
+    asserts.same(ints.length, 8 * 8, "packed doubles");
+    asserts.same(strs.length, 8);
+    cur.close();
+
+    cur = db.query("SELECT int_val FROM test_table");
+    asserts.same(cur.fetchColumns(1e30)[0].length, 8, "huge row count");
+    cur.close();
+}
+
+exports.test_sqlite3_statement_cache = function() {
+    var db = sqlite_test_helper.get_db();
+    var data = sqlite_test_helper.get_test_statements();
+
+    db.execMany(data);
+    // 6 distinct statements + CREATE TABLE
+    asserts.same(db.cacheMisses, 7);
+    asserts.same(db.cacheHits, 2);
+    asserts.ok(db.prepareTimeMs >= 0, "prepareTimeMs");
+
+    db.exec('INSERT INTO test_table VALUES(?,?,?)', [9, "nine", null]);
+    asserts.same(db.cacheHits, 3);
+
+    var cur = db.query("SELECT COUNT(*) FROM test_table");
+    asserts.same(cur.next()[0], 9);
+    cur.close();
+    cur = db.query("SELECT COUNT(*) FROM test_table");
+    asserts.same(cur.next()[0], 9);
+    asserts.same(db.cacheHits, 4);
+
+    db.statementCacheSize = 0;
+    db.exec('INSERT INTO test_table VALUES(?,?,?)', [10, "ten", null]);
+    db.exec('INSERT INTO test_table VALUES(?,?,?)', [11, "eleven", null]);
+    asserts.same(db.cacheHits, 4);
+}
+
+exports.test_sqlite3_execBatch = function() {
+    var db = sqlite_test_helper.get_db();
+
+    var rows = [];
+    for (var i = 0; i < 100; ++i)
+      rows.push([i, "row " + i, null]);
+
+    asserts.same(db.execBatch('INSERT INTO test_table VALUES(?,?,?)', rows), 100);
+
+    var cur = db.query("SELECT COUNT(*), SUM(int_val) FROM test_table");
+    asserts.same(cur.next(), [100, 4950]);
+    cur.close();
+
+    // A failing entry rolls back the whole batch
+    db.exec('CREATE TABLE uniq(a UNIQUE)');
+    asserts.throwsOk(function() {
+      db.execBatch('INSERT INTO uniq VALUES(?)', [1, 2, 2]);
+    }, "duplicate value");
+    cur = db.query("SELECT COUNT(*) FROM uniq");
+    asserts.same(cur.next()[0], 0);
+}
+
 }
 catch(e) {
   // this sucks we really should change the exception system (#44)
@@ -0,0 +1,107 @@
+let test = require('test'),
+    asserts = test.asserts,
+    worker = require('worker'),
+    binary = require('binary');
+
+const echo = "file://" + module.resource.resolve("lib/worker-test/echo.js");
+
+exports.test_echo = function() {
+  var w = new worker.Worker(echo);
+  try {
+    asserts.same(w.receive(), "ready", "worker loaded");
+
+    var o = { n: 1, s: "str", a: [true, null, undefined] };
+    o.self = o;
+    w.postMessage(o);
+    var r = w.receive();
+    asserts.same(r.n, 1, "number");
+    asserts.same(r.s, "str", "string");
+    asserts.same(r.a, [true, null, undefined], "array");
+    asserts.ok(r.self === r, "cycle preserved");
+
+    w.postMessage(binary.ByteString([1, 2, 3]));
+    asserts.same(w.receive().toArray(), [1, 2, 3], "ByteString");
+  }
+  finally {
+    w.terminate();
+    w.join();
+  }
+  asserts.same(w.running, false, "worker ended");
+}
+
+exports.test_transfer = function() {
+  var w = new worker.Worker(echo);
+  try {
+    w.receive();
+    var kept = binary.ByteArray([1, 2, 3]),
+        moved = binary.ByteArray([4, 5, 6]);
+
+    w.postMessage(kept);
+    asserts.same(w.receive().toArray(), [3, 2, 1], "worker got a copy");
+    asserts.same(kept.toArray(), [1, 2, 3], "original unchanged");
+
+    w.postMessage(moved, [moved]);
+    asserts.same(moved.length, 0, "transferred ByteArray is emptied");
+    asserts.same(w.receive().toArray(), [6, 5, 4], "worker got the bytes");
+  }
+  finally {
+    w.terminate();
+    w.join();
+  }
+}
+
+exports.test_errors = function() {
+  asserts.throwsOk(function() { new worker.Worker("./lib/worker-test/echo") },
+                   "relative ids are rejected");
+
+  var w = new worker.Worker(echo);
+  try {
+    w.receive();
+    asserts.throwsOk(function() { w.postMessage(function() {}) },
+                     "functions cannot be posted");
+
+    w.postMessage("throw");
+    var error;
+    w.onerror = function(e) { error = e.message };
+    asserts.same(w.dispatch(5000), 1, "one message dispatched");
+    asserts.matches(error, "asked to throw", "error reported to onerror");
+
+    w.postMessage(42);
+    asserts.same(w.receive(), 42, "worker still running after an error");
+  }
+  finally {
+    w.terminate();
+    w.join();
+  }
+}
+
+exports.test_event_loop = function() {
+  var w = new worker.Worker(echo), got = [];
+  w.onmessage = function(e) {
+    got.push(e.data);
+    if (e.data === "ready")
+      w.postMessage("hello");
+    else
+      w.terminate();
+  };
+
+  require('event').run();
+  asserts.same(got, ["ready", "hello"], "messages delivered by the event loop");
+  w.join();
+}
+
+exports.test_pending_interval = function() {
+  var w = new worker.Worker(
+    "file://" + module.resource.resolve("lib/worker-test/interval.js"));
+  try {
+    asserts.same(w.receive(), "ticking", "interval fires in the worker");
+  }
+  finally {
+    w.terminate();
+    w.join();
+  }
+  asserts.same(w.running, false, "worker with a pending interval ended");
+}
+
+if (require.main === module)
+  test.prove(module.id);
@@ -27,6 +27,8 @@ THE SOFTWARE.
 #include "flusspferd/arguments.hpp"
 #include "flusspferd/value.hpp"
 #include "flusspferd/value_io.hpp"
+#include "flusspferd/string.hpp"
+#include "flusspferd/init.hpp"
 #include "test_environment.hpp"
 
 
@@ -136,4 +138,29 @@ BOOST_AUTO_TEST_CASE( arguments_copy_ctor ) {
   }
 }
 
+BOOST_AUTO_TEST_CASE( arguments_beyond_inline_capacity ) {
+  flusspferd::arguments a;
+  for (int i = 0; i < 20; ++i)
+    a.push_root(flusspferd::value(i));
+  BOOST_CHECK_EQUAL(a.size(), 20ul);
+
+  flusspferd::arguments b(a);
+  for (int i = 0; i < 20; ++i) {
+    BOOST_CHECK_EQUAL(a[i], flusspferd::value(i));
+    BOOST_CHECK_EQUAL(b[i], flusspferd::value(i));
+  }
+}
+
+BOOST_AUTO_TEST_CASE( arguments_push_root_survives_gc ) {
+  flusspferd::arguments a;
+  a.push_root(flusspferd::string("rooted"));
+  {
+    flusspferd::arguments b(a);
+    b.push_root(flusspferd::string("copy"));
+  }
+  flusspferd::gc();
+  BOOST_CHECK_EQUAL(a.size(), 1ul);
+  BOOST_CHECK_EQUAL(a.front().to_std_string(), "rooted");
+}
+
 BOOST_AUTO_TEST_SUITE_END()